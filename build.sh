@@ -161,8 +161,8 @@ install_dependencies() {
                 libavutil-dev \
                 libavfilter-dev \
                 libswscale-dev \
+                libswresample-dev \
                 libavdevice-dev \
-                ffmpeg \
                 curl
             ;;
         fedora|centos|rhel)
@@ -194,8 +194,8 @@ install_dependencies() {
             log_warn "不支持的操作系统: $OS"
             log_info "请手动安装以下依赖:"
             echo "  - 构建工具: gcc, g++, make, cmake, pkg-config"
-            echo "  - FFmpeg 开发库: libavcodec, libavformat, libavutil, libavfilter, libswscale"
-            echo "  - 工具: ffmpeg, curl"
+            echo "  - FFmpeg 开发库: libavcodec, libavformat, libavutil, libavfilter, libswscale, libswresample"
+            echo "  - 工具: curl"
             read -p "按 Enter 键继续，或按 Ctrl+C 取消..."
             ;;
     esac
@@ -217,13 +217,9 @@ check_dependencies() {
     done
     
     # 检查FFmpeg开发库
-    if ! pkg-config --exists libavcodec libavformat libavutil; then
-        missing+=("FFmpeg开发库 (libavcodec-dev, libavformat-dev, libavutil-dev)")
-    fi
-    
-    # 检查FFmpeg工具
-    if ! command -v ffmpeg >/dev/null 2>&1; then
-        missing+=("ffmpeg")
+    # 转码在进程内完成，不再需要 ffmpeg 命令行工具
+    if ! pkg-config --exists libavcodec libavformat libavutil libswscale libswresample; then
+        missing+=("FFmpeg开发库 (libavcodec-dev, libavformat-dev, libavutil-dev, libswscale-dev, libswresample-dev)")
     fi
     
     if [ ${#missing[@]} -gt 0 ]; then
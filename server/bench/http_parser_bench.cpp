@@ -0,0 +1,51 @@
+// HttpParser 微基准：反复解析典型的 hls.js 分片请求，报告每秒解析请求数
+#include "http_parser.h"
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+int main(int argc, char** argv) {
+    const size_t iterations = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 2000000;
+
+    const std::string request =
+        "GET /hls/stream_media_1/segment_042.ts HTTP/1.1\r\n"
+        "Host: 192.168.1.10:8080\r\n"
+        "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko)\r\n"
+        "Accept: */*\r\n"
+        "Accept-Language: zh-CN,zh;q=0.9,en;q=0.8\r\n"
+        "Origin: http://192.168.1.10:8080\r\n"
+        "Referer: http://192.168.1.10:8080/\r\n"
+        "Connection: keep-alive\r\n"
+        "\r\n";
+
+    // 同一请求再拆成两段送入，覆盖跨读事件恢复的路径
+    const size_t split = request.size() / 2;
+
+    HttpParser parser;
+    size_t completed = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; ++i) {
+        if ((i & 1) == 0) {
+            if (parser.parse(request.data(), request.size()) == HttpParser::Status::Complete) {
+                ++completed;
+            }
+        } else {
+            parser.parse(request.data(), split);
+            if (parser.parse(request.data(), request.size()) == HttpParser::Status::Complete) {
+                ++completed;
+            }
+        }
+        parser.reset();
+    }
+    auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << "{\"benchmark\":\"http_parser\",\"iterations\":" << iterations
+              << ",\"completed\":" << completed
+              << ",\"seconds\":" << elapsed
+              << ",\"requests_per_second\":" << static_cast<uint64_t>(completed / elapsed)
+              << ",\"ns_per_request\":" << (elapsed * 1e9 / completed) << "}" << std::endl;
+
+    return completed == iterations ? 0 : 1;
+}
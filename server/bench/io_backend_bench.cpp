@@ -0,0 +1,219 @@
+// I/O 后端对比基准：在同一台机器上分别以 epoll 和 io_uring 启动 SimpleServer，
+// 用多个持久连接压测小响应路由和文件路由，按 JSON 输出每秒请求数与吞吐量。
+//
+// 用法: io_backend_bench [connections] [seconds] [reactors] [file_kb]
+#include "server.h"
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+const int BENCH_PORT = 18090;
+const char* BENCH_FILE = "/tmp/io_backend_bench.ts";
+
+struct LoadResult {
+    uint64_t requests = 0;
+    uint64_t bytes = 0;
+    uint64_t errors = 0;
+    double seconds = 0;
+};
+
+int connect_local(int port) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    int flag = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(static_cast<uint16_t>(port));
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// 读完一个响应（状态行 + 头部 + Content-Length 字节的消息体），返回消息体长度，出错返回 -1。
+// pending 保存已读入但属于下一个响应的字节
+long read_response(int fd, std::string& pending, std::vector<char>& scratch) {
+    size_t header_end;
+    while ((header_end = pending.find("\r\n\r\n")) == std::string::npos) {
+        ssize_t n = recv(fd, scratch.data(), scratch.size(), 0);
+        if (n <= 0) {
+            return -1;
+        }
+        pending.append(scratch.data(), static_cast<size_t>(n));
+    }
+
+    if (pending.compare(0, 12, "HTTP/1.1 200") != 0) {
+        return -1;
+    }
+    size_t pos = pending.find("Content-Length: ");
+    if (pos == std::string::npos || pos > header_end) {
+        return -1;
+    }
+    size_t body_length = std::strtoull(pending.c_str() + pos + 16, nullptr, 10);
+    size_t total = header_end + 4 + body_length;
+
+    // 消息体直接读入 scratch 丢弃，不追加到 pending
+    size_t have = pending.size();
+    if (have >= total) {
+        pending.erase(0, total);
+        return static_cast<long>(body_length);
+    }
+    pending.clear();
+    size_t remaining = total - have;
+    while (remaining > 0) {
+        ssize_t n = recv(fd, scratch.data(), std::min(remaining, scratch.size()), 0);
+        if (n <= 0) {
+            return -1;
+        }
+        remaining -= static_cast<size_t>(n);
+    }
+    return static_cast<long>(body_length);
+}
+
+LoadResult run_load(const std::string& path, int connections, double seconds) {
+    const std::string request =
+        "GET " + path + " HTTP/1.1\r\n"
+        "Host: 127.0.0.1\r\n"
+        "Connection: keep-alive\r\n"
+        "\r\n";
+
+    std::atomic<bool> stop{false};
+    std::atomic<uint64_t> requests{0}, bytes{0}, errors{0};
+    std::vector<std::thread> clients;
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < connections; ++i) {
+        clients.emplace_back([&]() {
+            std::vector<char> scratch(256 * 1024);
+            std::string pending;
+            uint64_t local_requests = 0, local_bytes = 0;
+            int fd = connect_local(BENCH_PORT);
+            while (fd >= 0 && !stop.load(std::memory_order_relaxed)) {
+                if (send(fd, request.data(), request.size(), MSG_NOSIGNAL) != static_cast<ssize_t>(request.size())) {
+                    break;
+                }
+                long body = read_response(fd, pending, scratch);
+                if (body < 0) {
+                    break;
+                }
+                ++local_requests;
+                local_bytes += static_cast<uint64_t>(body);
+            }
+            if (fd < 0 || !stop.load()) {
+                errors.fetch_add(1);
+            }
+            if (fd >= 0) {
+                close(fd);
+            }
+            requests.fetch_add(local_requests);
+            bytes.fetch_add(local_bytes);
+        });
+    }
+
+    std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+    stop = true;
+    for (auto& client : clients) {
+        client.join();
+    }
+
+    LoadResult result;
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    result.requests = requests.load();
+    result.bytes = bytes.load();
+    result.errors = errors.load();
+    return result;
+}
+
+const char* backend_name(SimpleServer::IoBackend backend) {
+    return backend == SimpleServer::IoBackend::IoUring ? "io_uring" : "epoll";
+}
+
+void print_result(SimpleServer::IoBackend backend, const char* route, int connections, const LoadResult& result) {
+    std::cout << "{\"benchmark\":\"io_backend\",\"backend\":\"" << backend_name(backend)
+              << "\",\"route\":\"" << route
+              << "\",\"connections\":" << connections
+              << ",\"seconds\":" << result.seconds
+              << ",\"requests\":" << result.requests
+              << ",\"errors\":" << result.errors
+              << ",\"requests_per_second\":" << static_cast<uint64_t>(result.requests / result.seconds)
+              << ",\"mb_per_second\":" << (result.bytes / result.seconds / (1024 * 1024)) << "}" << std::endl;
+}
+
+bool run_backend(SimpleServer::IoBackend backend, int connections, double seconds, int reactors, size_t file_size) {
+    SimpleServer server(BENCH_PORT, reactors);
+    server.set_io_backend(backend);
+    server.set_max_requests_per_connection(0);  // 压测期间不轮换连接
+    if (server.io_backend() != backend) {
+        return false;
+    }
+
+    server.get("/bench/ping", [](const HttpRequest&, const SimpleServer::RouteParams&) {
+        return HttpResponse::text(200, "pong");
+    });
+    server.get("/bench/segment", [file_size](const HttpRequest&, const SimpleServer::RouteParams&) {
+        int fd = open(BENCH_FILE, O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            return HttpResponse::text(404, "missing");
+        }
+        return HttpResponse::file(200, "video/MP2T", fd, 0, file_size);
+    });
+
+    if (!server.start()) {
+        return false;
+    }
+    print_result(backend, "ping", connections, run_load("/bench/ping", connections, seconds));
+    print_result(backend, "segment", connections, run_load("/bench/segment", connections, seconds));
+    server.stop();
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    const int connections = argc > 1 ? std::atoi(argv[1]) : 64;
+    const double seconds = argc > 2 ? std::atof(argv[2]) : 5.0;
+    const int reactors = argc > 3 ? std::atoi(argv[3]) : 1;
+    const size_t file_size = (argc > 4 ? std::strtoull(argv[4], nullptr, 10) : 512) * 1024;
+
+    // 模拟一个 HLS 分片
+    {
+        std::vector<char> data(file_size);
+        for (size_t i = 0; i < data.size(); ++i) {
+            data[i] = static_cast<char>(i * 131);
+        }
+        int fd = open(BENCH_FILE, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0 || write(fd, data.data(), data.size()) != static_cast<ssize_t>(data.size())) {
+            std::cerr << "无法创建测试文件 " << BENCH_FILE << std::endl;
+            return 1;
+        }
+        close(fd);
+    }
+
+    run_backend(SimpleServer::IoBackend::Epoll, connections, seconds, reactors, file_size);
+    if (!run_backend(SimpleServer::IoBackend::IoUring, connections, seconds, reactors, file_size)) {
+        std::cerr << "io_uring 后端不可用（未以 -DENABLE_IO_URING=ON 构建），仅输出 epoll 结果" << std::endl;
+    }
+
+    unlink(BENCH_FILE);
+    return 0;
+}
@@ -0,0 +1,730 @@
+// 端到端 HTTP 压测：在进程内启动 SimpleServer（注册与真实路由形状相同的替身路由），
+// 或压测已在运行的 media_server，用大量并发持久连接按配置的比例请求媒体列表、状态、
+// 静态文件和 HLS 分片，以 JSON 输出每秒请求数、p50 / p99 / p999 延迟与每请求 CPU 时间，
+// 便于在自己的机器上对比不同构建、发现性能回退。
+//
+// 用法: media_server_bench [--target=host:port] [--connections=N] [--seconds=S] [--threads=T]
+//                          [--reactors=R] [--mix=list:2,status:1,static:3,segment:10]
+//                          [--list=PATH] [--status=PATH] [--static=PATH] [--segment=PATH]
+//                          [--segment-kb=KB] [--server-pid=PID]
+//
+// 不给 --target 时在进程内启动服务器（端口 18091），服务器 CPU = 进程 CPU - 压测线程 CPU；
+// 压测外部服务器时只有给出 --server-pid 才报告服务器 CPU（读取 /proc/PID/stat）。
+// 外部服务器的单客户端连接数上限（默认 256）需放宽到不小于 --connections。
+// 响应必须带 Content-Length（不支持 chunked），每个连接同一时刻只有一个请求。
+#include "server.h"
+#include "json_writer.h"
+#include "metrics.h"
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <strings.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+const int IN_PROCESS_PORT = 18091;
+const char* SEGMENT_FILE = "/tmp/media_server_bench.ts";
+
+enum RequestKind { KIND_LIST, KIND_STATUS, KIND_STATIC, KIND_SEGMENT, KIND_COUNT };
+const char* KIND_NAMES[KIND_COUNT] = {"list", "status", "static", "segment"};
+
+struct Options {
+    std::string host = "127.0.0.1";
+    int port = 0;  // 0 表示进程内服务器
+    int connections = 1000;
+    double seconds = 10.0;
+    int threads = 0;
+    int reactors = 0;
+    std::string mix = "list:2,status:1,static:3,segment:10";
+    std::string paths[KIND_COUNT] = {"/api/media/list", "/api/status", "/js/app.js",
+                                     "/hls/bench/segment_000.ts"};
+    size_t segment_kb = 512;
+    int server_pid = 0;
+};
+
+bool starts_with(const std::string& text, const char* prefix, std::string& rest) {
+    size_t length = strlen(prefix);
+    if (text.compare(0, length, prefix) != 0) {
+        return false;
+    }
+    rest = text.substr(length);
+    return true;
+}
+
+bool parse_options(int argc, char** argv, Options& options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        std::string value;
+        if (starts_with(arg, "--target=", value)) {
+            size_t colon = value.rfind(':');
+            if (colon == std::string::npos) {
+                return false;
+            }
+            options.host = value.substr(0, colon);
+            options.port = std::atoi(value.c_str() + colon + 1);
+        } else if (starts_with(arg, "--connections=", value)) {
+            options.connections = std::max(std::atoi(value.c_str()), 1);
+        } else if (starts_with(arg, "--seconds=", value)) {
+            options.seconds = std::max(std::atof(value.c_str()), 0.1);
+        } else if (starts_with(arg, "--threads=", value)) {
+            options.threads = std::atoi(value.c_str());
+        } else if (starts_with(arg, "--reactors=", value)) {
+            options.reactors = std::atoi(value.c_str());
+        } else if (starts_with(arg, "--mix=", value)) {
+            options.mix = value;
+        } else if (starts_with(arg, "--list=", value)) {
+            options.paths[KIND_LIST] = value;
+        } else if (starts_with(arg, "--status=", value)) {
+            options.paths[KIND_STATUS] = value;
+        } else if (starts_with(arg, "--static=", value)) {
+            options.paths[KIND_STATIC] = value;
+        } else if (starts_with(arg, "--segment=", value)) {
+            options.paths[KIND_SEGMENT] = value;
+        } else if (starts_with(arg, "--segment-kb=", value)) {
+            options.segment_kb = std::strtoull(value.c_str(), nullptr, 10);
+        } else if (starts_with(arg, "--server-pid=", value)) {
+            options.server_pid = std::atoi(value.c_str());
+        } else {
+            return false;
+        }
+    }
+    return options.port >= 0 && options.port < 65536;
+}
+
+// "list:2,segment:10" -> 各类请求的权重，未列出的为 0
+bool parse_mix(const std::string& mix, unsigned weights[KIND_COUNT]) {
+    std::fill(weights, weights + KIND_COUNT, 0u);
+    size_t pos = 0;
+    while (pos < mix.size()) {
+        size_t end = mix.find(',', pos);
+        if (end == std::string::npos) {
+            end = mix.size();
+        }
+        std::string item = mix.substr(pos, end - pos);
+        size_t colon = item.find(':');
+        std::string name = item.substr(0, colon);
+        unsigned weight = colon == std::string::npos ? 1 : static_cast<unsigned>(std::atoi(item.c_str() + colon + 1));
+        int kind = -1;
+        for (int k = 0; k < KIND_COUNT; ++k) {
+            if (name == KIND_NAMES[k]) {
+                kind = k;
+            }
+        }
+        if (kind < 0) {
+            return false;
+        }
+        weights[kind] = weight;
+        pos = end + 1;
+    }
+    for (int k = 0; k < KIND_COUNT; ++k) {
+        if (weights[k] > 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// 每类请求的统计，延迟用与 /metrics 相同的对数-线性分桶
+struct RouteStats {
+    uint64_t requests = 0;
+    uint64_t non_2xx = 0;
+    uint64_t bytes = 0;
+    uint64_t max_micros = 0;
+    std::vector<uint64_t> buckets = std::vector<uint64_t>(LatencyBuckets::COUNT);
+
+    void record(uint64_t micros, int status, uint64_t body_bytes) {
+        ++requests;
+        if (status < 200 || status >= 400) {
+            ++non_2xx;
+        }
+        bytes += body_bytes;
+        max_micros = std::max(max_micros, micros);
+        ++buckets[LatencyBuckets::index(micros)];
+    }
+
+    void merge(const RouteStats& other) {
+        requests += other.requests;
+        non_2xx += other.non_2xx;
+        bytes += other.bytes;
+        max_micros = std::max(max_micros, other.max_micros);
+        for (int b = 0; b < LatencyBuckets::COUNT; ++b) {
+            buckets[b] += other.buckets[b];
+        }
+    }
+
+    // 桶上界，误差不超过 1/SUB_BUCKETS
+    uint64_t percentile(double q) const {
+        if (requests == 0) {
+            return 0;
+        }
+        uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(q * requests + 0.999999));
+        uint64_t seen = 0;
+        for (int b = 0; b < LatencyBuckets::COUNT; ++b) {
+            seen += buckets[b];
+            if (seen >= rank) {
+                return std::min(LatencyBuckets::upper_bound(b), max_micros);
+            }
+        }
+        return max_micros;
+    }
+};
+
+struct ThreadResult {
+    RouteStats routes[KIND_COUNT];
+    uint64_t errors = 0;      // 连接失败或响应中途断开
+    uint64_t reconnects = 0;  // 服务器按 Connection: close 关闭后重新建立的连接
+    double cpu_seconds = 0;
+};
+
+// 一个压测连接：同一时刻只有一个请求在途，响应收完后立即发送下一个
+struct Client {
+    int fd = -1;
+    bool connecting = false;
+    int kind = 0;
+    std::chrono::steady_clock::time_point sent_at;
+    size_t out_offset = 0;
+    bool in_flight = false;
+    std::string head;         // 尚未收齐的响应头
+    bool head_done = false;
+    int status = 0;
+    uint64_t body_length = 0;
+    uint64_t body_remaining = 0;
+    bool close_after = false;
+};
+
+double thread_cpu_seconds() {
+    timespec ts{};
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+double process_cpu_seconds() {
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 +
+           usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+}
+
+// /proc/PID/stat 的 utime + stime，失败返回负数
+double pid_cpu_seconds(int pid) {
+    std::ifstream stat("/proc/" + std::to_string(pid) + "/stat");
+    std::string content((std::istreambuf_iterator<char>(stat)), std::istreambuf_iterator<char>());
+    size_t paren = content.rfind(')');
+    if (paren == std::string::npos) {
+        return -1;
+    }
+    // ')' 之后依次是 state(3) ... utime(14) stime(15)
+    const char* p = content.c_str() + paren + 2;
+    char* end = nullptr;
+    unsigned long long fields[13] = {};
+    for (int i = 0; i < 13; ++i) {
+        if (i == 0) {
+            while (*p && *p != ' ') {
+                ++p;
+            }
+            continue;
+        }
+        fields[i] = std::strtoull(p, &end, 10);
+        p = end;
+    }
+    return static_cast<double>(fields[11] + fields[12]) / sysconf(_SC_CLK_TCK);
+}
+
+class LoadThread {
+public:
+    LoadThread(const sockaddr_in& address, const std::vector<std::string>& requests, const unsigned weights[KIND_COUNT],
+               int connections, uint64_t seed)
+        : address_(address), requests_(requests), connections_(connections), seed_(seed | 1) {
+        for (int k = 0; k < KIND_COUNT; ++k) {
+            weight_total_ += weights[k];
+            cumulative_[k] = weight_total_;
+        }
+    }
+
+    void run(const std::atomic<bool>& stop, ThreadResult& result) {
+        epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+        clients_.resize(static_cast<size_t>(connections_));
+        for (size_t i = 0; i < clients_.size(); ++i) {
+            open_connection(i, result);
+        }
+
+        std::vector<char> scratch(256 * 1024);
+        epoll_event events[256];
+        while (!stop.load(std::memory_order_relaxed)) {
+            int count = epoll_wait(epoll_fd_, events, 256, 50);
+            for (int i = 0; i < count; ++i) {
+                size_t index = events[i].data.u64;
+                Client& client = clients_[index];
+                if (client.fd < 0) {
+                    continue;
+                }
+                if (client.connecting) {
+                    int error = 0;
+                    socklen_t length = sizeof(error);
+                    getsockopt(client.fd, SOL_SOCKET, SO_ERROR, &error, &length);
+                    if (error != 0) {
+                        fail(index, result);
+                        continue;
+                    }
+                    if (!(events[i].events & EPOLLOUT)) {
+                        continue;
+                    }
+                    client.connecting = false;
+                    start_request(client);
+                }
+                if (!write_request(client) || !read_response(index, scratch, result)) {
+                    fail(index, result);
+                }
+            }
+            // 连接失败的槽位每轮最多重试一次，服务器不可达时不会空转
+            for (size_t index : broken_) {
+                open_connection(index, result);
+            }
+            broken_.clear();
+        }
+
+        for (Client& client : clients_) {
+            if (client.fd >= 0) {
+                close(client.fd);
+            }
+        }
+        close(epoll_fd_);
+        result.cpu_seconds = thread_cpu_seconds();
+    }
+
+private:
+    uint64_t next_random() {
+        seed_ ^= seed_ << 13;
+        seed_ ^= seed_ >> 7;
+        seed_ ^= seed_ << 17;
+        return seed_;
+    }
+
+    int pick_kind() {
+        uint64_t roll = next_random() % weight_total_;
+        for (int k = 0; k < KIND_COUNT; ++k) {
+            if (roll < cumulative_[k]) {
+                return k;
+            }
+        }
+        return KIND_COUNT - 1;
+    }
+
+    void open_connection(size_t index, ThreadResult& result) {
+        Client& client = clients_[index];
+        client = Client();
+        int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd < 0) {
+            ++result.errors;
+            broken_.push_back(index);
+            return;
+        }
+        int flag = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+        if (connect(fd, reinterpret_cast<const sockaddr*>(&address_), sizeof(address_)) < 0 && errno != EINPROGRESS) {
+            close(fd);
+            ++result.errors;
+            broken_.push_back(index);
+            return;
+        }
+
+        epoll_event event{};
+        event.events = EPOLLIN | EPOLLOUT | EPOLLET | EPOLLRDHUP;
+        event.data.u64 = index;
+        epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event);
+        client.fd = fd;
+        client.connecting = true;
+    }
+
+    void fail(size_t index, ThreadResult& result) {
+        close(clients_[index].fd);
+        clients_[index].fd = -1;
+        ++result.errors;
+        broken_.push_back(index);
+    }
+
+    void start_request(Client& client) {
+        client.kind = pick_kind();
+        client.out_offset = 0;
+        client.in_flight = true;
+        client.head.clear();
+        client.head_done = false;
+        client.sent_at = std::chrono::steady_clock::now();
+    }
+
+    bool write_request(Client& client) {
+        const std::string& request = requests_[static_cast<size_t>(client.kind)];
+        while (client.in_flight && client.out_offset < request.size()) {
+            ssize_t sent = send(client.fd, request.data() + client.out_offset, request.size() - client.out_offset,
+                                MSG_NOSIGNAL);
+            if (sent < 0) {
+                return errno == EAGAIN || errno == EWOULDBLOCK;
+            }
+            client.out_offset += static_cast<size_t>(sent);
+        }
+        return true;
+    }
+
+    // 返回 false 表示连接出错或在响应中途断开
+    bool read_response(size_t index, std::vector<char>& scratch, ThreadResult& result) {
+        Client& client = clients_[index];
+        while (true) {
+            ssize_t received = recv(client.fd, scratch.data(), scratch.size(), 0);
+            if (received < 0) {
+                return errno == EAGAIN || errno == EWOULDBLOCK;
+            }
+            if (received == 0) {
+                // 空闲时被服务器关闭（超时或请求数上限）不算错误
+                if (client.in_flight) {
+                    return false;
+                }
+                reconnect(index, result);
+                return true;
+            }
+
+            size_t size = static_cast<size_t>(received);
+            if (!client.head_done) {
+                size_t old_size = client.head.size();
+                client.head.append(scratch.data(), size);
+                size_t end = client.head.find("\r\n\r\n", old_size > 3 ? old_size - 3 : 0);
+                if (end == std::string::npos) {
+                    continue;
+                }
+                if (!parse_head(client, end)) {
+                    return false;
+                }
+                size = client.head.size() - (end + 4);  // 与响应头一起收到的消息体
+            }
+            if (size > client.body_remaining) {
+                return false;  // 未发送的请求不应有响应
+            }
+            client.body_remaining -= size;
+            if (client.body_remaining > 0) {
+                continue;
+            }
+
+            auto now = std::chrono::steady_clock::now();
+            uint64_t micros = static_cast<uint64_t>(
+                std::chrono::duration_cast<std::chrono::microseconds>(now - client.sent_at).count());
+            result.routes[client.kind].record(micros, client.status, client.body_length);
+            client.in_flight = false;
+            if (client.close_after) {
+                reconnect(index, result);
+                return true;
+            }
+            start_request(client);
+            if (!write_request(client)) {
+                return false;
+            }
+        }
+    }
+
+    bool parse_head(Client& client, size_t end) {
+        const std::string& head = client.head;
+        if (head.compare(0, 5, "HTTP/") != 0) {
+            return false;
+        }
+        size_t space = head.find(' ');
+        client.status = std::atoi(head.c_str() + space + 1);
+        client.close_after = false;
+        bool has_length = false;
+        client.body_length = 0;
+
+        size_t line = head.find("\r\n") + 2;
+        while (line < end) {
+            size_t line_end = head.find("\r\n", line);
+            if (strncasecmp(head.c_str() + line, "Content-Length:", 15) == 0) {
+                client.body_length = std::strtoull(head.c_str() + line + 15, nullptr, 10);
+                has_length = true;
+            } else if (strncasecmp(head.c_str() + line, "Connection:", 11) == 0 &&
+                       head.find("close", line) < line_end) {
+                client.close_after = true;
+            } else if (strncasecmp(head.c_str() + line, "Transfer-Encoding:", 18) == 0) {
+                return false;
+            }
+            line = line_end + 2;
+        }
+        if (!has_length && client.status != 204 && client.status != 304) {
+            return false;
+        }
+        client.body_remaining = client.body_length;
+        client.head_done = true;
+        return true;
+    }
+
+    void reconnect(size_t index, ThreadResult& result) {
+        close(clients_[index].fd);
+        clients_[index].fd = -1;
+        ++result.reconnects;
+        open_connection(index, result);
+    }
+
+    sockaddr_in address_;
+    const std::vector<std::string>& requests_;
+    int connections_;
+    uint64_t seed_;
+    uint64_t cumulative_[KIND_COUNT] = {};
+    uint64_t weight_total_ = 0;
+    int epoll_fd_ = -1;
+    std::vector<Client> clients_;
+    std::vector<size_t> broken_;
+};
+
+// 进程内服务器的替身路由：响应形状（大小、分派方式、优先级）与 routes.cpp 中的真实路由一致，
+// 但不依赖 FFmpeg 与媒体目录
+std::string media_list_body() {
+    std::string body;
+    JsonWriter json(body);
+    json.begin_object().key("media").begin_array();
+    for (int i = 0; i < 200; ++i) {
+        std::string id = "media_" + std::to_string(i);
+        json.begin_object()
+            .field("id", id)
+            .field("name", "Movie " + std::to_string(i) + ".mkv")
+            .field("path", "../media/Movie " + std::to_string(i) + ".mkv")
+            .field("size", static_cast<uint64_t>(700000000 + i * 1234567))
+            .field("duration", 5400.0 + i)
+            .field("video_codec", "h264")
+            .field("audio_codec", "aac")
+            .field("width", 1920)
+            .field("height", 1080)
+            .end_object();
+    }
+    json.end_array().field("count", 200).end_object();
+    return body;
+}
+
+void register_stand_in_routes(SimpleServer& server, size_t segment_size) {
+    auto list_body = std::make_shared<const std::string>(media_list_body());
+    auto static_body = std::make_shared<const std::string>(48 * 1024, 'x');
+
+    server.get("/api/status", [](const HttpRequest&, const SimpleServer::RouteParams&) {
+        auto time = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
+        std::tm local_time{};
+        localtime_r(&time, &local_time);
+        char body[128];
+        size_t length = strftime(body, sizeof(body),
+                                 "{\"status\": \"running\", \"time\": \"%Y-%m-%d %H:%M:%S\", "
+                                 "\"uptime\": 0, \"version\": \"1.0.0\"}", &local_time);
+        return HttpResponse::json(200, std::string(body, length));
+    }, SimpleServer::Dispatch::Inline, SimpleServer::Priority::Critical);
+    server.get("/api/media/list", [list_body](const HttpRequest&, const SimpleServer::RouteParams&) {
+        return HttpResponse::shared(200, "application/json", list_body);
+    });
+    server.get("/js/:filename", [static_body](const HttpRequest&, const SimpleServer::RouteParams&) {
+        HttpResponse response = HttpResponse::shared(200, "application/javascript", static_body);
+        response.header("Cache-Control", "no-cache");
+        return response;
+    });
+    server.get("/hls/:stream_id/:segment", [segment_size](const HttpRequest&, const SimpleServer::RouteParams&) {
+        int fd = open(SEGMENT_FILE, O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            return HttpResponse::text(404, "Segment not found");
+        }
+        HttpResponse response = HttpResponse::file(200, "video/MP2T", fd, 0, segment_size);
+        response.header("Access-Control-Allow-Origin", "*");
+        return response;
+    }, SimpleServer::Dispatch::Inline, SimpleServer::Priority::Critical);
+}
+
+bool write_segment_file(size_t size) {
+    std::vector<char> data(size);
+    for (size_t i = 0; i < data.size(); ++i) {
+        data[i] = static_cast<char>(i * 131);
+    }
+    int fd = open(SEGMENT_FILE, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    bool ok = fd >= 0 && write(fd, data.data(), data.size()) == static_cast<ssize_t>(data.size());
+    if (fd >= 0) {
+        close(fd);
+    }
+    return ok;
+}
+
+bool resolve(const std::string& host, int port, sockaddr_in& address) {
+    addrinfo hints{};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* found = nullptr;
+    if (getaddrinfo(host.c_str(), nullptr, &hints, &found) != 0 || !found) {
+        return false;
+    }
+    address = *reinterpret_cast<sockaddr_in*>(found->ai_addr);
+    address.sin_port = htons(static_cast<uint16_t>(port));
+    freeaddrinfo(found);
+    return true;
+}
+
+void write_latency(JsonWriter& json, const RouteStats& stats) {
+    json.field("requests", stats.requests)
+        .field("non_2xx", stats.non_2xx)
+        .field("p50_us", stats.percentile(0.50))
+        .field("p99_us", stats.percentile(0.99))
+        .field("p999_us", stats.percentile(0.999))
+        .field("max_us", stats.max_micros);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options options;
+    unsigned weights[KIND_COUNT];
+    if (!parse_options(argc, argv, options) || !parse_mix(options.mix, weights)) {
+        std::cerr << "用法: media_server_bench [--target=host:port] [--connections=N] [--seconds=S] "
+                     "[--threads=T] [--reactors=R] [--mix=list:2,status:1,static:3,segment:10] "
+                     "[--list=PATH] [--status=PATH] [--static=PATH] [--segment=PATH] "
+                     "[--segment-kb=KB] [--server-pid=PID]" << std::endl;
+        return 1;
+    }
+    bool in_process = options.port == 0;
+    if (in_process) {
+        options.port = IN_PROCESS_PORT;
+    }
+    int threads = options.threads > 0 ? options.threads
+                                      : std::max(1, static_cast<int>(std::thread::hardware_concurrency()) / 2);
+    threads = std::min(threads, options.connections);
+
+    // 每个连接一个 fd，进程内模式下服务器端还要再占一个
+    rlimit limit{};
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+
+    std::unique_ptr<SimpleServer> server;
+    if (in_process) {
+        size_t segment_size = options.segment_kb * 1024;
+        if (!write_segment_file(segment_size)) {
+            std::cerr << "无法创建测试分片 " << SEGMENT_FILE << std::endl;
+            return 1;
+        }
+        server = std::make_unique<SimpleServer>(IN_PROCESS_PORT, options.reactors);
+        server->set_connection_limits(0, 0);  // 全部连接来自 127.0.0.1
+        register_stand_in_routes(*server, segment_size);
+        if (!server->start()) {
+            unlink(SEGMENT_FILE);
+            return 1;
+        }
+    }
+
+    sockaddr_in address{};
+    if (!resolve(options.host, options.port, address)) {
+        std::cerr << "无法解析地址 " << options.host << std::endl;
+        return 1;
+    }
+
+    std::vector<std::string> requests;
+    std::string host_header = options.host + ":" + std::to_string(options.port);
+    for (int k = 0; k < KIND_COUNT; ++k) {
+        requests.push_back("GET " + options.paths[k] + " HTTP/1.1\r\n"
+                           "Host: " + host_header + "\r\n"
+                           "User-Agent: media_server_bench\r\n"
+                           "Accept: */*\r\n"
+                           "Accept-Encoding: gzip, br\r\n"
+                           "Connection: keep-alive\r\n"
+                           "\r\n");
+    }
+
+    std::atomic<bool> stop{false};
+    std::vector<ThreadResult> results(static_cast<size_t>(threads));
+    std::vector<std::unique_ptr<LoadThread>> loaders;
+    std::vector<std::thread> workers;
+    double server_cpu_before = options.server_pid > 0 ? pid_cpu_seconds(options.server_pid) : 0;
+    double process_cpu_before = process_cpu_seconds();
+    auto start = std::chrono::steady_clock::now();
+    for (int t = 0; t < threads; ++t) {
+        int share = options.connections / threads + (t < options.connections % threads ? 1 : 0);
+        loaders.push_back(std::make_unique<LoadThread>(address, requests, weights, share,
+                                                       0x9e3779b97f4a7c15ULL * static_cast<uint64_t>(t + 1)));
+        workers.emplace_back(&LoadThread::run, loaders.back().get(), std::cref(stop), std::ref(results[t]));
+    }
+
+    std::this_thread::sleep_for(std::chrono::duration<double>(options.seconds));
+    stop = true;
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    double process_cpu = process_cpu_seconds() - process_cpu_before;
+    double server_cpu_after = options.server_pid > 0 ? pid_cpu_seconds(options.server_pid) : 0;
+
+    if (server) {
+        server->stop();
+        unlink(SEGMENT_FILE);
+    }
+
+    RouteStats total;
+    RouteStats by_kind[KIND_COUNT];
+    uint64_t errors = 0, reconnects = 0;
+    double client_cpu = 0;
+    for (const ThreadResult& result : results) {
+        for (int k = 0; k < KIND_COUNT; ++k) {
+            by_kind[k].merge(result.routes[k]);
+            total.merge(result.routes[k]);
+        }
+        errors += result.errors;
+        reconnects += result.reconnects;
+        client_cpu += result.cpu_seconds;
+    }
+
+    double server_cpu = -1;
+    if (in_process) {
+        server_cpu = std::max(process_cpu - client_cpu, 0.0);
+    } else if (options.server_pid > 0 && server_cpu_before >= 0 && server_cpu_after >= 0) {
+        server_cpu = server_cpu_after - server_cpu_before;
+    }
+    auto per_request_us = [&total](double cpu_seconds) {
+        return total.requests > 0 ? cpu_seconds * 1e6 / total.requests : 0.0;
+    };
+
+    std::string out;
+    JsonWriter json(out);
+    json.begin_object()
+        .field("benchmark", "media_server")
+        .field("target", in_process ? std::string("in-process") : host_header)
+        .field("connections", options.connections)
+        .field("threads", threads)
+        .field("mix", options.mix)
+        .field("seconds", elapsed)
+        .field("errors", errors)
+        .field("reconnects", reconnects)
+        .field("requests_per_second", total.requests / elapsed)
+        .field("mb_per_second", total.bytes / elapsed / (1024 * 1024));
+    write_latency(json, total);
+    json.key("server_cpu_us_per_request");
+    if (server_cpu >= 0) {
+        json.value(per_request_us(server_cpu));
+    } else {
+        json.null_value();
+    }
+    json.field("client_cpu_us_per_request", per_request_us(client_cpu));
+    json.key("routes").begin_object();
+    for (int k = 0; k < KIND_COUNT; ++k) {
+        if (weights[k] == 0) {
+            continue;
+        }
+        json.key(KIND_NAMES[k]).begin_object().field("path", options.paths[k]);
+        write_latency(json, by_kind[k]);
+        json.end_object();
+    }
+    json.end_object().end_object();
+    std::cout << out << std::endl;
+    return errors > 0 && total.requests == 0 ? 1 : 0;
+}
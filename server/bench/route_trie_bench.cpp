@@ -0,0 +1,117 @@
+// RouteTrie 微基准：在实际路由表基础上逐步加入路由，对比路由树与原线性扫描的查找开销
+#include "route_trie.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace {
+
+// 原 SimpleServer::path_matches 的实现，作为对照
+std::vector<std::string> split_string(const std::string& str, char delimiter) {
+    std::vector<std::string> result;
+    size_t start = 0;
+    size_t end = 0;
+    while ((end = str.find(delimiter, start)) != std::string::npos) {
+        if (end != start) {
+            result.push_back(str.substr(start, end - start));
+        }
+        start = end + 1;
+    }
+    if (start < str.length()) {
+        result.push_back(str.substr(start));
+    }
+    return result;
+}
+
+bool path_matches(const std::string& request_path, const std::string& route_path,
+                  std::map<std::string, std::string>& params) {
+    std::vector<std::string> request_parts = split_string(request_path, '/');
+    std::vector<std::string> route_parts = split_string(route_path, '/');
+    if (request_parts.size() != route_parts.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < route_parts.size(); ++i) {
+        if (route_parts[i][0] == ':') {
+            params[route_parts[i].substr(1)] = request_parts[i];
+        } else if (route_parts[i] != request_parts[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+const std::vector<std::string> base_routes = {
+    "/api/status", "/api/media/list", "/api/media/scan", "/api/media/:id",
+    "/api/session/create", "/", "/index.html", "/css/:filename", "/js/:filename",
+    "/images/:filename", "/api/hls/create", "/api/hls/status/:stream_id",
+    "/hls/:stream_id/playlist.m3u8", "/hls/:stream_id/:segment", "/api/hls/list",
+    "/api/hls/stop/:stream_id", "/:filename",
+};
+
+const std::vector<std::string> lookups = {
+    "/hls/stream_media_1/segment_042.ts", "/hls/stream_media_1/playlist.m3u8",
+    "/api/media/list", "/api/hls/status/stream_media_1", "/js/app.js", "/favicon.ico",
+};
+
+template <typename F>
+double time_per_lookup(size_t iterations, F&& lookup) {
+    auto start = std::chrono::steady_clock::now();
+    size_t hits = 0;
+    for (size_t i = 0; i < iterations; ++i) {
+        hits += lookup(lookups[i % lookups.size()]) ? 1 : 0;
+    }
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (hits != iterations) {
+        std::cerr << "unexpected miss" << std::endl;
+        std::exit(1);
+    }
+    return elapsed * 1e9 / iterations;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    const size_t iterations = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 500000;
+
+    std::cout << "{\"benchmark\":\"route_lookup\",\"results\":[";
+    bool first = true;
+    for (size_t extra : {0, 16, 64, 256, 1024}) {
+        // 合成路由插在实际路由之前，模拟路由表增长
+        std::vector<std::string> routes;
+        for (size_t i = 0; i < extra; ++i) {
+            routes.push_back("/api/v1/resource" + std::to_string(i) + "/:id");
+        }
+        routes.insert(routes.end(), base_routes.begin(), base_routes.end());
+
+        RouteTrie trie;
+        for (size_t i = 0; i < routes.size(); ++i) {
+            trie.insert("GET", routes[i], static_cast<int>(i));
+        }
+
+        double trie_ns = time_per_lookup(iterations, [&](const std::string& path) {
+            RouteTrie::Match match;
+            return trie.find("GET", path, match);
+        });
+
+        size_t linear_iterations = std::max<size_t>(iterations / (1 + extra / 16), 1000);
+        double linear_ns = time_per_lookup(linear_iterations, [&](const std::string& path) {
+            std::map<std::string, std::string> params;
+            for (const auto& route : routes) {
+                if (path_matches(path, route, params)) {
+                    return true;
+                }
+            }
+            return false;
+        });
+
+        std::cout << (first ? "" : ",") << "{\"routes\":" << routes.size()
+                  << ",\"trie_ns\":" << trie_ns << ",\"linear_ns\":" << linear_ns << "}";
+        first = false;
+    }
+    std::cout << "]}" << std::endl;
+    return 0;
+}
@@ -8,50 +8,132 @@
 #include <thread>
 #include <atomic>
 #include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <functional>
+
+struct AVPacket;
+struct AVFrame;
 
 struct TranscodeConfig {
     std::string input_path;
     std::string output_dir;
     std::string stream_id;
-    
+
     int video_bitrate = 2000;  // kbps
     int audio_bitrate = 128;   // kbps
     int segment_duration = 4;  // seconds
     int max_segments = 10;
+    int encoder_threads = 0;   // 视频编码线程数，0 由编码器自行决定；调度器按此计算 CPU 占用
+    bool allow_stream_copy = true;  // 源编码已与 HLS 兼容的流只重封装，分片按源关键帧切分
+
+    // 按需分片：segment_cuts 为完整的切分计划（各分片起点秒数，末项为总时长），非空时只产出
+    // [first_segment, last_segment) 这几个分片。时间轴与一次完整转码相同，各次产出的分片可以拼接播放
+    std::vector<double> segment_cuts;
+    int first_segment = 0;
+    int last_segment = 0;
     std::string resolution = "1920x1080";
     std::string video_codec = "libx264";
     std::string audio_codec = "aac";
-    
+
     bool enable_logging = true;
 };
 
+// 进程内 HLS 转码：libavformat 解复用 → libavcodec 解码 → 缩放 / 重采样 → 编码 → MPEG-TS 分片
+//
+// 源流本身就是 HLS 可播的编码（8 位 4:2:0 H.264、不超过两声道的 AAC）时跳过编解码，
+// 解复用出的包直接交给复用线程，只占用极少的 CPU。两路可以分别决定，例如复制视频、转码 AC-3 音频。
+//
+// 每个流四个线程：解复用、视频、音频各一个阶段线程，阶段之间以有界队列相连（背压一直
+// 传到解复用）；转码线程本身负责按 DTS 合并两路编码结果并写分片。分片先写入 .tmp，
+// 完整后改名，open_segment 不会读到写了一半的文件；播放列表在内存中维护。
+// 按需分片时转码器从所需分片前的关键帧开始解复用，只产出计划中的一段分片后结束。
+// stop() 通过 libav 的中断回调与关闭队列取消全部阶段，返回时线程均已结束、
+// 编解码上下文均已释放。
 class FFmpegTranscoder {
 public:
     FFmpegTranscoder(const TranscodeConfig& config);
     ~FFmpegTranscoder();
-    
+
+    // 等待首个分片写完后返回；失败（无法打开输入或编码器等）返回 false
     bool start();
+    // 只启动转码线程，不等待首个分片。转码器只运行一次，stop() 之后返回 false
+    bool launch();
+    // 等待首个分片写完或转码结束，返回是否未出错
+    bool wait_ready(std::chrono::milliseconds timeout);
+    // 等待编号为 index 的分片写完；转码结束时仍未写出返回 false
+    bool wait_segment(int index, std::chrono::milliseconds timeout);
     void stop();
+    // 转码线程结束（完成、失败或被停止）时在该线程上调用；须在 launch() 之前设置
+    void set_finished_callback(std::function<void()> callback);
+    // 每写完一个分片时在转码线程上调用，此时 wait_segment 已能看到该分片；须在 launch() 之前设置
+    void set_segment_callback(std::function<void()> callback);
     bool is_running() const;
     std::string get_status() const;
     int get_segment_count() const;
-    
+
     std::string get_playlist() const;
     std::vector<char> get_segment(const std::string& segment_name) const;
-    
+
+    // 打开分片文件用于零拷贝发送，返回只读 fd（调用方负责关闭），失败返回 -1
+    int open_segment(const std::string& segment_name, size_t& size) const;
+
+    // 打开 output_dir 下的分片文件，校验规则同 open_segment
+    static int open_segment_file(const std::string& output_dir, const std::string& segment_name, size_t& size);
+
+    // 生成按需分片的切分计划：视频可直接复制时切点取源关键帧（来自 MediaIndexer 的包索引，
+    // 尚未建立时当场构建），否则按目标时长均分。返回各分片起点秒数，末项为总时长；无法打开输入或时长未知时返回空
+    static std::vector<double> plan_segments(const TranscodeConfig& config);
+
+    static constexpr std::chrono::seconds START_TIMEOUT{30};
+
 private:
+    struct Pipeline;
+    struct StreamStage;
+
     void transcode_process();
     void cleanup();
     bool create_output_directory();
-    std::string build_ffmpeg_command() const;
-    
+
+    bool open_pipeline(Pipeline& pipeline);
+    bool open_video(Pipeline& pipeline);
+    bool open_audio(Pipeline& pipeline);
+    bool open_copy(Pipeline& pipeline, StreamStage& stage);
+    bool open_resampler(Pipeline& pipeline, const AVFrame* frame);
+    bool decode_packets(StreamStage& stage, const std::function<bool(AVFrame*)>& on_frame);
+    bool encode_frame(StreamStage& stage, AVFrame* frame);
+    void demux_stage(Pipeline& pipeline);
+    void video_stage(Pipeline& pipeline);
+    void audio_stage(Pipeline& pipeline);
+    bool mux_packets(Pipeline& pipeline);
+    bool write_packet(Pipeline& pipeline, AVPacket* packet);
+    bool begin_segment(Pipeline& pipeline);
+    bool finish_segment(Pipeline& pipeline, int64_t end_pts, bool last);
+    void update_playlist(bool finished);  // 调用方持有 status_mutex_
+    double next_cut(double seconds) const;  // seconds 之后的下一个分片边界
+
+    void fail(const std::string& message);
+    static int interrupt_callback(void* opaque);
+
     TranscodeConfig config_;
     std::atomic<bool> is_running_{false};
+    std::atomic<bool> cancelled_{false};
     std::thread transcode_thread_;
-    pid_t ffmpeg_pid_{-1};
+    std::unique_ptr<Pipeline> pipeline_;
+    std::function<void()> on_finished_;
+    std::function<void()> on_segment_;
+
+    std::mutex lifecycle_mutex_;  // 串行化 launch() 与 stop()，二者可能来自调度线程和请求线程
+    bool stopped_ = false;
+
     mutable std::mutex status_mutex_;
+    std::condition_variable state_cv_;  // 首个分片完成或转码结束时通知 start()
     std::string error_message_;
+    bool finished_ = false;
     int segment_count_{0};
+    int next_segment_{0};  // 最近写完的分片编号 + 1
+    std::vector<double> segment_durations_;
+    std::string playlist_;
 };
 
-#endif // FFMPEG_TRANSCODER_H
\ No newline at end of file
+#endif // FFMPEG_TRANSCODER_H
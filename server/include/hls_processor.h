@@ -9,6 +9,8 @@
 #include <atomic>
 #include <thread>
 #include <condition_variable>
+#include <functional>
+#include "transcode_scheduler.h"
 
 // 前向声明
 namespace std {
@@ -18,8 +20,9 @@ namespace std {
 struct HLSStreamStatus {
     std::string stream_id;
     std::string media_id;
-    std::string status; // "creating", "ready", "error", "stopped"
+    std::string status; // "queued", "transcoding", "ready", "error", "not_found"
     std::string error_message;
+    int queue_position = 0;  // 排队等待转码预算时的位置（1 起），否则为 0
     int segments_generated = 0;
     int total_segments = 0;
     double progress = 0.0;
@@ -28,6 +31,21 @@ struct HLSStreamStatus {
     std::map<std::string, std::string> to_json() const;
 };
 
+// /metrics 使用的 HLS 计数快照
+struct HLSMetrics {
+    struct Stream {
+        std::string stream_id;
+        std::string media_id;
+        uint64_t segments_served = 0;
+        uint64_t segment_bytes = 0;
+    };
+    std::vector<Stream> streams;
+    uint64_t transcoders_started = 0;
+    uint64_t transcoders_failed = 0;
+    uint64_t transcoders_stopped = 0;
+    size_t transcoders_active = 0;
+};
+
 struct HLSStreamConfig {
     std::string stream_id;
     std::string media_path;
@@ -44,6 +62,22 @@ struct HLSStreamConfig {
     std::string video_codec = "h264";
     std::string audio_codec = "aac";
     
+    // 转码调度：编码线程数决定向调度器申请的 CPU，交互播放优先于后台预转码
+    int encoder_threads = 2;
+    TranscodeScheduler::Priority priority = TranscodeScheduler::Priority::Interactive;
+    
+    // 源编码信息（来自媒体库扫描），用于估算直接复制时的 CPU 占用；为空按需要转码估算
+    bool allow_stream_copy = true;
+    std::string source_video_codec;
+    std::string source_pixel_format;
+    std::string source_audio_codec;
+    int source_audio_channels = 0;
+    
+    // 按需分片：创建时按时长与关键帧生成完整的 VOD 播放列表，分片在首次请求时才产出，
+    // 同时预读其后 read_ahead 个分片；关闭时从头连续转码
+    bool on_demand = true;
+    int read_ahead = 3;
+    
     // 实时转码相关配置
     bool realtime_transcode = true;
     int buffer_size = 10; // 缓冲区大小（分片数）
@@ -59,7 +93,9 @@ public:
     HLSProcessor();
     ~HLSProcessor();
     
-    // 创建流（支持实时转码）
+    // 创建流（支持实时转码）。转码任务交给 TranscodeScheduler：预算充足时等待首个分片后返回，
+    // 否则流以 "queued" 状态登记后立即返回，排队位置见 get_stream_status。
+    // 按需分片的流生成切分计划后即返回，播放列表立即可用
     bool create_stream(const std::string& media_path, 
                       const std::string& media_id,
                       const HLSStreamConfig& config = HLSStreamConfig());
@@ -74,6 +110,21 @@ public:
     std::vector<char> get_segment(const std::string& stream_id, 
                                  const std::string& segment_name) const;
     
+    // 分片打开的结果：fd >= 0 为只读 fd（由回调方负责关闭），失败为 -1
+    using SegmentCallback = std::function<void(int fd, size_t size)>;
+    
+    // 打开分片文件用于零拷贝发送，不阻塞：分片已写完时在调用线程上立即回调；
+    // 按需分片尚未产出时交给 HLS 的分片线程安排产出，写完、产出失败或超时后在该线程上回调。
+    // 回调恰好调用一次，可以在事件循环线程中调用本函数
+    void open_segment_async(const std::string& stream_id,
+                            const std::string& segment_name,
+                            SegmentCallback done) const;
+    
+    // 同上，但阻塞到有结果为止，返回只读 fd（调用方负责关闭），失败返回 -1
+    int open_segment(const std::string& stream_id,
+                     const std::string& segment_name,
+                     size_t& size) const;
+    
     // 列出所有流
     std::vector<std::string> list_streams() const;
     
@@ -90,6 +141,9 @@ public:
     // 检查流是否存在
     bool stream_exists(const std::string& stream_id) const;
     
+    // 各流分片发送量与转码器计数
+    HLSMetrics get_metrics() const;
+    
 private:
     // 实时转码线程函数
     void transcode_thread_function(const std::string& stream_id, 
@@ -0,0 +1,96 @@
+#ifndef HPACK_H
+#define HPACK_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <deque>
+#include <utility>
+#include <cstddef>
+#include <cstdint>
+
+// HPACK（RFC 7541）头部压缩，供 HTTP/2 会话使用。
+//
+// 编码端和解码端各自维护一张动态表，分别与对端的解码端 / 编码端同步，
+// 因此头部块必须严格按照在连接上发出 / 收到的顺序编码 / 解码。
+
+using HpackHeaderList = std::vector<std::pair<std::string, std::string>>;
+
+// 动态表：新条目在前，条目大小按 RFC 计为 name + value + 32 字节
+class HpackDynamicTable {
+public:
+    explicit HpackDynamicTable(size_t max_size = DEFAULT_SIZE) : max_size_(max_size) {}
+
+    void set_max_size(size_t size);
+    size_t max_size() const { return max_size_; }
+    size_t size() const { return size_; }
+    size_t count() const { return entries_.size(); }
+
+    void add(std::string_view name, std::string_view value);
+    // index 从 0 开始（对应 HPACK 索引 62）
+    const std::pair<std::string, std::string>& at(size_t index) const { return entries_[index]; }
+
+    static const size_t ENTRY_OVERHEAD = 32;
+    static const size_t DEFAULT_SIZE = 4096;
+
+private:
+    void evict_to(size_t limit);
+
+    std::deque<std::pair<std::string, std::string>> entries_;
+    size_t size_ = 0;
+    size_t max_size_;
+};
+
+class HpackDecoder {
+public:
+    // max_header_list_size：解码后头部列表的上限（同 SETTINGS_MAX_HEADER_LIST_SIZE 的计法）
+    explicit HpackDecoder(size_t max_header_list_size);
+
+    // 解码一个完整的头部块（HEADERS + CONTINUATION 拼接后），追加到 headers。
+    // 返回 false 表示压缩错误或超出限制，连接必须以 COMPRESSION_ERROR 结束（动态表已不可信）
+    bool decode(const uint8_t* data, size_t size, HpackHeaderList& headers);
+
+    // 我方通告的 SETTINGS_HEADER_TABLE_SIZE，对端的动态表大小更新不能超过它
+    void set_max_table_size(size_t size) { max_table_size_ = size; }
+
+private:
+    bool lookup(uint64_t index, std::string& name, std::string* value) const;
+
+    HpackDynamicTable table_;
+    size_t max_table_size_ = HpackDynamicTable::DEFAULT_SIZE;
+    size_t max_header_list_size_;
+};
+
+class HpackEncoder {
+public:
+    // 对端通告的 SETTINGS_HEADER_TABLE_SIZE；动态表实际大小取它与 DEFAULT_SIZE 的较小值，
+    // 变化时在下一个头部块开头发出大小更新
+    void set_max_table_size(size_t size);
+
+    // 每个头部块开始时调用
+    void begin_block(std::string& out);
+
+    // name 必须是小写。indexable 为 false 时不进入动态表（取值每次都不同的头部）
+    void encode(std::string& out, std::string_view name, std::string_view value, bool indexable = true);
+
+private:
+    HpackDynamicTable table_;
+    bool size_update_pending_ = false;
+    size_t min_size_since_update_ = HpackDynamicTable::DEFAULT_SIZE;
+};
+
+// 编解码原语，单独暴露便于测试
+namespace hpack {
+
+// N 位前缀整数；first_byte_flags 是前缀之外的高位标志
+void encode_integer(std::string& out, uint64_t value, int prefix_bits, uint8_t first_byte_flags);
+// 成功时 pos 前进；数据不足或溢出返回 false
+bool decode_integer(const uint8_t* data, size_t size, size_t& pos, int prefix_bits, uint64_t& value);
+
+// 字符串字面量，Huffman 编码更短时使用 Huffman
+void encode_string(std::string& out, std::string_view text);
+bool decode_huffman(const uint8_t* data, size_t size, std::string& out);
+
+} // namespace hpack
+
+#endif // HPACK_H
@@ -0,0 +1,207 @@
+#ifndef HTTP2_SESSION_H
+#define HTTP2_SESSION_H
+
+#include "hpack.h"
+#include "http_parser.h"
+#include "http_response.h"
+#include <string>
+#include <vector>
+#include <deque>
+#include <functional>
+#include <unordered_map>
+#include <unordered_set>
+#include <cstddef>
+#include <cstdint>
+
+// HTTP/2 明文连接（h2c）的协议状态机
+//
+// 负责帧解析、HPACK、流状态、双向流量控制以及按优先级树调度响应帧，不做任何 I/O。
+// 收齐的请求以 HttpRequest 交给服务器，走与 HTTP/1.1 相同的路由分派；处理函数返回的
+// HttpResponse 经 respond() 交回，由 produce() 在连接输出积压允许时编码为 HEADERS /
+// DATA 帧。文件体用 pread 读入 DATA 帧（帧头与数据必须交错，无法整段 sendfile）。
+// 只在连接所属的事件循环线程中使用，不加锁。
+//
+// 两种进入方式：连接以客户端前言开头（prior knowledge），或 HTTP/1.1 请求带
+// Upgrade: h2c（升级请求本身成为流 1）。
+class Http2Session {
+public:
+    enum class ErrorCode : uint32_t {
+        NoError = 0x0,
+        ProtocolError = 0x1,
+        InternalError = 0x2,
+        FlowControlError = 0x3,
+        StreamClosed = 0x5,
+        FrameSizeError = 0x6,
+        RefusedStream = 0x7,
+        Cancel = 0x8,
+        CompressionError = 0x9,
+        EnhanceYourCalm = 0xb,
+    };
+
+    explicit Http2Session(const HttpParser::Limits& limits);
+
+    Http2Session(const Http2Session&) = delete;
+    Http2Session& operator=(const Http2Session&) = delete;
+
+    // data 是客户端连接前言 "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n" 的前缀（可能尚不完整）
+    static bool matches_preface(const char* data, size_t size);
+
+    // HTTP/1.1 升级请求：Upgrade 含 h2c、带 HTTP2-Settings 且没有消息体
+    static bool is_upgrade_request(const HttpRequest& request);
+    // 以升级请求作为流 1（对端已半关闭）开始会话；HTTP2-Settings 非法时返回 false，应按 HTTP/1.1 处理
+    bool start_upgrade(const HttpRequest& request);
+
+    // 处理 data 中的全部完整帧，返回消费的字节数；不完整的帧留待下次。
+    // 连接错误后丢弃之后的所有输入
+    size_t receive(const char* data, size_t size);
+
+    // 取出下一个收齐的请求
+    bool next_request(uint32_t& stream_id, HttpRequest& request);
+    // 暂不分派刚取出的请求（如本连接交给工作线程的请求已达上限），下次 next_request 时首先取出
+    void defer(uint32_t stream_id, HttpRequest request);
+
+    // 流式响应暂无数据时挂起该流；数据来源 notify 后在任意线程调用 resumer(stream_id)，
+    // 服务器应把它投递回事件循环线程再调用 resume()
+    void set_resumer(std::function<void(uint32_t)> resumer) { resumer_ = std::move(resumer); }
+    void resume(uint32_t stream_id);
+
+    // 提交流的响应；流已被重置时直接丢弃。已分派的流被重置后，在其响应交回之前
+    // 仍计入并发流上限，对端不能靠 HEADERS + RST_STREAM 反复堆积处理函数
+    void respond(uint32_t stream_id, HttpResponse response);
+
+    // 把待发送的帧追加到 out：控制帧总是全部写出，HEADERS / DATA 写到约 budget 字节为止，
+    // 受对端流量控制窗口约束，按优先级树在可发送的流之间分配
+    void produce(std::string& out, size_t budget);
+
+    // 已因连接错误发出 GOAWAY，或对端 GOAWAY 后没有进行中的流：输出发完后应关闭连接
+    bool finished() const { return closing_ || (peer_goaway_ && open_streams_ == 0); }
+    // 有已分派但处理函数尚未返回的请求，或挂起等待数据的流式响应（期间连接不计超时）
+    bool awaiting_responses() const;
+    // 有已提交但尚未发完的响应（可能在等待对端的 WINDOW_UPDATE）
+    bool has_pending_data() const;
+
+    static const size_t PREFACE_SIZE = 24;
+    static const size_t FRAME_HEADER_SIZE = 9;
+    static const uint32_t MAX_FRAME_SIZE = 16384;           // 我方接收的最大帧，即协议默认值
+    static const uint32_t MAX_CONCURRENT_STREAMS = 100;
+    static const int32_t STREAM_RECV_WINDOW = 256 * 1024;
+    static const int32_t CONNECTION_RECV_WINDOW = 1024 * 1024;
+    static const size_t MAX_PRIORITY_NODES = 256;          // 含 PRIORITY 帧创建的空闲占位节点
+    static const uint16_t DEFAULT_WEIGHT = 16;
+
+private:
+    enum class StreamState {
+        Idle,              // 只存在于优先级树中的占位节点
+        Open,
+        HalfClosedRemote   // 请求已收齐，等待或正在发送响应
+    };
+
+    struct Stream {
+        uint32_t id = 0;
+        StreamState state = StreamState::Idle;
+
+        HttpRequest request;
+        int64_t declared_length = -1;   // 请求的 content-length，-1 表示未声明
+        int reject_status = 0;          // 非 0 时收齐后直接以该状态应答（如请求体超限）
+        bool dispatched = false;
+        int32_t recv_window = 0;
+        uint32_t recv_unacked = 0;      // 已消费但尚未用 WINDOW_UPDATE 归还的字节
+
+        bool responded = false;
+        bool headers_sent = false;
+        HttpResponse response;
+        size_t body_sent = 0;           // 固定长度消息体已发送的字节
+        std::string produced;           // 流式响应已生成、尚未发出的数据
+        size_t produced_offset = 0;
+        bool producer_done = false;
+        bool producer_parked = false;   // producer 暂无数据，等待 resume
+        int64_t send_window = 0;
+
+        // 优先级树（RFC 7540 5.3）：兄弟节点之间按 pass（加权虚拟时间）轮流发送
+        uint32_t parent = 0;
+        uint16_t weight = DEFAULT_WEIGHT;
+        std::vector<uint32_t> children;
+        uint64_t pass = 0;
+        uint64_t child_vtime = 0;       // 最近一次被选中的子节点的 pass，新加入的子节点从这里起步
+    };
+
+    struct PendingPriority {
+        bool present = false;
+        uint32_t depends_on = 0;
+        uint16_t weight = DEFAULT_WEIGHT;
+        bool exclusive = false;
+    };
+
+    void handle_frame(uint8_t type, uint8_t flags, uint32_t stream_id, const uint8_t* payload, size_t length);
+    void on_data(uint8_t flags, uint32_t stream_id, const uint8_t* payload, size_t length);
+    void on_headers(uint8_t flags, uint32_t stream_id, const uint8_t* payload, size_t length);
+    void on_continuation(uint8_t flags, const uint8_t* payload, size_t length);
+    void on_priority(uint32_t stream_id, const uint8_t* payload, size_t length);
+    void on_rst_stream(uint32_t stream_id, const uint8_t* payload, size_t length);
+    void on_settings(uint8_t flags, uint32_t stream_id, const uint8_t* payload, size_t length);
+    void on_ping(uint8_t flags, uint32_t stream_id, const uint8_t* payload, size_t length);
+    void on_goaway(uint32_t stream_id, size_t length);
+    void on_window_update(uint32_t stream_id, const uint8_t* payload, size_t length);
+    void header_block_complete();
+    ErrorCode apply_settings(const uint8_t* payload, size_t length);
+    bool build_request(HpackHeaderList& headers, Stream& stream);
+    void finish_request(Stream& stream);
+
+    void connection_error(ErrorCode code, const char* reason);
+    void stream_error(uint32_t stream_id, ErrorCode code);
+    void close_stream(uint32_t stream_id);
+    Stream* find_stream(uint32_t stream_id);
+
+    // 优先级树
+    Stream& priority_node(uint32_t stream_id);
+    void set_priority(uint32_t stream_id, uint32_t depends_on, uint16_t weight, bool exclusive);
+    void attach(Stream& node, uint32_t parent_id);
+    void detach(Stream& node);
+    bool is_ancestor(uint32_t ancestor, uint32_t stream_id) const;
+    Stream* pick(Stream& node);
+    void charge(Stream& stream, size_t bytes);
+
+    // 发送
+    bool sendable(const Stream& stream) const;
+    static size_t body_length(const HttpResponse& response);
+    void send_headers(Stream& stream, std::string& out);
+    void send_data(Stream& stream, std::string& out);
+    bool copy_body(const HttpResponse& response, size_t offset, char* dest, size_t length);
+    void finish_sending(Stream& stream);
+    static void write_frame_header(std::string& out, size_t length, uint8_t type, uint8_t flags, uint32_t stream_id);
+    void queue_window_update(uint32_t stream_id, uint32_t increment);
+    void queue_rst_stream(uint32_t stream_id, ErrorCode code);
+
+    HttpParser::Limits limits_;
+    HpackDecoder decoder_;
+    HpackEncoder encoder_;
+    std::unordered_map<uint32_t, Stream> streams_;  // 0 为优先级树的根
+    std::deque<uint32_t> ready_;                    // 收齐待分派的流
+    std::string control_;                           // 待发送的控制帧，优先于 HEADERS / DATA
+    std::string header_scratch_;                    // 编码响应头部块的复用缓冲区
+    std::function<void(uint32_t)> resumer_;
+
+    bool preface_received_ = false;
+    bool settings_received_ = false;
+    bool closing_ = false;          // 已发出 GOAWAY
+    bool peer_goaway_ = false;
+    uint32_t last_stream_id_ = 0;   // 对端打开过的最大流 ID
+    uint32_t open_streams_ = 0;
+    std::unordered_set<uint32_t> abandoned_;  // 已分派、处理函数尚未返回时被重置的流
+
+    // 头部块跨 CONTINUATION 时的暂存
+    bool expecting_continuation_ = false;
+    uint32_t continuation_stream_ = 0;
+    bool continuation_end_stream_ = false;
+    PendingPriority continuation_priority_;
+    std::string header_block_;
+
+    // 对端设置与流量控制
+    uint32_t peer_max_frame_size_ = 16384;
+    int64_t peer_initial_window_ = 65535;
+    int64_t connection_send_window_ = 65535;
+    int64_t connection_recv_window_ = 65535;
+    uint32_t connection_recv_unacked_ = 0;
+};
+
+#endif // HTTP2_SESSION_H
@@ -0,0 +1,96 @@
+#ifndef HTTP_PARSER_H
+#define HTTP_PARSER_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <map>
+#include <utility>
+#include <cstddef>
+
+// HTTP 请求解析结果
+struct HttpRequest {
+    std::string method;
+    std::string path;
+    std::string version;
+    std::vector<std::pair<std::string, std::string>> headers;
+    std::string body;
+    std::map<std::string, std::string> query_params;
+
+    // 大小写不敏感的头部查找，不存在时返回 nullptr
+    const std::string* get_header(std::string_view name) const;
+
+    // 查询参数（已 URL 解码），不存在时返回 default_value
+    std::string query(const std::string& name, const std::string& default_value = "") const;
+};
+
+// 增量式 HTTP/1.x 请求解析器
+//
+// 每个连接持有一个实例。parse() 每次接收从当前请求起始处开始的全部未消费数据，
+// 解析器记住已扫描的位置和所处阶段，因此一个请求可以跨任意多次 epoll 唤醒到达，
+// 已扫描过的字节不会被重复扫描。请求完成后调用 reset() 复用同一对象（字符串容量保留）。
+class HttpParser {
+public:
+    enum class Status {
+        NeedMore,   // 数据不足，等待更多字节
+        Complete,   // 一个完整请求已解析，consumed() 为其占用字节数
+        Error       // 请求非法或超限，error_status() 给出应答状态码
+    };
+
+    struct Limits {
+        size_t max_header_size = 8 * 1024;      // 请求行 + 全部头部
+        size_t max_header_count = 100;
+        size_t max_body_size = 1024 * 1024;
+    };
+
+    HttpParser();
+    explicit HttpParser(const Limits& limits);
+
+    // data 必须从当前请求的第一个字节开始，且包含此前已传入的全部字节
+    Status parse(const char* data, size_t size);
+
+    void reset();
+
+    HttpRequest& request() { return request_; }
+    const HttpRequest& request() const { return request_; }
+
+    size_t consumed() const { return pos_; }
+    int error_status() const { return error_status_; }
+    bool in_progress() const { return state_ != State::RequestLine || pos_ > 0; }
+
+    static std::map<std::string, std::string> parse_query_string(const std::string& query_string);
+    static std::string url_decode(const std::string& value);
+
+private:
+    enum class State {
+        RequestLine,
+        Headers,
+        Body,
+        ChunkSize,
+        ChunkData,
+        ChunkTrailer,
+        Complete,
+        Error
+    };
+
+    Status fail(int status);
+    Status headers_complete();
+    bool parse_request_line(const char* line, size_t length);
+    bool parse_header_line(const char* line, size_t length);
+
+    // 在 [pos_, size) 中查找下一行，返回行长度（不含行尾），未找到返回 false
+    bool next_line(const char* data, size_t size, size_t& line_length, size_t& line_end) const;
+
+    Limits limits_;
+    HttpRequest request_;
+    // reset() 时回收的头部条目，后续请求复用其字符串缓冲区
+    std::vector<std::pair<std::string, std::string>> spare_headers_;
+    State state_ = State::RequestLine;
+    size_t pos_ = 0;
+    size_t content_length_ = 0;
+    size_t chunk_remaining_ = 0;
+    size_t trailer_start_ = 0;  // trailer 段起点，整段受 max_header_size 限制
+    int error_status_ = 0;
+};
+
+#endif // HTTP_PARSER_H
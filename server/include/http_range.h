@@ -0,0 +1,36 @@
+#ifndef HTTP_RANGE_H
+#define HTTP_RANGE_H
+
+#include <string>
+#include <string_view>
+#include <cstdint>
+#include <ctime>
+
+// 单个字节区间 [offset, offset + length)
+struct ByteRange {
+    uint64_t offset = 0;
+    uint64_t length = 0;
+};
+
+// Range 请求头的处理结果
+enum class RangeResult {
+    Full,           // 没有 Range 头、单位不是 bytes 或语法无效：按 RFC 7233 忽略，返回完整内容
+    Partial,        // 单个可满足区间：206
+    Unsatisfiable,  // 区间起点越界：416
+    MultipleRanges  // 多区间请求：不支持 multipart/byteranges，按 416 拒绝
+};
+
+// 解析 "bytes=a-b" / "bytes=a-" / "bytes=-n"，结束位置超出文件时截断到文件末尾
+RangeResult parse_range_header(std::string_view header, uint64_t file_size, ByteRange& range);
+
+// If-Range 判定：值为 ETag 时做强比较，否则按 HTTP 日期与 Last-Modified 精确比较。
+// 不匹配时应忽略 Range，返回完整的新内容。
+bool if_range_matches(std::string_view if_range, const std::string& etag, const std::string& last_modified);
+
+// 由文件大小和修改时间生成强校验 ETag，如 "1a2b3c-5f5e1000"
+std::string make_etag(uint64_t size, const struct timespec& mtime);
+
+// RFC 7231 IMF-fixdate，如 "Sun, 06 Nov 1994 08:49:37 GMT"
+std::string format_http_date(time_t time);
+
+#endif // HTTP_RANGE_H
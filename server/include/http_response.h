@@ -0,0 +1,106 @@
+#ifndef HTTP_RESPONSE_H
+#define HTTP_RESPONSE_H
+
+#include <string>
+#include <string_view>
+#include <memory>
+#include <functional>
+#include <mutex>
+#include <vector>
+#include <utility>
+#include <cstddef>
+#include <sys/types.h>
+
+// 路由处理结果
+//
+// 处理函数只描述状态码、头部和消息体；状态行、Content-Length 与 Connection
+// 由服务器在发送时统一生成。消息体可以是内存中的 body，也可以是 file_fd 指定的
+// 文件区间——后者由服务器用 sendfile 直接从文件发送，不经过用户态缓冲区。
+// shared_body 是多个响应共用的只读缓冲区（如静态资源缓存），发送时只持有引用不复制。
+// 对象独占 file_fd，析构时关闭。
+//
+// 流式响应（stream）不预先给出长度：服务器在连接的输出积压低于低水位时反复调用
+// producer，每次追加到 chunk 的内容作为一个 chunk 以 Transfer-Encoding: chunked
+// 发出（HTTP/1.0 客户端改为写完后关闭连接）。producer 返回 false 表示内容已结束。
+// producer 在连接所属的事件循环线程中调用，不能阻塞；连接关闭时随连接一起销毁。
+// 暂时没有数据可发（如实时输出尚未产生）时返回 true 且不追加内容：流随即挂起，不再
+// 调用 producer，直到数据来源调用 stream_wake->notify()。挂起需要构造时给出唤醒句柄，
+// 没有句柄的流返回空块按生成错误处理。
+//
+// 常见的 Content-Type 使用进程内预生成的头部行（content_type_line），不占用 headers，
+// 简单响应（无额外头部、小消息体）的构造不分配内存。
+struct HttpResponse {
+    using BodyProducer = std::function<bool(std::string& chunk)>;
+
+    // 流式响应的唤醒句柄，由处理函数与数据来源共享。notify 可在任意线程调用，
+    // 在 producer 返回空块之前调用也不会丢失（下一次挂起立即解除）
+    class StreamWake {
+    public:
+        void notify();
+        // 服务器在 producer 没有数据时调用：其间已有 notify 时返回 false，应立即再取；
+        // 否则记下 resume 并返回 true，下一次 notify 在其所在线程调用 resume
+        bool park(std::function<void()> resume);
+
+    private:
+        std::mutex mutex_;
+        std::function<void()> resume_;
+        bool notified_ = false;
+    };
+
+    int status = 200;
+    const std::string* content_type_line = nullptr;  // 预生成的 "Content-Type: ...\r\n"
+    std::vector<std::pair<std::string, std::string>> headers;
+    std::string body;
+    std::shared_ptr<const std::string> shared_body;
+    // 预先格式化好的头部行（每行以 \r\n 结尾，不含 Content-Length / Connection），
+    // 原样追加在 headers 之后，供内容固定的响应复用
+    std::shared_ptr<const std::string> header_block;
+
+    int file_fd = -1;
+    off_t file_offset = 0;
+    size_t file_length = 0;
+
+    BodyProducer producer;  // 非空表示流式响应，body / shared_body / 文件体不再使用
+    std::shared_ptr<StreamWake> stream_wake;
+
+    HttpResponse() = default;
+    explicit HttpResponse(int status_code) : status(status_code) {}
+    ~HttpResponse();
+
+    HttpResponse(HttpResponse&& other) noexcept;
+    HttpResponse& operator=(HttpResponse&& other) noexcept;
+    HttpResponse(const HttpResponse&) = delete;
+    HttpResponse& operator=(const HttpResponse&) = delete;
+
+    static HttpResponse json(int status, std::string body);
+    static HttpResponse text(int status, std::string body);
+    static HttpResponse with_body(int status, std::string_view content_type, std::string body);
+
+    // 消息体为共享缓冲区，响应只增加引用计数
+    static HttpResponse shared(int status, std::string_view content_type, std::shared_ptr<const std::string> body);
+
+    // 消息体为 fd 的 [offset, offset + length) 区间，响应接管 fd
+    static HttpResponse file(int status, std::string_view content_type, int fd, off_t offset, size_t length);
+
+    // 流式消息体，见类注释
+    static HttpResponse stream(int status, std::string_view content_type, BodyProducer producer,
+                               std::shared_ptr<StreamWake> wake = nullptr);
+
+    HttpResponse& header(std::string name, std::string value);
+    HttpResponse& content_type(std::string_view type);
+
+    bool has_file() const { return file_fd >= 0; }
+    bool is_stream() const { return static_cast<bool>(producer); }
+    size_t content_length() const {
+        return body.size() + (shared_body ? shared_body->size() : 0) + (has_file() ? file_length : 0);
+    }
+
+    static const char* reason_phrase(int status);
+
+    // 预生成的 "HTTP/1.1 <status> <reason>\r\n"
+    static std::string_view status_line(int status);
+    // 常见类型的 "Content-Type: <type>\r\n"，不在表中时返回 nullptr
+    static const std::string* content_type_fragment(std::string_view type);
+};
+
+#endif // HTTP_RESPONSE_H
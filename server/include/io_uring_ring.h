@@ -0,0 +1,103 @@
+#ifndef IO_URING_RING_H
+#define IO_URING_RING_H
+
+#include <linux/io_uring.h>
+#include <sys/uio.h>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// io_uring 实例的最小封装（直接使用系统调用，不依赖 liburing）
+//
+// 每个 reactor 一个实例，只在所属事件循环线程中使用，不加锁。
+// 除提交/完成队列外还管理两类预先注册的内存：
+//   provided buffer ring  多次触发 (multishot) recv 由内核从中挑选接收缓冲区
+//   fixed buffers         文件响应的暂存区，READ_FIXED 读入后链接 SEND 发出
+class IoUringRing {
+public:
+    // 创建失败时抛出 std::system_error（内核不支持或被禁用）
+    IoUringRing(unsigned entries, unsigned recv_buffer_count, unsigned recv_buffer_size,
+                unsigned fixed_buffer_count, unsigned fixed_buffer_size);
+    ~IoUringRing();
+
+    IoUringRing(const IoUringRing&) = delete;
+    IoUringRing& operator=(const IoUringRing&) = delete;
+
+    // 取一个清零的 SQE；队列已满时先提交再取
+    io_uring_sqe* get_sqe();
+
+    // 剩余可填写的 SQE 数；链接的多个 SQE 必须在同一次提交中，填写前先确认空间
+    unsigned sq_space_left() const {
+        return sq_entries_ - (sqe_tail_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE));
+    }
+
+    // 提交全部待提交的 SQE，并最多等待 timeout_ms 毫秒直到至少一个 CQE 就绪
+    int submit_and_wait(int timeout_ms);
+
+    // 依次处理已就绪的 CQE，返回处理数量
+    template <typename Handler>
+    unsigned drain_completions(Handler&& handler) {
+        unsigned head = *cq_head_;
+        unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+        unsigned count = 0;
+        while (head != tail) {
+            const io_uring_cqe& cqe = cqes_[head & cq_mask_];
+            handler(cqe);
+            ++head;
+            ++count;
+            __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+            tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+        }
+        return count;
+    }
+
+    // provided buffer ring
+    static const uint16_t RECV_BUFFER_GROUP = 0;
+    char* recv_buffer(uint16_t buffer_id) { return recv_memory_.data() + size_t(buffer_id) * recv_buffer_size_; }
+    void recycle_recv_buffer(uint16_t buffer_id);
+
+    // fixed buffers：acquire 失败返回 -1
+    int acquire_fixed_buffer();
+    void release_fixed_buffer(int index);
+    char* fixed_buffer(int index) { return fixed_memory_.data() + size_t(index) * fixed_buffer_size_; }
+    unsigned fixed_buffer_size() const { return fixed_buffer_size_; }
+
+private:
+    void map_rings(const io_uring_params& params);
+    void setup_recv_buffers(unsigned count, unsigned size);
+    void setup_fixed_buffers(unsigned count, unsigned size);
+    void unmap();
+
+    int ring_fd_ = -1;
+
+    void* sq_ring_ = nullptr;
+    size_t sq_ring_size_ = 0;
+    void* cq_ring_ = nullptr;
+    size_t cq_ring_size_ = 0;
+    io_uring_sqe* sqes_ = nullptr;
+    size_t sqes_size_ = 0;
+
+    unsigned* sq_head_ = nullptr;
+    unsigned* sq_tail_ = nullptr;
+    unsigned* sq_array_ = nullptr;
+    unsigned sq_mask_ = 0;
+    unsigned sq_entries_ = 0;
+    unsigned sqe_tail_ = 0;   // 本地已填写的 SQE 尾部，提交时发布给内核
+
+    unsigned* cq_head_ = nullptr;
+    unsigned* cq_tail_ = nullptr;
+    unsigned cq_mask_ = 0;
+    io_uring_cqe* cqes_ = nullptr;
+
+    io_uring_buf_ring* recv_ring_ = nullptr;
+    size_t recv_ring_size_ = 0;
+    unsigned recv_ring_mask_ = 0;
+    unsigned recv_buffer_size_ = 0;
+    std::vector<char> recv_memory_;
+
+    unsigned fixed_buffer_size_ = 0;
+    std::vector<char> fixed_memory_;
+    std::vector<int> free_fixed_buffers_;
+};
+
+#endif // IO_URING_RING_H
@@ -0,0 +1,62 @@
+#ifndef JSON_WRITER_H
+#define JSON_WRITER_H
+
+#include <charconv>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+// 流式 JSON 输出
+//
+// 直接追加到调用方提供的 std::string，不构造中间的树或 map；逗号由写入器根据
+// 嵌套层级自动补齐，字符串值和键名按 RFC 8259 转义（引号、反斜杠、控制字符）。
+// 不检查结构是否合法（如对象中缺少 key），调用顺序由使用者保证。
+class JsonWriter {
+public:
+    explicit JsonWriter(std::string& out) : out_(out) {}
+
+    JsonWriter& begin_object();
+    JsonWriter& end_object();
+    JsonWriter& begin_array();
+    JsonWriter& end_array();
+
+    JsonWriter& key(std::string_view name);
+
+    JsonWriter& value(std::string_view text);
+    JsonWriter& value(const char* text) { return value(std::string_view(text)); }
+    JsonWriter& value(const std::string& text) { return value(std::string_view(text)); }
+    JsonWriter& value(bool flag);
+    JsonWriter& value(double number);  // NaN / 无穷输出为 null
+    JsonWriter& null_value();
+
+    template <typename T, typename = std::enable_if_t<std::is_integral_v<T> && !std::is_same_v<T, bool>>>
+    JsonWriter& value(T number) {
+        before_value();
+        char buffer[24];
+        auto result = std::to_chars(buffer, buffer + sizeof(buffer), number);
+        out_.append(buffer, result.ptr);
+        return *this;
+    }
+
+    template <typename T>
+    JsonWriter& field(std::string_view name, const T& field_value) {
+        key(name);
+        return value(field_value);
+    }
+
+    // 追加 "text"（含引号与转义）
+    static void append_string(std::string& out, std::string_view text);
+
+    static const int MAX_DEPTH = 64;
+
+private:
+    void before_value();
+
+    std::string& out_;
+    uint64_t has_items_ = 0;  // 第 i 位：第 i 层容器是否已有元素（决定是否需要逗号）
+    int depth_ = 0;
+    bool after_key_ = false;
+};
+
+#endif // JSON_WRITER_H
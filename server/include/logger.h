@@ -0,0 +1,155 @@
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+
+enum class LogLevel : int {
+    Debug = 0,
+    Info = 1,
+    Warn = 2,
+    Error = 3,
+};
+
+// 编译期最低日志级别：低于它的 LOG_* 语句连同参数求值一起被编译器丢弃。
+// Release (NDEBUG) 默认去掉 Debug，也可以用 -DMEDIA_SERVER_LOG_MIN_LEVEL=N 指定
+#ifndef MEDIA_SERVER_LOG_MIN_LEVEL
+#ifdef NDEBUG
+#define MEDIA_SERVER_LOG_MIN_LEVEL 1
+#else
+#define MEDIA_SERVER_LOG_MIN_LEVEL 0
+#endif
+#endif
+
+// 异步日志
+//
+// 调用线程把一行日志格式化进线程局部缓冲区，再拷贝进固定大小的环形队列（多生产者、
+// 单消费者，CAS 占槽，无锁）；后台线程批量取出，加时间戳和级别后一次 write 到
+// stdout（Debug/Info）或 stderr（Warn/Error）。队列满时丢弃新日志并计数，调用线程
+// 永远不会因为终端或 journald 慢而阻塞。
+//
+// 运行期级别可由环境变量 MEDIA_SERVER_LOG_LEVEL（debug/info/warn/error）设置。
+// 进程退出时（atexit）会排空队列；之后的日志直接同步写出。
+class Logger {
+public:
+    static Logger& get_instance();
+
+    Logger(const Logger&) = delete;
+    Logger& operator=(const Logger&) = delete;
+
+    void set_level(LogLevel level) { level_.store(static_cast<int>(level), std::memory_order_relaxed); }
+    bool enabled(LogLevel level) const {
+        return static_cast<int>(level) >= level_.load(std::memory_order_relaxed);
+    }
+
+    // 取得当前线程的行缓冲区开始一行日志，写完后调用 commit 提交（由 LOG_* 宏成对调用）
+    std::ostream& begin();
+    void commit(LogLevel level);
+
+    // 等待此前提交的日志全部写出
+    void flush();
+    // 排空队列并停止后台线程
+    void shutdown();
+
+    uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+    static const size_t CAPACITY = 2048;   // 槽位数，必须是 2 的幂
+    static const size_t MAX_LINE = 480;    // 单行最大长度，超出截断
+
+private:
+    Logger();
+
+    struct Slot {
+        std::atomic<uint64_t> sequence{0};
+        LogLevel level = LogLevel::Info;
+        uint32_t length = 0;
+        int64_t time_micros = 0;   // system_clock，微秒
+        char text[MAX_LINE];
+    };
+
+    // 同一秒内的日期时间前缀只格式化一次
+    struct TimestampCache {
+        int64_t second = -1;
+        char prefix[32] = {};
+    };
+
+    bool try_push(LogLevel level, const char* text, size_t length, int64_t time_micros);
+    void run();
+    size_t drain(TimestampCache& cache, std::string& out, std::string& err);
+    static void format_line(TimestampCache& cache, std::string& target, LogLevel level, int64_t time_micros,
+                            const char* text, size_t length);
+    static void write_all(int fd, const std::string& data);
+
+    std::unique_ptr<Slot[]> slots_;
+    alignas(64) std::atomic<uint64_t> tail_{0};   // 生产者占槽位置
+    alignas(64) std::atomic<uint64_t> head_{0};   // 只有后台线程修改
+    std::atomic<uint64_t> dropped_{0};
+    std::atomic<int> level_;
+
+    std::atomic<bool> running_{false};
+    std::thread thread_;
+    std::mutex mutex_;
+    std::condition_variable wake_;      // 唤醒后台线程
+    std::condition_variable drained_;   // 通知 flush() 的等待者
+};
+
+// 按调用点限速：每秒最多输出 per_second 条，超出的只计数，下一条输出时附带被抑制的条数
+class LogRateLimiter {
+public:
+    explicit LogRateLimiter(uint32_t per_second) : per_second_(per_second) {}
+
+    // 返回 true 表示本条可以输出；suppressed 为此前被抑制、尚未报告的条数
+    bool allow(uint64_t& suppressed);
+
+private:
+    const uint32_t per_second_;
+    std::atomic<int64_t> window_{0};
+    std::atomic<uint32_t> count_{0};
+    std::atomic<uint64_t> suppressed_{0};
+};
+
+#define MEDIA_SERVER_LOG(level, expr)                                                    \
+    do {                                                                                 \
+        if constexpr (static_cast<int>(level) >= MEDIA_SERVER_LOG_MIN_LEVEL) {           \
+            Logger& ms_logger_ = Logger::get_instance();                                 \
+            if (ms_logger_.enabled(level)) {                                             \
+                ms_logger_.begin() << expr;                                              \
+                ms_logger_.commit(level);                                                \
+            }                                                                            \
+        }                                                                                \
+    } while (0)
+
+#define MEDIA_SERVER_LOG_LIMITED(level, per_second, expr)                                \
+    do {                                                                                 \
+        if constexpr (static_cast<int>(level) >= MEDIA_SERVER_LOG_MIN_LEVEL) {           \
+            static LogRateLimiter ms_log_limiter_(per_second);                           \
+            Logger& ms_logger_ = Logger::get_instance();                                 \
+            uint64_t ms_log_suppressed_ = 0;                                             \
+            if (ms_logger_.enabled(level) && ms_log_limiter_.allow(ms_log_suppressed_)) { \
+                std::ostream& ms_log_stream_ = ms_logger_.begin();                       \
+                ms_log_stream_ << expr;                                                  \
+                if (ms_log_suppressed_ > 0) {                                            \
+                    ms_log_stream_ << " (另有 " << ms_log_suppressed_ << " 条被限速)";    \
+                }                                                                        \
+                ms_logger_.commit(level);                                                \
+            }                                                                            \
+        }                                                                                \
+    } while (0)
+
+#define LOG_DEBUG(expr) MEDIA_SERVER_LOG(LogLevel::Debug, expr)
+#define LOG_INFO(expr) MEDIA_SERVER_LOG(LogLevel::Info, expr)
+#define LOG_WARN(expr) MEDIA_SERVER_LOG(LogLevel::Warn, expr)
+#define LOG_ERROR(expr) MEDIA_SERVER_LOG(LogLevel::Error, expr)
+
+// 每个调用点每秒最多 per_second 条，用于每个连接/请求都可能触发的日志
+#define LOG_INFO_LIMITED(per_second, expr) MEDIA_SERVER_LOG_LIMITED(LogLevel::Info, per_second, expr)
+#define LOG_WARN_LIMITED(per_second, expr) MEDIA_SERVER_LOG_LIMITED(LogLevel::Warn, per_second, expr)
+#define LOG_ERROR_LIMITED(per_second, expr) MEDIA_SERVER_LOG_LIMITED(LogLevel::Error, per_second, expr)
+
+#endif // LOGGER_H
@@ -0,0 +1,134 @@
+#ifndef MEDIA_INDEX_H
+#define MEDIA_INDEX_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <istream>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+// 单个媒体文件的包索引
+//
+// 记录主流（有视频时为视频，否则为音频）每个包的时间戳、字节偏移与大小。包按文件中的
+// 顺序（字节偏移递增）保存，关键帧另有按时间递增的下标表，切点与字节位置都能二分查找，
+// 不必重新解复用。索引以文件大小和修改时间标识对应的媒体文件，任一变化即失效。
+class MediaIndex {
+public:
+    struct Packet {
+        int64_t pts;    // 流时间基
+        int64_t pos;    // 文件内字节偏移
+        uint32_t size;
+        uint32_t flags;
+    };
+    static constexpr uint32_t KEYFRAME = 1;
+
+    // 解复用一遍（不解码）建立索引；stop 置位时尽快放弃并返回 nullptr
+    static std::shared_ptr<const MediaIndex> build(const std::string& media_path,
+                                                   const std::atomic<bool>* stop = nullptr);
+    // 读取磁盘上的索引，与 media_path 当前的大小或修改时间不符时返回 nullptr
+    static std::shared_ptr<const MediaIndex> load(const std::string& index_path, const std::string& media_path);
+    // 只校验文件头：索引存在且仍与 media_path 对应
+    static bool current(const std::string& index_path, const std::string& media_path);
+    // 先写临时文件再改名，读者不会看到写了一半的索引
+    bool save(const std::string& index_path) const;
+
+    // 与转码器的输出时间轴一致：秒，已减去输入起始时间
+    double seconds(const Packet& packet) const;
+
+    // 不晚于 / 不早于给定时间的关键帧，不存在时返回 nullptr；O(log n)
+    const Packet* keyframe_before(double seconds) const;
+    const Packet* keyframe_after(double seconds) const;
+    // 覆盖字节偏移 offset 的包（偏移不超过 offset 的最后一个包）；O(log n)
+    const Packet* packet_at(int64_t offset) const;
+
+    std::vector<double> keyframe_times() const;
+
+    bool valid_for(const std::string& media_path) const;
+
+    const std::string& media_path() const { return media_path_; }
+    int stream_index() const { return stream_index_; }
+    bool is_video() const { return video_; }
+    double duration() const { return duration_; }
+    size_t packet_count() const { return packets_.size(); }
+    size_t keyframe_count() const { return keyframes_.size(); }
+
+private:
+    bool read_header(std::istream& in, const std::string& media_path);
+
+    std::string media_path_;
+    uint64_t file_size_ = 0;
+    int64_t file_mtime_ = 0;
+
+    int stream_index_ = -1;
+    bool video_ = false;
+    int time_base_num_ = 0;
+    int time_base_den_ = 1;
+    int64_t start_pts_ = 0;
+    double duration_ = 0.0;
+
+    std::vector<Packet> packets_;     // 字节偏移递增
+    std::vector<uint32_t> keyframes_; // packets_ 下标，pts 递增
+};
+
+// 媒体索引的构建与缓存
+//
+// 媒体库扫描后把全部文件交给 enqueue()，后台线程逐个检查磁盘上的索引，缺失或失效的
+// 重新构建。get() 依次查内存缓存与磁盘；需要立即使用时可以要求在调用线程上构建。
+// 索引目录默认 ../media/.index，可用环境变量 MEDIA_SERVER_INDEX_DIR 覆盖。
+class MediaIndexer {
+public:
+    struct Stats {
+        size_t pending = 0;
+        size_t cached = 0;
+        uint64_t built_total = 0;
+        uint64_t failed_total = 0;
+    };
+
+    static MediaIndexer& get_instance();
+
+    MediaIndexer(const MediaIndexer&) = delete;
+    MediaIndexer& operator=(const MediaIndexer&) = delete;
+
+    void enqueue(const std::vector<std::string>& media_paths);
+
+    // 没有有效索引时返回 nullptr；build 为 true 则在当前线程构建并保存
+    std::shared_ptr<const MediaIndex> get(const std::string& media_path, bool build = false);
+
+    Stats stats() const;
+
+    // 停止后台线程，进程退出时调用
+    void shutdown();
+
+private:
+    MediaIndexer();
+
+    void run();
+    std::string index_path(const std::string& media_path) const;
+    std::shared_ptr<const MediaIndex> build_and_store(const std::string& media_path);
+
+    std::string index_dir_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable wake_;
+    std::deque<std::string> queue_;
+    std::set<std::string> queued_;
+    // 最近使用的在表头，超出 MAX_CACHED 时淘汰表尾
+    using CacheEntry = std::pair<std::string, std::shared_ptr<const MediaIndex>>;
+    std::list<CacheEntry> lru_;
+    std::map<std::string, std::list<CacheEntry>::iterator> cache_;
+    uint64_t built_total_ = 0;
+    uint64_t failed_total_ = 0;
+
+    std::atomic<bool> stopping_{false};
+    std::thread thread_;
+};
+
+#endif // MEDIA_INDEX_H
@@ -7,6 +7,7 @@
 #include <map>
 #include <mutex>
 #include <memory>
+#include <optional>
 
 struct MediaFile {
     std::string id;
@@ -37,6 +38,14 @@ struct MediaFile {
     static MediaFile from_media_info(const MediaInfo& info, const std::string& filename, const std::string& path, uint64_t size);
 };
 
+// 媒体库的序列化快照：/api/media/list 的响应体与 ETag，每次扫描替换媒体库时生成一次
+struct MediaCatalog {
+    uint64_t generation = 0;
+    std::string json;
+    std::string etag;
+    std::string headers;  // 预格式化的 ETag / Cache-Control 头部行
+};
+
 class MediaManager {
 public:
     static MediaManager& get_instance();
@@ -47,9 +56,15 @@ public:
     // Get all media files
     std::vector<MediaFile> get_all_media() const;
     
-    // Get specific media file
-    MediaFile* get_media(const std::string& id);
-    MediaFile* get_media_by_name(const std::string& filename);
+    // 当前媒体库的 JSON 快照（共享，不复制媒体库，也不重新序列化）
+    std::shared_ptr<const MediaCatalog> get_catalog() const;
+    
+    // Get specific media file（返回副本：扫描会整体替换媒体库，指针可能在使用中失效）
+    std::optional<MediaFile> get_media(const std::string& id) const;
+    std::optional<MediaFile> get_media_by_name(const std::string& filename) const;
+    
+    // 按 ID 取文件路径（返回副本，不受并发重扫影响），不存在时返回空串
+    std::string get_media_path(const std::string& id) const;
     
     // Search media files
     std::vector<MediaFile> search(const std::string& query) const;
@@ -66,11 +81,16 @@ private:
     ~MediaManager() = default;
     
     mutable std::mutex mutex_;
+    std::mutex scan_mutex_;   // 串行化目录扫描，与查询使用的 mutex_ 分离
     std::vector<MediaFile> media_files_;
     std::map<std::string, MediaFile*> media_map_;
+    std::shared_ptr<const MediaCatalog> catalog_;   // 与 media_files_ 同时替换
+    uint64_t generation_ = 0;
+    std::string instance_tag_;   // 区分进程实例，重启后旧 ETag 不会误命中
     std::unique_ptr<MediaAnalyzer> analyzer_;
     
     // Helper functions
+    std::shared_ptr<const MediaCatalog> build_catalog(const std::vector<MediaFile>& files, uint64_t generation) const;
     std::string generate_id() const;
     bool is_media_file(const std::string& filename) const;
 };
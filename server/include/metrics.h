@@ -0,0 +1,87 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <atomic>
+#include <cstdint>
+#include <initializer_list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// HDR 风格的对数-线性分桶（微秒）：每个 2 的幂区间再等分 SUB_BUCKETS 份，
+// 相对误差不超过 1/SUB_BUCKETS，桶数与量程呈对数关系
+struct LatencyBuckets {
+    static const int SUB_BUCKET_BITS = 3;
+    static const int SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+    static const int MAX_MAGNITUDE = 31;  // 2^31 微秒（约 35 分钟），更大的值计入最后一个桶
+    static const int COUNT = (MAX_MAGNITUDE - SUB_BUCKET_BITS + 2) * SUB_BUCKETS;
+
+    static int index(uint64_t micros);
+    static uint64_t upper_bound(int index);  // 桶内最大值（含）
+};
+
+// Prometheus 文本格式 (0.0.4) 输出
+class PrometheusText {
+public:
+    using Labels = std::initializer_list<std::pair<const char*, std::string_view>>;
+
+    void family(const char* name, const char* type, const char* help);
+    void sample(const char* name, Labels labels, uint64_t value);
+    void sample(const char* name, Labels labels, double value);
+
+    std::string& str() { return out_; }
+
+private:
+    void begin_sample(const char* name, Labels labels);
+
+    std::string out_;
+};
+
+// 进程级指标
+//
+// 请求路径上只写当前线程自己的分片：每个 reactor / 工作线程首次记录时分配一个分片，
+// 之后只有该线程写入（relaxed load + store，没有锁也没有原子读-改-写），
+// 采集时再把全部分片按路由相加。分片在线程退出后保留，计数不会丢失。
+class Metrics {
+public:
+    static Metrics& get_instance();
+
+    Metrics(const Metrics&) = delete;
+    Metrics& operator=(const Metrics&) = delete;
+
+    // 路由表编译时登记路由模式；index 即路由下标，未匹配的请求记在 routes.size() 处
+    void set_routes(const std::vector<std::pair<std::string, std::string>>& method_and_pattern);
+
+    void record_request(int route_index, int status, uint64_t latency_micros, uint64_t bytes);
+
+    // 追加请求相关的全部指标
+    void render(PrometheusText& out) const;
+
+private:
+    Metrics() = default;
+
+    struct RouteCounters {
+        std::atomic<uint64_t> by_class[5];  // 1xx .. 5xx
+        std::atomic<uint64_t> bytes;
+        std::atomic<uint64_t> latency_sum_micros;
+        std::atomic<uint64_t> buckets[LatencyBuckets::COUNT];
+    };
+
+    struct Shard {
+        explicit Shard(size_t route_slots);
+        size_t route_slots;
+        std::unique_ptr<RouteCounters[]> routes;
+    };
+
+    Shard* local_shard();
+
+    mutable std::mutex mutex_;  // 只保护路由表与分片列表本身，不在记录路径上
+    std::vector<std::pair<std::string, std::string>> routes_;
+    std::vector<std::unique_ptr<Shard>> shards_;
+    std::atomic<size_t> route_slots_{1};
+};
+
+#endif // METRICS_H
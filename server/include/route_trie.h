@@ -0,0 +1,59 @@
+#ifndef ROUTE_TRIE_H
+#define ROUTE_TRIE_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <utility>
+#include <cstddef>
+
+// 按路径段编译的路由树
+//
+// 路由模式以 '/' 分段，每段为以下三种之一：
+//   static   字面量，如 "api"
+//   :name    参数，匹配任意一个非空段
+//   *name    通配，匹配剩余的全部路径（可含 '/'），只能出现在末尾
+// 同一位置的优先级为 static > param > wildcard，与注册顺序无关；
+// 较高优先级的分支在更深处失败时回溯尝试下一种。
+// 查找只在请求路径上移动 string_view，不做任何堆分配。
+class RouteTrie {
+public:
+    static const size_t MAX_PARAMS = 8;
+
+    struct Match {
+        int route_index = -1;
+        size_t param_count = 0;
+        std::pair<std::string_view, std::string_view> params[MAX_PARAMS];  // 名称 -> 取值，均指向树或请求路径
+
+        std::string_view param(std::string_view name) const;
+    };
+
+    RouteTrie();
+
+    // 插入路由，route_index 为调用方路由表中的下标；同一方法和模式重复注册时保留第一个
+    void insert(const std::string& method, const std::string& pattern, int route_index);
+
+    bool find(std::string_view method, std::string_view path, Match& match) const;
+
+    void clear();
+    size_t node_count() const { return nodes_.size(); }
+
+private:
+    struct Node {
+        // 静态子节点按段名排序，二分查找
+        std::vector<std::pair<std::string, int>> static_children;
+        int param_child = -1;
+        int wildcard_child = -1;
+        std::string param_name;   // 本节点为参数/通配节点时的名称
+        std::vector<std::pair<std::string, int>> handlers;  // 方法 -> 路由下标
+    };
+
+    int add_child(int parent, std::string_view segment);
+    int handler_for(const Node& node, std::string_view method) const;
+    bool match_from(int node_index, std::string_view method, std::string_view path,
+                    size_t pos, Match& match) const;
+
+    std::vector<Node> nodes_;
+};
+
+#endif // ROUTE_TRIE_H
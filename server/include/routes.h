@@ -7,6 +7,6 @@
 void setup_routes(SimpleServer& server);
 
 // Utility functions
-std::string create_json_response(const std::string& message, bool success = true);
+HttpResponse create_json_response(const std::string& message, bool success = true);
 
 #endif // SIMPLE_ROUTES_H
\ No newline at end of file
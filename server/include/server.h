@@ -2,32 +2,109 @@
 #define SIMPLE_SERVER_H
 
 #include <string>
+#include <chrono>
 #include <functional>
 #include <thread>
 #include <atomic>
+#include <array>
 #include <vector>
 #include <map>
+#include <deque>
+#include <memory>
+#include <unordered_map>
+#include <mutex>
+#include <cstdint>
 #include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include "http_parser.h"
+#include "http_response.h"
+#include "http2_session.h"
+#include "route_trie.h"
+#include "timer_wheel.h"
+#include "worker_pool.h"
+
+#ifdef MEDIA_SERVER_IO_URING
+class IoUringRing;
+#endif
 
 class SimpleServer {
 public:
-    struct Route {
-        std::string method;
-        std::string path;
-        std::function<std::string(const std::string&)> handler;
+    using HttpRequest = ::HttpRequest;
+
+    // 路由模式中 :name / *name 段的匹配结果，取值指向请求路径，仅在处理函数调用期间有效
+    using RouteParams = RouteTrie::Match;
+
+    // 处理函数接收解析好的请求和路径参数，返回结构化响应；状态行与分帧头部由服务器生成
+    using RouteHandler = std::function<HttpResponse(const HttpRequest&, const RouteParams&)>;
+
+    // 异步处理函数交付结果的回调，可在任意线程调用，只有第一次调用有效。
+    // 从未调用就被销毁时请求以 500 应答
+    using Responder = std::function<void(HttpResponse)>;
+
+    // 异步处理函数在事件循环线程中调用，不得阻塞。结果现成时直接调用 respond，响应随即入队；
+    // 要等待外部事件（如分片产出）时保存 respond，由事件来源的线程调用，结果经 eventfd 回到所属 reactor。
+    // 等待期间不占用工作线程，也不计入准入控制的在途处理函数数
+    using AsyncRouteHandler = std::function<void(const HttpRequest&, const RouteParams&, Responder)>;
+
+    // I/O 后端。IoUring 仅在以 -DENABLE_IO_URING=ON 构建时可用，
+    // 运行时内核不支持则自动退回 epoll；路由处理接口两者完全相同
+    enum class IoBackend {
+        Epoll,
+        IoUring
+    };
+
+    // 处理函数的执行位置：Inline 在事件循环线程中直接执行，只适合不阻塞的处理；
+    // Worker 交给工作线程池，完成后经 eventfd 通知所属事件循环发送响应
+    enum class Dispatch {
+        Inline,
+        Worker
+    };
+
+    // 过载时的丢弃次序：负载升高时 Sheddable 路由先以 503 拒绝，严重过载时 Normal 路由也拒绝，
+    // Critical 路由（播放中的播放列表与分片）始终处理
+    enum class Priority {
+        Critical,
+        Normal,
+        Sheddable
+    };
+
+    // 负载等级，由事件循环延迟与在途处理函数数中较严重的一项决定
+    enum class LoadLevel {
+        Normal,
+        Elevated,
+        Overloaded
     };
 
-    // HTTP 请求解析结果
-    struct HttpRequest {
+    // 准入控制阈值，0 表示不按该项判断。
+    // 事件循环延迟按 reactor 各自计算（一批就绪事件的处理时长，指数平滑），
+    // 在途处理函数数为工作线程池中排队与执行中的任务合计
+    struct AdmissionLimits {
+        std::chrono::milliseconds lag_elevated{20};
+        std::chrono::milliseconds lag_overloaded{100};
+        int inflight_elevated = 8;
+        int inflight_overloaded = 32;
+    };
+
+    // 连接超时，0 表示不限制
+    struct Timeouts {
+        std::chrono::milliseconds request{10000};     // 新连接或请求开始后收齐请求的期限，防止慢速发送占住连接
+        std::chrono::milliseconds keep_alive{15000};  // 两个请求之间允许的空闲时间
+        std::chrono::milliseconds write{30000};       // 有待发送数据时，发送持续无进展的最长时间
+    };
+
+    struct Route {
         std::string method;
         std::string path;
-        std::string version;
-        std::map<std::string, std::string> headers;
-        std::string body;
-        std::map<std::string, std::string> query_params;
+        RouteHandler handler;
+        Dispatch dispatch = Dispatch::Inline;
+        Priority priority = Priority::Normal;
+        AsyncRouteHandler async_handler;  // 非空表示异步路由，handler 与 dispatch 不使用
     };
 
-    SimpleServer(int port = 8080);
+    // num_reactors: 事件循环数量，0 表示每个 CPU 核心一个
+    SimpleServer(int port = 8080, int num_reactors = 1);
     ~SimpleServer();
 
     bool start();
@@ -35,46 +112,338 @@ public:
     bool is_running() const;
 
     // HTTP 方法路由注册
-    void get(const std::string& path, std::function<std::string(const std::string&)> handler);
-    void post(const std::string& path, std::function<std::string(const std::string&)> handler);
-    void put(const std::string& path, std::function<std::string(const std::string&)> handler);
-    void del(const std::string& path, std::function<std::string(const std::string&)> handler);
+    void get(const std::string& path, RouteHandler handler, Dispatch dispatch = Dispatch::Inline,
+             Priority priority = Priority::Normal);
+    void post(const std::string& path, RouteHandler handler, Dispatch dispatch = Dispatch::Inline,
+              Priority priority = Priority::Normal);
+    void put(const std::string& path, RouteHandler handler, Dispatch dispatch = Dispatch::Inline,
+             Priority priority = Priority::Normal);
+    void del(const std::string& path, RouteHandler handler, Dispatch dispatch = Dispatch::Inline,
+             Priority priority = Priority::Normal);
 
     // 通用路由注册
-    void add_route(const std::string& method, const std::string& path,
-                   std::function<std::string(const std::string&)> handler);
+    void add_route(const std::string& method, const std::string& path, RouteHandler handler,
+                   Dispatch dispatch = Dispatch::Inline, Priority priority = Priority::Normal);
+
+    // 异步路由注册
+    void get_async(const std::string& path, AsyncRouteHandler handler, Priority priority = Priority::Normal);
+    void add_async_route(const std::string& method, const std::string& path, AsyncRouteHandler handler,
+                         Priority priority = Priority::Normal);
+
+    int reactor_count() const;
+
+    // 当前打开的连接数（全部 reactor 合计）与工作线程池排队的任务数
+    int open_connections() const;
+    size_t queued_worker_tasks() const;
+
+    // 当前负载等级（各 reactor 中最严重的），以及因过载被拒绝的请求累计数
+    LoadLevel load_level() const;
+    uint64_t requests_shed() const;
+    int inflight_handlers() const;
+
+    // 单个持久连接上允许处理的最大请求数，0 表示不限制
+    void set_max_requests_per_connection(int max_requests);
+
+    // 请求头/消息体大小限制，对之后建立的连接生效
+    void set_parser_limits(const HttpParser::Limits& limits);
+
+    // 每连接输出队列水位（字节）：积压超过 high 时暂停读取和处理后续请求，
+    // 回落到 low 以下时恢复。慢速客户端只占用内存，不占用 CPU。
+    void set_write_watermarks(size_t low, size_t high);
+
+    // 阻塞型处理函数的工作线程数，需在 start() 之前设置
+    void set_worker_threads(int num_threads);
+
+    // 读 / 空闲 / 写超时，由每个 reactor 的时间轮驱动
+    void set_timeouts(const Timeouts& timeouts);
+
+    // 同时打开的连接数上限（全部 reactor 合计）与单个客户端 IP 的连接数上限，0 表示不限制。
+    // 单 IP 计数按地址散列到若干分片，各分片一把锁，不同客户端的 accept / close 互不争用。
+    // 超限的新连接直接收到一个预先生成的 503 后关闭，不进入事件循环
+    void set_connection_limits(int max_connections, int max_connections_per_client);
+
+    // 过载时按路由优先级拒绝请求（503 + Retry-After）
+    void set_admission_limits(const AdmissionLimits& limits);
+
+    // 需在 start() 之前设置
+    void set_io_backend(IoBackend backend);
+    IoBackend io_backend() const;
 
 private:
-    void run();
-    void setup_server_socket();
+    // 一个 reactor = 一个独立的事件循环线程：
+    // 独占的监听 socket (SO_REUSEPORT)、epoll 实例以及其上的全部连接。
+    // reactor 之间不共享任何可变状态，路由表在 start() 之后只读。
+    // 输出队列中的一个片段：内存数据，或文件区间（sendfile 发送，发送完毕后关闭 fd）
+    struct OutputChunk {
+        std::string data;
+        std::shared_ptr<const std::string> shared;  // 非空时发送共享缓冲区，data 不使用
+        int file_fd = -1;
+        off_t file_offset = 0;
+        size_t file_length = 0;
+
+        OutputChunk() = default;
+        explicit OutputChunk(std::string bytes) : data(std::move(bytes)) {}
+        explicit OutputChunk(std::shared_ptr<const std::string> bytes) : shared(std::move(bytes)) {}
+        ~OutputChunk();
+        OutputChunk(OutputChunk&& other) noexcept;
+        OutputChunk& operator=(OutputChunk&&) = delete;
+        OutputChunk(const OutputChunk&) = delete;
+
+        bool is_file() const { return file_fd >= 0; }
+        const std::string& bytes() const { return shared ? *shared : data; }
+        size_t size() const { return is_file() ? file_length : bytes().size(); }
+    };
+
+    // 连接当前所处的超时阶段
+    enum class TimerPhase {
+        None,      // 等待工作线程，不计时
+        Request,   // 新连接尚未收到请求，或请求尚未收齐
+        Idle,      // 持久连接在两个请求之间
+        Write      // 有响应尚未发完
+    };
+
+    struct Connection {
+        explicit Connection(const HttpParser::Limits& limits) : parser(limits) {}
+
+        uint64_t id = 0;           // reactor 内唯一，区分 fd 被复用后的新连接
+        std::string in_buffer;     // 已接收但尚未处理的字节（可能包含多个流水线请求）
+        HttpParser parser;         // 当前请求的解析进度，跨 epoll 唤醒保持
+        int requests_served = 0;
+
+        std::deque<OutputChunk> out_queue;  // 待发送的响应片段，按请求顺序排列
+        size_t out_offset = 0;     // 队首片段已发送的字节数
+        size_t out_bytes = 0;      // 队列中尚未发送的总字节数
+        std::string spare_buffer;  // 已发送完的片段留下的缓冲区，下一个响应头直接复用其容量
+        bool want_write = false;   // 是否已在 epoll 中注册 EPOLLOUT
+        bool read_paused = false;  // 输出积压超过高水位，暂停读取
+        bool peer_closed = false;  // 对端已关闭写方向
+        bool close_after_flush = false;
+        bool awaiting_worker = false;  // 当前请求在工作线程中执行或在等待异步结果，后续流水线请求需等待以保证响应顺序
+
+        // 正在生成的流式响应：积压低于低水位时由 pump_stream 取下一块。
+        // 流结束前暂停读取，后续流水线请求在其后处理
+        HttpResponse::BodyProducer stream;
+        std::shared_ptr<HttpResponse::StreamWake> stream_wake;
+        bool stream_chunked = false;   // false 表示 HTTP/1.0 客户端，消息体以关闭连接结束
+        bool stream_parked = false;    // producer 暂无数据，等待唤醒句柄投递 resume（期间不计超时）
+
+        // 非空表示连接已切换到 HTTP/2（前言或 Upgrade: h2c），in_buffer 此后按帧解析。
+        // 多个流的响应在会话内排队，由 pump_stream 按积压情况编码成帧
+        std::unique_ptr<Http2Session> h2;
+        int h2_worker_jobs = 0;    // 已交给工作线程、结果尚未交回的 HTTP/2 请求（含其间被重置的流）
+
+        // 超时：同一阶段内只在阶段开始时调度一次（写阶段在发送有进展时顺延），
+        // 因此慢速发送请求的客户端无法靠不断发送零星字节推迟截止时间
+        TimerWheel::Timer timer;
+        TimerPhase timer_phase = TimerPhase::None;
+        uint64_t bytes_sent = 0;
+        uint64_t timer_bytes_sent = 0;  // 写阶段上次调度时的已发送字节数
+        uint32_t client_addr = 0;    // 对端 IPv4 地址（网络字节序），用于按客户端计数
+
+#ifdef MEDIA_SERVER_IO_URING
+        // io_uring 后端的在途操作。连接在 inflight_ops 归零前不能关闭 fd 或释放，
+        // 因为内核仍持有 send_iov / 暂存缓冲区的地址
+        struct UringState {
+            int inflight_ops = 0;
+            bool recv_armed = false;
+            bool recv_cancel_pending = false;
+            bool send_inflight = false;
+            bool closing = false;
+            std::vector<iovec> send_iov;
+            msghdr send_msg{};
+            int fixed_buffer = -1;                  // 文件暂存用的注册缓冲区，-1 表示未持有
+            std::unique_ptr<char[]> heap_buffer;    // 注册缓冲区耗尽时的退路
+            size_t staged_bytes = 0;                // 本轮读入暂存区的字节数
+            size_t staged_sent = 0;                 // 其中已发送的字节数
+        } uring;
+#endif
+    };
+
+    // 工作线程执行完毕的响应，交回连接所属的 reactor 发送
+    struct Completion {
+        int client_fd = -1;
+        uint64_t connection_id = 0;
+        bool keep_alive = false;
+        bool chunked = true;       // 客户端能否接收 chunked 编码（HTTP/1.1）
+        uint32_t stream_id = 0;    // HTTP/2 流，0 表示 HTTP/1.x 连接上的当前请求
+        int route_index = -1;
+        bool pooled = false;       // 由工作线程池执行的 HTTP/2 请求，计入连接的 h2_worker_jobs
+        bool resume = false;       // 挂起的流式响应有了新数据，不带响应，只需重新补充输出
+        std::chrono::steady_clock::time_point started;  // 请求解析完成的时刻，用于延迟统计
+        HttpResponse response;
+    };
+
+    struct Reactor {
+        int id = 0;
+        int server_fd = -1;
+        int epoll_fd = -1;
+        int wake_fd = -1;          // eventfd，工作线程投递完成结果后写入以唤醒事件循环
+        std::thread thread;
+        std::unordered_map<int, Connection> connections;
+        uint64_t next_connection_id = 0;
+        TimerWheel timers;
+        // 事件循环延迟估计（微秒），只由本 reactor 写入，/metrics 等可从其他线程读取
+        std::atomic<uint64_t> lag_micros{0};
+
+        std::mutex completion_mutex;
+        std::vector<Completion> completions;
+
+#ifdef MEDIA_SERVER_IO_URING
+        std::unique_ptr<IoUringRing> ring;  // 非空表示该 reactor 使用 io_uring 后端
+#endif
+    };
+
+    void run(Reactor& reactor);
+    void setup_server_socket(Reactor& reactor);
+    void close_reactor(Reactor& reactor);
     void cleanup();
 
-    // HTTP 解析相关
-    HttpRequest parse_http_request(const std::string& request) const;
-    std::string extract_clean_path(const std::string& path) const;
-    std::map<std::string, std::string> parse_query_params(const std::string& query_string) const;
-    bool path_matches(const std::string& request_path, const std::string& route_path,
-                      std::map<std::string, std::string>& params) const;
+    // 路由匹配
+    void compile_routes();
 
     // 客户端连接处理
-    void handle_client_connection(int client_fd);
-    void send_response(int client_fd, const std::string& response);
+    void handle_client_connection(Reactor& reactor, int client_fd);
+    void handle_client_writable(Reactor& reactor, int client_fd);
+    void close_connection(Reactor& reactor, int client_fd);
+    void forget_connection(Reactor& reactor, int client_fd, Connection& conn);
+    void process_requests(Reactor& reactor, int client_fd, Connection& conn);
+    // HTTP/2 连接：解析收到的帧，收齐的请求按流分派（内联或工作线程），不必等待前一个响应。
+    // 单个连接同时交给工作线程的请求不超过工作线程数，其余留在会话中等前面的结果交回
+    void process_h2(Reactor& reactor, int client_fd, Connection& conn);
+    HttpResponse dispatch_request(const HttpRequest& request) const;
+    HttpResponse invoke_route(const HttpRequest& request, const RouteParams& params) const;
+
+    // 工作线程路径：请求副本交给线程池，结果填入 completion.response 后经 post_completion 回到所属 reactor
+    bool dispatch_to_worker(Reactor& reactor, Completion completion, HttpRequest request);
+    static void post_completion(Reactor& reactor, Completion completion);
+    // 异步路由：在当前线程调用处理函数。处理函数返回前已交付结果时写入 response 并返回 true，
+    // 否则结果稍后经 post_completion 回到所属 reactor
+    bool invoke_async(Reactor& reactor, Completion completion, const HttpRequest& request,
+                      const RouteParams& params, HttpResponse& response);
+    void handle_completions(Reactor& reactor);
+
+    // 非阻塞写路径：响应先入队，flush_output 尽量写出，写不完时注册 EPOLLOUT 续写。
+    // 返回 false 表示连接应被关闭（写错误或已发送完最后一个响应）。
+    // 返回入队的总字节数（头部 + 消息体；流式响应只计头部）。
+    // chunked 为 false 时流式响应改用关闭连接结束消息体
+    static size_t enqueue_output(Connection& conn, HttpResponse response, bool keep_alive, bool chunked);
+    bool flush_output(Reactor& reactor, int client_fd, Connection& conn);
+    // 积压低于低水位时向输出队列补充流式响应的后续块（HTTP/2 连接为会话待发送的帧）
+    void pump_stream(Reactor& reactor, int client_fd, Connection& conn);
+    // 挂起的流式响应被唤醒时调用（任意线程）：经异步闸门向所属 reactor 投递 resume
+    std::function<void(uint32_t)> stream_resumer(Reactor& reactor, int client_fd, const Connection& conn) const;
+    // 暂停读取（积压或流式响应）的条件已解除时清除暂停标记并返回 true
+    bool resume_reading(Connection& conn);
+    static ssize_t write_front(int client_fd, Connection& conn);
+    static void consume_output(Connection& conn, size_t sent);
+
+#ifdef MEDIA_SERVER_IO_URING
+    // io_uring 后端（server_uring.cpp）。reactor 复用监听 socket 与 eventfd，
+    // 以 multishot accept / recv / poll 取代 epoll 就绪通知
+    bool setup_uring(Reactor& reactor);
+    void run_uring(Reactor& reactor);
+    void uring_handle_completion(Reactor& reactor, uint64_t user_data, int result, uint32_t flags);
+    void uring_accept(Reactor& reactor, int client_fd);
+    void uring_received(Reactor& reactor, int client_fd, Connection& conn, int result, uint32_t flags);
+    void uring_sent(Reactor& reactor, int client_fd, Connection& conn, int result);
+    void uring_file_read(Reactor& reactor, int client_fd, Connection& conn, int result);
+    void uring_file_sent(Reactor& reactor, int client_fd, Connection& conn, int result);
+    void uring_send_staged(Reactor& reactor, int client_fd, Connection& conn);
+    void uring_after_send(Reactor& reactor, int client_fd, Connection& conn);
+    void uring_resume(Reactor& reactor, int client_fd, Connection& conn);
+    bool uring_update_recv(Reactor& reactor, int client_fd, Connection& conn);
+    bool uring_flush(Reactor& reactor, int client_fd, Connection& conn);
+    void uring_close(Reactor& reactor, int client_fd, Connection& conn);
+    bool uring_op_finished(Reactor& reactor, int client_fd, Connection& conn);
+    bool uring_arm_accept(Reactor& reactor);
+    bool uring_arm_wake(Reactor& reactor);
+    static void release_staging(Reactor& reactor, Connection& conn);
+#endif
+
+    // 超时与连接数限制
+    void update_connection_timer(Reactor& reactor, Connection& conn);
+    void expire_timers(Reactor& reactor);
+    void handle_timeout(Reactor& reactor, int client_fd);
+    int timer_wait_ms(const Reactor& reactor) const;
+    bool admit_client(uint32_t client_addr);
+    void release_client(uint32_t client_addr);
+    static void reject_client(int client_fd);
+    static std::string peer_name(const sockaddr_in& addr);  // "ip:port"，用于日志
+
+    // 准入控制：每批就绪事件处理完后更新 reactor 的延迟估计；
+    // shed_request 为 true 时请求直接以 overloaded_response 应答，不调用处理函数
+    static void record_loop_lag(Reactor& reactor, std::chrono::steady_clock::time_point wait_started,
+                                std::chrono::steady_clock::time_point batch_started);
+    LoadLevel reactor_load(const Reactor& reactor) const;
+    bool shed_request(const Reactor& reactor, int route_index);
+    static HttpResponse overloaded_response();
+
+    // 持久连接与响应分帧
+    static bool wants_keep_alive(const HttpRequest& request);
+    static void serialize_head(const HttpResponse& response, bool keep_alive, bool chunked, std::string& head);
+    static HttpResponse error_response(int status);
 
     // 工具函数
     static bool set_socket_nonblocking(int fd);
-    static std::vector<std::string> split_string(const std::string& str, char delimiter);
 
     int port_;
-    int server_fd_;
-    int epoll_fd_;
+    int num_reactors_;
+    int max_requests_per_connection_ = DEFAULT_MAX_REQUESTS_PER_CONNECTION;
+    HttpParser::Limits parser_limits_;
+    size_t write_low_watermark_ = DEFAULT_WRITE_LOW_WATERMARK;
+    size_t write_high_watermark_ = DEFAULT_WRITE_HIGH_WATERMARK;
+    int worker_threads_ = DEFAULT_WORKER_THREADS;
+    IoBackend io_backend_;
+    Timeouts timeouts_;
+    int max_connections_ = DEFAULT_MAX_CONNECTIONS;
+    int max_connections_per_client_ = DEFAULT_MAX_CONNECTIONS_PER_CLIENT;
+    std::atomic<int> open_connections_{0};
+    // 客户端 IP -> 打开的连接数（全部 reactor 合计），按 IP 散列分片
+    struct ClientShard {
+        std::mutex mutex;
+        std::unordered_map<uint32_t, int> connections;
+    };
+    static const size_t CLIENT_SHARDS = 64;
+    std::array<ClientShard, CLIENT_SHARDS> client_shards_;
+    static size_t client_shard(uint32_t client_addr);
+    AdmissionLimits admission_;
+    std::atomic<int> inflight_handlers_{0};
+    std::atomic<uint64_t> requests_shed_{0};
+    WorkerPool worker_pool_;
+    // 异步路由的回调可能在服务器停止之后才被调用（如 HLS 等待线程在进程退出时了结剩余请求）；
+    // stop() 关闭闸门后回调不再投递，不会触及已销毁的 reactor
+    struct AsyncGate {
+        std::mutex mutex;
+        bool open = true;
+    };
+    std::shared_ptr<AsyncGate> async_gate_;
     std::atomic<bool> running_{false};
-    std::thread server_thread_;
+    std::vector<std::unique_ptr<Reactor>> reactors_;
     std::vector<Route> routes_;
+    RouteTrie route_trie_;
 
     // 常量定义
     static const int MAX_EVENTS = 64;
     static const int BUFFER_SIZE = 4096;
     static const int BACKLOG = 1024;
+    static const int DEFAULT_MAX_REQUESTS_PER_CONNECTION = 1000;
+    static const int MAX_IOVECS = 64;
+    static const size_t DEFAULT_WRITE_LOW_WATERMARK = 256 * 1024;
+    static const size_t DEFAULT_WRITE_HIGH_WATERMARK = 1024 * 1024;
+    static const int DEFAULT_WORKER_THREADS = 4;
+    static const int DEFAULT_MAX_CONNECTIONS = 10000;
+    static const int DEFAULT_MAX_CONNECTIONS_PER_CLIENT = 256;
+    static const size_t HEAD_RESERVE = 256;          // 响应头缓冲区的初始容量
+    static const size_t MAX_SPARE_BUFFER = 16 * 1024; // 可留作复用的缓冲区容量上限
+
+#ifdef MEDIA_SERVER_IO_URING
+    // io_uring 后端：每个 reactor 的队列深度、接收缓冲区与文件暂存区
+    static const unsigned URING_ENTRIES = 1024;
+    static const unsigned URING_RECV_BUFFERS = 256;
+    static const unsigned URING_RECV_BUFFER_SIZE = 16 * 1024;
+    static const unsigned URING_FIXED_BUFFERS = 32;
+    static const unsigned URING_FIXED_BUFFER_SIZE = 64 * 1024;
+#endif
 };
 
 #endif // SIMPLE_SERVER_H
\ No newline at end of file
@@ -0,0 +1,115 @@
+#ifndef STATIC_ASSET_CACHE_H
+#define STATIC_ASSET_CACHE_H
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+// Web 前端静态资源（index.html、css、js 等）的内存缓存
+//
+// 文件首次访问（或 warm() 预热）时整体读入内存，可压缩的类型同时生成 gzip / brotli
+// 预压缩版本。之后的命中只返回共享缓冲区的引用：没有 open/stat/read 系统调用，
+// 也不复制消息体。每个条目最多每 revalidate_interval 做一次 stat，mtime 或大小
+// 变化时重新加载，开发时修改前端文件无需重启服务器。
+//
+// lookup() 在事件循环线程上调用，自身不读文件也不压缩：变化或尚未缓存的文件交给后台
+// 线程加载，期间继续返回旧内容（尚未缓存的返回空，由调用方直接发送文件）。
+//
+// 超过 MAX_ASSET_SIZE 的文件不缓存，lookup() 返回空，由调用方走 sendfile。
+class StaticAssetCache {
+public:
+    // 同一资源的一种编码表示，各自拥有强 ETag
+    struct Variant {
+        std::shared_ptr<const std::string> body;
+        std::string etag;
+        const char* content_encoding = nullptr;  // nullptr 表示原始内容
+
+        // 加载时预先格式化的头部行，命中时整块追加到响应头，不再逐个拼接
+        std::string response_headers;      // 200：Content-Type、Content-Encoding、Vary、ETag 等
+        std::string not_modified_headers;  // 304：不含 Content-Type / Content-Encoding
+
+        // If-None-Match 是否命中本表示（弱比较，支持 "*"）。只与将要发送的表示比较：
+        // 持有其他编码 ETag 的客户端缓存的不是这个表示，应得到 200
+        bool matches(std::string_view if_none_match) const;
+    };
+
+    struct Asset {
+        std::string content_type;
+        std::string last_modified;
+        bool compressible = false;  // 是否需要 Vary: Accept-Encoding
+
+        Variant identity;
+        Variant gzip;    // body 为空表示没有该版本（未编译支持、不可压缩或压缩后不更小）
+        Variant brotli;
+
+        // 按 Accept-Encoding 的 q 值选择表示：br 优先于 gzip，都不可接受时返回原始内容
+        const Variant& select(std::string_view accept_encoding) const;
+    };
+
+    // 由文件路径得到 Content-Type
+    using ContentTypeResolver = std::function<std::string(const std::string&)>;
+
+    StaticAssetCache(std::string root, ContentTypeResolver content_type_of,
+                     std::chrono::milliseconds revalidate_interval = DEFAULT_REVALIDATE_INTERVAL);
+    ~StaticAssetCache();
+
+    StaticAssetCache(const StaticAssetCache&) = delete;
+    StaticAssetCache& operator=(const StaticAssetCache&) = delete;
+
+    // path 为相对 root 的请求路径（如 "/js/app.js"），需已做目录穿越检查。
+    // 文件不存在、不是普通文件、过大或正在后台加载时返回空
+    std::shared_ptr<const Asset> lookup(const std::string& path);
+
+    // 在调用线程上加载 root 下的全部文件，把压缩开销放在启动阶段
+    void warm();
+
+    const std::string& root() const { return root_; }
+
+    static const size_t MAX_ASSET_SIZE = 4 * 1024 * 1024;
+    static const std::chrono::milliseconds DEFAULT_REVALIDATE_INTERVAL;
+
+private:
+    struct Entry {
+        std::shared_ptr<const Asset> asset;
+        struct timespec mtime{};
+        off_t size = 0;
+        std::chrono::steady_clock::time_point checked;
+    };
+
+    // 请求路径对应的文件（目录取其 index.html），不是普通文件时返回空串
+    std::string resolve(const std::string& path, struct stat& file_stat) const;
+    // 读入并压缩 path 对应的文件，替换缓存条目
+    std::shared_ptr<const Asset> reload(const std::string& path);
+    std::shared_ptr<const Asset> load(const std::string& file_path, Entry& entry) const;
+    static void format_headers(const Asset& asset, Variant& variant);
+
+    void schedule_reload(const std::string& path);
+    void run_reloads();
+
+    std::string root_;
+    std::chrono::milliseconds revalidate_interval_;
+    ContentTypeResolver content_type_of_;
+    std::mutex mutex_;
+    std::unordered_map<std::string, Entry> entries_;
+
+    // 后台加载：队列中的路径去重，同一文件不会同时加载两次
+    std::condition_variable reload_cv_;
+    std::deque<std::string> reload_queue_;
+    std::unordered_set<std::string> reloading_;
+    bool stopping_ = false;
+    std::thread reload_thread_;
+};
+
+#endif // STATIC_ASSET_CACHE_H
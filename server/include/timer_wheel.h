@@ -0,0 +1,91 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+
+// 分层时间轮
+//
+// 每个 reactor 一个，只在所属事件循环线程中使用。定时器节点是侵入式的（嵌在连接里），
+// 调度、重新调度、取消都是 O(1)，不分配内存；推进时每个 tick 只看一个槽位，
+// 高层槽位在低层转完一圈时整体下放（cascade）。
+//
+// LEVELS 层 × SLOTS 个槽位，tick 为 100ms 时可表示约 19 天，更远的到期时间按上限处理。
+class TimerWheel {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    class Timer {
+    public:
+        Timer() = default;
+        ~Timer() = default;
+        // 节点地址被时间轮引用；移动只用于容器插入，此时节点必须未调度，移动后得到未调度的新节点
+        Timer(Timer&&) noexcept {}
+        Timer& operator=(Timer&&) = delete;
+        Timer(const Timer&) = delete;
+        Timer& operator=(const Timer&) = delete;
+
+        bool active() const { return prev_ != nullptr; }
+
+        uint64_t data = 0;  // 使用者自定义（如 fd），到期回调中用来找回所属对象
+
+    private:
+        friend class TimerWheel;
+        Timer* prev_ = nullptr;
+        Timer* next_ = nullptr;
+        uint64_t expires_ = 0;  // 到期 tick
+    };
+
+    explicit TimerWheel(std::chrono::milliseconds tick = DEFAULT_TICK);
+
+    TimerWheel(const TimerWheel&) = delete;
+    TimerWheel& operator=(const TimerWheel&) = delete;
+
+    // delay 后到期（至少一个 tick）；已调度的定时器先取消再重新调度
+    void schedule(Timer& timer, std::chrono::milliseconds delay);
+    void cancel(Timer& timer);
+
+    // 推进到 now，按到期顺序逐个回调 on_expire(Timer&)。回调中可以安全地
+    // 取消或重新调度任意定时器（包括正在回调的这个）
+    template <typename Handler>
+    void advance(Clock::time_point now, Handler&& on_expire) {
+        uint64_t target = static_cast<uint64_t>((now - start_) / tick_);
+        while (current_tick_ < target) {
+            ++current_tick_;
+            cascade();
+            Timer& slot = slots_[0][current_tick_ & SLOT_MASK];
+            while (slot.next_ != &slot) {
+                Timer* timer = slot.next_;
+                unlink(*timer);
+                --size_;
+                on_expire(*timer);
+            }
+        }
+    }
+
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    std::chrono::milliseconds tick() const { return tick_; }
+
+    static const std::chrono::milliseconds DEFAULT_TICK;
+
+private:
+    static const int LEVELS = 4;
+    static const int SLOT_BITS = 6;
+    static const uint64_t SLOTS = 1u << SLOT_BITS;
+    static const uint64_t SLOT_MASK = SLOTS - 1;
+
+    // 槽位是双向循环链表的哨兵节点
+    void place(Timer& timer);
+    void cascade();
+    static void unlink(Timer& timer);
+
+    std::chrono::milliseconds tick_;
+    Clock::time_point start_;
+    uint64_t current_tick_ = 0;
+    size_t size_ = 0;
+    Timer slots_[LEVELS][SLOTS];
+};
+
+#endif // TIMER_WHEEL_H
@@ -0,0 +1,92 @@
+#ifndef TRANSCODE_SCHEDULER_H
+#define TRANSCODE_SCHEDULER_H
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// 全局转码任务调度
+//
+// 每个任务声明自己要占用的 CPU（以 1/100 核计），运行中任务的占用之和不超过预算，
+// 超出的任务排队。交互播放（Interactive）总排在后台任务（Background）之前，同级先进先出；
+// 队首放不下时后面的任务也不插队，保证交互任务不会被一串小的后台任务拖住。
+// 没有任务在运行时队首总会被放行，单个超出预算的任务不会永远等待。
+//
+// 预算默认是全部核心，可以用环境变量 MEDIA_SERVER_TRANSCODE_CORES 覆盖。
+class TranscodeScheduler {
+public:
+    enum class Priority { Interactive, Background };
+
+    using JobId = uint64_t;
+    // 任务获准运行时调用，参数为任务 ID；只负责启动转码线程，不应阻塞。
+    // 任务结束（完成、失败或停止）后调用方必须调用 finish(id) 归还预算
+    using StartFn = std::function<void(JobId)>;
+
+    struct Stats {
+        size_t queued_interactive = 0;
+        size_t queued_background = 0;
+        size_t running = 0;
+        unsigned cpu_used = 0;    // 1/100 核
+        unsigned cpu_budget = 0;  // 1/100 核
+        uint64_t admitted_total = 0;
+        uint64_t cancelled_total = 0;  // 排队期间被取消
+        uint64_t wait_sum_micros = 0;  // 已放行任务的排队时间
+        uint64_t wait_max_micros = 0;
+    };
+
+    static TranscodeScheduler& get_instance();
+
+    TranscodeScheduler(const TranscodeScheduler&) = delete;
+    TranscodeScheduler& operator=(const TranscodeScheduler&) = delete;
+
+    // 预算足够时在当前线程立即调用 start；否则排队，之后由调用 finish 的线程放行
+    JobId submit(const std::string& name, Priority priority, unsigned cpu, StartFn start);
+
+    // 运行中的任务结束，归还预算并放行排队任务；对未运行或已结束的任务无效果
+    void finish(JobId id);
+
+    // 取消排队中的任务；任务已在运行（或不存在）时返回 false
+    bool cancel(JobId id);
+
+    // 排队位置（1 起）；0 表示已在运行或已结束
+    size_t queue_position(JobId id) const;
+
+    Stats stats() const;
+
+    void set_cpu_budget(unsigned cpu);
+
+private:
+    TranscodeScheduler();
+
+    struct Job {
+        JobId id;
+        std::string name;
+        Priority priority;
+        unsigned cpu;
+        StartFn start;
+        std::chrono::steady_clock::time_point enqueued;
+    };
+
+    // 在锁内取出所有可以放行的任务，调用方在锁外逐个启动
+    std::vector<Job> admit_locked();
+    size_t queue_position_locked(JobId id) const;
+    static void start_jobs(std::vector<Job>& jobs);
+
+    mutable std::mutex mutex_;
+    std::deque<Job> queues_[2];          // 按 Priority 下标
+    std::map<JobId, unsigned> running_;  // 任务 → 占用的 CPU
+    unsigned cpu_used_ = 0;
+    unsigned cpu_budget_;
+    JobId next_id_ = 1;
+    uint64_t admitted_total_ = 0;
+    uint64_t cancelled_total_ = 0;
+    uint64_t wait_sum_micros_ = 0;
+    uint64_t wait_max_micros_ = 0;
+};
+
+#endif // TRANSCODE_SCHEDULER_H
@@ -0,0 +1,47 @@
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+#include <cstddef>
+
+// 固定大小的阻塞任务线程池
+//
+// 用于执行会长时间阻塞的路由处理函数（FFmpeg 探测、转码器启动等），
+// 使事件循环线程始终只做非阻塞 I/O。队列有上限，满时 submit() 直接返回 false，
+// 由调用方决定如何拒绝，而不是无限堆积。
+class WorkerPool {
+public:
+    using Task = std::function<void()>;
+
+    explicit WorkerPool(size_t max_queue = DEFAULT_MAX_QUEUE);
+    ~WorkerPool();
+
+    void start(size_t num_threads);
+
+    // 停止接收新任务，丢弃尚未开始的任务，等待执行中的任务完成
+    void stop();
+
+    bool submit(Task task);
+
+    size_t thread_count() const { return threads_.size(); }
+    size_t queued() const;
+
+    static const size_t DEFAULT_MAX_QUEUE = 256;
+
+private:
+    void worker_loop();
+
+    size_t max_queue_;
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<Task> tasks_;
+    std::vector<std::thread> threads_;
+    bool stopping_ = false;
+};
+
+#endif // WORKER_POOL_H
@@ -1,6 +1,11 @@
 // server/src/ffmpeg_transcoder.cpp
 #include "ffmpeg_transcoder.h"
-#include <iostream>
+#include "logger.h"
+#include "media_index.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <deque>
 #include <fstream>
 #include <sstream>
 #include <vector>
@@ -10,16 +15,293 @@
 #include <chrono>
 #include <cstring>
 #include <sys/types.h>
-#include <sys/wait.h>
 #include <unistd.h>
-#include <signal.h>
+#include <fcntl.h>
+#include <sys/stat.h>
 #include <filesystem>
 
+extern "C" {
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+#include <libavutil/audio_fifo.h>
+#include <libavutil/channel_layout.h>
+#include <libavutil/opt.h>
+#include <libswscale/swscale.h>
+#include <libswresample/swresample.h>
+}
+
 namespace fs = std::filesystem;
 
-FFmpegTranscoder::FFmpegTranscoder(const TranscodeConfig& config) 
+// FFmpeg 5.1 起声道布局改为 AVChannelLayout，旧的 channels / channel_layout 字段在 7.0 移除
+#if LIBAVUTIL_VERSION_INT >= AV_VERSION_INT(57, 28, 100)
+#define MEDIA_SERVER_CH_LAYOUT 1
+#endif
+
+namespace {
+
+// 队列容量按包数计：视频包大、解码慢，容量小即可形成背压；音频包小而密，
+// 容量放宽以容忍输入文件里音频领先视频交错的情况
+constexpr size_t VIDEO_PACKET_QUEUE = 64;
+constexpr size_t AUDIO_PACKET_QUEUE = 1024;
+constexpr size_t ENCODED_PACKET_QUEUE = 1024;
+
+// 按需分片比较切点时容忍的时间戳换算误差（秒）
+constexpr double CUT_TOLERANCE = 0.001;
+
+std::string av_error(int code) {
+    char error_buffer[AV_ERROR_MAX_STRING_SIZE] = {};
+    av_strerror(code, error_buffer, sizeof(error_buffer));
+    return error_buffer;
+}
+
+int64_t packet_time(const AVPacket* packet) {
+    if (packet->dts != AV_NOPTS_VALUE) return packet->dts;
+    return packet->pts != AV_NOPTS_VALUE ? packet->pts : 0;
+}
+
+// 按配置的最大分辨率等比缩小（不放大），宽高取偶数以满足 yuv420p
+void fit_resolution(int width, int height, const std::string& limit,
+                    int& out_width, int& out_height) {
+    int max_width = 0;
+    int max_height = 0;
+    if (std::sscanf(limit.c_str(), "%dx%d", &max_width, &max_height) != 2 ||
+        max_width <= 0 || max_height <= 0) {
+        max_width = width;
+        max_height = height;
+    }
+    double scale = std::min({1.0, static_cast<double>(max_width) / width,
+                             static_cast<double>(max_height) / height});
+    out_width = std::max(2, static_cast<int>(std::lround(width * scale)) & ~1);
+    out_height = std::max(2, static_cast<int>(std::lround(height * scale)) & ~1);
+}
+
+// AAC 只支持固定的几档采样率，源采样率不在其中时统一重采样到 48 kHz
+int aac_sample_rate(int source_rate) {
+    static const int rates[] = {96000, 88200, 64000, 48000, 44100, 32000,
+                                24000, 22050, 16000, 12000, 11025, 8000};
+    for (int rate : rates) {
+        if (rate == source_rate) return rate;
+    }
+    return 48000;
+}
+
+int channel_count(const AVCodecContext* context) {
+#ifdef MEDIA_SERVER_CH_LAYOUT
+    return context->ch_layout.nb_channels;
+#else
+    return context->channels;
+#endif
+}
+
+void set_default_layout(AVCodecContext* context, int channels) {
+#ifdef MEDIA_SERVER_CH_LAYOUT
+    av_channel_layout_default(&context->ch_layout, channels);
+#else
+    context->channels = channels;
+    context->channel_layout = av_get_default_channel_layout(channels);
+#endif
+}
+
+int parameter_channels(const AVCodecParameters* parameters) {
+#ifdef MEDIA_SERVER_CH_LAYOUT
+    return parameters->ch_layout.nb_channels;
+#else
+    return parameters->channels;
+#endif
+}
+
+bool copy_layout(AVFrame* frame, const AVCodecContext* context) {
+#ifdef MEDIA_SERVER_CH_LAYOUT
+    return av_channel_layout_copy(&frame->ch_layout, &context->ch_layout) == 0;
+#else
+    frame->channels = context->channels;
+    frame->channel_layout = context->channel_layout;
+    return true;
+#endif
+}
+
+// 浏览器和 hls.js 都能直接解码的视频：8 位 4:2:0 的 H.264，且不超过配置的最大分辨率
+bool video_copyable(const AVCodecParameters* parameters, const std::string& limit) {
+    if (parameters->codec_id != AV_CODEC_ID_H264 ||
+        (parameters->format != AV_PIX_FMT_YUV420P && parameters->format != AV_PIX_FMT_YUVJ420P) ||
+        parameters->width <= 0 || parameters->height <= 0) {
+        return false;
+    }
+    int width = 0;
+    int height = 0;
+    fit_resolution(parameters->width, parameters->height, limit, width, height);
+    return width == (parameters->width & ~1) && height == (parameters->height & ~1);
+}
+
+// 解复用器自带的索引条目数（MP4、MKV 打开时即建立，MPEG-TS 等没有）
+int demuxer_index_entries(AVStream* stream) {
+#if LIBAVFORMAT_VERSION_INT >= AV_VERSION_INT(58, 76, 100)
+    return avformat_index_get_entries_count(stream);
+#else
+    return stream->nb_index_entries;
+#endif
+}
+
+// 与转码路径的输出保持一致：AAC，最多两声道
+bool audio_copyable(const AVCodecParameters* parameters) {
+    int channels = parameter_channels(parameters);
+    return parameters->codec_id == AV_CODEC_ID_AAC && channels > 0 && channels <= 2;
+}
+
+// 阶段之间的有界包队列：队列满时生产者阻塞，背压由此逐级传到解复用。
+// finish() 表示生产者写完，消费者取空剩余包后得到 nullptr；
+// cancel() 丢弃积压的包并立即唤醒两端，之后 push 失败
+class PacketQueue {
+public:
+    explicit PacketQueue(size_t capacity) : capacity_(capacity) {}
+    ~PacketQueue() { drop(); }
+
+    PacketQueue(const PacketQueue&) = delete;
+    PacketQueue& operator=(const PacketQueue&) = delete;
+
+    // 取得 packet 的所有权；队列已取消时释放 packet 并返回 false
+    bool push(AVPacket* packet) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        not_full_.wait(lock, [this] { return cancelled_ || items_.size() < capacity_; });
+        if (cancelled_) {
+            av_packet_free(&packet);
+            return false;
+        }
+        items_.push_back(packet);
+        not_empty_.notify_one();
+        return true;
+    }
+
+    AVPacket* pop() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        not_empty_.wait(lock, [this] { return finished_ || !items_.empty(); });
+        if (items_.empty()) {
+            return nullptr;
+        }
+        AVPacket* packet = items_.front();
+        items_.pop_front();
+        not_full_.notify_one();
+        return packet;
+    }
+
+    void finish() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        finished_ = true;
+        not_empty_.notify_all();
+    }
+
+    void cancel() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        cancelled_ = true;
+        finished_ = true;
+        drop();
+        not_empty_.notify_all();
+        not_full_.notify_all();
+    }
+
+private:
+    void drop() {
+        for (AVPacket* packet : items_) {
+            av_packet_free(&packet);
+        }
+        items_.clear();
+    }
+
+    const size_t capacity_;
+    std::mutex mutex_;
+    std::condition_variable not_empty_;
+    std::condition_variable not_full_;
+    std::deque<AVPacket*> items_;
+    bool finished_ = false;
+    bool cancelled_ = false;
+};
+
+} // namespace
+
+// 一路（视频或音频）转码阶段：解复用 → packets → 解码/编码 → encoded → 复用
+struct FFmpegTranscoder::StreamStage {
+    StreamStage(size_t packet_capacity)
+        : packets(packet_capacity), encoded(ENCODED_PACKET_QUEUE) {}
+
+    bool active() const { return input_index >= 0; }
+    bool transcoded() const { return active() && !copy; }
+
+    void release() {
+        avcodec_free_context(&decoder);
+        avcodec_free_context(&encoder);
+    }
+
+    int input_index = -1;
+    int output_index = -1;
+    bool copy = false;  // 直接复制：解复用出的包不经编解码，直接进入 encoded
+    int64_t start_pts = 0;  // 输入起始时间（输入流时间基），输出时间轴从 0 开始
+    AVRational input_time_base{0, 1};
+    AVRational output_time_base{0, 1};  // 写完文件头后由复用器确定
+    AVCodecContext* decoder = nullptr;
+    AVCodecContext* encoder = nullptr;
+    PacketQueue packets;
+    PacketQueue encoded;
+    std::thread thread;
+};
+
+struct FFmpegTranscoder::Pipeline {
+    Pipeline() : video(VIDEO_PACKET_QUEUE), audio(AUDIO_PACKET_QUEUE) {}
+    ~Pipeline() { release(); }
+
+    // 唤醒所有阻塞在队列上的阶段；可在任意线程调用
+    void cancel() {
+        video.packets.cancel();
+        video.encoded.cancel();
+        audio.packets.cancel();
+        audio.encoded.cancel();
+    }
+
+    // 释放全部 libav 上下文，须在阶段线程结束后调用
+    void release() {
+        video.release();
+        audio.release();
+        sws_freeContext(sws);
+        sws = nullptr;
+        swr_free(&swr);
+        if (fifo) {
+            av_audio_fifo_free(fifo);
+            fifo = nullptr;
+        }
+        avformat_close_input(&input);
+        if (output) {
+            if (output->pb) {
+                avio_closep(&output->pb);
+            }
+            avformat_free_context(output);
+            output = nullptr;
+        }
+    }
+
+    AVFormatContext* input = nullptr;
+    AVFormatContext* output = nullptr;
+    StreamStage video;
+    StreamStage audio;
+    std::thread demux_thread;
+
+    SwsContext* sws = nullptr;
+    SwrContext* swr = nullptr;
+    AVAudioFifo* fifo = nullptr;
+
+    // 按需分片时本次产出覆盖的时间范围（输出时间轴，秒）
+    double range_start = 0.0;
+    double range_end = INFINITY;
+
+    // 分片按该输出流（有视频时为视频）的关键帧切分
+    int cut_index = -1;
+    int segment_index = 0;
+    std::string segment_name;
+    int64_t segment_start = AV_NOPTS_VALUE;
+    int64_t segment_end = AV_NOPTS_VALUE;
+};
+
+FFmpegTranscoder::FFmpegTranscoder(const TranscodeConfig& config)
     : config_(config) {
-    std::cout << "[FFmpeg] 创建转码器: " << config.stream_id << std::endl;
+    LOG_INFO("[FFmpeg] 创建转码器: " << config.stream_id);
 }
 
 FFmpegTranscoder::~FFmpegTranscoder() {
@@ -34,135 +316,1089 @@ bool FFmpegTranscoder::create_output_directory() {
         fs::create_directories(config_.output_dir + "/segments");
         return true;
     } catch (const std::exception& e) {
+        std::lock_guard<std::mutex> lock(status_mutex_);
         error_message_ = std::string("创建目录失败: ") + e.what();
         return false;
     }
 }
 
-std::string FFmpegTranscoder::build_ffmpeg_command() const {
-    std::stringstream cmd;
-    
-    cmd << "ffmpeg -y -i \"" << config_.input_path << "\" "
-        << "-c:v libx264 -c:a aac "
-        << "-preset ultrafast "
-        << "-crf 23 "
-        << "-maxrate 2000k -bufsize 4000k "
-        << "-pix_fmt yuv420p "
-        << "-g 48 -keyint_min 48 "
-        << "-sc_threshold 0 "
-        << "-hls_time " << config_.segment_duration << " "
-        << "-hls_list_size 0 "
-        << "-hls_flags delete_segments "
-        << "-hls_playlist_type vod "
-        << "-hls_segment_filename \"" << config_.output_dir << "/segments/segment_%03d.ts\" "
-        << "\"" << config_.output_dir << "/playlist.m3u8\"";
-    
-    if (!config_.enable_logging) {
-        cmd << " 2>/dev/null";
+int FFmpegTranscoder::interrupt_callback(void* opaque) {
+    return static_cast<FFmpegTranscoder*>(opaque)->cancelled_.load() ? 1 : 0;
+}
+
+void FFmpegTranscoder::fail(const std::string& message) {
+    if (cancelled_) {
+        return;  // 取消引起的 libav 错误不算转码失败
+    }
+    {
+        std::lock_guard<std::mutex> lock(status_mutex_);
+        if (!error_message_.empty()) {
+            return;
+        }
+        error_message_ = message;
+    }
+    LOG_ERROR("[FFmpeg] " << config_.stream_id << ": " << message);
+}
+
+bool FFmpegTranscoder::open_pipeline(Pipeline& pipeline) {
+    pipeline.input = avformat_alloc_context();
+    if (!pipeline.input) {
+        fail("无法分配输入上下文");
+        return false;
+    }
+    pipeline.input->interrupt_callback = {&FFmpegTranscoder::interrupt_callback, this};
+
+    int ret = avformat_open_input(&pipeline.input, config_.input_path.c_str(), nullptr, nullptr);
+    if (ret < 0) {
+        fail("打开文件失败: " + av_error(ret));
+        return false;
+    }
+
+    ret = avformat_find_stream_info(pipeline.input, nullptr);
+    if (ret < 0) {
+        fail("获取流信息失败: " + av_error(ret));
+        return false;
+    }
+
+    int video_index = av_find_best_stream(pipeline.input, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+    if (video_index >= 0 &&
+        (pipeline.input->streams[video_index]->disposition & AV_DISPOSITION_ATTACHED_PIC)) {
+        video_index = -1;  // 音频文件的封面图不参与转码
+    }
+    int audio_index = av_find_best_stream(pipeline.input, AVMEDIA_TYPE_AUDIO, -1,
+                                          video_index, nullptr, 0);
+    pipeline.video.input_index = std::max(video_index, -1);
+    pipeline.audio.input_index = std::max(audio_index, -1);
+    if (!pipeline.video.active() && !pipeline.audio.active()) {
+        fail("输入中没有可转码的音视频流");
+        return false;
+    }
+
+    // 其余流在解复用时直接丢弃
+    const int64_t start_time = pipeline.input->start_time != AV_NOPTS_VALUE
+                                   ? pipeline.input->start_time : 0;
+    for (unsigned i = 0; i < pipeline.input->nb_streams; ++i) {
+        AVStream* stream = pipeline.input->streams[i];
+        if (static_cast<int>(i) != pipeline.video.input_index &&
+            static_cast<int>(i) != pipeline.audio.input_index) {
+            stream->discard = AVDISCARD_ALL;
+        }
+    }
+    for (StreamStage* stage : {&pipeline.video, &pipeline.audio}) {
+        if (stage->active()) {
+            stage->input_time_base = pipeline.input->streams[stage->input_index]->time_base;
+            stage->start_pts = av_rescale_q(start_time, AV_TIME_BASE_Q, stage->input_time_base);
+        }
+    }
+    if (config_.allow_stream_copy) {
+        pipeline.video.copy = pipeline.video.active() &&
+            video_copyable(pipeline.input->streams[pipeline.video.input_index]->codecpar, config_.resolution);
+        pipeline.audio.copy = pipeline.audio.active() &&
+            audio_copyable(pipeline.input->streams[pipeline.audio.input_index]->codecpar);
+    }
+    auto mode = [](const StreamStage& stage) {
+        return !stage.active() ? "无" : (stage.copy ? "直接复制" : "转码");
+    };
+    LOG_INFO("[FFmpeg] " << config_.stream_id << " 视频: " << mode(pipeline.video)
+             << ", 音频: " << mode(pipeline.audio));
+
+    const std::vector<double>& cuts = config_.segment_cuts;
+    if (!cuts.empty()) {
+        if (config_.first_segment < 0 || config_.last_segment <= config_.first_segment ||
+            config_.last_segment >= static_cast<int>(cuts.size())) {
+            fail("分片范围无效");
+            return false;
+        }
+        pipeline.segment_index = config_.first_segment;
+        pipeline.range_start = cuts[config_.first_segment];
+        if (config_.last_segment + 1 < static_cast<int>(cuts.size())) {
+            pipeline.range_end = cuts[config_.last_segment];  // 最后一段读到文件尾，不依赖时长估计
+        }
+        if (config_.first_segment > 0) {
+            // 回退到起点之前的关键帧，起点之前的帧由各阶段丢弃。有包索引时直接定位到该关键帧：
+            // 解复用器自带索引的容器按时间戳，没有索引的（MPEG-TS 等）按字节偏移，免去二分探测
+            const int cut_stream = pipeline.video.active() ? pipeline.video.input_index
+                                                           : pipeline.audio.input_index;
+            std::shared_ptr<const MediaIndex> index = MediaIndexer::get_instance().get(config_.input_path);
+            const MediaIndex::Packet* keyframe = index && index->stream_index() == cut_stream
+                ? index->keyframe_before(pipeline.range_start + CUT_TOLERANCE) : nullptr;
+            if (!keyframe) {
+                int64_t target = start_time + static_cast<int64_t>(pipeline.range_start * AV_TIME_BASE);
+                ret = av_seek_frame(pipeline.input, -1, target, AVSEEK_FLAG_BACKWARD);
+            } else if (demuxer_index_entries(pipeline.input->streams[cut_stream]) == 0 &&
+                       !(pipeline.input->iformat->flags & AVFMT_NO_BYTE_SEEK)) {
+                ret = av_seek_frame(pipeline.input, cut_stream, keyframe->pos, AVSEEK_FLAG_BYTE);
+            } else {
+                ret = avformat_seek_file(pipeline.input, cut_stream, INT64_MIN, keyframe->pts, keyframe->pts, 0);
+            }
+            if (ret < 0) {
+                fail("定位输入失败: " + av_error(ret));
+                return false;
+            }
+        }
+    }
+
+    ret = avformat_alloc_output_context2(&pipeline.output, nullptr, "mpegts", nullptr);
+    if (ret < 0 || !pipeline.output) {
+        fail("无法创建 MPEG-TS 复用器: " + av_error(ret));
+        return false;
+    }
+    pipeline.output->interrupt_callback = {&FFmpegTranscoder::interrupt_callback, this};
+    if (!cuts.empty()) {
+        // 复用器默认按每次产出的首个包平移负时间戳，各段的平移量不同会破坏拼接；
+        // MPEG-TS 自身预留的延迟已足以容纳 B 帧带来的负 DTS
+        pipeline.output->avoid_negative_ts = AVFMT_AVOID_NEG_TS_DISABLED;
+    }
+
+    if (pipeline.video.active() &&
+        !(pipeline.video.copy ? open_copy(pipeline, pipeline.video) : open_video(pipeline))) {
+        return false;
+    }
+    if (pipeline.audio.active() &&
+        !(pipeline.audio.copy ? open_copy(pipeline, pipeline.audio) : open_audio(pipeline))) {
+        return false;
+    }
+    pipeline.cut_index = pipeline.video.active() ? pipeline.video.output_index
+                                                 : pipeline.audio.output_index;
+
+    if (!begin_segment(pipeline)) {
+        return false;
+    }
+    ret = avformat_write_header(pipeline.output, nullptr);
+    if (ret < 0) {
+        fail("写入文件头失败: " + av_error(ret));
+        return false;
+    }
+
+    // 文件头写完后复用器才确定各输出流的时间基，阶段线程据此换算编码包时间戳
+    for (StreamStage* stage : {&pipeline.video, &pipeline.audio}) {
+        if (stage->active()) {
+            stage->output_time_base = pipeline.output->streams[stage->output_index]->time_base;
+        }
+    }
+    return true;
+}
+
+bool FFmpegTranscoder::open_video(Pipeline& pipeline) {
+    StreamStage& stage = pipeline.video;
+    AVStream* input = pipeline.input->streams[stage.input_index];
+
+    const AVCodec* decoder = avcodec_find_decoder(input->codecpar->codec_id);
+    if (!decoder) {
+        fail(std::string("不支持的视频编码: ") + avcodec_get_name(input->codecpar->codec_id));
+        return false;
+    }
+    stage.decoder = avcodec_alloc_context3(decoder);
+    if (!stage.decoder ||
+        avcodec_parameters_to_context(stage.decoder, input->codecpar) < 0) {
+        fail("无法创建视频解码器");
+        return false;
+    }
+    stage.decoder->pkt_timebase = input->time_base;
+    stage.decoder->thread_count = 0;
+    int ret = avcodec_open2(stage.decoder, decoder, nullptr);
+    if (ret < 0) {
+        fail("打开视频解码器失败: " + av_error(ret));
+        return false;
+    }
+    if (stage.decoder->width <= 0 || stage.decoder->height <= 0) {
+        fail("无法确定视频尺寸");
+        return false;
+    }
+
+    const AVCodec* encoder = avcodec_find_encoder_by_name(config_.video_codec.c_str());
+    if (!encoder) {
+        encoder = avcodec_find_encoder(AV_CODEC_ID_H264);
+    }
+    if (!encoder) {
+        fail("找不到视频编码器: " + config_.video_codec);
+        return false;
+    }
+    stage.encoder = avcodec_alloc_context3(encoder);
+    if (!stage.encoder) {
+        fail("无法创建视频编码器");
+        return false;
+    }
+
+    AVCodecContext* context = stage.encoder;
+    fit_resolution(stage.decoder->width, stage.decoder->height, config_.resolution,
+                   context->width, context->height);
+    AVRational frame_rate = av_guess_frame_rate(pipeline.input, input, nullptr);
+    if (frame_rate.num <= 0 || frame_rate.den <= 0) {
+        frame_rate = {25, 1};
+    }
+    context->pix_fmt = AV_PIX_FMT_YUV420P;
+    context->sample_aspect_ratio = stage.decoder->sample_aspect_ratio;
+    context->time_base = input->time_base;
+    context->framerate = frame_rate;
+    // GOP 与分片时长对齐并关闭场景切换检测，分片边界由 video_stage 强制 IDR
+    context->gop_size = std::max(1, static_cast<int>(std::lround(av_q2d(frame_rate) *
+                                                                 config_.segment_duration)));
+    context->keyint_min = context->gop_size;
+    context->max_b_frames = 0;
+    context->rc_max_rate = static_cast<int64_t>(config_.video_bitrate) * 1000;
+    context->rc_buffer_size = static_cast<int>(context->rc_max_rate * 2);
+    context->thread_count = config_.encoder_threads;
+    if (pipeline.output->oformat->flags & AVFMT_GLOBALHEADER) {
+        context->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+    }
+    av_opt_set(context->priv_data, "preset", "ultrafast", 0);
+    av_opt_set(context->priv_data, "crf", "23", 0);
+    av_opt_set(context->priv_data, "forced-idr", "1", 0);
+    av_opt_set(context->priv_data, "x264-params", "scenecut=0", 0);
+
+    ret = avcodec_open2(context, encoder, nullptr);
+    if (ret < 0) {
+        fail("打开视频编码器失败: " + av_error(ret));
+        return false;
+    }
+
+    AVStream* output = avformat_new_stream(pipeline.output, nullptr);
+    if (!output || avcodec_parameters_from_context(output->codecpar, context) < 0) {
+        fail("无法创建视频输出流");
+        return false;
+    }
+    output->time_base = context->time_base;
+    stage.output_index = output->index;
+    return true;
+}
+
+bool FFmpegTranscoder::open_audio(Pipeline& pipeline) {
+    StreamStage& stage = pipeline.audio;
+    AVStream* input = pipeline.input->streams[stage.input_index];
+
+    const AVCodec* decoder = avcodec_find_decoder(input->codecpar->codec_id);
+    if (!decoder) {
+        fail(std::string("不支持的音频编码: ") + avcodec_get_name(input->codecpar->codec_id));
+        return false;
+    }
+    stage.decoder = avcodec_alloc_context3(decoder);
+    if (!stage.decoder ||
+        avcodec_parameters_to_context(stage.decoder, input->codecpar) < 0) {
+        fail("无法创建音频解码器");
+        return false;
+    }
+    stage.decoder->pkt_timebase = input->time_base;
+    int ret = avcodec_open2(stage.decoder, decoder, nullptr);
+    if (ret < 0) {
+        fail("打开音频解码器失败: " + av_error(ret));
+        return false;
+    }
+
+    const AVCodec* encoder = avcodec_find_encoder_by_name(config_.audio_codec.c_str());
+    if (!encoder) {
+        encoder = avcodec_find_encoder(AV_CODEC_ID_AAC);
+    }
+    if (!encoder) {
+        fail("找不到音频编码器: " + config_.audio_codec);
+        return false;
+    }
+    stage.encoder = avcodec_alloc_context3(encoder);
+    if (!stage.encoder) {
+        fail("无法创建音频编码器");
+        return false;
+    }
+
+    // 内置 AAC 编码器只接受 planar float；多声道统一下混为立体声，保证浏览器可播
+    AVCodecContext* context = stage.encoder;
+    int channels = std::min(channel_count(stage.decoder), 2);
+    context->sample_fmt = AV_SAMPLE_FMT_FLTP;
+    context->sample_rate = aac_sample_rate(stage.decoder->sample_rate);
+    set_default_layout(context, channels > 0 ? channels : 2);
+    context->bit_rate = static_cast<int64_t>(config_.audio_bitrate) * 1000;
+    context->time_base = {1, context->sample_rate};
+    if (pipeline.output->oformat->flags & AVFMT_GLOBALHEADER) {
+        context->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+    }
+
+    ret = avcodec_open2(context, encoder, nullptr);
+    if (ret < 0) {
+        fail("打开音频编码器失败: " + av_error(ret));
+        return false;
+    }
+
+    pipeline.fifo = av_audio_fifo_alloc(context->sample_fmt, channel_count(context),
+                                        std::max(context->frame_size, 1024));
+    if (!pipeline.fifo) {
+        fail("无法分配音频缓冲");
+        return false;
+    }
+
+    AVStream* output = avformat_new_stream(pipeline.output, nullptr);
+    if (!output || avcodec_parameters_from_context(output->codecpar, context) < 0) {
+        fail("无法创建音频输出流");
+        return false;
+    }
+    output->time_base = context->time_base;
+    stage.output_index = output->index;
+    return true;
+}
+
+bool FFmpegTranscoder::open_copy(Pipeline& pipeline, StreamStage& stage) {
+    AVStream* input = pipeline.input->streams[stage.input_index];
+    AVStream* output = avformat_new_stream(pipeline.output, nullptr);
+    if (!output || avcodec_parameters_copy(output->codecpar, input->codecpar) < 0) {
+        fail("无法创建复制输出流");
+        return false;
     }
-    
-    return cmd.str();
+    // MP4 / MKV 的 codec tag 对 MPEG-TS 无意义；AVCC 到 Annex B 的转换由复用器自动插入的
+    // h264_mp4toannexb 完成，裸 AAC 由复用器补 ADTS 头
+    output->codecpar->codec_tag = 0;
+    output->time_base = input->time_base;
+    stage.output_index = output->index;
+    return true;
+}
+
+bool FFmpegTranscoder::open_resampler(Pipeline& pipeline, const AVFrame* frame) {
+    const AVCodecContext* context = pipeline.audio.encoder;
+#ifdef MEDIA_SERVER_CH_LAYOUT
+    AVChannelLayout input_layout;
+    if (frame->ch_layout.order == AV_CHANNEL_ORDER_UNSPEC) {
+        av_channel_layout_default(&input_layout, frame->ch_layout.nb_channels);
+    } else if (av_channel_layout_copy(&input_layout, &frame->ch_layout) < 0) {
+        fail("无法复制声道布局");
+        return false;
+    }
+    int ret = swr_alloc_set_opts2(&pipeline.swr,
+                                  &context->ch_layout, context->sample_fmt, context->sample_rate,
+                                  &input_layout, static_cast<AVSampleFormat>(frame->format),
+                                  frame->sample_rate, 0, nullptr);
+    av_channel_layout_uninit(&input_layout);
+#else
+    uint64_t input_layout = frame->channel_layout
+                                ? frame->channel_layout
+                                : static_cast<uint64_t>(av_get_default_channel_layout(frame->channels));
+    pipeline.swr = swr_alloc_set_opts(nullptr,
+                                      context->channel_layout, context->sample_fmt, context->sample_rate,
+                                      input_layout, static_cast<AVSampleFormat>(frame->format),
+                                      frame->sample_rate, 0, nullptr);
+    int ret = pipeline.swr ? 0 : AVERROR(ENOMEM);
+#endif
+    if (ret >= 0) {
+        ret = swr_init(pipeline.swr);
+    }
+    if (ret < 0) {
+        fail("初始化重采样失败: " + av_error(ret));
+        return false;
+    }
+    return true;
+}
+
+bool FFmpegTranscoder::decode_packets(StreamStage& stage,
+                                      const std::function<bool(AVFrame*)>& on_frame) {
+    AVFrame* frame = av_frame_alloc();
+    if (!frame) {
+        fail("无法分配解码帧");
+        return false;
+    }
+
+    bool ok = true;
+    while (ok && !cancelled_) {
+        // 输入结束时送入空包冲刷解码器
+        AVPacket* packet = stage.packets.pop();
+        const bool end_of_input = packet == nullptr;
+        if (end_of_input && cancelled_) {
+            break;
+        }
+        int ret = avcodec_send_packet(stage.decoder, packet);
+        av_packet_free(&packet);
+        if (ret < 0 && ret != AVERROR_EOF) {
+            // 单个损坏的包只丢弃，不中止整个转码
+            LOG_WARN_LIMITED(1, "[FFmpeg] " << config_.stream_id << " 解码失败: " << av_error(ret));
+        }
+
+        while (ok) {
+            ret = avcodec_receive_frame(stage.decoder, frame);
+            if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
+                break;
+            }
+            if (ret < 0) {
+                fail("解码失败: " + av_error(ret));
+                ok = false;
+                break;
+            }
+            ok = on_frame(frame);
+            av_frame_unref(frame);
+        }
+
+        if (end_of_input) {
+            break;
+        }
+    }
+
+    av_frame_free(&frame);
+    return ok && !cancelled_;
+}
+
+bool FFmpegTranscoder::encode_frame(StreamStage& stage, AVFrame* frame) {
+    int ret = avcodec_send_frame(stage.encoder, frame);
+    if (ret < 0 && ret != AVERROR_EOF) {
+        fail("编码失败: " + av_error(ret));
+        return false;
+    }
+
+    while (true) {
+        AVPacket* packet = av_packet_alloc();
+        if (!packet) {
+            fail("无法分配编码包");
+            return false;
+        }
+        ret = avcodec_receive_packet(stage.encoder, packet);
+        if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
+            av_packet_free(&packet);
+            return true;
+        }
+        if (ret < 0) {
+            av_packet_free(&packet);
+            fail("编码失败: " + av_error(ret));
+            return false;
+        }
+        packet->stream_index = stage.output_index;
+        av_packet_rescale_ts(packet, stage.encoder->time_base, stage.output_time_base);
+        if (!stage.encoded.push(packet)) {
+            return false;  // 已取消
+        }
+    }
+}
+
+void FFmpegTranscoder::demux_stage(Pipeline& pipeline) {
+    AVPacket* packet = av_packet_alloc();
+    bool reached_end[2] = {!pipeline.video.active(), !pipeline.audio.active()};
+    while (packet && !cancelled_ && !(reached_end[0] && reached_end[1])) {
+        int ret = av_read_frame(pipeline.input, packet);
+        if (ret < 0) {
+            // 截断的文件按正常结束处理，已转出的部分照常可播
+            if (ret != AVERROR_EOF && !cancelled_) {
+                LOG_WARN("[FFmpeg] " << config_.stream_id << " 读取输入中断: " << av_error(ret));
+            }
+            break;
+        }
+
+        StreamStage* stage = nullptr;
+        if (packet->stream_index == pipeline.video.input_index) {
+            stage = &pipeline.video;
+        } else if (packet->stream_index == pipeline.audio.input_index) {
+            stage = &pipeline.audio;
+        }
+        if (!stage) {
+            av_packet_unref(packet);
+            continue;
+        }
+
+        // 按需分片：DTS 越过范围终点后该路不再需要更多的包（终点前显示的帧 DTS 都更早）；
+        // 直接复制的流同时丢弃起点之前的包
+        bool& ended = reached_end[stage == &pipeline.video ? 0 : 1];
+        const double seconds = (packet_time(packet) - stage->start_pts) * av_q2d(stage->input_time_base);
+        if (!ended && seconds >= pipeline.range_end - CUT_TOLERANCE) {
+            ended = true;
+        }
+        if (ended || (stage->copy && packet->pts != AV_NOPTS_VALUE &&
+                      (packet->pts - stage->start_pts) * av_q2d(stage->input_time_base) <
+                          pipeline.range_start - CUT_TOLERANCE)) {
+            av_packet_unref(packet);
+            continue;
+        }
+
+        if (stage->copy) {
+            // 直接复制的流：时间戳平移到从 0 开始并换算到输出时间基，跳过编解码阶段
+            if (packet->pts != AV_NOPTS_VALUE) {
+                packet->pts -= stage->start_pts;
+            }
+            if (packet->dts != AV_NOPTS_VALUE) {
+                packet->dts -= stage->start_pts;
+            }
+            av_packet_rescale_ts(packet, stage->input_time_base, stage->output_time_base);
+            packet->stream_index = stage->output_index;
+            packet->pos = -1;
+        }
+
+        AVPacket* queued = av_packet_alloc();
+        if (!queued) {
+            fail("无法分配数据包");
+            pipeline.cancel();
+            break;
+        }
+        av_packet_move_ref(queued, packet);
+        PacketQueue& queue = stage->copy ? stage->encoded : stage->packets;
+        if (!queue.push(queued)) {
+            break;  // 已取消
+        }
+    }
+    av_packet_free(&packet);
+    for (StreamStage* stage : {&pipeline.video, &pipeline.audio}) {
+        stage->packets.finish();
+        if (stage->copy) {
+            stage->encoded.finish();
+        }
+    }
+}
+
+void FFmpegTranscoder::video_stage(Pipeline& pipeline) {
+    StreamStage& stage = pipeline.video;
+    AVCodecContext* context = stage.encoder;
+    double next_keyframe = 0.0;
+    int64_t last_pts = AV_NOPTS_VALUE;
+
+    bool ok = decode_packets(stage, [&](AVFrame* frame) {
+        int64_t pts = frame->best_effort_timestamp;
+        if (pts == AV_NOPTS_VALUE) {
+            pts = last_pts == AV_NOPTS_VALUE ? 0 : last_pts + 1;
+        } else {
+            pts -= stage.start_pts;
+        }
+        if (last_pts != AV_NOPTS_VALUE && pts <= last_pts) {
+            return true;  // 编码器要求时间戳严格递增，重复帧直接丢弃
+        }
+        const double seconds = pts * av_q2d(stage.input_time_base);
+        if (seconds < pipeline.range_start - CUT_TOLERANCE || seconds >= pipeline.range_end - CUT_TOLERANCE) {
+            return true;  // 按需分片：定位回退带出的前导帧与范围之后的帧
+        }
+        last_pts = pts;
+
+        AVFrame* scaled = nullptr;
+        AVFrame* input = frame;
+        if (frame->format != context->pix_fmt || frame->width != context->width ||
+            frame->height != context->height) {
+            // 源尺寸可能在流中途变化，缓存的缩放上下文按帧参数重建
+            pipeline.sws = sws_getCachedContext(pipeline.sws, frame->width, frame->height,
+                                                static_cast<AVPixelFormat>(frame->format),
+                                                context->width, context->height, context->pix_fmt,
+                                                SWS_BILINEAR, nullptr, nullptr, nullptr);
+            scaled = av_frame_alloc();
+            if (!pipeline.sws || !scaled) {
+                av_frame_free(&scaled);
+                fail("无法创建缩放上下文");
+                return false;
+            }
+            scaled->format = context->pix_fmt;
+            scaled->width = context->width;
+            scaled->height = context->height;
+            if (av_frame_get_buffer(scaled, 0) < 0 ||
+                sws_scale(pipeline.sws, frame->data, frame->linesize, 0, frame->height,
+                          scaled->data, scaled->linesize) <= 0) {
+                av_frame_free(&scaled);
+                fail("视频缩放失败");
+                return false;
+            }
+            av_frame_copy_props(scaled, frame);
+            input = scaled;
+        }
+
+        // 在分片边界强制 IDR：每个分片都能独立解码，切点也与目标时长（或切分计划）一致
+        input->pts = pts;
+        if (seconds >= next_keyframe - CUT_TOLERANCE) {
+            input->pict_type = AV_PICTURE_TYPE_I;
+            next_keyframe = next_cut(seconds);
+        } else {
+            input->pict_type = AV_PICTURE_TYPE_NONE;
+        }
+
+        bool encoded = encode_frame(stage, input);
+        av_frame_free(&scaled);
+        return encoded;
+    });
+    if (ok) {
+        ok = encode_frame(stage, nullptr);  // 冲刷编码器
+    }
+    if (!ok) {
+        pipeline.cancel();
+    }
+    stage.encoded.finish();
+}
+
+void FFmpegTranscoder::audio_stage(Pipeline& pipeline) {
+    StreamStage& stage = pipeline.audio;
+    AVCodecContext* context = stage.encoder;
+    const int frame_size = context->frame_size > 0 ? context->frame_size : 1024;
+    int64_t next_pts = AV_NOPTS_VALUE;
+    AVFrame* resampled = av_frame_alloc();
+    int resampled_capacity = 0;
+
+    // 编码器要求固定帧长（AAC 为 1024），重采样结果先进 FIFO 再按帧长取出；flush 时取出不足一帧的尾部
+    auto drain = [&](bool flush) {
+        while (av_audio_fifo_size(pipeline.fifo) >= frame_size ||
+               (flush && av_audio_fifo_size(pipeline.fifo) > 0)) {
+            const int samples = std::min(av_audio_fifo_size(pipeline.fifo), frame_size);
+            AVFrame* frame = av_frame_alloc();
+            if (!frame) {
+                fail("无法分配音频帧");
+                return false;
+            }
+            frame->nb_samples = samples;
+            frame->format = context->sample_fmt;
+            frame->sample_rate = context->sample_rate;
+            if (!copy_layout(frame, context) || av_frame_get_buffer(frame, 0) < 0 ||
+                av_audio_fifo_read(pipeline.fifo, reinterpret_cast<void**>(frame->data), samples) < samples) {
+                av_frame_free(&frame);
+                fail("读取音频缓冲失败");
+                return false;
+            }
+            frame->pts = next_pts;
+            next_pts += samples;
+            bool encoded = encode_frame(stage, frame);
+            av_frame_free(&frame);
+            if (!encoded) {
+                return false;
+            }
+        }
+        return true;
+    };
+
+    // frame 为 nullptr 时取出重采样器内部缓存的尾部样本
+    auto resample = [&](const AVFrame* frame) {
+        const int capacity = swr_get_out_samples(pipeline.swr, frame ? frame->nb_samples : 0);
+        if (capacity <= 0) {
+            return drain(false);
+        }
+        if (capacity > resampled_capacity) {
+            av_frame_unref(resampled);
+            resampled->nb_samples = capacity;
+            resampled->format = context->sample_fmt;
+            resampled->sample_rate = context->sample_rate;
+            if (!copy_layout(resampled, context) || av_frame_get_buffer(resampled, 0) < 0) {
+                fail("无法分配重采样缓冲");
+                return false;
+            }
+            resampled_capacity = capacity;
+        }
+        int converted = swr_convert(pipeline.swr, resampled->data, capacity,
+                                    frame ? const_cast<const uint8_t**>(frame->extended_data) : nullptr,
+                                    frame ? frame->nb_samples : 0);
+        if (converted < 0) {
+            fail("重采样失败: " + av_error(converted));
+            return false;
+        }
+        if (converted > 0 &&
+            av_audio_fifo_write(pipeline.fifo, reinterpret_cast<void**>(resampled->data),
+                                converted) < converted) {
+            fail("写入音频缓冲失败");
+            return false;
+        }
+        return drain(false);
+    };
+
+    bool ok = resampled != nullptr && decode_packets(stage, [&](AVFrame* frame) {
+        if (frame->best_effort_timestamp != AV_NOPTS_VALUE) {
+            // 按需分片：按帧起点归属范围，相邻两段既不重叠也不留缝
+            double seconds = (frame->best_effort_timestamp - stage.start_pts) * av_q2d(stage.input_time_base);
+            if (seconds < pipeline.range_start - CUT_TOLERANCE || seconds >= pipeline.range_end - CUT_TOLERANCE) {
+                return true;
+            }
+        }
+        if (!pipeline.swr && !open_resampler(pipeline, frame)) {
+            return false;
+        }
+        if (next_pts == AV_NOPTS_VALUE) {
+            // 输出按连续样本计数打时间戳，起点取首个解码帧
+            int64_t pts = frame->best_effort_timestamp;
+            pts = pts == AV_NOPTS_VALUE ? 0 : pts - stage.start_pts;
+            next_pts = std::max<int64_t>(0, av_rescale_q(pts, stage.input_time_base,
+                                                         context->time_base));
+        }
+        return resample(frame);
+    });
+    if (ok && pipeline.swr) {
+        ok = resample(nullptr) && drain(true);
+    }
+    if (ok) {
+        ok = encode_frame(stage, nullptr);  // 冲刷编码器
+    }
+    if (!ok) {
+        pipeline.cancel();
+    }
+    av_frame_free(&resampled);
+    stage.encoded.finish();
+}
+
+bool FFmpegTranscoder::begin_segment(Pipeline& pipeline) {
+    char name[32];
+    std::snprintf(name, sizeof(name), "segment_%03d.ts", pipeline.segment_index);
+    pipeline.segment_name = name;
+
+    std::string path = config_.output_dir + "/segments/" + pipeline.segment_name + ".tmp";
+    int ret = avio_open2(&pipeline.output->pb, path.c_str(), AVIO_FLAG_WRITE,
+                         &pipeline.output->interrupt_callback, nullptr);
+    if (ret < 0) {
+        fail("创建分片失败: " + av_error(ret));
+        return false;
+    }
+    // 每个分片以 PAT/PMT 开头，播放器可以从任意分片起播
+    av_opt_set(pipeline.output->priv_data, "mpegts_flags", "+resend_headers", 0);
+    return true;
+}
+
+bool FFmpegTranscoder::finish_segment(Pipeline& pipeline, int64_t end_pts, bool last) {
+    // 刷出复用器里缓存的 PES，最后一个分片写文件尾
+    int ret = last ? av_write_trailer(pipeline.output) : av_write_frame(pipeline.output, nullptr);
+    if (ret >= 0) {
+        ret = avio_closep(&pipeline.output->pb);
+    }
+    if (ret < 0) {
+        fail("写入分片失败: " + av_error(ret));
+        return false;
+    }
+
+    const std::string path = config_.output_dir + "/segments/" + pipeline.segment_name;
+    const AVRational time_base = pipeline.output->streams[pipeline.cut_index]->time_base;
+    double duration = 0.0;
+    if (pipeline.segment_start != AV_NOPTS_VALUE && end_pts != AV_NOPTS_VALUE) {
+        duration = (end_pts - pipeline.segment_start) * av_q2d(time_base);
+    }
+
+    std::error_code ec;
+    if (duration <= 0.0) {
+        fs::remove(path + ".tmp", ec);  // 输入没有任何帧
+        return true;
+    }
+    fs::rename(path + ".tmp", path, ec);
+    if (ec) {
+        fail("分片改名失败: " + ec.message());
+        return false;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(status_mutex_);
+        segment_durations_.push_back(duration);
+        segment_count_ = static_cast<int>(segment_durations_.size());
+        next_segment_ = pipeline.segment_index + 1;
+        update_playlist(last);
+    }
+    state_cv_.notify_all();
+    if (on_segment_) {
+        on_segment_();
+    }
+    ++pipeline.segment_index;
+    return true;
+}
+
+bool FFmpegTranscoder::write_packet(Pipeline& pipeline, AVPacket* packet) {
+    const std::vector<double>& cuts = config_.segment_cuts;
+    if (packet->pts != AV_NOPTS_VALUE &&
+        packet->pts * av_q2d(pipeline.output->streams[packet->stream_index]->time_base) >=
+            pipeline.range_end - CUT_TOLERANCE) {
+        return true;  // 按需分片：属于下一段范围，由那一次产出负责
+    }
+
+    if (packet->stream_index == pipeline.cut_index && packet->pts != AV_NOPTS_VALUE) {
+        const AVRational time_base = pipeline.output->streams[pipeline.cut_index]->time_base;
+        bool cut = false;
+        if (pipeline.segment_start != AV_NOPTS_VALUE && (packet->flags & AV_PKT_FLAG_KEY)) {
+            const size_t next = static_cast<size_t>(pipeline.segment_index) + 1;
+            cut = cuts.empty()
+                ? (packet->pts - pipeline.segment_start) * av_q2d(time_base) >= config_.segment_duration * 0.95
+                : next < cuts.size() && packet->pts * av_q2d(time_base) >= cuts[next] - CUT_TOLERANCE;
+        }
+        if (pipeline.segment_start == AV_NOPTS_VALUE) {
+            pipeline.segment_start = packet->pts;
+        } else if (cut) {
+            // 关键帧落在目标时长附近（或切分计划的切点）即切分片，容忍帧间隔带来的误差
+            if (!finish_segment(pipeline, packet->pts, false) || !begin_segment(pipeline)) {
+                return false;
+            }
+            pipeline.segment_start = packet->pts;
+        }
+        int64_t end = packet->pts + std::max<int64_t>(packet->duration, 0);
+        if (pipeline.segment_end == AV_NOPTS_VALUE || end > pipeline.segment_end) {
+            pipeline.segment_end = end;
+        }
+    }
+
+    int ret = av_write_frame(pipeline.output, packet);
+    if (ret < 0) {
+        fail("写入分片失败: " + av_error(ret));
+        return false;
+    }
+    return true;
+}
+
+double FFmpegTranscoder::next_cut(double seconds) const {
+    const std::vector<double>& cuts = config_.segment_cuts;
+    if (cuts.empty()) {
+        const double duration = config_.segment_duration;
+        return (std::floor((seconds + CUT_TOLERANCE) / duration) + 1) * duration;
+    }
+    auto it = std::upper_bound(cuts.begin(), cuts.end(), seconds + CUT_TOLERANCE);
+    return it == cuts.end() ? INFINITY : *it;
+}
+
+bool FFmpegTranscoder::mux_packets(Pipeline& pipeline) {
+    StreamStage* stages[2] = {&pipeline.video, &pipeline.audio};
+    AVPacket* heads[2] = {nullptr, nullptr};
+    bool done[2] = {!pipeline.video.active(), !pipeline.audio.active()};
+
+    bool ok = true;
+    while (ok) {
+        for (int i = 0; i < 2; ++i) {
+            if (!heads[i] && !done[i]) {
+                heads[i] = stages[i]->encoded.pop();
+                done[i] = heads[i] == nullptr;
+            }
+        }
+
+        // 两路都有待写包时先写 DTS 较小者，让每个分片内音视频覆盖相同的时间范围
+        int next = -1;
+        for (int i = 0; i < 2; ++i) {
+            if (heads[i] && (next < 0 ||
+                             av_compare_ts(packet_time(heads[i]), stages[i]->output_time_base,
+                                           packet_time(heads[next]), stages[next]->output_time_base) < 0)) {
+                next = i;
+            }
+        }
+        if (next < 0) {
+            break;
+        }
+        ok = write_packet(pipeline, heads[next]);
+        av_packet_free(&heads[next]);
+    }
+
+    for (AVPacket*& packet : heads) {
+        av_packet_free(&packet);
+    }
+    return ok && !cancelled_;
+}
+
+void FFmpegTranscoder::update_playlist(bool finished) {
+    double longest = config_.segment_duration;
+    for (double duration : segment_durations_) {
+        longest = std::max(longest, duration);
+    }
+
+    std::ostringstream playlist;
+    playlist << "#EXTM3U\n"
+             << "#EXT-X-VERSION:3\n"
+             << "#EXT-X-TARGETDURATION:" << static_cast<int>(std::ceil(longest)) << "\n"
+             << "#EXT-X-MEDIA-SEQUENCE:0\n"
+             << "#EXT-X-PLAYLIST-TYPE:" << (finished ? "VOD" : "EVENT") << "\n";
+    char extinf[48];
+    for (size_t i = 0; i < segment_durations_.size(); ++i) {
+        std::snprintf(extinf, sizeof(extinf), "#EXTINF:%.6f,\n", segment_durations_[i]);
+        playlist << extinf;
+        char name[32];
+        std::snprintf(name, sizeof(name), "segment_%03zu.ts\n", i);
+        playlist << name;
+    }
+    if (finished) {
+        playlist << "#EXT-X-ENDLIST\n";
+    }
+    playlist_ = playlist.str();
 }
 
 void FFmpegTranscoder::transcode_process() {
-    std::cout << "[FFmpeg] 开始转码: " << config_.stream_id << std::endl;
-    
-    // 构建命令
-    std::string cmd = build_ffmpeg_command();
-    
-    if (config_.enable_logging) {
-        std::cout << "[FFmpeg] 命令: " << cmd << std::endl;
-    }
-    
-    // 执行命令
-    FILE* pipe = popen(cmd.c_str(), "r");
-    if (!pipe) {
+    LOG_INFO("[FFmpeg] 开始转码: " << config_.stream_id);
+
+    Pipeline& pipeline = *pipeline_;
+    bool ok = open_pipeline(pipeline);
+    if (ok) {
+        pipeline.demux_thread = std::thread(&FFmpegTranscoder::demux_stage, this, std::ref(pipeline));
+        if (pipeline.video.transcoded()) {
+            pipeline.video.thread = std::thread(&FFmpegTranscoder::video_stage, this, std::ref(pipeline));
+        }
+        if (pipeline.audio.transcoded()) {
+            pipeline.audio.thread = std::thread(&FFmpegTranscoder::audio_stage, this, std::ref(pipeline));
+        }
+
+        ok = mux_packets(pipeline);
+        if (!ok) {
+            pipeline.cancel();  // 写分片失败或已取消：让上游阶段尽快退出
+        }
+        for (std::thread* thread : {&pipeline.demux_thread, &pipeline.video.thread,
+                                    &pipeline.audio.thread}) {
+            if (thread->joinable()) {
+                thread->join();
+            }
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(status_mutex_);
+            ok = ok && error_message_.empty();
+        }
+        if (ok) {
+            ok = finish_segment(pipeline, pipeline.segment_end, true);
+        }
+    }
+
+    // 所有阶段线程都已结束，此处统一释放 libav 上下文；未写完的分片直接删除
+    pipeline.release();
+    if (!ok && !pipeline.segment_name.empty()) {
+        std::error_code ec;
+        fs::remove(config_.output_dir + "/segments/" + pipeline.segment_name + ".tmp", ec);
+    }
+
+    {
         std::lock_guard<std::mutex> lock(status_mutex_);
-        error_message_ = "无法启动FFmpeg进程";
+        finished_ = true;
         is_running_ = false;
-        return;
-    }
-    
-    // 获取进程ID
-    ffmpeg_pid_ = 1; // 简化处理
-    
-    char buffer[256];
-    while (is_running_ && fgets(buffer, sizeof(buffer), pipe) != nullptr) {
-        if (config_.enable_logging) {
-            std::cout << "[FFmpeg] " << config_.stream_id << ": " << buffer;
-        }
-        
-        // 更新分片计数
-        std::string segments_dir = config_.output_dir + "/segments";
-        try {
-            int count = 0;
-            for (const auto& entry : fs::directory_iterator(segments_dir)) {
-                if (entry.is_regular_file() && entry.path().extension() == ".ts") {
-                    count++;
-                }
+    }
+    state_cv_.notify_all();
+
+    LOG_INFO("[FFmpeg] 转码结束: " << config_.stream_id
+             << (ok ? "" : (cancelled_ ? "（已取消）" : "（失败）")));
+
+    if (on_finished_) {
+        on_finished_();
+    }
+}
+
+std::vector<double> FFmpegTranscoder::plan_segments(const TranscodeConfig& config) {
+    std::vector<double> cuts;
+    AVFormatContext* input = nullptr;
+    if (avformat_open_input(&input, config.input_path.c_str(), nullptr, nullptr) < 0) {
+        return cuts;
+    }
+    if (avformat_find_stream_info(input, nullptr) < 0 || input->duration <= 0) {
+        avformat_close_input(&input);
+        return cuts;
+    }
+
+    const double duration = static_cast<double>(input->duration) / AV_TIME_BASE;
+    const double target = std::max(1, config.segment_duration);
+    int video_index = av_find_best_stream(input, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+    if (video_index >= 0 && (input->streams[video_index]->disposition & AV_DISPOSITION_ATTACHED_PIC)) {
+        video_index = -1;
+    }
+
+    const bool copy_video = video_index >= 0 && config.allow_stream_copy &&
+                            video_copyable(input->streams[video_index]->codecpar, config.resolution);
+    avformat_close_input(&input);
+
+    cuts.push_back(0.0);
+    if (copy_video) {
+        // 直接复制时分片只能从源关键帧开始，切点取包索引（媒体库扫描后由后台建立，
+        // 尚未建立时在此构建），沿用 write_packet 的切分规则
+        std::shared_ptr<const MediaIndex> index = MediaIndexer::get_instance().get(config.input_path, true);
+        if (!index || !index->is_video() || index->stream_index() != video_index) {
+            return {};
+        }
+        for (double seconds : index->keyframe_times()) {
+            if (seconds - cuts.back() >= target * 0.95) {
+                cuts.push_back(seconds);
             }
-            segment_count_ = count;
-        } catch (...) {
-            // 忽略目录读取错误
         }
+    } else {
+        for (double cut = target; cut < duration; cut += target) {
+            cuts.push_back(cut);
+        }
+    }
+
+    // 末段过短时并入前一段，避免时长估计误差产出没有任何帧的分片
+    while (cuts.size() > 1 && duration - cuts.back() < target * 0.25) {
+        cuts.pop_back();
     }
-    
-    pclose(pipe);
-    ffmpeg_pid_ = -1;
-    
-    std::cout << "[FFmpeg] 转码结束: " << config_.stream_id << std::endl;
+    cuts.push_back(duration);
+    return cuts;
 }
 
 bool FFmpegTranscoder::start() {
-    if (is_running_) {
-        return true;
+    if (!launch()) {
+        return false;
+    }
+
+    // 等到首个分片写完（或转码失败）再返回，播放列表从此刻起就有内容可播
+    if (!wait_ready(START_TIMEOUT)) {
+        stop();
+        return false;
+    }
+    return true;
+}
+
+bool FFmpegTranscoder::launch() {
+    std::lock_guard<std::mutex> lifecycle(lifecycle_mutex_);
+    if (stopped_) {
+        return false;
+    }
+    if (transcode_thread_.joinable()) {
+        return is_running_;  // 已经启动过
     }
-    
+
     // 创建输出目录
     if (!create_output_directory()) {
         return false;
     }
-    
+
     // 检查输入文件
     if (!fs::exists(config_.input_path)) {
+        std::lock_guard<std::mutex> lock(status_mutex_);
         error_message_ = "输入文件不存在: " + config_.input_path;
         return false;
     }
-    
+
+    {
+        std::lock_guard<std::mutex> lock(status_mutex_);
+        error_message_.clear();
+        finished_ = false;
+        segment_count_ = 0;
+        next_segment_ = config_.segment_cuts.empty() ? 0 : config_.first_segment;
+        segment_durations_.clear();
+        playlist_.clear();
+    }
+    cancelled_ = false;
     is_running_ = true;
-    
+    pipeline_ = std::make_unique<Pipeline>();
+
     // 启动转码线程
     transcode_thread_ = std::thread(&FFmpegTranscoder::transcode_process, this);
-    
-    // 等待一段时间，让FFmpeg开始
-    std::this_thread::sleep_for(std::chrono::seconds(2));
-    
     return true;
 }
 
+bool FFmpegTranscoder::wait_ready(std::chrono::milliseconds timeout) {
+    std::unique_lock<std::mutex> lock(status_mutex_);
+    state_cv_.wait_for(lock, timeout, [this] {
+        return segment_count_ > 0 || finished_;
+    });
+    return error_message_.empty();
+}
+
+bool FFmpegTranscoder::wait_segment(int index, std::chrono::milliseconds timeout) {
+    std::unique_lock<std::mutex> lock(status_mutex_);
+    state_cv_.wait_for(lock, timeout, [this, index] {
+        return next_segment_ > index || finished_;
+    });
+    return next_segment_ > index;
+}
+
+void FFmpegTranscoder::set_finished_callback(std::function<void()> callback) {
+    on_finished_ = std::move(callback);
+}
+
+void FFmpegTranscoder::set_segment_callback(std::function<void()> callback) {
+    on_segment_ = std::move(callback);
+}
+
 void FFmpegTranscoder::stop() {
-    if (!is_running_) {
-        return;
-    }
-    
-    is_running_ = false;
-    
-    // 终止FFmpeg进程
-    if (ffmpeg_pid_ > 0) {
-        kill(ffmpeg_pid_, SIGTERM);
+    std::lock_guard<std::mutex> lifecycle(lifecycle_mutex_);
+    stopped_ = true;
+
+    // 中断回调让阻塞中的 libav I/O 立即返回，取消队列唤醒各阶段线程
+    cancelled_ = true;
+    if (pipeline_) {
+        pipeline_->cancel();
     }
-    
+
     // 等待线程结束
     if (transcode_thread_.joinable()) {
         transcode_thread_.join();
     }
+    pipeline_.reset();
+    is_running_ = false;
 }
 
 void FFmpegTranscoder::cleanup() {
-    // 清理临时文件
+    // 清理取消时残留的临时分片；按需分片时同一目录下还有其他产出在写，只清理本次范围内的
     try {
-        if (fs::exists(config_.output_dir)) {
-            // 可以在这里删除临时文件
+        std::string segments_dir = config_.output_dir + "/segments";
+        if (fs::exists(segments_dir)) {
+            for (const auto& entry : fs::directory_iterator(segments_dir)) {
+                if (!entry.is_regular_file() || entry.path().extension() != ".tmp") {
+                    continue;
+                }
+                int index = -1;
+                if (!config_.segment_cuts.empty() &&
+                    (std::sscanf(entry.path().filename().c_str(), "segment_%d.ts.tmp", &index) != 1 ||
+                     index < config_.first_segment || index >= config_.last_segment)) {
+                    continue;
+                }
+                fs::remove(entry.path());
+            }
         }
     } catch (...) {
         // 忽略清理错误
@@ -175,51 +1411,44 @@ bool FFmpegTranscoder::is_running() const {
 
 std::string FFmpegTranscoder::get_status() const {
     std::lock_guard<std::mutex> lock(status_mutex_);
-    
+
     if (!error_message_.empty()) {
         return "error: " + error_message_;
     }
-    
+
     if (is_running_) {
         return "transcoding";
     }
-    
-    return "stopped";
+
+    if (!finished_) {
+        return "pending";  // 尚未启动（等待调度）
+    }
+
+    return cancelled_ ? "stopped" : "completed";
 }
 
 int FFmpegTranscoder::get_segment_count() const {
+    std::lock_guard<std::mutex> lock(status_mutex_);
     return segment_count_;
 }
 
 std::string FFmpegTranscoder::get_playlist() const {
-    std::string playlist_path = config_.output_dir + "/playlist.m3u8";
-    
-    if (!fs::exists(playlist_path)) {
-        return "";
-    }
-    
-    try {
-        std::ifstream file(playlist_path);
-        std::stringstream buffer;
-        buffer << file.rdbuf();
-        return buffer.str();
-    } catch (...) {
-        return "";
-    }
+    std::lock_guard<std::mutex> lock(status_mutex_);
+    return playlist_;
 }
 
 std::vector<char> FFmpegTranscoder::get_segment(const std::string& segment_name) const {
     std::string segment_path = config_.output_dir + "/segments/" + segment_name;
-    
+
     if (!fs::exists(segment_path)) {
         return {};
     }
-    
+
     try {
         std::ifstream file(segment_path, std::ios::binary | std::ios::ate);
         std::streamsize size = file.tellg();
         file.seekg(0, std::ios::beg);
-        
+
         std::vector<char> buffer(size);
         if (file.read(buffer.data(), size)) {
             return buffer;
@@ -227,6 +1456,36 @@ std::vector<char> FFmpegTranscoder::get_segment(const std::string& segment_name)
     } catch (...) {
         // 读取失败
     }
-    
+
     return {};
-}
\ No newline at end of file
+}
+
+int FFmpegTranscoder::open_segment(const std::string& segment_name, size_t& size) const {
+    return open_segment_file(config_.output_dir, segment_name, size);
+}
+
+int FFmpegTranscoder::open_segment_file(const std::string& output_dir, const std::string& segment_name,
+                                        size_t& size) {
+    // 分片名来自 URL，禁止路径分隔符以防目录穿越
+    if (segment_name.empty() || segment_name.find('/') != std::string::npos ||
+        segment_name.find("..") != std::string::npos ||
+        fs::path(segment_name).extension() == ".tmp") {
+        return -1;
+    }
+
+    std::string segment_path = output_dir + "/segments/" + segment_name;
+
+    int fd = open(segment_path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+
+    struct stat st{};
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        close(fd);
+        return -1;
+    }
+
+    size = static_cast<size_t>(st.st_size);
+    return fd;
+}
@@ -1,27 +1,494 @@
 // server/src/hls_processor_real.cpp
 #include "hls_processor.h"
+#include "logger.h"
 #include "ffmpeg_transcoder.h"
-#include <iostream>
 #include <memory>
 #include <map>
 #include <mutex>
+#include <set>
+#include <condition_variable>
+#include <atomic>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <sstream>
 #include <vector>
 #include <filesystem>
+#include <future>
+#include <deque>
+#include <unistd.h>
 
 namespace fs = std::filesystem;
 
+namespace {
+
+TranscodeConfig make_transcode_config(const HLSStreamConfig& stream_config) {
+    TranscodeConfig transcode_config;
+    transcode_config.input_path = stream_config.media_path;
+    transcode_config.output_dir = stream_config.output_dir;
+    transcode_config.stream_id = stream_config.stream_id;
+    transcode_config.video_bitrate = stream_config.video_bitrate;
+    transcode_config.audio_bitrate = stream_config.audio_bitrate;
+    transcode_config.segment_duration = stream_config.segment_duration;
+    transcode_config.max_segments = stream_config.max_segments;
+    transcode_config.resolution = stream_config.resolution;
+    transcode_config.encoder_threads = stream_config.encoder_threads;
+    transcode_config.allow_stream_copy = stream_config.allow_stream_copy;
+    return transcode_config;
+}
+
+// 转码时编码线程之外再为解码与缩放留半个核；视频直接复制只是重封装，
+// 此时若音频仍需转码再加四分之一核。转码器最终按实际打开的流决定，这里只是预估
+unsigned estimate_cpu(const HLSStreamConfig& stream_config) {
+    const std::string& pixel_format = stream_config.source_pixel_format;
+    bool copy_video = stream_config.allow_stream_copy && stream_config.source_video_codec == "h264" &&
+                      (pixel_format == "yuv420p" || pixel_format == "yuvj420p");
+    bool copy_audio = stream_config.source_audio_codec == "unknown" ||
+                      (stream_config.allow_stream_copy && stream_config.source_audio_codec == "aac" &&
+                       stream_config.source_audio_channels <= 2);
+    return copy_video
+        ? (copy_audio ? 10u : 35u)
+        : static_cast<unsigned>(std::max(1, stream_config.encoder_threads)) * 100 + 50;
+}
+
+std::string segment_file_name(size_t index) {
+    char name[32];
+    std::snprintf(name, sizeof(name), "segment_%03zu.ts", index);
+    return name;
+}
+
+// 分片名 → 编号，名字不合规时返回 -1
+int segment_number(const std::string& segment_name) {
+    int index = -1;
+    if (std::sscanf(segment_name.c_str(), "segment_%d.ts", &index) != 1 || index < 0 ||
+        segment_file_name(static_cast<size_t>(index)) != segment_name) {
+        return -1;
+    }
+    return index;
+}
+
+bool segment_on_disk(const std::string& output_dir, int index) {
+    std::error_code ec;
+    return fs::exists(output_dir + "/segments/" + segment_file_name(static_cast<size_t>(index)), ec);
+}
+
+// 按切分计划一次生成完整的 VOD 播放列表
+std::string vod_playlist(const std::vector<double>& cuts) {
+    double longest = 0.0;
+    for (size_t i = 0; i + 1 < cuts.size(); ++i) {
+        longest = std::max(longest, cuts[i + 1] - cuts[i]);
+    }
+
+    std::ostringstream playlist;
+    playlist << "#EXTM3U\n"
+             << "#EXT-X-VERSION:3\n"
+             << "#EXT-X-TARGETDURATION:" << static_cast<int>(std::ceil(longest)) << "\n"
+             << "#EXT-X-MEDIA-SEQUENCE:0\n"
+             << "#EXT-X-PLAYLIST-TYPE:VOD\n";
+    char extinf[48];
+    for (size_t i = 0; i + 1 < cuts.size(); ++i) {
+        std::snprintf(extinf, sizeof(extinf), "#EXTINF:%.6f,\n", cuts[i + 1] - cuts[i]);
+        playlist << extinf << segment_file_name(i) << "\n";
+    }
+    playlist << "#EXT-X-ENDLIST\n";
+    return playlist.str();
+}
+
+} // namespace
+
 class HLSProcessor::Impl {
 public:
+    // 按需分片的一次产出：转码 [first, last) 这几个分片后结束
+    struct Producer {
+        std::shared_ptr<FFmpegTranscoder> transcoder;
+        TranscodeScheduler::JobId job = 0;
+        int first = 0;
+        int last = 0;
+    };
+    
+    // 分片发出计数：请求线程查表时取得引用，发出后原子累加，不再获取 mutex
+    struct ServedStats {
+        std::atomic<uint64_t> segments{0};
+        std::atomic<uint64_t> bytes{0};
+        
+        void record(size_t size) {
+            segments.fetch_add(1, std::memory_order_relaxed);
+            bytes.fetch_add(size, std::memory_order_relaxed);
+        }
+    };
+    
     struct StreamData {
-        std::unique_ptr<FFmpegTranscoder> transcoder;
+        // 调度器的启动回调也持有转码器，流被删除后回调仍可安全执行
+        std::shared_ptr<FFmpegTranscoder> transcoder;
+        TranscodeScheduler::JobId job = 0;
         std::string media_id;
         std::string media_path;
         HLSStreamConfig config;
         int viewers = 0;
+        std::shared_ptr<ServedStats> served = std::make_shared<ServedStats>();
+        
+        // 按需分片（cuts 非空时）：切分计划、完整播放列表、已确认写完的分片与进行中的产出
+        std::vector<double> cuts;
+        std::string playlist;
+        std::vector<bool> ready;
+        std::vector<Producer> producers;
     };
     
+    // 记下分片已写完。调用方只在查表时该位尚未置位时调用；served 用于识别期间被停止后重建的同名流
+    void mark_ready(const std::string& stream_id, const std::shared_ptr<ServedStats>& served, int index) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = streams.find(stream_id);
+        if (it == streams.end() || it->second.served != served) {
+            return;  // 期间流已被停止
+        }
+        if (index >= 0 && index < static_cast<int>(it->second.ready.size())) {
+            it->second.ready[index] = true;
+        }
+    }
+    
+    // mutex 只保护下面的表，持有期间不做文件系统操作、不提交转码任务、不等待转码线程
     std::map<std::string, StreamData> streams;
+    // 正在创建或停止的流：输出目录在锁外清理，期间同名的创建需等待，否则会删掉新流的分片
+    std::set<std::string> busy;
+    std::condition_variable busy_cv;
     mutable std::mutex mutex;
+    
+    std::atomic<uint64_t> transcoders_started{0};
+    std::atomic<uint64_t> transcoders_failed{0};
+    std::atomic<uint64_t> transcoders_stopped{0};
+    
+    // 按需分片请求中需要检查磁盘或提交产出的部分交给专用的分片线程，请求线程（事件循环）不阻塞；
+    // 分片尚未写完的请求作为等待者停在这里，分片写完、产出结束或超时后回调，不占用任何工作线程
+    struct SegmentRequest {
+        std::string stream_id;
+        std::string segment_name;
+        int index = 0;
+        SegmentCallback done;  // 为空表示分片已发出，只需保证预读
+    };
+    
+    struct SegmentWaiter {
+        SegmentRequest request;
+        std::string output_dir;
+        std::shared_ptr<FFmpegTranscoder> producer;
+        std::shared_ptr<ServedStats> served;
+        std::chrono::steady_clock::time_point deadline;
+    };
+    
+    std::mutex waiter_mutex;
+    std::condition_variable waiter_cv;
+    std::deque<SegmentRequest> requests;
+    std::vector<SegmentWaiter> waiters;
+    bool waiters_changed = false;  // 产出有进展或等待者被撤销，需要重新检查
+    bool waiter_stopping = false;
+    std::thread waiter_thread;
+    
+    // 启动回调在调度器放行时执行（可能就在 submit 内，也可能在其他转码器结束的线程上），
+    // 只启动转码线程不等待；转码线程结束时归还预算。回调不获取 HLS 锁，在锁内提交也不会死锁
+    TranscodeScheduler::StartFn make_start(std::shared_ptr<FFmpegTranscoder> transcoder) {
+        return [this, transcoder](TranscodeScheduler::JobId job) {
+            transcoder->set_finished_callback([this, raw = transcoder.get(), job] {
+                if (raw->get_status().rfind("error", 0) == 0) {
+                    transcoders_failed++;
+                }
+                TranscodeScheduler::get_instance().finish(job);
+                wake_waiters();
+            });
+            if (transcoder->launch()) {
+                transcoders_started++;
+            } else {
+                // 排队期间流已被停止，或输出目录 / 输入文件不可用
+                if (transcoder->get_status().rfind("error", 0) == 0) {
+                    transcoders_failed++;
+                }
+                TranscodeScheduler::get_instance().finish(job);
+                wake_waiters();
+            }
+        };
+    }
+    
+    // 以下按需分片的辅助函数均由调用方持有 mutex；分片是否已在磁盘上由调用方在锁外检查后写入 ready
+    
+    // 负责 index 的进行中产出；顺带清理已结束的产出（成功的分片已在磁盘上，失败的下次请求重试）
+    Producer* find_producer(StreamData& data, int index) {
+        auto& producers = data.producers;
+        producers.erase(std::remove_if(producers.begin(), producers.end(), [](const Producer& producer) {
+            return !producer.transcoder->is_running() && producer.transcoder->get_status() != "pending";
+        }), producers.end());
+        for (Producer& producer : producers) {
+            if (producer.first <= index && index < producer.last) {
+                return &producer;
+            }
+        }
+        return nullptr;
+    }
+    
+    // 登记从 first 起、不超过 end 的连续若干分片的产出，遇到已写完或已有产出负责的分片即止。
+    // 只创建转码器，调用方释放 mutex 后交给 submit() 提交
+    const Producer& produce(StreamData& data, int first, int end) {
+        int last = first + 1;
+        while (last < end && !data.ready[last] && !find_producer(data, last)) {
+            ++last;
+        }
+        
+        TranscodeConfig transcode_config = make_transcode_config(data.config);
+        transcode_config.stream_id += "#" + std::to_string(first);
+        transcode_config.segment_cuts = data.cuts;
+        transcode_config.first_segment = first;
+        transcode_config.last_segment = last;
+        
+        auto transcoder = std::make_shared<FFmpegTranscoder>(transcode_config);
+        transcoder->set_segment_callback([this] { wake_waiters(); });
+        data.producers.push_back({transcoder, 0, first, last});
+        return data.producers.back();
+    }
+    
+    // 请求分片及其后 read_ahead 个分片都要已写完或已有产出负责；新登记的产出追加到 pending
+    void ensure_producers(StreamData& data, int index, int end, std::vector<Producer>& pending) {
+        for (int next = index; next < end; ++next) {
+            if (!data.ready[next] && !find_producer(data, next)) {
+                pending.push_back(produce(data, next, end));
+            }
+        }
+    }
+    
+    // 在锁外提交新登记的产出（启动回调可能就在 submit 内执行），再回锁记下任务号。
+    // 提交期间流已被停止时撤下任务；已放行的转码器已被停止，launch 失败后归还预算
+    void submit(const std::string& stream_id, const HLSStreamConfig& config, const std::vector<Producer>& pending) {
+        auto& scheduler = TranscodeScheduler::get_instance();
+        for (const Producer& producer : pending) {
+            TranscodeScheduler::JobId job = scheduler.submit(
+                stream_id + "#" + std::to_string(producer.first), config.priority, estimate_cpu(config),
+                make_start(producer.transcoder));
+            
+            std::lock_guard<std::mutex> lock(mutex);
+            bool registered = false;
+            auto it = streams.find(stream_id);
+            if (it != streams.end()) {
+                for (Producer& candidate : it->second.producers) {
+                    if (candidate.transcoder == producer.transcoder) {
+                        candidate.job = job;
+                        registered = true;
+                        break;
+                    }
+                }
+            }
+            if (!registered) {
+                scheduler.cancel(job);
+            }
+        }
+    }
+    
+    // ---- 分片线程 ----
+    
+    void post_request(SegmentRequest request) {
+        bool accepted = false;
+        {
+            std::lock_guard<std::mutex> lock(waiter_mutex);
+            if (!waiter_stopping) {
+                requests.push_back(std::move(request));
+                accepted = true;
+            }
+        }
+        if (accepted) {
+            waiter_cv.notify_one();
+        } else if (request.done) {
+            request.done(-1, 0);  // 正在退出
+        }
+    }
+    
+    // 产出写完分片或结束时在转码线程上调用，只做通知
+    void wake_waiters() {
+        {
+            std::lock_guard<std::mutex> lock(waiter_mutex);
+            waiters_changed = true;
+        }
+        waiter_cv.notify_one();
+    }
+    
+    // 流已停止：其产出可能还排在调度队列里、不会再有进展，等待者立即以失败了结
+    void expire_waiters(const std::string& stream_id) {
+        {
+            std::lock_guard<std::mutex> lock(waiter_mutex);
+            for (SegmentWaiter& waiter : waiters) {
+                if (waiter.request.stream_id == stream_id) {
+                    waiter.deadline = std::chrono::steady_clock::time_point();
+                }
+            }
+            waiters_changed = true;
+        }
+        waiter_cv.notify_one();
+    }
+    
+    // 检查磁盘，登记并提交请求分片及其预读的产出；分片已写完时立即回调，否则登记等待者
+    void serve(SegmentRequest request) {
+        std::string output_dir;
+        std::vector<bool> ready;  // 请求的分片及其后 read_ahead 个分片是否已确认写完
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto it = streams.find(request.stream_id);
+            // 期间同名的流被停止后以更短的切分计划重建时下标可能越界，按流已停止处理
+            if (it != streams.end() && !it->second.cuts.empty() &&
+                static_cast<size_t>(request.index) < it->second.ready.size()) {
+                const StreamData& data = it->second;
+                size_t end = std::min(data.ready.size(), static_cast<size_t>(request.index) + 1 +
+                                      static_cast<size_t>(std::max(0, data.config.read_ahead)));
+                ready.assign(data.ready.begin() + request.index, data.ready.begin() + end);
+                output_dir = data.config.output_dir;
+            }
+        }
+        for (size_t i = 0; i < ready.size(); ++i) {
+            if (!ready[i]) {
+                ready[i] = segment_on_disk(output_dir, request.index + static_cast<int>(i));
+            }
+        }
+        
+        std::shared_ptr<FFmpegTranscoder> producer;
+        std::shared_ptr<ServedStats> served;
+        std::vector<Producer> pending;
+        HLSStreamConfig config;
+        bool found = false;
+        if (!ready.empty()) {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto it = streams.find(request.stream_id);
+            // 期间同名的流被停止后重建时切分计划可能不同，按流已停止处理
+            if (it != streams.end() && request.index + ready.size() <= it->second.ready.size()) {
+                found = true;
+                StreamData& data = it->second;
+                served = data.served;
+                const int index = request.index;
+                for (size_t i = 0; i < ready.size(); ++i) {
+                    if (ready[i]) {
+                        data.ready[index + i] = true;
+                    }
+                }
+                const int end = index + static_cast<int>(ready.size());
+                if (!data.ready[index]) {
+                    Producer* existing = find_producer(data, index);
+                    if (existing) {
+                        producer = existing->transcoder;
+                    } else {
+                        pending.push_back(produce(data, index, end));
+                        producer = pending.back().transcoder;
+                    }
+                }
+                ensure_producers(data, index + 1, end, pending);
+                if (!pending.empty()) {
+                    config = data.config;
+                }
+            }
+        }
+        if (!pending.empty()) {
+            submit(request.stream_id, config, pending);
+        }
+        
+        if (!request.done) {
+            return;
+        }
+        if (!found) {
+            request.done(-1, 0);  // 期间流已被停止
+            return;
+        }
+        if (!producer) {
+            size_t size = 0;
+            int fd = FFmpegTranscoder::open_segment_file(output_dir, request.segment_name, size);
+            if (fd >= 0) {
+                served->record(size);  // ready 位已在上面置位
+            }
+            request.done(fd, size);
+            return;
+        }
+        
+        // 首帧耗时只取决于从最近关键帧转出一个分片，与定位位置无关
+        std::lock_guard<std::mutex> lock(waiter_mutex);
+        waiters.push_back({std::move(request), output_dir, producer, std::move(served),
+                           std::chrono::steady_clock::now() + FFmpegTranscoder::START_TIMEOUT});
+    }
+    
+    void finish_waiter(SegmentWaiter& waiter, bool produced) {
+        size_t size = 0;
+        int fd = produced
+            ? FFmpegTranscoder::open_segment_file(waiter.output_dir, waiter.request.segment_name, size)
+            : -1;
+        if (fd >= 0) {
+            waiter.served->record(size);
+            mark_ready(waiter.request.stream_id, waiter.served, waiter.request.index);
+        } else {
+            LOG_WARN("[HLS] 分片产出失败: " << waiter.request.stream_id << "/" << waiter.request.segment_name
+                     << " (" << waiter.producer->get_status() << ")");
+        }
+        waiter.request.done(fd, size);
+    }
+    
+    void run_waiters() {
+        std::unique_lock<std::mutex> lock(waiter_mutex);
+        while (true) {
+            auto woken = [this] { return waiter_stopping || waiters_changed || !requests.empty(); };
+            if (waiters.empty()) {
+                waiter_cv.wait(lock, woken);
+            } else {
+                auto earliest = std::min_element(waiters.begin(), waiters.end(),
+                    [](const SegmentWaiter& a, const SegmentWaiter& b) { return a.deadline < b.deadline; });
+                waiter_cv.wait_until(lock, earliest->deadline, woken);
+            }
+            waiters_changed = false;
+            
+            std::deque<SegmentRequest> batch;
+            batch.swap(requests);
+            const bool stopping = waiter_stopping;
+            lock.unlock();
+            for (SegmentRequest& request : batch) {
+                if (!stopping) {
+                    serve(std::move(request));
+                } else if (request.done) {
+                    request.done(-1, 0);
+                }
+            }
+            lock.lock();
+            
+            // 先看产出是否已结束、再看分片是否写出，二者之间才结束的产出不会被误判为失败
+            std::vector<std::pair<SegmentWaiter, bool>> due;
+            const auto now = std::chrono::steady_clock::now();
+            for (auto it = waiters.begin(); it != waiters.end();) {
+                const FFmpegTranscoder& producer = *it->producer;
+                bool finished = !producer.is_running() && producer.get_status() != "pending";
+                bool produced = it->producer->wait_segment(it->request.index, std::chrono::milliseconds(0));
+                if (produced || finished || waiter_stopping || now >= it->deadline) {
+                    due.emplace_back(std::move(*it), produced);
+                    it = waiters.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+            lock.unlock();
+            for (auto& [waiter, produced] : due) {
+                finish_waiter(waiter, produced);
+            }
+            lock.lock();
+            if (waiter_stopping && requests.empty() && waiters.empty()) {
+                return;
+            }
+        }
+    }
+    
+    // 以下两个函数在 mutex 外调用，StreamData 已从表中移出
+    
+    static void cancel_jobs(StreamData& data) {
+        auto& scheduler = TranscodeScheduler::get_instance();
+        scheduler.cancel(data.job);
+        for (const Producer& producer : data.producers) {
+            scheduler.cancel(producer.job);
+        }
+    }
+    
+    // 已放行的转码器停止后由结束回调归还预算
+    static void stop_transcoders(StreamData& data) {
+        if (data.transcoder) {
+            data.transcoder->stop();
+        }
+        for (const Producer& producer : data.producers) {
+            producer.transcoder->stop();
+        }
+    }
 };
 
 std::map<std::string, std::string> HLSStreamStatus::to_json() const {
@@ -30,6 +497,7 @@ std::map<std::string, std::string> HLSStreamStatus::to_json() const {
     json["media_id"] = media_id;
     json["status"] = status;
     json["error_message"] = error_message;
+    json["queue_position"] = std::to_string(queue_position);
     json["segments_generated"] = std::to_string(segments_generated);
     json["total_segments"] = std::to_string(total_segments);
     json["progress"] = std::to_string(progress);
@@ -38,7 +506,8 @@ std::map<std::string, std::string> HLSStreamStatus::to_json() const {
 }
 
 HLSProcessor::HLSProcessor() : impl_(std::make_unique<Impl>()) {
-    std::cout << "[HLS] HLSProcessor 初始化 (真实转码版本)" << std::endl;
+    LOG_INFO("[HLS] HLSProcessor 初始化 (真实转码版本)");
+    impl_->waiter_thread = std::thread(&Impl::run_waiters, impl_.get());
     
     // 创建HLS目录
     fs::create_directories("../media/hls");
@@ -46,16 +515,31 @@ HLSProcessor::HLSProcessor() : impl_(std::make_unique<Impl>()) {
 }
 
 HLSProcessor::~HLSProcessor() {
-    std::cout << "[HLS] HLSProcessor 清理" << std::endl;
+    LOG_INFO("[HLS] HLSProcessor 清理");
+    
+    std::map<std::string, Impl::StreamData> streams;
+    {
+        std::lock_guard<std::mutex> lock(impl_->mutex);
+        streams.swap(impl_->streams);
+    }
+    
+    // 先撤下排队中的任务，停止运行中的转码器时调度器就不会再放行它们
+    for (auto& pair : streams) {
+        Impl::cancel_jobs(pair.second);
+    }
     
     // 停止所有转码器
-    std::lock_guard<std::mutex> lock(impl_->mutex);
-    for (auto& pair : impl_->streams) {
-        if (pair.second.transcoder) {
-            pair.second.transcoder->stop();
-        }
+    for (auto& pair : streams) {
+        Impl::stop_transcoders(pair.second);
     }
-    impl_->streams.clear();
+    
+    // 仍在等待的分片请求以失败了结
+    {
+        std::lock_guard<std::mutex> lock(impl_->waiter_mutex);
+        impl_->waiter_stopping = true;
+    }
+    impl_->waiter_cv.notify_one();
+    impl_->waiter_thread.join();
 }
 
 HLSProcessor& HLSProcessor::get_instance() {
@@ -66,24 +550,16 @@ HLSProcessor& HLSProcessor::get_instance() {
 bool HLSProcessor::create_stream(const std::string& media_path, 
                                 const std::string& media_id,
                                 const HLSStreamConfig& config) {
-    std::lock_guard<std::mutex> lock(impl_->mutex);
-    
     // 生成流ID
     std::string stream_id = config.stream_id;
     if (stream_id.empty()) {
-        static int counter = 0;
+        static std::atomic<int> counter{0};
         stream_id = "stream_" + std::to_string(++counter);
     }
     
-    // 检查是否已存在
-    if (impl_->streams.find(stream_id) != impl_->streams.end()) {
-        std::cout << "[HLS] 流已存在: " << stream_id << std::endl;
-        return true;
-    }
-    
     // 检查媒体文件
     if (!fs::exists(media_path)) {
-        std::cerr << "[HLS] 媒体文件不存在: " << media_path << std::endl;
+        LOG_WARN("[HLS] 媒体文件不存在: " << media_path);
         return false;
     }
     
@@ -99,35 +575,113 @@ bool HLSProcessor::create_stream(const std::string& media_path,
     stream_config.playlist_path = output_dir + "/playlist.m3u8";
     stream_config.segment_prefix = "segment";
     
-    // 创建转码器配置
-    TranscodeConfig transcode_config;
-    transcode_config.input_path = media_path;
-    transcode_config.output_dir = output_dir;
-    transcode_config.stream_id = stream_id;
-    transcode_config.video_bitrate = stream_config.video_bitrate;
-    transcode_config.audio_bitrate = stream_config.audio_bitrate;
-    transcode_config.segment_duration = stream_config.segment_duration;
-    transcode_config.max_segments = stream_config.max_segments;
-    transcode_config.resolution = stream_config.resolution;
+    if (stream_config.on_demand) {
+        {
+            std::lock_guard<std::mutex> lock(impl_->mutex);
+            if (impl_->streams.find(stream_id) != impl_->streams.end()) {
+                LOG_INFO("[HLS] 流已存在: " << stream_id);
+                return true;
+            }
+        }
+        
+        // 切分计划在锁外生成：需要打开输入，直接复制时还要扫一遍视频包
+        std::vector<double> cuts = FFmpegTranscoder::plan_segments(make_transcode_config(stream_config));
+        if (cuts.size() >= 2) {
+            {
+                std::unique_lock<std::mutex> lock(impl_->mutex);
+                impl_->busy_cv.wait(lock, [&] { return impl_->busy.count(stream_id) == 0; });
+                if (impl_->streams.find(stream_id) != impl_->streams.end()) {
+                    LOG_INFO("[HLS] 流已存在: " << stream_id);
+                    return true;
+                }
+                impl_->busy.insert(stream_id);
+            }
+            
+            // 上次运行留下的分片可能出自不同的切分计划，不能直接复用
+            std::error_code ec;
+            fs::remove_all(output_dir, ec);
+            
+            std::vector<Impl::Producer> pending;
+            size_t segment_count = cuts.size() - 1;
+            {
+                std::lock_guard<std::mutex> lock(impl_->mutex);
+                impl_->busy.erase(stream_id);
+                
+                Impl::StreamData& data = impl_->streams[stream_id];
+                data.media_id = media_id;
+                data.media_path = media_path;
+                data.config = stream_config;
+                data.playlist = vod_playlist(cuts);
+                data.ready.assign(segment_count, false);
+                data.cuts = std::move(cuts);
+                
+                // 播放器拿到播放列表后通常先请求首个分片，提前开始产出
+                int end = static_cast<int>(std::min<size_t>(segment_count, 1 + std::max(0, stream_config.read_ahead)));
+                pending.push_back(impl_->produce(data, 0, end));
+            }
+            impl_->busy_cv.notify_all();
+            impl_->submit(stream_id, stream_config, pending);
+            
+            LOG_INFO("[HLS] 按需分片流创建成功: " << stream_id << " (" << segment_count << " 个分片)");
+            return true;
+        }
+        LOG_WARN("[HLS] 无法生成切分计划，改为连续转码: " << stream_id);
+    }
     
-    // 创建并启动转码器
-    auto transcoder = std::make_unique<FFmpegTranscoder>(transcode_config);
-    if (!transcoder->start()) {
-        std::cerr << "[HLS] 无法启动转码器: " << stream_id << std::endl;
-        return false;
+    auto transcoder = std::make_shared<FFmpegTranscoder>(make_transcode_config(stream_config));
+    
+    // 先登记流（重复创建直接返回，排队中的流也能查询和停止），再在锁外提交任务：
+    // 预算充足时启动回调就在 submit 内执行，会创建输出目录
+    {
+        std::unique_lock<std::mutex> lock(impl_->mutex);
+        impl_->busy_cv.wait(lock, [&] { return impl_->busy.count(stream_id) == 0; });
+        if (impl_->streams.find(stream_id) != impl_->streams.end()) {
+            LOG_INFO("[HLS] 流已存在: " << stream_id);
+            return true;
+        }
+        
+        // 保存流数据
+        Impl::StreamData& data = impl_->streams[stream_id];
+        data.transcoder = transcoder;
+        data.media_id = media_id;
+        data.media_path = media_path;
+        data.config = stream_config;
     }
     
-    // 保存流数据
-    impl_->streams[stream_id] = {
-        .transcoder = std::move(transcoder),
-        .media_id = media_id,
-        .media_path = media_path,
-        .config = stream_config
-    };
+    auto& scheduler = TranscodeScheduler::get_instance();
+    TranscodeScheduler::JobId job = scheduler.submit(
+        stream_id, stream_config.priority, estimate_cpu(stream_config), impl_->make_start(transcoder));
+    bool queued = scheduler.queue_position(job) > 0;
+    {
+        std::lock_guard<std::mutex> lock(impl_->mutex);
+        auto it = impl_->streams.find(stream_id);
+        if (it == impl_->streams.end() || it->second.transcoder != transcoder) {
+            scheduler.cancel(job);  // 提交期间流已被停止
+            return false;
+        }
+        it->second.job = job;
+    }
+    
+    if (queued) {
+        LOG_INFO("[HLS] 转码任务排队中: " << stream_id);
+        return true;
+    }
+    
+    // 已获准运行：等待首个分片（不持有锁，其他流的播放列表和分片请求不受影响）
+    if (!transcoder->wait_ready(FFmpegTranscoder::START_TIMEOUT)) {
+        LOG_ERROR("[HLS] 无法启动转码器: " << stream_id << " (" << transcoder->get_status() << ")");
+        transcoder->stop();
+        std::lock_guard<std::mutex> lock(impl_->mutex);
+        auto it = impl_->streams.find(stream_id);
+        if (it != impl_->streams.end() && it->second.transcoder == transcoder) {
+            impl_->streams.erase(it);
+        }
+        return false;
+    }
     
-    std::cout << "[HLS] 实时转码流创建成功: " << stream_id << std::endl;
-    std::cout << "[HLS] 输出目录: " << output_dir << std::endl;
-    std::cout << "[HLS] 播放列表: " << stream_config.playlist_path << std::endl;
+    LOG_INFO("[HLS] 实时转码流创建成功: " << stream_id);
+    LOG_INFO("[HLS] 输出目录: " << output_dir);
+    LOG_INFO("[HLS] 播放列表: " << stream_config.playlist_path);
     
     return true;
 }
@@ -143,9 +697,22 @@ HLSStreamStatus HLSProcessor::get_stream_status(const std::string& stream_id) co
         status.media_id = stream_data.media_id;
         status.viewers = stream_data.viewers;
         
-        if (stream_data.transcoder) {
+        size_t queue_position = TranscodeScheduler::get_instance().queue_position(stream_data.job);
+        if (!stream_data.cuts.empty()) {
+            // 按需分片：播放列表创建时即完整可用，进度只反映已产出的分片
+            status.status = "ready";
+            status.total_segments = static_cast<int>(stream_data.ready.size());
+            status.segments_generated = static_cast<int>(
+                std::count(stream_data.ready.begin(), stream_data.ready.end(), true));
+            status.progress = (double)status.segments_generated / status.total_segments;
+        } else if (queue_position > 0) {
+            status.status = "queued";
+            status.queue_position = static_cast<int>(queue_position);
+        } else if (stream_data.transcoder) {
             std::string transcoder_status = stream_data.transcoder->get_status();
-            if (transcoder_status.find("transcoding") != std::string::npos) {
+            if (transcoder_status == "pending") {
+                status.status = "queued";  // 已获准运行，转码线程即将启动
+            } else if (transcoder_status.find("transcoding") != std::string::npos) {
                 status.status = "transcoding";
             } else if (transcoder_status.find("error") != std::string::npos) {
                 status.status = "error";
@@ -175,28 +742,111 @@ HLSStreamStatus HLSProcessor::get_stream_status(const std::string& stream_id) co
 std::string HLSProcessor::get_playlist(const std::string& stream_id) const {
     std::lock_guard<std::mutex> lock(impl_->mutex);
     auto it = impl_->streams.find(stream_id);
-    if (it != impl_->streams.end() && it->second.transcoder) {
-        return it->second.transcoder->get_playlist();
+    if (it != impl_->streams.end()) {
+        if (!it->second.cuts.empty()) {
+            return it->second.playlist;
+        }
+        if (it->second.transcoder) {
+            return it->second.transcoder->get_playlist();
+        }
     }
     return "";
 }
 
 std::vector<char> HLSProcessor::get_segment(const std::string& stream_id, 
                                           const std::string& segment_name) const {
-    std::lock_guard<std::mutex> lock(impl_->mutex);
-    auto it = impl_->streams.find(stream_id);
-    if (it != impl_->streams.end() && it->second.transcoder) {
-        // 增加观看者计数
-        it->second.viewers++;
-        
-        auto segment_data = it->second.transcoder->get_segment(segment_name);
-        
-        // 减少观看者计数
-        it->second.viewers--;
-        
-        return segment_data;
+    size_t size = 0;
+    int fd = open_segment(stream_id, segment_name, size);
+    if (fd < 0) {
+        return {};
+    }
+    
+    std::vector<char> segment_data(size);
+    size_t offset = 0;
+    while (offset < size) {
+        ssize_t n = ::read(fd, segment_data.data() + offset, size - offset);
+        if (n <= 0) {
+            break;
+        }
+        offset += static_cast<size_t>(n);
+    }
+    close(fd);
+    segment_data.resize(offset);
+    return segment_data;
+}
+
+void HLSProcessor::open_segment_async(const std::string& stream_id,
+                                      const std::string& segment_name,
+                                      SegmentCallback done) const {
+    // 请求线程上只做一次查表和一次 open；其余交给分片线程。计数在锁外原子累加，
+    // 只有分片此前未确认写完时才再次加锁置位
+    std::shared_ptr<FFmpegTranscoder> transcoder;
+    std::shared_ptr<Impl::ServedStats> served;
+    std::string output_dir;
+    int index = -1;
+    bool segment_ready = false;
+    bool window_ready = false;  // 请求的分片及其预读都已确认写完，不必再交给分片线程
+    {
+        std::lock_guard<std::mutex> lock(impl_->mutex);
+        auto it = impl_->streams.find(stream_id);
+        if (it != impl_->streams.end()) {
+            const Impl::StreamData& data = it->second;
+            served = data.served;
+            if (data.cuts.empty()) {
+                transcoder = data.transcoder;
+            } else {
+                index = segment_number(segment_name);
+                if (index >= static_cast<int>(data.ready.size())) {
+                    index = -1;
+                } else if (index >= 0) {
+                    size_t end = std::min(data.ready.size(), static_cast<size_t>(index) + 1 +
+                                          static_cast<size_t>(std::max(0, data.config.read_ahead)));
+                    segment_ready = data.ready[index];
+                    window_ready = std::all_of(data.ready.begin() + index, data.ready.begin() + end,
+                                               [](bool ready) { return ready; });
+                    output_dir = data.config.output_dir;
+                }
+            }
+        }
+    }
+    
+    size_t size = 0;
+    if (index < 0) {
+        int fd = transcoder ? transcoder->open_segment(segment_name, size) : -1;
+        if (fd >= 0) {
+            served->record(size);
+        }
+        done(fd, size);
+        return;
+    }
+    
+    int fd = FFmpegTranscoder::open_segment_file(output_dir, segment_name, size);
+    if (fd < 0) {
+        // 尚未产出：由分片线程登记产出并等待
+        impl_->post_request({stream_id, segment_name, index, std::move(done)});
+        return;
+    }
+    served->record(size);
+    if (!segment_ready) {
+        impl_->mark_ready(stream_id, served, index);
+    }
+    if (!window_ready) {
+        impl_->post_request({stream_id, segment_name, index, nullptr});
     }
-    return {};
+    done(fd, size);
+}
+
+int HLSProcessor::open_segment(const std::string& stream_id,
+                               const std::string& segment_name,
+                               size_t& size) const {
+    auto result = std::make_shared<std::promise<std::pair<int, size_t>>>();
+    std::future<std::pair<int, size_t>> opened = result->get_future();
+    open_segment_async(stream_id, segment_name, [result](int fd, size_t segment_size) {
+        result->set_value({fd, segment_size});
+    });
+    std::pair<int, size_t> segment = opened.get();
+    size = segment.second;
+    return segment.first;
 }
 
 std::vector<std::string> HLSProcessor::list_streams() const {
@@ -209,26 +859,64 @@ std::vector<std::string> HLSProcessor::list_streams() const {
 }
 
 bool HLSProcessor::stop_stream(const std::string& stream_id) {
+    // 先把流从表中移出，撤任务、等待转码线程退出与删除目录都在锁外
+    Impl::StreamData data;
+    {
+        std::lock_guard<std::mutex> lock(impl_->mutex);
+        auto it = impl_->streams.find(stream_id);
+        if (it == impl_->streams.end()) {
+            return false;
+        }
+        data = std::move(it->second);
+        impl_->streams.erase(it);
+        impl_->busy.insert(stream_id);
+    }
+    
+    // 排队中的任务直接撤下；已放行的转码器停止后由结束回调归还预算
+    Impl::cancel_jobs(data);
+    Impl::stop_transcoders(data);
+    impl_->expire_waiters(stream_id);
+    
+    // 清理目录
+    std::string output_dir = "../media/hls/streams/" + stream_id;
+    try {
+        if (fs::exists(output_dir)) {
+            fs::remove_all(output_dir);
+        }
+    } catch (...) {
+        // 忽略清理错误
+    }
+    
+    {
+        std::lock_guard<std::mutex> lock(impl_->mutex);
+        impl_->busy.erase(stream_id);
+    }
+    impl_->busy_cv.notify_all();
+    
+    impl_->transcoders_stopped++;
+    LOG_INFO("[HLS] 流已停止: " << stream_id);
+    return true;
+}
+
+HLSMetrics HLSProcessor::get_metrics() const {
+    HLSMetrics metrics;
+    metrics.transcoders_started = impl_->transcoders_started.load();
+    metrics.transcoders_failed = impl_->transcoders_failed.load();
+    metrics.transcoders_stopped = impl_->transcoders_stopped.load();
+    
     std::lock_guard<std::mutex> lock(impl_->mutex);
-    auto it = impl_->streams.find(stream_id);
-    if (it != impl_->streams.end()) {
-        if (it->second.transcoder) {
-            it->second.transcoder->stop();
+    for (const auto& pair : impl_->streams) {
+        metrics.streams.push_back({pair.first, pair.second.media_id,
+                                   pair.second.served->segments.load(std::memory_order_relaxed),
+                                   pair.second.served->bytes.load(std::memory_order_relaxed)});
+        if (pair.second.transcoder && pair.second.transcoder->is_running()) {
+            metrics.transcoders_active++;
         }
-        
-        // 清理目录
-        std::string output_dir = "../media/hls/streams/" + stream_id;
-        try {
-            if (fs::exists(output_dir)) {
-                fs::remove_all(output_dir);
+        for (const auto& producer : pair.second.producers) {
+            if (producer.transcoder->is_running()) {
+                metrics.transcoders_active++;
             }
-        } catch (...) {
-            // 忽略清理错误
         }
-        
-        impl_->streams.erase(it);
-        std::cout << "[HLS] 流已停止: " << stream_id << std::endl;
-        return true;
     }
-    return false;
-}
\ No newline at end of file
+    return metrics;
+}
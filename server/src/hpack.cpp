@@ -0,0 +1,422 @@
+#include "hpack.h"
+#include <algorithm>
+
+const size_t HpackDynamicTable::ENTRY_OVERHEAD;
+const size_t HpackDynamicTable::DEFAULT_SIZE;
+
+namespace {
+
+struct StaticEntry {
+    const char* name;
+    const char* value;
+};
+
+// RFC 7541 附录 A，下标 0 对应索引 1
+const StaticEntry STATIC_TABLE[] = {
+    {":authority", ""}, {":method", "GET"}, {":method", "POST"}, {":path", "/"},
+    {":path", "/index.html"}, {":scheme", "http"}, {":scheme", "https"}, {":status", "200"},
+    {":status", "204"}, {":status", "206"}, {":status", "304"}, {":status", "400"},
+    {":status", "404"}, {":status", "500"}, {"accept-charset", ""}, {"accept-encoding", "gzip, deflate"},
+    {"accept-language", ""}, {"accept-ranges", ""}, {"accept", ""}, {"access-control-allow-origin", ""},
+    {"age", ""}, {"allow", ""}, {"authorization", ""}, {"cache-control", ""},
+    {"content-disposition", ""}, {"content-encoding", ""}, {"content-language", ""}, {"content-length", ""},
+    {"content-location", ""}, {"content-range", ""}, {"content-type", ""}, {"cookie", ""},
+    {"date", ""}, {"etag", ""}, {"expect", ""}, {"expires", ""},
+    {"from", ""}, {"host", ""}, {"if-match", ""}, {"if-modified-since", ""},
+    {"if-none-match", ""}, {"if-range", ""}, {"if-unmodified-since", ""}, {"last-modified", ""},
+    {"link", ""}, {"location", ""}, {"max-forwards", ""}, {"proxy-authenticate", ""},
+    {"proxy-authorization", ""}, {"range", ""}, {"referer", ""}, {"refresh", ""},
+    {"retry-after", ""}, {"server", ""}, {"set-cookie", ""}, {"strict-transport-security", ""},
+    {"transfer-encoding", ""}, {"user-agent", ""}, {"vary", ""}, {"via", ""},
+    {"www-authenticate", ""},
+};
+const size_t STATIC_TABLE_SIZE = sizeof(STATIC_TABLE) / sizeof(STATIC_TABLE[0]);
+
+struct HuffmanCode {
+    uint32_t code;
+    uint8_t bits;
+};
+
+// RFC 7541 附录 B，下标为符号，256 为 EOS
+const HuffmanCode HUFFMAN_CODES[257] = {
+    {0x1ff8, 13}, {0x7fffd8, 23}, {0xfffffe2, 28}, {0xfffffe3, 28}, {0xfffffe4, 28}, {0xfffffe5, 28},
+    {0xfffffe6, 28}, {0xfffffe7, 28}, {0xfffffe8, 28}, {0xffffea, 24}, {0x3ffffffc, 30}, {0xfffffe9, 28},
+    {0xfffffea, 28}, {0x3ffffffd, 30}, {0xfffffeb, 28}, {0xfffffec, 28}, {0xfffffed, 28}, {0xfffffee, 28},
+    {0xfffffef, 28}, {0xffffff0, 28}, {0xffffff1, 28}, {0xffffff2, 28}, {0x3ffffffe, 30}, {0xffffff3, 28},
+    {0xffffff4, 28}, {0xffffff5, 28}, {0xffffff6, 28}, {0xffffff7, 28}, {0xffffff8, 28}, {0xffffff9, 28},
+    {0xffffffa, 28}, {0xffffffb, 28}, {0x14, 6}, {0x3f8, 10}, {0x3f9, 10}, {0xffa, 12},
+    {0x1ff9, 13}, {0x15, 6}, {0xf8, 8}, {0x7fa, 11}, {0x3fa, 10}, {0x3fb, 10},
+    {0xf9, 8}, {0x7fb, 11}, {0xfa, 8}, {0x16, 6}, {0x17, 6}, {0x18, 6},
+    {0x0, 5}, {0x1, 5}, {0x2, 5}, {0x19, 6}, {0x1a, 6}, {0x1b, 6},
+    {0x1c, 6}, {0x1d, 6}, {0x1e, 6}, {0x1f, 6}, {0x5c, 7}, {0xfb, 8},
+    {0x7ffc, 15}, {0x20, 6}, {0xffb, 12}, {0x3fc, 10}, {0x1ffa, 13}, {0x21, 6},
+    {0x5d, 7}, {0x5e, 7}, {0x5f, 7}, {0x60, 7}, {0x61, 7}, {0x62, 7},
+    {0x63, 7}, {0x64, 7}, {0x65, 7}, {0x66, 7}, {0x67, 7}, {0x68, 7},
+    {0x69, 7}, {0x6a, 7}, {0x6b, 7}, {0x6c, 7}, {0x6d, 7}, {0x6e, 7},
+    {0x6f, 7}, {0x70, 7}, {0x71, 7}, {0x72, 7}, {0xfc, 8}, {0x73, 7},
+    {0xfd, 8}, {0x1ffb, 13}, {0x7fff0, 19}, {0x1ffc, 13}, {0x3ffc, 14}, {0x22, 6},
+    {0x7ffd, 15}, {0x3, 5}, {0x23, 6}, {0x4, 5}, {0x24, 6}, {0x5, 5},
+    {0x25, 6}, {0x26, 6}, {0x27, 6}, {0x6, 5}, {0x74, 7}, {0x75, 7},
+    {0x28, 6}, {0x29, 6}, {0x2a, 6}, {0x7, 5}, {0x2b, 6}, {0x76, 7},
+    {0x2c, 6}, {0x8, 5}, {0x9, 5}, {0x2d, 6}, {0x77, 7}, {0x78, 7},
+    {0x79, 7}, {0x7a, 7}, {0x7b, 7}, {0x7ffe, 15}, {0x7fc, 11}, {0x3ffd, 14},
+    {0x1ffd, 13}, {0xffffffc, 28}, {0xfffe6, 20}, {0x3fffd2, 22}, {0xfffe7, 20}, {0xfffe8, 20},
+    {0x3fffd3, 22}, {0x3fffd4, 22}, {0x3fffd5, 22}, {0x7fffd9, 23}, {0x3fffd6, 22}, {0x7fffda, 23},
+    {0x7fffdb, 23}, {0x7fffdc, 23}, {0x7fffdd, 23}, {0x7fffde, 23}, {0xffffeb, 24}, {0x7fffdf, 23},
+    {0xffffec, 24}, {0xffffed, 24}, {0x3fffd7, 22}, {0x7fffe0, 23}, {0xffffee, 24}, {0x7fffe1, 23},
+    {0x7fffe2, 23}, {0x7fffe3, 23}, {0x7fffe4, 23}, {0x1fffdc, 21}, {0x3fffd8, 22}, {0x7fffe5, 23},
+    {0x3fffd9, 22}, {0x7fffe6, 23}, {0x7fffe7, 23}, {0xffffef, 24}, {0x3fffda, 22}, {0x1fffdd, 21},
+    {0xfffe9, 20}, {0x3fffdb, 22}, {0x3fffdc, 22}, {0x7fffe8, 23}, {0x7fffe9, 23}, {0x1fffde, 21},
+    {0x7fffea, 23}, {0x3fffdd, 22}, {0x3fffde, 22}, {0xfffff0, 24}, {0x1fffdf, 21}, {0x3fffdf, 22},
+    {0x7fffeb, 23}, {0x7fffec, 23}, {0x1fffe0, 21}, {0x1fffe1, 21}, {0x3fffe0, 22}, {0x1fffe2, 21},
+    {0x7fffed, 23}, {0x3fffe1, 22}, {0x7fffee, 23}, {0x7fffef, 23}, {0xfffea, 20}, {0x3fffe2, 22},
+    {0x3fffe3, 22}, {0x3fffe4, 22}, {0x7ffff0, 23}, {0x3fffe5, 22}, {0x3fffe6, 22}, {0x7ffff1, 23},
+    {0x3ffffe0, 26}, {0x3ffffe1, 26}, {0xfffeb, 20}, {0x7fff1, 19}, {0x3fffe7, 22}, {0x7ffff2, 23},
+    {0x3fffe8, 22}, {0x1ffffec, 25}, {0x3ffffe2, 26}, {0x3ffffe3, 26}, {0x3ffffe4, 26}, {0x7ffffde, 27},
+    {0x7ffffdf, 27}, {0x3ffffe5, 26}, {0xfffff1, 24}, {0x1ffffed, 25}, {0x7fff2, 19}, {0x1fffe3, 21},
+    {0x3ffffe6, 26}, {0x7ffffe0, 27}, {0x7ffffe1, 27}, {0x3ffffe7, 26}, {0x7ffffe2, 27}, {0xfffff2, 24},
+    {0x1fffe4, 21}, {0x1fffe5, 21}, {0x3ffffe8, 26}, {0x3ffffe9, 26}, {0xffffffd, 28}, {0x7ffffe3, 27},
+    {0x7ffffe4, 27}, {0x7ffffe5, 27}, {0xfffec, 20}, {0xfffff3, 24}, {0xfffed, 20}, {0x1fffe6, 21},
+    {0x3fffe9, 22}, {0x1fffe7, 21}, {0x1fffe8, 21}, {0x7ffff3, 23}, {0x3fffea, 22}, {0x3fffeb, 22},
+    {0x1ffffee, 25}, {0x1ffffef, 25}, {0xfffff4, 24}, {0xfffff5, 24}, {0x3ffffea, 26}, {0x7ffff4, 23},
+    {0x3ffffeb, 26}, {0x7ffffe6, 27}, {0x3ffffec, 26}, {0x3ffffed, 26}, {0x7ffffe7, 27}, {0x7ffffe8, 27},
+    {0x7ffffe9, 27}, {0x7ffffea, 27}, {0x7ffffeb, 27}, {0xffffffe, 28}, {0x7ffffec, 27}, {0x7ffffed, 27},
+    {0x7ffffee, 27}, {0x7ffffef, 27}, {0x7fffff0, 27}, {0x3ffffee, 26}, {0x3fffffff, 30},
+};
+const int HUFFMAN_EOS = 256;
+
+// 解码用的二叉树，首次使用时由码表构造。叶子的 symbol >= 0
+struct HuffmanTree {
+    struct Node {
+        int16_t child[2] = {-1, -1};
+        int16_t symbol = -1;
+    };
+    std::vector<Node> nodes;
+
+    HuffmanTree() {
+        nodes.reserve(2 * 257);
+        nodes.emplace_back();
+        for (int symbol = 0; symbol <= HUFFMAN_EOS; ++symbol) {
+            const HuffmanCode& entry = HUFFMAN_CODES[symbol];
+            size_t node = 0;
+            for (int bit = entry.bits - 1; bit >= 0; --bit) {
+                int branch = (entry.code >> bit) & 1;
+                if (nodes[node].child[branch] < 0) {
+                    nodes[node].child[branch] = static_cast<int16_t>(nodes.size());
+                    nodes.emplace_back();
+                }
+                node = static_cast<size_t>(nodes[node].child[branch]);
+            }
+            nodes[node].symbol = static_cast<int16_t>(symbol);
+        }
+    }
+};
+
+const HuffmanTree& huffman_tree() {
+    static const HuffmanTree tree;
+    return tree;
+}
+
+size_t huffman_length(std::string_view text) {
+    uint64_t bits = 0;
+    for (unsigned char c : text) {
+        bits += HUFFMAN_CODES[c].bits;
+    }
+    return static_cast<size_t>((bits + 7) / 8);
+}
+
+void encode_huffman(std::string& out, std::string_view text) {
+    uint64_t buffer = 0;
+    int pending = 0;
+    for (unsigned char c : text) {
+        const HuffmanCode& entry = HUFFMAN_CODES[c];
+        buffer = (buffer << entry.bits) | entry.code;
+        pending += entry.bits;
+        while (pending >= 8) {
+            pending -= 8;
+            out += static_cast<char>(buffer >> pending);
+        }
+    }
+    if (pending > 0) {
+        // 末尾用 EOS 的高位（全 1）补齐到字节边界
+        out += static_cast<char>((buffer << (8 - pending)) | (0xff >> pending));
+    }
+}
+
+bool decode_string(const uint8_t* data, size_t size, size_t& pos, size_t limit, std::string& out) {
+    if (pos >= size) {
+        return false;
+    }
+    bool huffman = (data[pos] & 0x80) != 0;
+    uint64_t length = 0;
+    if (!hpack::decode_integer(data, size, pos, 7, length) || length > size - pos || length > limit) {
+        return false;
+    }
+    out.clear();
+    if (huffman) {
+        if (!hpack::decode_huffman(data + pos, static_cast<size_t>(length), out)) {
+            return false;
+        }
+    } else {
+        out.assign(reinterpret_cast<const char*>(data + pos), static_cast<size_t>(length));
+    }
+    pos += static_cast<size_t>(length);
+    return true;
+}
+
+} // namespace
+
+namespace hpack {
+
+void encode_integer(std::string& out, uint64_t value, int prefix_bits, uint8_t first_byte_flags) {
+    uint64_t max_prefix = (uint64_t(1) << prefix_bits) - 1;
+    if (value < max_prefix) {
+        out += static_cast<char>(first_byte_flags | value);
+        return;
+    }
+    out += static_cast<char>(first_byte_flags | max_prefix);
+    value -= max_prefix;
+    while (value >= 128) {
+        out += static_cast<char>((value & 0x7f) | 0x80);
+        value >>= 7;
+    }
+    out += static_cast<char>(value);
+}
+
+bool decode_integer(const uint8_t* data, size_t size, size_t& pos, int prefix_bits, uint64_t& value) {
+    if (pos >= size) {
+        return false;
+    }
+    uint64_t max_prefix = (uint64_t(1) << prefix_bits) - 1;
+    value = data[pos++] & max_prefix;
+    if (value < max_prefix) {
+        return true;
+    }
+    // 实际用到的整数（索引、长度、表大小）都远小于 2^32，更长的编码按错误处理
+    for (int shift = 0; shift < 32; shift += 7) {
+        if (pos >= size) {
+            return false;
+        }
+        uint8_t byte = data[pos++];
+        value += static_cast<uint64_t>(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void encode_string(std::string& out, std::string_view text) {
+    size_t huffman_size = huffman_length(text);
+    if (huffman_size < text.size()) {
+        encode_integer(out, huffman_size, 7, 0x80);
+        encode_huffman(out, text);
+    } else {
+        encode_integer(out, text.size(), 7, 0x00);
+        out.append(text.data(), text.size());
+    }
+}
+
+bool decode_huffman(const uint8_t* data, size_t size, std::string& out) {
+    const HuffmanTree& tree = huffman_tree();
+    size_t node = 0;
+    int depth = 0;          // 当前未完成码字的位数
+    bool all_ones = true;   // 未完成码字是否全为 1（合法的填充）
+    for (size_t i = 0; i < size; ++i) {
+        for (int bit = 7; bit >= 0; --bit) {
+            int branch = (data[i] >> bit) & 1;
+            int16_t next = tree.nodes[node].child[branch];
+            if (next < 0) {
+                return false;
+            }
+            node = static_cast<size_t>(next);
+            ++depth;
+            all_ones = all_ones && branch == 1;
+            int16_t symbol = tree.nodes[node].symbol;
+            if (symbol >= 0) {
+                if (symbol == HUFFMAN_EOS) {
+                    return false;  // 字符串中出现 EOS 是解码错误
+                }
+                out += static_cast<char>(symbol);
+                node = 0;
+                depth = 0;
+                all_ones = true;
+            }
+        }
+    }
+    // 填充必须是 EOS 的前缀（全 1）且不超过 7 位
+    return depth <= 7 && all_ones;
+}
+
+} // namespace hpack
+
+void HpackDynamicTable::set_max_size(size_t size) {
+    max_size_ = size;
+    evict_to(max_size_);
+}
+
+void HpackDynamicTable::evict_to(size_t limit) {
+    while (size_ > limit && !entries_.empty()) {
+        const auto& oldest = entries_.back();
+        size_ -= oldest.first.size() + oldest.second.size() + ENTRY_OVERHEAD;
+        entries_.pop_back();
+    }
+}
+
+void HpackDynamicTable::add(std::string_view name, std::string_view value) {
+    size_t entry_size = name.size() + value.size() + ENTRY_OVERHEAD;
+    if (entry_size > max_size_) {
+        // 大于整张表的条目：清空表，条目本身不加入
+        evict_to(0);
+        return;
+    }
+    evict_to(max_size_ - entry_size);
+    entries_.emplace_front(std::string(name), std::string(value));
+    size_ += entry_size;
+}
+
+HpackDecoder::HpackDecoder(size_t max_header_list_size)
+    : max_header_list_size_(max_header_list_size) {
+}
+
+bool HpackDecoder::lookup(uint64_t index, std::string& name, std::string* value) const {
+    if (index == 0) {
+        return false;
+    }
+    if (index <= STATIC_TABLE_SIZE) {
+        const StaticEntry& entry = STATIC_TABLE[index - 1];
+        name = entry.name;
+        if (value) {
+            *value = entry.value;
+        }
+        return true;
+    }
+    size_t dynamic = static_cast<size_t>(index - STATIC_TABLE_SIZE - 1);
+    if (dynamic >= table_.count()) {
+        return false;
+    }
+    const auto& entry = table_.at(dynamic);
+    name = entry.first;
+    if (value) {
+        *value = entry.second;
+    }
+    return true;
+}
+
+bool HpackDecoder::decode(const uint8_t* data, size_t size, HpackHeaderList& headers) {
+    size_t pos = 0;
+    size_t list_size = 0;
+    bool header_seen = false;
+    std::string name;
+    std::string value;
+
+    while (pos < size) {
+        uint8_t first = data[pos];
+        if (first & 0x80) {
+            // 索引头部字段
+            uint64_t index = 0;
+            if (!hpack::decode_integer(data, size, pos, 7, index) || !lookup(index, name, &value)) {
+                return false;
+            }
+        } else if ((first & 0xe0) == 0x20) {
+            // 动态表大小更新，只能出现在头部块开头
+            uint64_t new_size = 0;
+            if (header_seen || !hpack::decode_integer(data, size, pos, 5, new_size) || new_size > max_table_size_) {
+                return false;
+            }
+            table_.set_max_size(static_cast<size_t>(new_size));
+            continue;
+        } else {
+            // 字面量：0x40 加入动态表，0x00 / 0x10 不加入（后者要求中间节点也不得索引）
+            bool incremental = (first & 0x40) != 0;
+            int prefix_bits = incremental ? 6 : 4;
+            uint64_t index = 0;
+            if (!hpack::decode_integer(data, size, pos, prefix_bits, index)) {
+                return false;
+            }
+            if (index != 0) {
+                if (!lookup(index, name, nullptr)) {
+                    return false;
+                }
+            } else if (!decode_string(data, size, pos, max_header_list_size_, name)) {
+                return false;
+            }
+            if (!decode_string(data, size, pos, max_header_list_size_, value)) {
+                return false;
+            }
+            if (incremental) {
+                table_.add(name, value);
+            }
+        }
+
+        header_seen = true;
+        list_size += name.size() + value.size() + HpackDynamicTable::ENTRY_OVERHEAD;
+        if (list_size > max_header_list_size_) {
+            return false;
+        }
+        headers.emplace_back(std::move(name), std::move(value));
+        name.clear();
+        value.clear();
+    }
+    return true;
+}
+
+void HpackEncoder::set_max_table_size(size_t size) {
+    size_t effective = std::min(size, HpackDynamicTable::DEFAULT_SIZE);
+    if (effective == table_.max_size()) {
+        return;
+    }
+    min_size_since_update_ = std::min(min_size_since_update_, effective);
+    table_.set_max_size(effective);
+    size_update_pending_ = true;
+}
+
+void HpackEncoder::begin_block(std::string& out) {
+    if (!size_update_pending_) {
+        return;
+    }
+    // 两次头部块之间先缩小再放大时，需要先通告最小值，保证对端同样逐出了条目
+    if (min_size_since_update_ < table_.max_size()) {
+        hpack::encode_integer(out, min_size_since_update_, 5, 0x20);
+    }
+    hpack::encode_integer(out, table_.max_size(), 5, 0x20);
+    size_update_pending_ = false;
+    min_size_since_update_ = table_.max_size();
+}
+
+void HpackEncoder::encode(std::string& out, std::string_view name, std::string_view value, bool indexable) {
+    uint64_t name_index = 0;
+    for (size_t i = 0; i < STATIC_TABLE_SIZE; ++i) {
+        if (name == STATIC_TABLE[i].name) {
+            if (value == STATIC_TABLE[i].value) {
+                hpack::encode_integer(out, i + 1, 7, 0x80);
+                return;
+            }
+            if (name_index == 0) {
+                name_index = i + 1;
+            }
+        }
+    }
+    for (size_t i = 0; i < table_.count(); ++i) {
+        const auto& entry = table_.at(i);
+        if (entry.first == name) {
+            if (entry.second == value) {
+                hpack::encode_integer(out, STATIC_TABLE_SIZE + 1 + i, 7, 0x80);
+                return;
+            }
+            if (name_index == 0) {
+                name_index = STATIC_TABLE_SIZE + 1 + i;
+            }
+        }
+    }
+
+    bool add = indexable && name.size() + value.size() + HpackDynamicTable::ENTRY_OVERHEAD <= table_.max_size();
+    hpack::encode_integer(out, name_index, add ? 6 : 4, add ? 0x40 : 0x00);
+    if (name_index == 0) {
+        hpack::encode_string(out, name);
+    }
+    hpack::encode_string(out, value);
+    if (add) {
+        table_.add(name, value);
+    }
+}
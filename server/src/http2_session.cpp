@@ -0,0 +1,1140 @@
+#include "http2_session.h"
+#include "logger.h"
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cstring>
+#include <limits>
+#include <strings.h>
+#include <unistd.h>
+
+const size_t Http2Session::PREFACE_SIZE;
+const size_t Http2Session::FRAME_HEADER_SIZE;
+const uint32_t Http2Session::MAX_FRAME_SIZE;
+const uint32_t Http2Session::MAX_CONCURRENT_STREAMS;
+const int32_t Http2Session::STREAM_RECV_WINDOW;
+const int32_t Http2Session::CONNECTION_RECV_WINDOW;
+const size_t Http2Session::MAX_PRIORITY_NODES;
+const uint16_t Http2Session::DEFAULT_WEIGHT;
+
+namespace {
+
+const char PREFACE[] = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+
+enum FrameType : uint8_t {
+    FRAME_DATA = 0x0,
+    FRAME_HEADERS = 0x1,
+    FRAME_PRIORITY = 0x2,
+    FRAME_RST_STREAM = 0x3,
+    FRAME_SETTINGS = 0x4,
+    FRAME_PUSH_PROMISE = 0x5,
+    FRAME_PING = 0x6,
+    FRAME_GOAWAY = 0x7,
+    FRAME_WINDOW_UPDATE = 0x8,
+    FRAME_CONTINUATION = 0x9,
+};
+
+enum FrameFlags : uint8_t {
+    FLAG_END_STREAM = 0x1,
+    FLAG_ACK = 0x1,
+    FLAG_END_HEADERS = 0x4,
+    FLAG_PADDED = 0x8,
+    FLAG_PRIORITY = 0x20,
+};
+
+enum SettingId : uint16_t {
+    SETTINGS_HEADER_TABLE_SIZE = 0x1,
+    SETTINGS_ENABLE_PUSH = 0x2,
+    SETTINGS_MAX_CONCURRENT_STREAMS = 0x3,
+    SETTINGS_INITIAL_WINDOW_SIZE = 0x4,
+    SETTINGS_MAX_FRAME_SIZE = 0x5,
+    SETTINGS_MAX_HEADER_LIST_SIZE = 0x6,
+};
+
+const int64_t MAX_WINDOW = 0x7fffffff;
+
+uint32_t read_u32(const uint8_t* p) {
+    return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+}
+
+void append_u32(std::string& out, uint32_t value) {
+    out += static_cast<char>(value >> 24);
+    out += static_cast<char>(value >> 16);
+    out += static_cast<char>(value >> 8);
+    out += static_cast<char>(value);
+}
+
+void append_setting(std::string& out, uint16_t id, uint32_t value) {
+    out += static_cast<char>(id >> 8);
+    out += static_cast<char>(id);
+    append_u32(out, value);
+}
+
+// HTTP2-Settings 头部的 base64url（无填充）解码
+bool decode_base64url(std::string_view text, std::string& out) {
+    uint32_t buffer = 0;
+    int bits = 0;
+    for (char c : text) {
+        int value;
+        if (c >= 'A' && c <= 'Z') value = c - 'A';
+        else if (c >= 'a' && c <= 'z') value = c - 'a' + 26;
+        else if (c >= '0' && c <= '9') value = c - '0' + 52;
+        else if (c == '-' || c == '+') value = 62;
+        else if (c == '_' || c == '/') value = 63;
+        else if (c == '=') break;
+        else return false;
+        buffer = (buffer << 6) | static_cast<uint32_t>(value);
+        bits += 6;
+        if (bits >= 8) {
+            bits -= 8;
+            out += static_cast<char>((buffer >> bits) & 0xff);
+        }
+    }
+    return true;
+}
+
+bool has_token(const std::string* header, std::string_view token) {
+    if (!header) {
+        return false;
+    }
+    std::string_view list = *header;
+    while (!list.empty()) {
+        size_t comma = list.find(',');
+        std::string_view item = list.substr(0, comma);
+        while (!item.empty() && (item.front() == ' ' || item.front() == '\t')) item.remove_prefix(1);
+        while (!item.empty() && (item.back() == ' ' || item.back() == '\t')) item.remove_suffix(1);
+        if (item.size() == token.size() && strncasecmp(item.data(), token.data(), token.size()) == 0) {
+            return true;
+        }
+        if (comma == std::string_view::npos) {
+            break;
+        }
+        list.remove_prefix(comma + 1);
+    }
+    return false;
+}
+
+// HTTP/2 禁止的逐跳头部：出现在请求中视为畸形，出现在响应中直接去掉
+bool is_connection_header(std::string_view name) {
+    return name == "connection" || name == "keep-alive" || name == "proxy-connection" ||
+           name == "transfer-encoding" || name == "upgrade";
+}
+
+// 每个响应取值都不同的头部不进入 HPACK 动态表，避免把有用的条目挤出去
+bool is_volatile_header(std::string_view name) {
+    return name == "content-length" || name == "etag" || name == "last-modified" || name == "date" ||
+           name == "content-range" || name == "set-cookie" || name == "age";
+}
+
+} // namespace
+
+Http2Session::Http2Session(const HttpParser::Limits& limits)
+    : limits_(limits),
+      decoder_(limits.max_header_size) {
+    Stream& root = streams_[0];
+    root.id = 0;
+
+    // 服务器连接前言：SETTINGS，随后把连接级接收窗口放大到 CONNECTION_RECV_WINDOW
+    write_frame_header(control_, 3 * 6, FRAME_SETTINGS, 0, 0);
+    append_setting(control_, SETTINGS_MAX_CONCURRENT_STREAMS, MAX_CONCURRENT_STREAMS);
+    append_setting(control_, SETTINGS_INITIAL_WINDOW_SIZE, static_cast<uint32_t>(STREAM_RECV_WINDOW));
+    append_setting(control_, SETTINGS_MAX_HEADER_LIST_SIZE, static_cast<uint32_t>(limits.max_header_size));
+    queue_window_update(0, static_cast<uint32_t>(CONNECTION_RECV_WINDOW - connection_recv_window_));
+    connection_recv_window_ = CONNECTION_RECV_WINDOW;
+}
+
+bool Http2Session::matches_preface(const char* data, size_t size) {
+    return size > 0 && memcmp(data, PREFACE, std::min(size, PREFACE_SIZE)) == 0;
+}
+
+bool Http2Session::is_upgrade_request(const HttpRequest& request) {
+    return request.version == "HTTP/1.1" && request.body.empty() &&
+           has_token(request.get_header("Upgrade"), "h2c") &&
+           has_token(request.get_header("Connection"), "upgrade") &&
+           request.get_header("HTTP2-Settings") != nullptr;
+}
+
+bool Http2Session::start_upgrade(const HttpRequest& request) {
+    std::string payload;
+    const std::string* settings = request.get_header("HTTP2-Settings");
+    if (!settings || !decode_base64url(*settings, payload) || payload.size() % 6 != 0) {
+        return false;
+    }
+    // 101 响应即是对这些设置的确认，不需要 SETTINGS ACK
+    if (apply_settings(reinterpret_cast<const uint8_t*>(payload.data()), payload.size()) != ErrorCode::NoError) {
+        return false;
+    }
+
+    Stream& stream = priority_node(1);
+    stream.state = StreamState::HalfClosedRemote;
+    stream.request = request;
+    stream.request.version = "HTTP/2.0";
+    stream.send_window = peer_initial_window_;
+    last_stream_id_ = 1;
+    ++open_streams_;
+    ready_.push_back(1);
+    return true;
+}
+
+size_t Http2Session::receive(const char* data, size_t size) {
+    if (closing_) {
+        return size;
+    }
+
+    size_t pos = 0;
+    if (!preface_received_) {
+        if (size < PREFACE_SIZE) {
+            // 升级后客户端前言可能尚未到达，缓冲区为空
+            if (size > 0 && !matches_preface(data, size)) {
+                connection_error(ErrorCode::ProtocolError, "连接前言错误");
+                return size;
+            }
+            return 0;
+        }
+        if (memcmp(data, PREFACE, PREFACE_SIZE) != 0) {
+            connection_error(ErrorCode::ProtocolError, "连接前言错误");
+            return size;
+        }
+        preface_received_ = true;
+        pos = PREFACE_SIZE;
+    }
+
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(data);
+    while (!closing_ && size - pos >= FRAME_HEADER_SIZE) {
+        const uint8_t* header = bytes + pos;
+        size_t length = (size_t(header[0]) << 16) | (size_t(header[1]) << 8) | size_t(header[2]);
+        uint8_t type = header[3];
+        uint8_t flags = header[4];
+        uint32_t stream_id = read_u32(header + 5) & 0x7fffffff;
+
+        if (length > MAX_FRAME_SIZE) {
+            connection_error(ErrorCode::FrameSizeError, "帧超过 SETTINGS_MAX_FRAME_SIZE");
+            break;
+        }
+        if (size - pos < FRAME_HEADER_SIZE + length) {
+            break;
+        }
+        pos += FRAME_HEADER_SIZE + length;
+        handle_frame(type, flags, stream_id, header + FRAME_HEADER_SIZE, length);
+    }
+    return closing_ ? size : pos;
+}
+
+void Http2Session::handle_frame(uint8_t type, uint8_t flags, uint32_t stream_id, const uint8_t* payload,
+                                size_t length) {
+    if (!settings_received_ && (type != FRAME_SETTINGS || (flags & FLAG_ACK))) {
+        connection_error(ErrorCode::ProtocolError, "首帧不是 SETTINGS");
+        return;
+    }
+    // 头部块必须连续：HEADERS 之后直到 END_HEADERS 只能是同一个流的 CONTINUATION
+    if (expecting_continuation_ != (type == FRAME_CONTINUATION) ||
+        (expecting_continuation_ && stream_id != continuation_stream_)) {
+        connection_error(ErrorCode::ProtocolError, "CONTINUATION 顺序错误");
+        return;
+    }
+
+    switch (type) {
+        case FRAME_DATA: on_data(flags, stream_id, payload, length); break;
+        case FRAME_HEADERS: on_headers(flags, stream_id, payload, length); break;
+        case FRAME_PRIORITY: on_priority(stream_id, payload, length); break;
+        case FRAME_RST_STREAM: on_rst_stream(stream_id, payload, length); break;
+        case FRAME_SETTINGS: on_settings(flags, stream_id, payload, length); break;
+        case FRAME_PUSH_PROMISE: connection_error(ErrorCode::ProtocolError, "客户端发送 PUSH_PROMISE"); break;
+        case FRAME_PING: on_ping(flags, stream_id, payload, length); break;
+        case FRAME_GOAWAY: on_goaway(stream_id, length); break;
+        case FRAME_WINDOW_UPDATE: on_window_update(stream_id, payload, length); break;
+        case FRAME_CONTINUATION: on_continuation(flags, payload, length); break;
+        default: break;  // 未知帧类型必须忽略
+    }
+}
+
+void Http2Session::on_data(uint8_t flags, uint32_t stream_id, const uint8_t* payload, size_t length) {
+    if (stream_id == 0) {
+        connection_error(ErrorCode::ProtocolError, "DATA 帧流 ID 为 0");
+        return;
+    }
+    const uint8_t* data = payload;
+    size_t data_length = length;
+    if (flags & FLAG_PADDED) {
+        if (length < 1 || payload[0] >= length) {
+            connection_error(ErrorCode::ProtocolError, "DATA 填充长度错误");
+            return;
+        }
+        data = payload + 1;
+        data_length = length - 1 - payload[0];
+    }
+
+    // 连接级流量控制按整帧（含填充）计算；数据立即被消费，累计到半个窗口时归还
+    if (static_cast<int64_t>(length) > connection_recv_window_) {
+        connection_error(ErrorCode::FlowControlError, "超出连接接收窗口");
+        return;
+    }
+    connection_recv_window_ -= static_cast<int64_t>(length);
+    connection_recv_unacked_ += static_cast<uint32_t>(length);
+    if (connection_recv_unacked_ >= static_cast<uint32_t>(CONNECTION_RECV_WINDOW / 2)) {
+        queue_window_update(0, connection_recv_unacked_);
+        connection_recv_window_ += connection_recv_unacked_;
+        connection_recv_unacked_ = 0;
+    }
+
+    Stream* stream = find_stream(stream_id);
+    if (!stream || stream->state != StreamState::Open) {
+        if (stream_id > last_stream_id_) {
+            connection_error(ErrorCode::ProtocolError, "DATA 帧发往空闲流");
+        } else {
+            stream_error(stream_id, ErrorCode::StreamClosed);
+        }
+        return;
+    }
+    if (static_cast<int32_t>(length) > stream->recv_window) {
+        stream_error(stream_id, ErrorCode::FlowControlError);
+        return;
+    }
+    stream->recv_window -= static_cast<int32_t>(length);
+
+    if (stream->reject_status == 0) {
+        if (stream->request.body.size() + data_length > limits_.max_body_size) {
+            stream->reject_status = 413;
+            std::string().swap(stream->request.body);
+        } else {
+            stream->request.body.append(reinterpret_cast<const char*>(data), data_length);
+        }
+    }
+
+    if (flags & FLAG_END_STREAM) {
+        finish_request(*stream);
+        return;
+    }
+    stream->recv_unacked += static_cast<uint32_t>(length);
+    if (stream->recv_unacked >= static_cast<uint32_t>(STREAM_RECV_WINDOW / 2)) {
+        queue_window_update(stream_id, stream->recv_unacked);
+        stream->recv_window += static_cast<int32_t>(stream->recv_unacked);
+        stream->recv_unacked = 0;
+    }
+}
+
+void Http2Session::on_headers(uint8_t flags, uint32_t stream_id, const uint8_t* payload, size_t length) {
+    if (stream_id == 0) {
+        connection_error(ErrorCode::ProtocolError, "HEADERS 帧流 ID 为 0");
+        return;
+    }
+    size_t begin = 0;
+    size_t padding = 0;
+    if (flags & FLAG_PADDED) {
+        if (length < 1) {
+            connection_error(ErrorCode::ProtocolError, "HEADERS 填充长度错误");
+            return;
+        }
+        padding = payload[0];
+        begin = 1;
+    }
+    PendingPriority priority;
+    if (flags & FLAG_PRIORITY) {
+        if (length < begin + 5) {
+            connection_error(ErrorCode::FrameSizeError, "HEADERS 优先级字段不完整");
+            return;
+        }
+        uint32_t dependency = read_u32(payload + begin);
+        priority.present = true;
+        priority.exclusive = (dependency & 0x80000000u) != 0;
+        priority.depends_on = dependency & 0x7fffffff;
+        priority.weight = static_cast<uint16_t>(payload[begin + 4] + 1);
+        begin += 5;
+    }
+    if (begin + padding > length) {
+        connection_error(ErrorCode::ProtocolError, "HEADERS 填充长度错误");
+        return;
+    }
+
+    header_block_.assign(reinterpret_cast<const char*>(payload + begin), length - begin - padding);
+    continuation_stream_ = stream_id;
+    continuation_end_stream_ = (flags & FLAG_END_STREAM) != 0;
+    continuation_priority_ = priority;
+    if (flags & FLAG_END_HEADERS) {
+        header_block_complete();
+    } else {
+        expecting_continuation_ = true;
+    }
+}
+
+void Http2Session::on_continuation(uint8_t flags, const uint8_t* payload, size_t length) {
+    // 头部块必须完整解码才能保持 HPACK 动态表同步，超限时只能结束整个连接
+    if (header_block_.size() + length > limits_.max_header_size) {
+        connection_error(ErrorCode::EnhanceYourCalm, "头部块过大");
+        return;
+    }
+    header_block_.append(reinterpret_cast<const char*>(payload), length);
+    if (flags & FLAG_END_HEADERS) {
+        expecting_continuation_ = false;
+        header_block_complete();
+    }
+}
+
+void Http2Session::header_block_complete() {
+    uint32_t stream_id = continuation_stream_;
+    HpackHeaderList headers;
+    if (!decoder_.decode(reinterpret_cast<const uint8_t*>(header_block_.data()), header_block_.size(), headers)) {
+        connection_error(ErrorCode::CompressionError, "HPACK 解码失败");
+        return;
+    }
+    if (stream_id % 2 == 0) {
+        connection_error(ErrorCode::ProtocolError, "客户端使用偶数流 ID");
+        return;
+    }
+
+    Stream* existing = find_stream(stream_id);
+    if (existing && existing->state == StreamState::Open) {
+        // 请求体之后的 trailers：内容不使用，只结束请求
+        if (!continuation_end_stream_) {
+            stream_error(stream_id, ErrorCode::ProtocolError);
+            return;
+        }
+        finish_request(*existing);
+        return;
+    }
+    if (stream_id <= last_stream_id_) {
+        connection_error(ErrorCode::StreamClosed, "HEADERS 帧发往已关闭的流");
+        return;
+    }
+    last_stream_id_ = stream_id;
+
+    if (continuation_priority_.present && continuation_priority_.depends_on == stream_id) {
+        stream_error(stream_id, ErrorCode::ProtocolError);
+        return;
+    }
+    if (open_streams_ + abandoned_.size() >= MAX_CONCURRENT_STREAMS) {
+        queue_rst_stream(stream_id, ErrorCode::RefusedStream);
+        return;
+    }
+
+    Stream& stream = priority_node(stream_id);
+    stream.state = StreamState::Open;
+    stream.send_window = peer_initial_window_;
+    stream.recv_window = STREAM_RECV_WINDOW;
+    ++open_streams_;
+    if (continuation_priority_.present) {
+        set_priority(stream_id, continuation_priority_.depends_on, continuation_priority_.weight,
+                     continuation_priority_.exclusive);
+    }
+
+    if (!build_request(headers, stream)) {
+        stream_error(stream_id, ErrorCode::ProtocolError);
+        return;
+    }
+    if (continuation_end_stream_) {
+        finish_request(stream);
+    }
+}
+
+bool Http2Session::build_request(HpackHeaderList& headers, Stream& stream) {
+    HttpRequest& request = stream.request;
+    request.version = "HTTP/2.0";
+    std::string path;
+    std::string authority;
+    bool has_scheme = false;
+    bool regular_seen = false;
+    std::string cookie;
+
+    for (auto& [name, value] : headers) {
+        for (char c : name) {
+            if (c >= 'A' && c <= 'Z') {
+                return false;  // 头部名必须是小写
+            }
+        }
+        if (!name.empty() && name[0] == ':') {
+            // 伪头部只能出现在普通头部之前，且各出现一次
+            if (regular_seen) {
+                return false;
+            }
+            if (name == ":method" && request.method.empty()) {
+                request.method = std::move(value);
+            } else if (name == ":path" && path.empty()) {
+                path = std::move(value);
+            } else if (name == ":scheme" && !has_scheme) {
+                has_scheme = true;
+            } else if (name == ":authority" && authority.empty()) {
+                authority = std::move(value);
+            } else {
+                return false;
+            }
+            continue;
+        }
+        regular_seen = true;
+        if (is_connection_header(name) || (name == "te" && value != "trailers")) {
+            return false;
+        }
+        if (name == "cookie") {
+            // 拆开发送的 cookie 按 HTTP/1.1 的格式合并
+            if (!cookie.empty()) {
+                cookie += "; ";
+            }
+            cookie += value;
+            continue;
+        }
+        if (name == "content-length") {
+            int64_t declared = 0;
+            auto result = std::from_chars(value.data(), value.data() + value.size(), declared);
+            if (result.ec != std::errc() || result.ptr != value.data() + value.size() || declared < 0) {
+                return false;
+            }
+            stream.declared_length = declared;
+        }
+        request.headers.emplace_back(std::move(name), std::move(value));
+    }
+
+    if (request.method.empty() || path.empty() || !has_scheme) {
+        return false;
+    }
+    if (!cookie.empty()) {
+        request.headers.emplace_back("cookie", std::move(cookie));
+    }
+    if (!authority.empty() && !request.get_header("host")) {
+        request.headers.emplace_back("host", std::move(authority));
+    }
+
+    size_t query = path.find('?');
+    request.path.assign(path, 0, query);
+    if (query != std::string::npos) {
+        request.query_params = HttpParser::parse_query_string(path.substr(query + 1));
+    }
+    return true;
+}
+
+void Http2Session::finish_request(Stream& stream) {
+    stream.state = StreamState::HalfClosedRemote;
+    if (stream.declared_length >= 0 && stream.reject_status == 0 &&
+        static_cast<size_t>(stream.declared_length) != stream.request.body.size()) {
+        stream_error(stream.id, ErrorCode::ProtocolError);
+        return;
+    }
+    if (stream.reject_status != 0) {
+        stream.dispatched = true;
+        respond(stream.id, HttpResponse::text(stream.reject_status, HttpResponse::reason_phrase(stream.reject_status)));
+        return;
+    }
+    ready_.push_back(stream.id);
+}
+
+void Http2Session::on_priority(uint32_t stream_id, const uint8_t* payload, size_t length) {
+    if (stream_id == 0) {
+        connection_error(ErrorCode::ProtocolError, "PRIORITY 帧流 ID 为 0");
+        return;
+    }
+    if (length != 5) {
+        stream_error(stream_id, ErrorCode::FrameSizeError);
+        return;
+    }
+    uint32_t dependency = read_u32(payload);
+    uint32_t depends_on = dependency & 0x7fffffff;
+    if (depends_on == stream_id) {
+        stream_error(stream_id, ErrorCode::ProtocolError);
+        return;
+    }
+
+    // 已关闭的流不再参与调度；尚未打开的流可以先建立占位节点（有上限）
+    if (!find_stream(stream_id)) {
+        if (stream_id <= last_stream_id_ || streams_.size() >= MAX_PRIORITY_NODES) {
+            return;
+        }
+        priority_node(stream_id);
+    }
+    set_priority(stream_id, depends_on, static_cast<uint16_t>(payload[4] + 1), (dependency & 0x80000000u) != 0);
+}
+
+void Http2Session::on_rst_stream(uint32_t stream_id, const uint8_t*, size_t length) {
+    if (length != 4) {
+        connection_error(ErrorCode::FrameSizeError, "RST_STREAM 长度错误");
+        return;
+    }
+    Stream* stream = find_stream(stream_id);
+    if (stream_id == 0 || (stream_id > last_stream_id_ && (!stream || stream->state == StreamState::Idle))) {
+        connection_error(ErrorCode::ProtocolError, "RST_STREAM 发往空闲流");
+        return;
+    }
+    // 对端取消（如播放器跳转后放弃旧分片）：丢弃未发完的响应，释放文件描述符
+    if (stream && stream->state != StreamState::Idle) {
+        close_stream(stream_id);
+    }
+}
+
+void Http2Session::on_settings(uint8_t flags, uint32_t stream_id, const uint8_t* payload, size_t length) {
+    if (stream_id != 0) {
+        connection_error(ErrorCode::ProtocolError, "SETTINGS 帧流 ID 不为 0");
+        return;
+    }
+    if (flags & FLAG_ACK) {
+        if (length != 0) {
+            connection_error(ErrorCode::FrameSizeError, "SETTINGS ACK 带有负载");
+        }
+        return;
+    }
+    if (length % 6 != 0) {
+        connection_error(ErrorCode::FrameSizeError, "SETTINGS 长度错误");
+        return;
+    }
+    ErrorCode error = apply_settings(payload, length);
+    if (error != ErrorCode::NoError) {
+        connection_error(error, "SETTINGS 取值非法");
+        return;
+    }
+    settings_received_ = true;
+    write_frame_header(control_, 0, FRAME_SETTINGS, FLAG_ACK, 0);
+}
+
+Http2Session::ErrorCode Http2Session::apply_settings(const uint8_t* payload, size_t length) {
+    for (size_t offset = 0; offset + 6 <= length; offset += 6) {
+        uint16_t id = static_cast<uint16_t>((payload[offset] << 8) | payload[offset + 1]);
+        uint32_t value = read_u32(payload + offset + 2);
+        switch (id) {
+            case SETTINGS_HEADER_TABLE_SIZE:
+                encoder_.set_max_table_size(value);
+                break;
+            case SETTINGS_ENABLE_PUSH:
+                if (value > 1) {
+                    return ErrorCode::ProtocolError;
+                }
+                break;
+            case SETTINGS_INITIAL_WINDOW_SIZE: {
+                if (value > MAX_WINDOW) {
+                    return ErrorCode::FlowControlError;
+                }
+                // 初始窗口的变化按差值作用于所有流的当前窗口，窗口可以因此变为负数
+                int64_t delta = static_cast<int64_t>(value) - peer_initial_window_;
+                for (auto& [id_, stream] : streams_) {
+                    if (stream.state == StreamState::Idle) {
+                        continue;
+                    }
+                    stream.send_window += delta;
+                    if (stream.send_window > MAX_WINDOW) {
+                        return ErrorCode::FlowControlError;
+                    }
+                }
+                peer_initial_window_ = value;
+                break;
+            }
+            case SETTINGS_MAX_FRAME_SIZE:
+                if (value < 16384 || value > 16777215) {
+                    return ErrorCode::ProtocolError;
+                }
+                peer_max_frame_size_ = value;
+                break;
+            default:
+                break;  // MAX_CONCURRENT_STREAMS 只约束服务器推送；未知设置忽略
+        }
+    }
+    return ErrorCode::NoError;
+}
+
+void Http2Session::on_ping(uint8_t flags, uint32_t stream_id, const uint8_t* payload, size_t length) {
+    if (length != 8) {
+        connection_error(ErrorCode::FrameSizeError, "PING 长度错误");
+        return;
+    }
+    if (stream_id != 0) {
+        connection_error(ErrorCode::ProtocolError, "PING 帧流 ID 不为 0");
+        return;
+    }
+    if (!(flags & FLAG_ACK)) {
+        write_frame_header(control_, 8, FRAME_PING, FLAG_ACK, 0);
+        control_.append(reinterpret_cast<const char*>(payload), 8);
+    }
+}
+
+void Http2Session::on_goaway(uint32_t stream_id, size_t length) {
+    if (stream_id != 0) {
+        connection_error(ErrorCode::ProtocolError, "GOAWAY 帧流 ID 不为 0");
+        return;
+    }
+    if (length < 8) {
+        connection_error(ErrorCode::FrameSizeError, "GOAWAY 长度错误");
+        return;
+    }
+    // 不再接受新流；进行中的响应发完后关闭连接
+    peer_goaway_ = true;
+}
+
+void Http2Session::on_window_update(uint32_t stream_id, const uint8_t* payload, size_t length) {
+    if (length != 4) {
+        connection_error(ErrorCode::FrameSizeError, "WINDOW_UPDATE 长度错误");
+        return;
+    }
+    int64_t increment = read_u32(payload) & 0x7fffffff;
+
+    if (stream_id == 0) {
+        if (increment == 0) {
+            connection_error(ErrorCode::ProtocolError, "WINDOW_UPDATE 增量为 0");
+            return;
+        }
+        connection_send_window_ += increment;
+        if (connection_send_window_ > MAX_WINDOW) {
+            connection_error(ErrorCode::FlowControlError, "连接发送窗口溢出");
+        }
+        return;
+    }
+
+    Stream* stream = find_stream(stream_id);
+    if (!stream || stream->state == StreamState::Idle) {
+        if (stream_id > last_stream_id_) {
+            connection_error(ErrorCode::ProtocolError, "WINDOW_UPDATE 发往空闲流");
+        }
+        return;  // 已关闭的流：对端可能还没收到 END_STREAM / RST_STREAM，忽略
+    }
+    if (increment == 0) {
+        stream_error(stream_id, ErrorCode::ProtocolError);
+        return;
+    }
+    stream->send_window += increment;
+    if (stream->send_window > MAX_WINDOW) {
+        stream_error(stream_id, ErrorCode::FlowControlError);
+    }
+}
+
+bool Http2Session::next_request(uint32_t& stream_id, HttpRequest& request) {
+    while (!ready_.empty()) {
+        uint32_t id = ready_.front();
+        ready_.pop_front();
+        Stream* stream = find_stream(id);
+        if (!stream || stream->dispatched) {
+            continue;  // 分派前已被对端重置
+        }
+        stream->dispatched = true;
+        stream_id = id;
+        request = std::move(stream->request);
+        return true;
+    }
+    return false;
+}
+
+void Http2Session::defer(uint32_t stream_id, HttpRequest request) {
+    Stream* stream = find_stream(stream_id);
+    if (!stream) {
+        return;
+    }
+    stream->dispatched = false;
+    stream->request = std::move(request);
+    ready_.push_front(stream_id);
+}
+
+void Http2Session::respond(uint32_t stream_id, HttpResponse response) {
+    Stream* stream = find_stream(stream_id);
+    if (!stream) {
+        abandoned_.erase(stream_id);
+        return;
+    }
+    if (stream->state == StreamState::Idle || stream->responded || closing_) {
+        return;
+    }
+    if (response.is_stream() && (response.status < 200 || response.status == 204 || response.status == 304)) {
+        response.producer = nullptr;  // 204 / 304 没有消息体
+    }
+    stream->response = std::move(response);
+    stream->responded = true;
+}
+
+void Http2Session::resume(uint32_t stream_id) {
+    Stream* stream = find_stream(stream_id);
+    if (stream) {
+        stream->producer_parked = false;
+    }
+}
+
+bool Http2Session::awaiting_responses() const {
+    for (const auto& [id, stream] : streams_) {
+        if ((stream.dispatched && !stream.responded) || stream.producer_parked) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool Http2Session::has_pending_data() const {
+    for (const auto& [id, stream] : streams_) {
+        if (stream.responded) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void Http2Session::connection_error(ErrorCode code, const char* reason) {
+    if (closing_) {
+        return;
+    }
+    LOG_WARN_LIMITED(10, "HTTP/2 连接错误: " << reason << " (code=" << static_cast<uint32_t>(code) << ")");
+    write_frame_header(control_, 8, FRAME_GOAWAY, 0, 0);
+    append_u32(control_, last_stream_id_);
+    append_u32(control_, static_cast<uint32_t>(code));
+    closing_ = true;
+}
+
+void Http2Session::stream_error(uint32_t stream_id, ErrorCode code) {
+    queue_rst_stream(stream_id, code);
+    Stream* stream = find_stream(stream_id);
+    if (stream && stream->state != StreamState::Idle) {
+        close_stream(stream_id);
+    }
+}
+
+Http2Session::Stream* Http2Session::find_stream(uint32_t stream_id) {
+    if (stream_id == 0) {
+        return nullptr;
+    }
+    auto it = streams_.find(stream_id);
+    return it != streams_.end() ? &it->second : nullptr;
+}
+
+void Http2Session::close_stream(uint32_t stream_id) {
+    auto it = streams_.find(stream_id);
+    if (it == streams_.end() || stream_id == 0) {
+        return;
+    }
+    Stream& stream = it->second;
+    if (stream.state != StreamState::Idle) {
+        --open_streams_;
+    }
+    if (stream.dispatched && !stream.responded) {
+        abandoned_.insert(stream_id);
+    }
+    // 子节点挂到被移除节点的父节点下，保留各自的权重
+    detach(stream);
+    Stream& parent = streams_.at(stream.parent);
+    for (uint32_t child_id : stream.children) {
+        Stream& child = streams_.at(child_id);
+        child.parent = stream.parent;
+        parent.children.push_back(child_id);
+    }
+    streams_.erase(it);
+}
+
+Http2Session::Stream& Http2Session::priority_node(uint32_t stream_id) {
+    auto inserted = streams_.try_emplace(stream_id);
+    Stream& node = inserted.first->second;
+    if (inserted.second) {
+        node.id = stream_id;
+        attach(node, 0);
+    }
+    return node;
+}
+
+void Http2Session::attach(Stream& node, uint32_t parent_id) {
+    Stream& parent = streams_.at(parent_id);
+    parent.children.push_back(node.id);
+    node.parent = parent_id;
+    node.pass = parent.child_vtime;
+}
+
+void Http2Session::detach(Stream& node) {
+    auto& siblings = streams_.at(node.parent).children;
+    siblings.erase(std::remove(siblings.begin(), siblings.end(), node.id), siblings.end());
+}
+
+bool Http2Session::is_ancestor(uint32_t ancestor, uint32_t stream_id) const {
+    while (stream_id != 0) {
+        stream_id = streams_.at(stream_id).parent;
+        if (stream_id == ancestor) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void Http2Session::set_priority(uint32_t stream_id, uint32_t depends_on, uint16_t weight, bool exclusive) {
+    Stream& node = streams_.at(stream_id);
+    if (depends_on != 0 && !find_stream(depends_on)) {
+        // 依赖不存在的流时使用默认优先级（RFC 7540 5.3.1）
+        depends_on = 0;
+        weight = DEFAULT_WEIGHT;
+        exclusive = false;
+    }
+    // 新的父节点是自己的后代：先把它移到自己原来的位置（RFC 7540 5.3.3）
+    if (depends_on != 0 && is_ancestor(stream_id, depends_on)) {
+        Stream& dependency = streams_.at(depends_on);
+        detach(dependency);
+        attach(dependency, node.parent);
+    }
+    detach(node);
+    if (exclusive) {
+        Stream& parent = streams_.at(depends_on);
+        std::vector<uint32_t> moved;
+        moved.swap(parent.children);
+        for (uint32_t child_id : moved) {
+            streams_.at(child_id).parent = stream_id;
+            node.children.push_back(child_id);
+        }
+    }
+    node.weight = weight;
+    attach(node, depends_on);
+}
+
+Http2Session::Stream* Http2Session::pick(Stream& node) {
+    // 父节点能发送时优先于其依赖者；否则在有可发送后代的子节点中取 pass 最小的
+    if (node.id != 0 && sendable(node)) {
+        return &node;
+    }
+    Stream* best = nullptr;
+    uint64_t best_pass = std::numeric_limits<uint64_t>::max();
+    for (uint32_t child_id : node.children) {
+        Stream& child = streams_.at(child_id);
+        if (child.pass >= best_pass) {
+            continue;
+        }
+        if (Stream* candidate = pick(child)) {
+            best = candidate;
+            best_pass = child.pass;
+        }
+    }
+    return best;
+}
+
+void Http2Session::charge(Stream& stream, size_t bytes) {
+    // 沿路径向上累加虚拟时间，权重越大增长越慢，兄弟节点间按权重比例分配带宽
+    uint64_t cost = (static_cast<uint64_t>(bytes) + 1) * 256;
+    for (Stream* node = &stream; node->id != 0;) {
+        Stream& parent = streams_.at(node->parent);
+        parent.child_vtime = std::max(parent.child_vtime, node->pass);
+        node->pass += cost / node->weight;
+        node = &parent;
+    }
+}
+
+size_t Http2Session::body_length(const HttpResponse& response) {
+    if (response.status < 200 || response.status == 204 || response.status == 304) {
+        return 0;
+    }
+    return response.content_length();
+}
+
+bool Http2Session::sendable(const Stream& stream) const {
+    if (!stream.responded) {
+        return false;
+    }
+    if (!stream.headers_sent) {
+        return true;  // HEADERS 不受流量控制
+    }
+    if (stream.producer_parked) {
+        return false;
+    }
+    if (stream.response.is_stream() && stream.producer_done && stream.produced_offset == stream.produced.size()) {
+        return true;  // 只差一个带 END_STREAM 的空 DATA 帧
+    }
+    return stream.send_window > 0 && connection_send_window_ > 0;
+}
+
+void Http2Session::produce(std::string& out, size_t budget) {
+    out += control_;
+    control_.clear();
+    // 升级连接在收到客户端前言之前只发送 SETTINGS：客户端切换协议后才开始读帧，
+    // 部分客户端只为 101 之后的数据预留了有限的缓冲区
+    if (closing_ || !preface_received_) {
+        return;
+    }
+
+    size_t start = out.size();
+    while (out.size() - start < budget) {
+        Stream* stream = pick(streams_.at(0));
+        if (!stream) {
+            break;
+        }
+        if (!stream->headers_sent) {
+            send_headers(*stream, out);
+        } else {
+            send_data(*stream, out);
+        }
+    }
+}
+
+void Http2Session::send_headers(Stream& stream, std::string& out) {
+    const HttpResponse& response = stream.response;
+    std::string& block = header_scratch_;
+    block.clear();
+    encoder_.begin_block(block);
+
+    char status[8];
+    int status_code = response.status >= 100 && response.status <= 999 ? response.status : 500;
+    auto status_end = std::to_chars(status, status + sizeof(status), status_code).ptr;
+    encoder_.encode(block, ":status", std::string_view(status, static_cast<size_t>(status_end - status)));
+
+    std::string name;
+    auto encode_header = [&](std::string_view header_name, std::string_view value) {
+        name.assign(header_name.data(), header_name.size());
+        std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+        if (is_connection_header(name) || name == "content-length") {
+            return;  // 分帧由 HTTP/2 负责
+        }
+        encoder_.encode(block, name, value, !is_volatile_header(name));
+    };
+
+    if (response.content_type_line) {
+        // 预生成的 "Content-Type: <type>\r\n"
+        std::string_view line = *response.content_type_line;
+        encode_header("content-type", line.substr(14, line.size() - 16));
+    }
+    for (const auto& [header_name, value] : response.headers) {
+        encode_header(header_name, value);
+    }
+    if (response.header_block) {
+        std::string_view lines = *response.header_block;
+        while (!lines.empty()) {
+            size_t end = lines.find("\r\n");
+            std::string_view line = lines.substr(0, end);
+            size_t colon = line.find(':');
+            if (colon != std::string_view::npos) {
+                std::string_view value = line.substr(colon + 1);
+                while (!value.empty() && value.front() == ' ') value.remove_prefix(1);
+                encode_header(line.substr(0, colon), value);
+            }
+            if (end == std::string_view::npos) {
+                break;
+            }
+            lines.remove_prefix(end + 2);
+        }
+    }
+
+    size_t length = body_length(response);
+    bool has_body = response.is_stream() || length > 0;
+    if (!response.is_stream() && response.status >= 200 && response.status != 204 && response.status != 304) {
+        char digits[24];
+        auto digits_end = std::to_chars(digits, digits + sizeof(digits), length).ptr;
+        encoder_.encode(block, "content-length", std::string_view(digits, static_cast<size_t>(digits_end - digits)),
+                        false);
+    }
+
+    // 头部块超过对端帧大小上限时拆成 HEADERS + CONTINUATION
+    size_t offset = 0;
+    bool first = true;
+    do {
+        size_t chunk = std::min<size_t>(block.size() - offset, peer_max_frame_size_);
+        bool last = offset + chunk == block.size();
+        uint8_t flags = static_cast<uint8_t>((last ? FLAG_END_HEADERS : 0) | (first && !has_body ? FLAG_END_STREAM : 0));
+        write_frame_header(out, chunk, first ? FRAME_HEADERS : FRAME_CONTINUATION, flags, stream.id);
+        out.append(block, offset, chunk);
+        offset += chunk;
+        first = false;
+    } while (offset < block.size());
+
+    stream.headers_sent = true;
+    charge(stream, block.size());
+    if (!has_body) {
+        finish_sending(stream);
+    }
+}
+
+void Http2Session::send_data(Stream& stream, std::string& out) {
+    HttpResponse& response = stream.response;
+    size_t window = static_cast<size_t>(std::max<int64_t>(0, std::min(stream.send_window, connection_send_window_)));
+    size_t limit = std::min<size_t>(peer_max_frame_size_, window);
+
+    size_t length = 0;
+    bool end_stream = false;
+    size_t header_pos = out.size();
+
+    if (response.is_stream()) {
+        if (stream.produced_offset == stream.produced.size() && !stream.producer_done) {
+            stream.produced.clear();
+            stream.produced_offset = 0;
+            try {
+                stream.producer_done = !response.producer(stream.produced);
+            } catch (const std::exception& e) {
+                LOG_ERROR_LIMITED(10, "流式响应生成错误: " << e.what());
+                stream_error(stream.id, ErrorCode::InternalError);
+                return;
+            }
+        }
+        size_t available = stream.produced.size() - stream.produced_offset;
+        length = std::min(limit, available);
+        end_stream = stream.producer_done && length == available;
+        if (length == 0 && !end_stream) {
+            // producer 暂无数据：挂起到 notify 为止，否则 pick() 会反复选中它，produce() 无法结束
+            if (!response.stream_wake || !resumer_) {
+                LOG_ERROR_LIMITED(10, "流式响应没有唤醒句柄却返回了空块");
+                stream_error(stream.id, ErrorCode::InternalError);
+            } else if (response.stream_wake->park([resumer = resumer_, id = stream.id] { resumer(id); })) {
+                stream.producer_parked = true;
+            }
+            return;
+        }
+        write_frame_header(out, length, FRAME_DATA, end_stream ? FLAG_END_STREAM : 0, stream.id);
+        out.append(stream.produced, stream.produced_offset, length);
+        stream.produced_offset += length;
+    } else {
+        size_t remaining = body_length(response) - stream.body_sent;
+        length = std::min(limit, remaining);
+        end_stream = length == remaining;
+        write_frame_header(out, length, FRAME_DATA, end_stream ? FLAG_END_STREAM : 0, stream.id);
+        out.resize(header_pos + FRAME_HEADER_SIZE + length);
+        if (!copy_body(response, stream.body_sent, &out[header_pos + FRAME_HEADER_SIZE], length)) {
+            // 文件读取失败，已声明的 content-length 无法兑现
+            out.resize(header_pos);
+            stream_error(stream.id, ErrorCode::InternalError);
+            return;
+        }
+        stream.body_sent += length;
+    }
+
+    stream.send_window -= static_cast<int64_t>(length);
+    connection_send_window_ -= static_cast<int64_t>(length);
+    charge(stream, length + FRAME_HEADER_SIZE);
+    if (end_stream) {
+        finish_sending(stream);
+    }
+}
+
+bool Http2Session::copy_body(const HttpResponse& response, size_t offset, char* dest, size_t length) {
+    // 消息体依次由 body、shared_body、文件区间组成
+    size_t shared_size = response.shared_body ? response.shared_body->size() : 0;
+    while (length > 0) {
+        size_t copied;
+        if (offset < response.body.size()) {
+            copied = std::min(length, response.body.size() - offset);
+            memcpy(dest, response.body.data() + offset, copied);
+        } else if (offset < response.body.size() + shared_size) {
+            size_t shared_offset = offset - response.body.size();
+            copied = std::min(length, shared_size - shared_offset);
+            memcpy(dest, response.shared_body->data() + shared_offset, copied);
+        } else {
+            size_t file_offset = offset - response.body.size() - shared_size;
+            ssize_t n = pread(response.file_fd, dest, length,
+                              response.file_offset + static_cast<off_t>(file_offset));
+            if (n <= 0) {
+                if (n < 0 && errno == EINTR) {
+                    continue;
+                }
+                return false;
+            }
+            copied = static_cast<size_t>(n);
+        }
+        dest += copied;
+        offset += copied;
+        length -= copied;
+    }
+    return true;
+}
+
+void Http2Session::finish_sending(Stream& stream) {
+    uint32_t stream_id = stream.id;
+    if (stream.state == StreamState::Open) {
+        // 响应已完整发出而请求仍在上传（如 413）：告知对端不必继续发送
+        queue_rst_stream(stream_id, ErrorCode::NoError);
+    }
+    close_stream(stream_id);
+}
+
+void Http2Session::write_frame_header(std::string& out, size_t length, uint8_t type, uint8_t flags,
+                                      uint32_t stream_id) {
+    out += static_cast<char>((length >> 16) & 0xff);
+    out += static_cast<char>((length >> 8) & 0xff);
+    out += static_cast<char>(length & 0xff);
+    out += static_cast<char>(type);
+    out += static_cast<char>(flags);
+    append_u32(out, stream_id & 0x7fffffff);
+}
+
+void Http2Session::queue_window_update(uint32_t stream_id, uint32_t increment) {
+    write_frame_header(control_, 4, FRAME_WINDOW_UPDATE, 0, stream_id);
+    append_u32(control_, increment & 0x7fffffff);
+}
+
+void Http2Session::queue_rst_stream(uint32_t stream_id, ErrorCode code) {
+    write_frame_header(control_, 4, FRAME_RST_STREAM, 0, stream_id);
+    append_u32(control_, static_cast<uint32_t>(code));
+}
@@ -0,0 +1,414 @@
+#include "http_parser.h"
+#include <algorithm>
+#include <cstring>
+#include <cctype>
+
+namespace {
+
+// 头部名称只含 ASCII，按位折叠大小写即可，避免 std::tolower 的 locale 开销
+inline char ascii_lower(char c) {
+    return (c >= 'A' && c <= 'Z') ? static_cast<char>(c | 0x20) : c;
+}
+
+bool iequals(const char* a, size_t a_len, const char* b, size_t b_len) {
+    if (a_len != b_len) {
+        return false;
+    }
+    for (size_t i = 0; i < a_len; ++i) {
+        if (ascii_lower(a[i]) != ascii_lower(b[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// RFC 7230 tchar 查找表
+struct TokenTable {
+    bool allowed[256] = {};
+    TokenTable() {
+        for (int c = 0x21; c < 0x7f; ++c) {
+            allowed[c] = !std::strchr("()<>@,;:\\\"/[]?={}", c);
+        }
+    }
+};
+
+const TokenTable token_table;
+
+inline bool is_token_char(char c) {
+    return token_table.allowed[static_cast<unsigned char>(c)];
+}
+
+int hex_value(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+} // namespace
+
+const std::string* HttpRequest::get_header(std::string_view name) const {
+    // 头部名称大小写不敏感
+    for (const auto& [key, value] : headers) {
+        if (iequals(key.data(), key.size(), name.data(), name.size())) {
+            return &value;
+        }
+    }
+    return nullptr;
+}
+
+std::string HttpRequest::query(const std::string& name, const std::string& default_value) const {
+    auto it = query_params.find(name);
+    return it != query_params.end() ? it->second : default_value;
+}
+
+HttpParser::HttpParser() = default;
+
+HttpParser::HttpParser(const Limits& limits) : limits_(limits) {
+}
+
+void HttpParser::reset() {
+    // clear() 保留字符串容量，复用时请求行和消息体不会重新分配
+    request_.method.clear();
+    request_.path.clear();
+    request_.version.clear();
+    for (auto& header : request_.headers) {
+        spare_headers_.push_back(std::move(header));
+    }
+    request_.headers.clear();
+    request_.body.clear();
+    request_.query_params.clear();
+
+    state_ = State::RequestLine;
+    pos_ = 0;
+    content_length_ = 0;
+    chunk_remaining_ = 0;
+    trailer_start_ = 0;
+    error_status_ = 0;
+}
+
+HttpParser::Status HttpParser::fail(int status) {
+    state_ = State::Error;
+    error_status_ = status;
+    return Status::Error;
+}
+
+bool HttpParser::next_line(const char* data, size_t size, size_t& line_length, size_t& line_end) const {
+    if (pos_ >= size) {
+        return false;
+    }
+
+    const void* found = std::memchr(data + pos_, '\n', size - pos_);
+    if (!found) {
+        return false;
+    }
+
+    line_end = static_cast<const char*>(found) - data + 1;
+    line_length = line_end - 1 - pos_;
+    if (line_length > 0 && data[pos_ + line_length - 1] == '\r') {
+        --line_length;
+    }
+    return true;
+}
+
+HttpParser::Status HttpParser::parse(const char* data, size_t size) {
+    while (true) {
+        switch (state_) {
+        case State::RequestLine: {
+            size_t line_length = 0, line_end = 0;
+            if (!next_line(data, size, line_length, line_end)) {
+                return size > limits_.max_header_size ? fail(431) : Status::NeedMore;
+            }
+            if (line_length == 0) {
+                pos_ = line_end;  // 容忍请求之间多余的空行
+                continue;
+            }
+            if (line_end > limits_.max_header_size) {
+                return fail(431);
+            }
+            if (!parse_request_line(data + pos_, line_length)) {
+                return fail(400);
+            }
+            pos_ = line_end;
+            state_ = State::Headers;
+            break;
+        }
+
+        case State::Headers: {
+            size_t line_length = 0, line_end = 0;
+            if (!next_line(data, size, line_length, line_end)) {
+                return size > limits_.max_header_size ? fail(431) : Status::NeedMore;
+            }
+            if (line_end > limits_.max_header_size) {
+                return fail(431);
+            }
+            if (line_length == 0) {
+                pos_ = line_end;
+                Status status = headers_complete();
+                if (status != Status::NeedMore) {
+                    return status;
+                }
+                break;
+            }
+            if (request_.headers.size() >= limits_.max_header_count) {
+                return fail(431);
+            }
+            if (!parse_header_line(data + pos_, line_length)) {
+                return fail(400);
+            }
+            pos_ = line_end;
+            break;
+        }
+
+        case State::Body: {
+            if (size - pos_ < content_length_) {
+                return Status::NeedMore;
+            }
+            request_.body.assign(data + pos_, content_length_);
+            pos_ += content_length_;
+            state_ = State::Complete;
+            return Status::Complete;
+        }
+
+        case State::ChunkSize: {
+            size_t line_length = 0, line_end = 0;
+            if (!next_line(data, size, line_length, line_end)) {
+                return size - pos_ > limits_.max_header_size ? fail(400) : Status::NeedMore;
+            }
+            if (line_end - pos_ > limits_.max_header_size) {
+                return fail(400);
+            }
+
+            // chunk-size [ ";" chunk-ext ]
+            size_t chunk_size = 0;
+            size_t digits = 0;
+            for (; digits < line_length; ++digits) {
+                int value = hex_value(data[pos_ + digits]);
+                if (value < 0) {
+                    break;
+                }
+                if (chunk_size > (limits_.max_body_size >> 4)) {
+                    return fail(413);
+                }
+                chunk_size = (chunk_size << 4) | static_cast<size_t>(value);
+            }
+            if (digits == 0) {
+                return fail(400);
+            }
+            // 十六进制数字之后只允许空白和以 ';' 开始的扩展
+            size_t rest = digits;
+            while (rest < line_length && (data[pos_ + rest] == ' ' || data[pos_ + rest] == '\t')) {
+                ++rest;
+            }
+            if (rest < line_length && data[pos_ + rest] != ';') {
+                return fail(400);
+            }
+            if (request_.body.size() + chunk_size > limits_.max_body_size) {
+                return fail(413);
+            }
+
+            pos_ = line_end;
+            chunk_remaining_ = chunk_size;
+            trailer_start_ = pos_;
+            state_ = chunk_size == 0 ? State::ChunkTrailer : State::ChunkData;
+            break;
+        }
+
+        case State::ChunkData: {
+            // 等待整个分块及其后的 CRLF 到齐
+            if (size - pos_ < chunk_remaining_ + 2) {
+                return Status::NeedMore;
+            }
+            if (data[pos_ + chunk_remaining_] != '\r' || data[pos_ + chunk_remaining_ + 1] != '\n') {
+                return fail(400);
+            }
+            request_.body.append(data + pos_, chunk_remaining_);
+            pos_ += chunk_remaining_ + 2;
+            chunk_remaining_ = 0;
+            state_ = State::ChunkSize;
+            break;
+        }
+
+        case State::ChunkTrailer: {
+            size_t line_length = 0, line_end = 0;
+            if (!next_line(data, size, line_length, line_end)) {
+                return size - trailer_start_ > limits_.max_header_size ? fail(431) : Status::NeedMore;
+            }
+            if (line_end - trailer_start_ > limits_.max_header_size) {
+                return fail(431);
+            }
+            pos_ = line_end;  // 忽略 trailer 字段
+            if (line_length == 0) {
+                state_ = State::Complete;
+                return Status::Complete;
+            }
+            break;
+        }
+
+        case State::Complete:
+            return Status::Complete;
+
+        case State::Error:
+            return Status::Error;
+        }
+    }
+}
+
+HttpParser::Status HttpParser::headers_complete() {
+    const std::string* transfer_encoding = request_.get_header("Transfer-Encoding");
+    if (transfer_encoding) {
+        // 仅支持以 chunked 结尾的传输编码；同时出现时忽略 Content-Length
+        std::string value = *transfer_encoding;
+        std::transform(value.begin(), value.end(), value.begin(), ::tolower);
+        size_t last = value.find_last_not_of(" \t");
+        if (last == std::string::npos || last < 6 || value.compare(last - 6, 7, "chunked") != 0) {
+            return fail(501);
+        }
+        state_ = State::ChunkSize;
+        return Status::NeedMore;
+    }
+
+    const std::string* length_header = request_.get_header("Content-Length");
+    if (length_header) {
+        if (length_header->empty()) {
+            return fail(400);
+        }
+        size_t length = 0;
+        for (char c : *length_header) {
+            if (c < '0' || c > '9') {
+                return fail(400);
+            }
+            if (length > limits_.max_body_size) {
+                return fail(413);
+            }
+            length = length * 10 + static_cast<size_t>(c - '0');
+        }
+        if (length > limits_.max_body_size) {
+            return fail(413);
+        }
+        content_length_ = length;
+    }
+
+    if (content_length_ == 0) {
+        state_ = State::Complete;
+        return Status::Complete;
+    }
+
+    state_ = State::Body;
+    return Status::NeedMore;
+}
+
+bool HttpParser::parse_request_line(const char* line, size_t length) {
+    // method SP request-target SP HTTP-version
+    const char* end = line + length;
+    const char* method_end = std::find(line, end, ' ');
+    if (method_end == line || method_end == end) {
+        return false;
+    }
+    const char* target_begin = method_end + 1;
+    const char* target_end = std::find(target_begin, end, ' ');
+    if (target_end == target_begin || target_end == end) {
+        return false;
+    }
+    const char* version_begin = target_end + 1;
+    if (end - version_begin != 8 || std::memcmp(version_begin, "HTTP/1.", 7) != 0) {
+        return false;
+    }
+
+    for (const char* p = line; p < method_end; ++p) {
+        if (!is_token_char(*p)) {
+            return false;
+        }
+    }
+
+    request_.method.assign(line, method_end);
+    request_.version.assign(version_begin, end);
+
+    const char* query = std::find(target_begin, target_end, '?');
+    request_.path.assign(target_begin, query);
+    if (query != target_end) {
+        request_.query_params = parse_query_string(std::string(query + 1, target_end));
+    }
+    return true;
+}
+
+bool HttpParser::parse_header_line(const char* line, size_t length) {
+    // 拒绝已废弃的多行折叠头部
+    if (line[0] == ' ' || line[0] == '\t') {
+        return false;
+    }
+
+    const char* end = line + length;
+    const char* colon = std::find(line, end, ':');
+    if (colon == line || colon == end) {
+        return false;
+    }
+    for (const char* p = line; p < colon; ++p) {
+        if (!is_token_char(*p)) {
+            return false;
+        }
+    }
+
+    // 去除值两端的空白
+    const char* value_begin = colon + 1;
+    while (value_begin < end && (*value_begin == ' ' || *value_begin == '\t')) {
+        ++value_begin;
+    }
+    const char* value_end = end;
+    while (value_end > value_begin && (value_end[-1] == ' ' || value_end[-1] == '\t')) {
+        --value_end;
+    }
+
+    if (spare_headers_.empty()) {
+        request_.headers.emplace_back(std::string(line, colon), std::string(value_begin, value_end));
+    } else {
+        auto header = std::move(spare_headers_.back());
+        spare_headers_.pop_back();
+        header.first.assign(line, colon);
+        header.second.assign(value_begin, value_end);
+        request_.headers.push_back(std::move(header));
+    }
+    return true;
+}
+
+std::map<std::string, std::string> HttpParser::parse_query_string(const std::string& query_string) {
+    std::map<std::string, std::string> params;
+    size_t start = 0;
+
+    while (start < query_string.length()) {
+        size_t end = query_string.find('&', start);
+        if (end == std::string::npos) {
+            end = query_string.length();
+        }
+
+        size_t equal_pos = query_string.find('=', start);
+        if (equal_pos != std::string::npos && equal_pos < end) {
+            params[url_decode(query_string.substr(start, equal_pos - start))] =
+                url_decode(query_string.substr(equal_pos + 1, end - equal_pos - 1));
+        }
+        start = end + 1;
+    }
+
+    return params;
+}
+
+std::string HttpParser::url_decode(const std::string& value) {
+    if (value.find_first_of("%+") == std::string::npos) {
+        return value;
+    }
+
+    std::string result;
+    result.reserve(value.size());
+    for (size_t i = 0; i < value.size(); ++i) {
+        if (value[i] == '+') {
+            result += ' ';
+        } else if (value[i] == '%' && i + 2 < value.size() &&
+                   hex_value(value[i + 1]) >= 0 && hex_value(value[i + 2]) >= 0) {
+            result += static_cast<char>((hex_value(value[i + 1]) << 4) | hex_value(value[i + 2]));
+            i += 2;
+        } else {
+            result += value[i];
+        }
+    }
+    return result;
+}
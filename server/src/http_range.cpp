@@ -0,0 +1,122 @@
+#include "http_range.h"
+#include <cstdio>
+#include <ctime>
+
+namespace {
+
+std::string_view trim(std::string_view value) {
+    while (!value.empty() && (value.front() == ' ' || value.front() == '\t')) {
+        value.remove_prefix(1);
+    }
+    while (!value.empty() && (value.back() == ' ' || value.back() == '\t')) {
+        value.remove_suffix(1);
+    }
+    return value;
+}
+
+// 解析无符号十进制数，空串、非数字或溢出时返回 false
+bool parse_uint(std::string_view text, uint64_t& value) {
+    if (text.empty()) {
+        return false;
+    }
+    value = 0;
+    for (char c : text) {
+        if (c < '0' || c > '9') {
+            return false;
+        }
+        uint64_t digit = static_cast<uint64_t>(c - '0');
+        if (value > (UINT64_MAX - digit) / 10) {
+            return false;
+        }
+        value = value * 10 + digit;
+    }
+    return true;
+}
+
+} // namespace
+
+RangeResult parse_range_header(std::string_view header, uint64_t file_size, ByteRange& range) {
+    header = trim(header);
+    static const std::string_view unit = "bytes=";
+    if (header.size() <= unit.size() || header.substr(0, unit.size()) != unit) {
+        return RangeResult::Full;
+    }
+
+    std::string_view spec = trim(header.substr(unit.size()));
+    if (spec.find(',') != std::string_view::npos) {
+        return RangeResult::MultipleRanges;
+    }
+
+    size_t dash = spec.find('-');
+    if (dash == std::string_view::npos) {
+        return RangeResult::Full;
+    }
+    std::string_view first = trim(spec.substr(0, dash));
+    std::string_view last = trim(spec.substr(dash + 1));
+
+    if (first.empty()) {
+        // 后缀区间：最后 n 个字节
+        uint64_t suffix = 0;
+        if (!parse_uint(last, suffix)) {
+            return RangeResult::Full;
+        }
+        if (suffix == 0 || file_size == 0) {
+            return RangeResult::Unsatisfiable;
+        }
+        range.length = suffix < file_size ? suffix : file_size;
+        range.offset = file_size - range.length;
+        return RangeResult::Partial;
+    }
+
+    uint64_t start = 0;
+    if (!parse_uint(first, start)) {
+        return RangeResult::Full;
+    }
+
+    uint64_t end = file_size > 0 ? file_size - 1 : 0;
+    if (!last.empty()) {
+        uint64_t requested_end = 0;
+        if (!parse_uint(last, requested_end) || requested_end < start) {
+            return RangeResult::Full;
+        }
+        if (requested_end < end) {
+            end = requested_end;
+        }
+    }
+
+    if (start >= file_size) {
+        return RangeResult::Unsatisfiable;
+    }
+
+    range.offset = start;
+    range.length = end - start + 1;
+    return RangeResult::Partial;
+}
+
+bool if_range_matches(std::string_view if_range, const std::string& etag, const std::string& last_modified) {
+    if_range = trim(if_range);
+    if (if_range.empty()) {
+        return true;
+    }
+    if (if_range.front() == '"' || if_range.substr(0, 2) == "W/") {
+        // 弱 ETag 不能用于 If-Range
+        return if_range == etag;
+    }
+    return if_range == last_modified;
+}
+
+std::string make_etag(uint64_t size, const struct timespec& mtime) {
+    char buffer[64];
+    uint64_t mtime_ns = static_cast<uint64_t>(mtime.tv_sec) * 1000000000ULL + static_cast<uint64_t>(mtime.tv_nsec);
+    snprintf(buffer, sizeof(buffer), "\"%llx-%llx\"",
+             static_cast<unsigned long long>(size), static_cast<unsigned long long>(mtime_ns));
+    return buffer;
+}
+
+std::string format_http_date(time_t time) {
+    std::tm gmt{};
+    gmtime_r(&time, &gmt);
+    char buffer[64];
+    size_t length = strftime(buffer, sizeof(buffer), "%a, %d %b %Y %H:%M:%S GMT", &gmt);
+    return std::string(buffer, length);
+}
@@ -0,0 +1,205 @@
+#include "http_response.h"
+#include <unistd.h>
+#include <utility>
+
+namespace {
+
+const int MIN_STATUS = 100;
+const int MAX_STATUS = 599;
+
+// 出现在热路径上的类型；其余类型走 headers
+const char* const COMMON_CONTENT_TYPES[] = {
+    "application/json",
+    "text/plain",
+    "text/html",
+    "text/css",
+    "application/javascript",
+    "application/vnd.apple.mpegurl",
+    "video/MP2T",
+    "video/mp4",
+    "image/png",
+    "image/jpeg",
+    "image/svg+xml",
+    "image/x-icon",
+    "application/octet-stream",
+};
+const size_t COMMON_CONTENT_TYPE_COUNT = sizeof(COMMON_CONTENT_TYPES) / sizeof(COMMON_CONTENT_TYPES[0]);
+
+struct HeaderFragments {
+    std::vector<std::string> status_lines;
+    std::vector<std::string> content_types;
+
+    HeaderFragments() {
+        status_lines.resize(MAX_STATUS - MIN_STATUS + 1);
+        for (int status = MIN_STATUS; status <= MAX_STATUS; ++status) {
+            status_lines[status - MIN_STATUS] = "HTTP/1.1 " + std::to_string(status) + " " +
+                                                HttpResponse::reason_phrase(status) + "\r\n";
+        }
+        for (const char* type : COMMON_CONTENT_TYPES) {
+            content_types.push_back(std::string("Content-Type: ") + type + "\r\n");
+        }
+    }
+};
+
+const HeaderFragments& fragments() {
+    static const HeaderFragments instance;
+    return instance;
+}
+
+} // namespace
+
+HttpResponse::~HttpResponse() {
+    if (file_fd >= 0) {
+        close(file_fd);
+    }
+}
+
+HttpResponse::HttpResponse(HttpResponse&& other) noexcept
+    : status(other.status),
+      content_type_line(other.content_type_line),
+      headers(std::move(other.headers)),
+      body(std::move(other.body)),
+      shared_body(std::move(other.shared_body)),
+      header_block(std::move(other.header_block)),
+      file_fd(std::exchange(other.file_fd, -1)),
+      file_offset(other.file_offset),
+      file_length(other.file_length),
+      producer(std::move(other.producer)),
+      stream_wake(std::move(other.stream_wake)) {
+}
+
+HttpResponse& HttpResponse::operator=(HttpResponse&& other) noexcept {
+    if (this != &other) {
+        if (file_fd >= 0) {
+            close(file_fd);
+        }
+        status = other.status;
+        content_type_line = other.content_type_line;
+        headers = std::move(other.headers);
+        body = std::move(other.body);
+        shared_body = std::move(other.shared_body);
+        header_block = std::move(other.header_block);
+        file_fd = std::exchange(other.file_fd, -1);
+        file_offset = other.file_offset;
+        file_length = other.file_length;
+        producer = std::move(other.producer);
+        stream_wake = std::move(other.stream_wake);
+    }
+    return *this;
+}
+
+HttpResponse HttpResponse::json(int status, std::string body) {
+    return with_body(status, "application/json", std::move(body));
+}
+
+HttpResponse HttpResponse::text(int status, std::string body) {
+    return with_body(status, "text/plain", std::move(body));
+}
+
+HttpResponse HttpResponse::with_body(int status, std::string_view content_type, std::string body) {
+    HttpResponse response(status);
+    response.content_type(content_type);
+    response.body = std::move(body);
+    return response;
+}
+
+HttpResponse HttpResponse::shared(int status, std::string_view content_type,
+                                  std::shared_ptr<const std::string> body) {
+    HttpResponse response(status);
+    response.content_type(content_type);
+    response.shared_body = std::move(body);
+    return response;
+}
+
+HttpResponse HttpResponse::file(int status, std::string_view content_type, int fd, off_t offset, size_t length) {
+    HttpResponse response(status);
+    response.content_type(content_type);
+    response.file_fd = fd;
+    response.file_offset = offset;
+    response.file_length = length;
+    return response;
+}
+
+HttpResponse HttpResponse::stream(int status, std::string_view content_type, BodyProducer producer,
+                                  std::shared_ptr<StreamWake> wake) {
+    HttpResponse response(status);
+    response.content_type(content_type);
+    response.producer = std::move(producer);
+    response.stream_wake = std::move(wake);
+    return response;
+}
+
+void HttpResponse::StreamWake::notify() {
+    std::function<void()> resume;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!resume_) {
+            notified_ = true;  // 流没有挂起：记下，下次挂起时立即解除
+            return;
+        }
+        resume = std::move(resume_);
+        resume_ = nullptr;
+    }
+    resume();
+}
+
+bool HttpResponse::StreamWake::park(std::function<void()> resume) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (notified_) {
+        notified_ = false;
+        return false;
+    }
+    resume_ = std::move(resume);
+    return true;
+}
+
+HttpResponse& HttpResponse::header(std::string name, std::string value) {
+    headers.emplace_back(std::move(name), std::move(value));
+    return *this;
+}
+
+HttpResponse& HttpResponse::content_type(std::string_view type) {
+    content_type_line = content_type_fragment(type);
+    if (!content_type_line) {
+        headers.emplace_back("Content-Type", std::string(type));
+    }
+    return *this;
+}
+
+std::string_view HttpResponse::status_line(int status) {
+    if (status < MIN_STATUS || status > MAX_STATUS) {
+        status = 500;
+    }
+    return fragments().status_lines[status - MIN_STATUS];
+}
+
+const std::string* HttpResponse::content_type_fragment(std::string_view type) {
+    for (size_t i = 0; i < COMMON_CONTENT_TYPE_COUNT; ++i) {
+        if (type == COMMON_CONTENT_TYPES[i]) {
+            return &fragments().content_types[i];
+        }
+    }
+    return nullptr;
+}
+
+const char* HttpResponse::reason_phrase(int status) {
+    switch (status) {
+        case 200: return "OK";
+        case 204: return "No Content";
+        case 206: return "Partial Content";
+        case 304: return "Not Modified";
+        case 400: return "Bad Request";
+        case 403: return "Forbidden";
+        case 404: return "Not Found";
+        case 405: return "Method Not Allowed";
+        case 408: return "Request Timeout";
+        case 412: return "Precondition Failed";
+        case 413: return "Payload Too Large";
+        case 416: return "Range Not Satisfiable";
+        case 431: return "Request Header Fields Too Large";
+        case 500: return "Internal Server Error";
+        case 501: return "Not Implemented";
+        case 503: return "Service Unavailable";
+        default: return "Unknown";
+    }
+}
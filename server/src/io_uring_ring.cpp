@@ -0,0 +1,247 @@
+// io_uring 后端仅在 -DENABLE_IO_URING=ON 时编译
+#ifdef MEDIA_SERVER_IO_URING
+
+#include "io_uring_ring.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <system_error>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace {
+
+int sys_io_uring_setup(unsigned entries, io_uring_params* params) {
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+int sys_io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags,
+                       const void* arg, size_t arg_size) {
+    return static_cast<int>(syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, arg, arg_size));
+}
+
+int sys_io_uring_register(int fd, unsigned opcode, const void* arg, unsigned nr_args) {
+    return static_cast<int>(syscall(__NR_io_uring_register, fd, opcode, arg, nr_args));
+}
+
+} // namespace
+
+const uint16_t IoUringRing::RECV_BUFFER_GROUP;
+
+IoUringRing::IoUringRing(unsigned entries, unsigned recv_buffer_count, unsigned recv_buffer_size,
+                         unsigned fixed_buffer_count, unsigned fixed_buffer_size) {
+    io_uring_params params{};
+    params.flags = IORING_SETUP_CQSIZE;
+    params.cq_entries = entries * 4;  // multishot 操作一次提交产生多个 CQE，完成队列放大
+
+    ring_fd_ = sys_io_uring_setup(entries, &params);
+    if (ring_fd_ < 0) {
+        throw std::system_error(errno, std::system_category(), "io_uring_setup 失败");
+    }
+
+    // 超时等待依赖 EXT_ARG（5.11），multishot recv 依赖 provided buffer ring（5.19+）
+    if (!(params.features & IORING_FEAT_EXT_ARG) || !(params.features & IORING_FEAT_NODROP)) {
+        close(ring_fd_);
+        throw std::system_error(ENOSYS, std::system_category(), "内核 io_uring 版本过旧");
+    }
+
+    try {
+        map_rings(params);
+        setup_recv_buffers(recv_buffer_count, recv_buffer_size);
+        setup_fixed_buffers(fixed_buffer_count, fixed_buffer_size);
+    } catch (...) {
+        unmap();
+        close(ring_fd_);
+        throw;
+    }
+}
+
+IoUringRing::~IoUringRing() {
+    unmap();
+    if (ring_fd_ >= 0) {
+        close(ring_fd_);
+    }
+}
+
+void IoUringRing::map_rings(const io_uring_params& params) {
+    sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap) {
+        sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+    }
+
+    sq_ring_ = mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                    ring_fd_, IORING_OFF_SQ_RING);
+    if (sq_ring_ == MAP_FAILED) {
+        sq_ring_ = nullptr;
+        throw std::system_error(errno, std::system_category(), "mmap(SQ ring) 失败");
+    }
+
+    if (single_mmap) {
+        cq_ring_ = sq_ring_;
+    } else {
+        cq_ring_ = mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        ring_fd_, IORING_OFF_CQ_RING);
+        if (cq_ring_ == MAP_FAILED) {
+            cq_ring_ = nullptr;
+            throw std::system_error(errno, std::system_category(), "mmap(CQ ring) 失败");
+        }
+    }
+
+    sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+    void* sqes = mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      ring_fd_, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+        throw std::system_error(errno, std::system_category(), "mmap(SQEs) 失败");
+    }
+    sqes_ = static_cast<io_uring_sqe*>(sqes);
+
+    char* sq = static_cast<char*>(sq_ring_);
+    sq_head_ = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    sq_tail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sq_array_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    sq_mask_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sq_entries_ = params.sq_entries;
+    sqe_tail_ = *sq_tail_;
+
+    char* cq = static_cast<char*>(cq_ring_);
+    cq_head_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cq_mask_ = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+}
+
+void IoUringRing::setup_recv_buffers(unsigned count, unsigned size) {
+    // 环大小必须是 2 的幂
+    unsigned entries = 1;
+    while (entries < count) {
+        entries <<= 1;
+    }
+
+    recv_ring_size_ = entries * sizeof(io_uring_buf);
+    void* ring = mmap(nullptr, recv_ring_size_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ring == MAP_FAILED) {
+        throw std::system_error(errno, std::system_category(), "mmap(buffer ring) 失败");
+    }
+    recv_ring_ = static_cast<io_uring_buf_ring*>(ring);
+    recv_ring_mask_ = entries - 1;
+    recv_buffer_size_ = size;
+    recv_memory_.resize(size_t(entries) * size);
+
+    io_uring_buf_reg reg{};
+    reg.ring_addr = reinterpret_cast<uint64_t>(recv_ring_);
+    reg.ring_entries = entries;
+    reg.bgid = RECV_BUFFER_GROUP;
+    if (sys_io_uring_register(ring_fd_, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        throw std::system_error(errno, std::system_category(), "IORING_REGISTER_PBUF_RING 失败");
+    }
+
+    recv_ring_->tail = 0;
+    for (unsigned i = 0; i < entries; ++i) {
+        recycle_recv_buffer(static_cast<uint16_t>(i));
+    }
+}
+
+void IoUringRing::recycle_recv_buffer(uint16_t buffer_id) {
+    // 不使用 io_uring_buf_ring::bufs：该柔性数组在 C++ 下前面的空结构体占 1 字节，
+    // 偏移与内核不一致。环本身就是 io_uring_buf 数组，tail 复用 0 号元素的 resv 字段
+    uint16_t tail = recv_ring_->tail;
+    io_uring_buf& buf = reinterpret_cast<io_uring_buf*>(recv_ring_)[tail & recv_ring_mask_];
+    buf.addr = reinterpret_cast<uint64_t>(recv_buffer(buffer_id));
+    buf.len = recv_buffer_size_;
+    buf.bid = buffer_id;
+    __atomic_store_n(&recv_ring_->tail, static_cast<uint16_t>(tail + 1), __ATOMIC_RELEASE);
+}
+
+void IoUringRing::setup_fixed_buffers(unsigned count, unsigned size) {
+    fixed_buffer_size_ = size;
+    fixed_memory_.resize(size_t(count) * size);
+
+    std::vector<iovec> iovecs(count);
+    for (unsigned i = 0; i < count; ++i) {
+        iovecs[i].iov_base = fixed_buffer(static_cast<int>(i));
+        iovecs[i].iov_len = size;
+        free_fixed_buffers_.push_back(static_cast<int>(count - 1 - i));
+    }
+    if (count > 0 && sys_io_uring_register(ring_fd_, IORING_REGISTER_BUFFERS, iovecs.data(), count) < 0) {
+        throw std::system_error(errno, std::system_category(), "IORING_REGISTER_BUFFERS 失败");
+    }
+}
+
+int IoUringRing::acquire_fixed_buffer() {
+    if (free_fixed_buffers_.empty()) {
+        return -1;
+    }
+    int index = free_fixed_buffers_.back();
+    free_fixed_buffers_.pop_back();
+    return index;
+}
+
+void IoUringRing::release_fixed_buffer(int index) {
+    free_fixed_buffers_.push_back(index);
+}
+
+io_uring_sqe* IoUringRing::get_sqe() {
+    unsigned head = __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+    if (sqe_tail_ - head >= sq_entries_) {
+        submit_and_wait(0);
+        head = __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+        if (sqe_tail_ - head >= sq_entries_) {
+            return nullptr;
+        }
+    }
+
+    unsigned index = sqe_tail_ & sq_mask_;
+    io_uring_sqe* sqe = &sqes_[index];
+    std::memset(sqe, 0, sizeof(*sqe));
+    sq_array_[index] = index;
+    ++sqe_tail_;
+    return sqe;
+}
+
+int IoUringRing::submit_and_wait(int timeout_ms) {
+    __atomic_store_n(sq_tail_, sqe_tail_, __ATOMIC_RELEASE);
+    unsigned to_submit = sqe_tail_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+
+    unsigned flags = 0;
+    unsigned min_complete = 0;
+    __kernel_timespec timeout{};
+    io_uring_getevents_arg arg{};
+    if (timeout_ms > 0) {
+        timeout.tv_sec = timeout_ms / 1000;
+        timeout.tv_nsec = static_cast<long long>(timeout_ms % 1000) * 1000000;
+        arg.ts = reinterpret_cast<uint64_t>(&timeout);
+        flags = IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG;
+        min_complete = 1;
+    }
+
+    int ret = sys_io_uring_enter(ring_fd_, to_submit, min_complete, flags,
+                                 flags ? &arg : nullptr, flags ? sizeof(arg) : 0);
+    if (ret < 0 && (errno == ETIME || errno == EINTR)) {
+        return 0;
+    }
+    return ret;
+}
+
+void IoUringRing::unmap() {
+    if (recv_ring_) {
+        munmap(recv_ring_, recv_ring_size_);
+        recv_ring_ = nullptr;
+    }
+    if (sqes_) {
+        munmap(sqes_, sqes_size_);
+        sqes_ = nullptr;
+    }
+    if (cq_ring_ && cq_ring_ != sq_ring_) {
+        munmap(cq_ring_, cq_ring_size_);
+    }
+    cq_ring_ = nullptr;
+    if (sq_ring_) {
+        munmap(sq_ring_, sq_ring_size_);
+        sq_ring_ = nullptr;
+    }
+}
+
+#endif // MEDIA_SERVER_IO_URING
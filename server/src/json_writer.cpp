@@ -0,0 +1,122 @@
+#include "json_writer.h"
+#include <cmath>
+
+const int JsonWriter::MAX_DEPTH;
+
+void JsonWriter::before_value() {
+    if (after_key_) {
+        after_key_ = false;
+        return;
+    }
+    if (depth_ > 0) {
+        uint64_t bit = uint64_t(1) << (depth_ - 1);
+        if (has_items_ & bit) {
+            out_ += ',';
+        }
+        has_items_ |= bit;
+    }
+}
+
+JsonWriter& JsonWriter::begin_object() {
+    before_value();
+    out_ += '{';
+    if (depth_ < MAX_DEPTH) {
+        ++depth_;
+        has_items_ &= ~(uint64_t(1) << (depth_ - 1));
+    }
+    return *this;
+}
+
+JsonWriter& JsonWriter::end_object() {
+    out_ += '}';
+    if (depth_ > 0) {
+        --depth_;
+    }
+    return *this;
+}
+
+JsonWriter& JsonWriter::begin_array() {
+    before_value();
+    out_ += '[';
+    if (depth_ < MAX_DEPTH) {
+        ++depth_;
+        has_items_ &= ~(uint64_t(1) << (depth_ - 1));
+    }
+    return *this;
+}
+
+JsonWriter& JsonWriter::end_array() {
+    out_ += ']';
+    if (depth_ > 0) {
+        --depth_;
+    }
+    return *this;
+}
+
+JsonWriter& JsonWriter::key(std::string_view name) {
+    before_value();
+    append_string(out_, name);
+    out_ += ':';
+    after_key_ = true;
+    return *this;
+}
+
+JsonWriter& JsonWriter::value(std::string_view text) {
+    before_value();
+    append_string(out_, text);
+    return *this;
+}
+
+JsonWriter& JsonWriter::value(bool flag) {
+    before_value();
+    out_ += flag ? "true" : "false";
+    return *this;
+}
+
+JsonWriter& JsonWriter::value(double number) {
+    if (!std::isfinite(number)) {
+        return null_value();
+    }
+    before_value();
+    char buffer[32];
+    auto result = std::to_chars(buffer, buffer + sizeof(buffer), number);
+    out_.append(buffer, result.ptr);
+    return *this;
+}
+
+JsonWriter& JsonWriter::null_value() {
+    before_value();
+    out_ += "null";
+    return *this;
+}
+
+void JsonWriter::append_string(std::string& out, std::string_view text) {
+    static const char HEX[] = "0123456789abcdef";
+    out += '"';
+    // 不需要转义的连续片段整段追加；UTF-8 多字节序列原样保留
+    size_t run_start = 0;
+    for (size_t i = 0; i < text.size(); ++i) {
+        unsigned char c = static_cast<unsigned char>(text[i]);
+        if (c >= 0x20 && c != '"' && c != '\\') {
+            continue;
+        }
+        out.append(text.data() + run_start, i - run_start);
+        run_start = i + 1;
+        switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\b': out += "\\b"; break;
+            case '\f': out += "\\f"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default: {
+                char escaped[6] = {'\\', 'u', '0', '0', HEX[c >> 4], HEX[c & 0xf]};
+                out.append(escaped, sizeof(escaped));
+                break;
+            }
+        }
+    }
+    out.append(text.data() + run_start, text.size() - run_start);
+    out += '"';
+}
@@ -0,0 +1,291 @@
+#include "logger.h"
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <streambuf>
+#include <strings.h>
+#include <unistd.h>
+
+const size_t Logger::CAPACITY;
+const size_t Logger::MAX_LINE;
+
+namespace {
+
+static_assert((Logger::CAPACITY & (Logger::CAPACITY - 1)) == 0, "Logger::CAPACITY must be a power of two");
+
+// 写入固定数组的 streambuf，超出部分丢弃，格式化一行日志不分配内存
+class LineBuffer : public std::streambuf {
+public:
+    LineBuffer() { reset(); }
+
+    void reset() { setp(data_, data_ + sizeof(data_)); }
+    const char* data() const { return data_; }
+    size_t size() const { return static_cast<size_t>(pptr() - pbase()); }
+
+protected:
+    int_type overflow(int_type ch) override {
+        return traits_type::not_eof(ch);
+    }
+
+private:
+    char data_[Logger::MAX_LINE];
+};
+
+// 主线程的 thread_local 先于静态对象析构，之后单例析构里写的日志改用一份不析构的缓冲
+thread_local bool line_destroyed = false;
+
+struct LineStream {
+    ~LineStream() { line_destroyed = true; }
+
+    LineBuffer buffer;
+    std::ostream stream{&buffer};
+};
+
+LineStream& thread_line() {
+    if (line_destroyed) {
+        thread_local LineStream* fallback = new LineStream();
+        return *fallback;
+    }
+    thread_local LineStream line;
+    return line;
+}
+
+int64_t now_micros() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+const char* level_name(LogLevel level) {
+    switch (level) {
+        case LogLevel::Debug: return "DEBUG";
+        case LogLevel::Info: return "INFO ";
+        case LogLevel::Warn: return "WARN ";
+        case LogLevel::Error: return "ERROR";
+    }
+    return "?    ";
+}
+
+int level_from_env() {
+    const char* value = std::getenv("MEDIA_SERVER_LOG_LEVEL");
+    if (!value) {
+        return static_cast<int>(LogLevel::Info);
+    }
+    if (strcasecmp(value, "debug") == 0) return static_cast<int>(LogLevel::Debug);
+    if (strcasecmp(value, "warn") == 0) return static_cast<int>(LogLevel::Warn);
+    if (strcasecmp(value, "error") == 0) return static_cast<int>(LogLevel::Error);
+    return static_cast<int>(LogLevel::Info);
+}
+
+} // namespace
+
+Logger& Logger::get_instance() {
+    // 有意不析构：其它单例的析构函数里仍可能写日志，停止后改为同步写出
+    static Logger* instance = new Logger();
+    return *instance;
+}
+
+Logger::Logger()
+    : slots_(new Slot[CAPACITY]),
+      level_(level_from_env()) {
+    for (size_t i = 0; i < CAPACITY; ++i) {
+        slots_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    running_.store(true, std::memory_order_release);
+    thread_ = std::thread(&Logger::run, this);
+    std::atexit([] { Logger::get_instance().shutdown(); });
+}
+
+std::ostream& Logger::begin() {
+    LineStream& line = thread_line();
+    line.buffer.reset();
+    line.stream.clear();
+    line.stream.flags(std::ios_base::dec | std::ios_base::skipws);
+    line.stream.precision(6);
+    line.stream.fill(' ');
+    return line.stream;
+}
+
+void Logger::commit(LogLevel level) {
+    LineStream& line = thread_line();
+    const char* text = line.buffer.data();
+    size_t length = line.buffer.size();
+    // 行尾由写出线程统一添加；原有消息里的首尾换行去掉
+    while (length > 0 && text[length - 1] == '\n') {
+        --length;
+    }
+    while (length > 0 && text[0] == '\n') {
+        ++text;
+        --length;
+    }
+    int64_t time_micros = now_micros();
+
+    if (!running_.load(std::memory_order_acquire)) {
+        TimestampCache cache;
+        std::string line_text;
+        format_line(cache, line_text, level, time_micros, text, length);
+        write_all(level >= LogLevel::Warn ? STDERR_FILENO : STDOUT_FILENO, line_text);
+        return;
+    }
+
+    if (!try_push(level, text, length, time_micros)) {
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        wake_.notify_one();
+        return;
+    }
+    // 警告和错误尽快写出；普通日志由后台线程定期批量取走，积压过半时提前唤醒
+    if (level >= LogLevel::Warn ||
+        tail_.load(std::memory_order_relaxed) - head_.load(std::memory_order_relaxed) > CAPACITY / 2) {
+        wake_.notify_one();
+    }
+}
+
+bool Logger::try_push(LogLevel level, const char* text, size_t length, int64_t time_micros) {
+    // 有界 MPMC 队列（Vyukov）：槽位序号等于位置时可写，写完置为位置 + 1 交给消费者
+    uint64_t position = tail_.load(std::memory_order_relaxed);
+    Slot* slot;
+    for (;;) {
+        slot = &slots_[position & (CAPACITY - 1)];
+        uint64_t sequence = slot->sequence.load(std::memory_order_acquire);
+        int64_t diff = static_cast<int64_t>(sequence) - static_cast<int64_t>(position);
+        if (diff == 0) {
+            if (tail_.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            return false;   // 队列已满
+        } else {
+            position = tail_.load(std::memory_order_relaxed);
+        }
+    }
+
+    slot->level = level;
+    slot->time_micros = time_micros;
+    slot->length = static_cast<uint32_t>(length);
+    memcpy(slot->text, text, length);
+    slot->sequence.store(position + 1, std::memory_order_release);
+    return true;
+}
+
+size_t Logger::drain(TimestampCache& cache, std::string& out, std::string& err) {
+    size_t count = 0;
+    uint64_t position = head_.load(std::memory_order_relaxed);
+    for (;;) {
+        Slot& slot = slots_[position & (CAPACITY - 1)];
+        if (slot.sequence.load(std::memory_order_acquire) != position + 1) {
+            break;
+        }
+        format_line(cache, slot.level >= LogLevel::Warn ? err : out,
+                    slot.level, slot.time_micros, slot.text, slot.length);
+        slot.sequence.store(position + CAPACITY, std::memory_order_release);
+        ++position;
+        ++count;
+    }
+    head_.store(position, std::memory_order_release);
+
+    uint64_t dropped = dropped_.exchange(0, std::memory_order_relaxed);
+    if (dropped > 0) {
+        std::string notice = "日志队列已满，丢弃 " + std::to_string(dropped) + " 条";
+        format_line(cache, err, LogLevel::Warn, now_micros(), notice.data(), notice.size());
+    }
+    return count;
+}
+
+void Logger::run() {
+    TimestampCache cache;
+    std::string out;
+    std::string err;
+    while (true) {
+        bool stopping = !running_.load(std::memory_order_acquire);
+        out.clear();
+        err.clear();
+        size_t count = drain(cache, out, err);
+        write_all(STDOUT_FILENO, out);
+        write_all(STDERR_FILENO, err);
+        drained_.notify_all();
+
+        if (count == 0) {
+            if (stopping) {
+                break;
+            }
+            std::unique_lock<std::mutex> lock(mutex_);
+            wake_.wait_for(lock, std::chrono::milliseconds(50));
+        }
+    }
+}
+
+void Logger::format_line(TimestampCache& cache, std::string& target, LogLevel level, int64_t time_micros,
+                         const char* text, size_t length) {
+    int64_t second = time_micros / 1000000;
+    if (second != cache.second) {
+        time_t seconds = static_cast<time_t>(second);
+        std::tm local_time{};
+        localtime_r(&seconds, &local_time);
+        strftime(cache.prefix, sizeof(cache.prefix), "%Y-%m-%d %H:%M:%S", &local_time);
+        cache.second = second;
+    }
+    char suffix[24];
+    snprintf(suffix, sizeof(suffix), ".%03d %s ", static_cast<int>(time_micros / 1000 % 1000), level_name(level));
+    target += cache.prefix;
+    target += suffix;
+    target.append(text, length);
+    target += '\n';
+}
+
+void Logger::write_all(int fd, const std::string& data) {
+    size_t written = 0;
+    while (written < data.size()) {
+        ssize_t n = ::write(fd, data.data() + written, data.size() - written);
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            return;
+        }
+        written += static_cast<size_t>(n);
+    }
+}
+
+void Logger::flush() {
+    uint64_t target = tail_.load(std::memory_order_acquire);
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (running_.load(std::memory_order_acquire) && head_.load(std::memory_order_acquire) < target) {
+        wake_.notify_one();
+        drained_.wait_for(lock, std::chrono::milliseconds(10));
+    }
+}
+
+void Logger::shutdown() {
+    bool expected = true;
+    if (!running_.compare_exchange_strong(expected, false)) {
+        return;
+    }
+    wake_.notify_one();
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+    // 后台线程最后一次排空之后才提交的日志
+    TimestampCache cache;
+    std::string out;
+    std::string err;
+    drain(cache, out, err);
+    write_all(STDOUT_FILENO, out);
+    write_all(STDERR_FILENO, err);
+}
+
+bool LogRateLimiter::allow(uint64_t& suppressed) {
+    int64_t now = std::chrono::duration_cast<std::chrono::seconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+    int64_t window = window_.load(std::memory_order_relaxed);
+    if (window != now && window_.compare_exchange_strong(window, now, std::memory_order_relaxed)) {
+        count_.store(0, std::memory_order_relaxed);
+    }
+    if (count_.fetch_add(1, std::memory_order_relaxed) < per_second_) {
+        suppressed = suppressed_.exchange(0, std::memory_order_relaxed);
+        return true;
+    }
+    suppressed_.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
@@ -1,5 +1,6 @@
 #include "server.h"
 #include "routes.h"
+#include "logger.h"
 #include <iostream>
 #include <csignal>
 #include <atomic>
@@ -8,7 +9,6 @@ std::atomic<bool> running{true};
 
 void signal_handler(int signal) {
 	(void)signal;
-    std::cout << "Received signal, shutting down..." << std::endl;
     running = false;
 }
 
@@ -22,37 +22,41 @@ int main() {
     std::signal(SIGTERM, signal_handler);
     
     try {
-        // Create server instance
-        SimpleServer server(8080);
+        // Create server instance (one event loop per CPU core)
+        SimpleServer server(8080, 0);
         
         // Setup routes
         setup_routes(server);
         
         // Start server
         if (server.start()) {
-            std::cout << "Server started on port 8080" << std::endl;
-            std::cout << "Test endpoints:" << std::endl;
-            std::cout << "  - http://localhost:8080/" << std::endl;
-            std::cout << "  - http://localhost:8080/api/status" << std::endl;
-            std::cout << "  - http://localhost:8080/api/media/list" << std::endl;
-            std::cout << "Press Ctrl+C to stop" << std::endl;
+            LOG_INFO("Server started on port 8080");
+            LOG_INFO("Test endpoints:");
+            LOG_INFO("  - http://localhost:8080/");
+            LOG_INFO("  - http://localhost:8080/api/status");
+            LOG_INFO("  - http://localhost:8080/api/media/list");
+            LOG_INFO("Press Ctrl+C to stop");
             
             // Keep running
             while (running && server.is_running()) {
                 std::this_thread::sleep_for(std::chrono::seconds(1));
             }
+            if (!running) {
+                LOG_INFO("Received signal, shutting down...");
+            }
             
             server.stop();
         } else {
-            std::cerr << "Failed to start server" << std::endl;
+            LOG_ERROR("Failed to start server");
             return 1;
         }
         
     } catch (const std::exception& e) {
-        std::cerr << "Error: " << e.what() << std::endl;
+        LOG_ERROR("Error: " << e.what());
         return 1;
     }
     
-    std::cout << "Server stopped" << std::endl;
+    LOG_INFO("Server stopped");
+    Logger::get_instance().shutdown();
     return 0;
 }
\ No newline at end of file
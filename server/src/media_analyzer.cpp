@@ -1,5 +1,5 @@
 #include "media_analyzer.h"
-#include <iostream>
+#include "logger.h"
 #include <sstream>
 #include <iomanip>
 #include <cstring>
@@ -49,7 +49,7 @@ MediaInfo MediaAnalyzer::analyze(const std::string& filepath) {
     
     cleanup();
     
-    std::cout << "\n[ANALYZE] 开始分析: " << filepath << std::endl;
+    LOG_DEBUG("[ANALYZE] 开始分析: " << filepath);
     
     // 1. 打开文件
     int ret = avformat_open_input(&format_ctx_, filepath.c_str(), nullptr, nullptr);
@@ -57,7 +57,7 @@ MediaInfo MediaAnalyzer::analyze(const std::string& filepath) {
         char error_buffer[AV_ERROR_MAX_STRING_SIZE];
         av_strerror(ret, error_buffer, sizeof(error_buffer));
         info.error_message = std::string("打开文件失败: ") + error_buffer;
-        std::cerr << "[ERROR] " << info.error_message << std::endl;
+        LOG_WARN("[ERROR] " << info.error_message);
         return info;
     }
     
@@ -67,7 +67,7 @@ MediaInfo MediaAnalyzer::analyze(const std::string& filepath) {
         char error_buffer[AV_ERROR_MAX_STRING_SIZE];
         av_strerror(ret, error_buffer, sizeof(error_buffer));
         info.error_message = std::string("获取流信息失败: ") + error_buffer;
-        std::cerr << "[ERROR] " << info.error_message << std::endl;
+        LOG_WARN("[ERROR] " << info.error_message);
         cleanup();
         return info;
     }
@@ -83,10 +83,10 @@ MediaInfo MediaAnalyzer::analyze(const std::string& filepath) {
     }
     info.bit_rate = format_ctx_->bit_rate;
     
-    std::cout << "[ANALYZE] 格式: " << info.format_name << std::endl;
-    std::cout << "[ANALYZE] 时长: " << std::fixed << std::setprecision(3) << info.duration << "s" << std::endl;
-    std::cout << "[ANALYZE] 比特率: " << info.bit_rate << " bps" << std::endl;
-    std::cout << "[ANALYZE] 流数量: " << format_ctx_->nb_streams << std::endl;
+    LOG_DEBUG("[ANALYZE] 格式: " << info.format_name);
+    LOG_DEBUG("[ANALYZE] 时长: " << std::fixed << std::setprecision(3) << info.duration << "s");
+    LOG_DEBUG("[ANALYZE] 比特率: " << info.bit_rate << " bps");
+    LOG_DEBUG("[ANALYZE] 流数量: " << format_ctx_->nb_streams);
     
     // 4. 元数据
     if (format_ctx_->metadata) {
@@ -201,9 +201,9 @@ StreamInfo MediaAnalyzer::analyze_stream(AVFormatContext* format_ctx, AVStream*
         }
     }
     
-    std::cout << "[STREAM] 流 #" << stream_index << ": 类型=" << info.codec_type 
+    LOG_DEBUG("[STREAM] 流 #" << stream_index << ": 类型=" << info.codec_type 
               << ", codec_id=" << codecpar->codec_id 
-              << ", 编解码器=" << info.codec_name << std::endl;
+              << ", 编解码器=" << info.codec_name);
     
     info.bit_rate = codecpar->bit_rate;
     
@@ -222,7 +222,7 @@ StreamInfo MediaAnalyzer::analyze_stream(AVFormatContext* format_ctx, AVStream*
         info.width = codecpar->width;
         info.height = codecpar->height;
         
-        std::cout << "[VIDEO] 分辨率: " << info.width << "x" << info.height << std::endl;
+        LOG_DEBUG("[VIDEO] 分辨率: " << info.width << "x" << info.height);
         
         // 安全检查
         if (info.width <= 0 || info.width > 10000) info.width = 0;
@@ -235,7 +235,7 @@ StreamInfo MediaAnalyzer::analyze_stream(AVFormatContext* format_ctx, AVStream*
             info.frame_rate = av_q2d(stream->r_frame_rate);
         }
         
-        std::cout << "[VIDEO] 帧率: " << info.frame_rate << " fps" << std::endl;
+        LOG_DEBUG("[VIDEO] 帧率: " << info.frame_rate << " fps");
         
         // 像素格式
         if (codecpar->format != AV_PIX_FMT_NONE) {
@@ -252,7 +252,7 @@ StreamInfo MediaAnalyzer::analyze_stream(AVFormatContext* format_ctx, AVStream*
         info.sample_rate = codecpar->sample_rate;
         info.channels = codecpar->channels;
         
-        std::cout << "[AUDIO] 采样率: " << info.sample_rate << " Hz, 声道: " << info.channels << std::endl;
+        LOG_DEBUG("[AUDIO] 采样率: " << info.sample_rate << " Hz, 声道: " << info.channels);
         
         // 安全检查
         if (info.sample_rate <= 0 || info.sample_rate > 384000) info.sample_rate = 0;
@@ -274,7 +274,7 @@ StreamInfo MediaAnalyzer::analyze_stream(AVFormatContext* format_ctx, AVStream*
             }
         }
         
-        std::cout << "[AUDIO] 声道布局: " << info.channel_layout << std::endl;
+        LOG_DEBUG("[AUDIO] 声道布局: " << info.channel_layout);
         
         // 采样格式
         if (codecpar->format != AV_SAMPLE_FMT_NONE) {
@@ -0,0 +1,427 @@
+#include "media_index.h"
+#include "logger.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+
+extern "C" {
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+}
+
+namespace fs = std::filesystem;
+
+namespace {
+
+constexpr char INDEX_MAGIC[8] = {'M', 'S', 'I', 'D', 'X', '\0', '\0', '\0'};
+constexpr uint32_t INDEX_VERSION = 1;
+
+// 内存里只缓存最近用到的索引，长片的包索引可达数 MB
+constexpr size_t MAX_CACHED = 32;
+
+bool file_identity(const std::string& path, uint64_t& size, int64_t& mtime) {
+    std::error_code ec;
+    size = fs::file_size(path, ec);
+    if (ec) {
+        return false;
+    }
+    auto time = fs::last_write_time(path, ec);
+    if (ec) {
+        return false;
+    }
+    mtime = static_cast<int64_t>(time.time_since_epoch().count());
+    return true;
+}
+
+int interrupt_callback(void* opaque) {
+    const auto* stop = static_cast<const std::atomic<bool>*>(opaque);
+    return stop && stop->load() ? 1 : 0;
+}
+
+// 索引只是本机缓存，字段按本机字节序原样读写
+template <typename T>
+void put(std::ostream& out, const T& value) {
+    out.write(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+template <typename T>
+bool get(std::istream& in, T& value) {
+    return static_cast<bool>(in.read(reinterpret_cast<char*>(&value), sizeof(value)));
+}
+
+} // namespace
+
+std::shared_ptr<const MediaIndex> MediaIndex::build(const std::string& media_path,
+                                                    const std::atomic<bool>* stop) {
+    auto index = std::make_shared<MediaIndex>();
+    index->media_path_ = media_path;
+    if (!file_identity(media_path, index->file_size_, index->file_mtime_)) {
+        return nullptr;
+    }
+
+    AVFormatContext* input = avformat_alloc_context();
+    if (!input) {
+        return nullptr;
+    }
+    input->interrupt_callback = {&interrupt_callback, const_cast<std::atomic<bool>*>(stop)};
+    if (avformat_open_input(&input, media_path.c_str(), nullptr, nullptr) < 0) {
+        return nullptr;  // 失败时 input 已被释放
+    }
+    if (avformat_find_stream_info(input, nullptr) < 0) {
+        avformat_close_input(&input);
+        return nullptr;
+    }
+
+    // 与转码器相同的主流选择：音频文件的封面图不算视频
+    int stream_index = av_find_best_stream(input, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+    if (stream_index >= 0 && (input->streams[stream_index]->disposition & AV_DISPOSITION_ATTACHED_PIC)) {
+        stream_index = -1;
+    }
+    index->video_ = stream_index >= 0;
+    if (stream_index < 0) {
+        stream_index = av_find_best_stream(input, AVMEDIA_TYPE_AUDIO, -1, -1, nullptr, 0);
+    }
+    if (stream_index < 0) {
+        avformat_close_input(&input);
+        return nullptr;
+    }
+
+    AVStream* stream = input->streams[stream_index];
+    for (unsigned i = 0; i < input->nb_streams; ++i) {
+        if (static_cast<int>(i) != stream_index) {
+            input->streams[i]->discard = AVDISCARD_ALL;
+        }
+    }
+    index->stream_index_ = stream_index;
+    index->time_base_num_ = stream->time_base.num;
+    index->time_base_den_ = stream->time_base.den;
+    index->start_pts_ = av_rescale_q(input->start_time != AV_NOPTS_VALUE ? input->start_time : 0,
+                                     AV_TIME_BASE_Q, stream->time_base);
+    index->duration_ = input->duration > 0 ? static_cast<double>(input->duration) / AV_TIME_BASE : 0.0;
+
+    AVPacket* packet = av_packet_alloc();
+    while (packet && av_read_frame(input, packet) >= 0) {
+        if (packet->stream_index == stream_index) {
+            int64_t pts = packet->pts != AV_NOPTS_VALUE ? packet->pts : packet->dts;
+            if (pts != AV_NOPTS_VALUE && packet->pos >= 0) {
+                index->packets_.push_back({pts, packet->pos, static_cast<uint32_t>(packet->size),
+                                           (packet->flags & AV_PKT_FLAG_KEY) ? KEYFRAME : 0u});
+            }
+        }
+        av_packet_unref(packet);
+    }
+    av_packet_free(&packet);
+    avformat_close_input(&input);
+    if (stop && stop->load()) {
+        return nullptr;
+    }
+
+    // 交错异常的文件里同一流的偏移也可能回退，统一按偏移排序以便二分
+    auto by_pos = [](const Packet& a, const Packet& b) { return a.pos < b.pos; };
+    if (!std::is_sorted(index->packets_.begin(), index->packets_.end(), by_pos)) {
+        std::stable_sort(index->packets_.begin(), index->packets_.end(), by_pos);
+    }
+    for (size_t i = 0; i < index->packets_.size(); ++i) {
+        if (index->packets_[i].flags & KEYFRAME) {
+            index->keyframes_.push_back(static_cast<uint32_t>(i));
+        }
+    }
+    const auto& packets = index->packets_;
+    std::stable_sort(index->keyframes_.begin(), index->keyframes_.end(),
+                     [&packets](uint32_t a, uint32_t b) { return packets[a].pts < packets[b].pts; });
+    return index;
+}
+
+bool MediaIndex::read_header(std::istream& in, const std::string& media_path) {
+    char magic[sizeof(INDEX_MAGIC)];
+    uint32_t version = 0;
+    if (!in.read(magic, sizeof(magic)) || !std::equal(magic, magic + sizeof(magic), INDEX_MAGIC) ||
+        !get(in, version) || version != INDEX_VERSION) {
+        return false;
+    }
+
+    uint32_t path_length = 0;
+    if (!get(in, file_size_) || !get(in, file_mtime_) || !get(in, path_length) || path_length > 4096) {
+        return false;
+    }
+    media_path_.resize(path_length);
+    // 路径散列冲突，或媒体文件已变化
+    return in.read(&media_path_[0], path_length) && media_path_ == media_path && valid_for(media_path);
+}
+
+bool MediaIndex::current(const std::string& index_path, const std::string& media_path) {
+    std::ifstream in(index_path, std::ios::binary);
+    MediaIndex index;
+    return in && index.read_header(in, media_path);
+}
+
+std::shared_ptr<const MediaIndex> MediaIndex::load(const std::string& index_path, const std::string& media_path) {
+    std::ifstream in(index_path, std::ios::binary);
+    auto index = std::make_shared<MediaIndex>();
+    if (!in || !index->read_header(in, media_path)) {
+        return nullptr;
+    }
+
+    uint8_t video = 0;
+    uint64_t packet_count = 0;
+    uint64_t keyframe_count = 0;
+    if (!get(in, index->stream_index_) || !get(in, video) || !get(in, index->time_base_num_) ||
+        !get(in, index->time_base_den_) || !get(in, index->start_pts_) || !get(in, index->duration_) ||
+        !get(in, packet_count) || !get(in, keyframe_count) ||
+        index->time_base_den_ <= 0 || keyframe_count > packet_count || packet_count > (1ull << 32)) {
+        return nullptr;
+    }
+    // 两个数组必须正好装在文件剩余部分里，损坏的计数不能触发巨量分配
+    std::error_code ec;
+    const uint64_t total = fs::file_size(index_path, ec);
+    const std::streamoff offset = in.tellg();
+    if (ec || offset < 0 || static_cast<uint64_t>(offset) > total ||
+        packet_count * sizeof(Packet) + keyframe_count * sizeof(uint32_t) != total - static_cast<uint64_t>(offset)) {
+        return nullptr;
+    }
+    index->video_ = video != 0;
+
+    index->packets_.resize(packet_count);
+    index->keyframes_.resize(keyframe_count);
+    if (!in.read(reinterpret_cast<char*>(index->packets_.data()),
+                 static_cast<std::streamsize>(packet_count * sizeof(Packet))) ||
+        !in.read(reinterpret_cast<char*>(index->keyframes_.data()),
+                 static_cast<std::streamsize>(keyframe_count * sizeof(uint32_t)))) {
+        return nullptr;
+    }
+    for (uint32_t keyframe : index->keyframes_) {
+        if (keyframe >= packet_count) {
+            return nullptr;
+        }
+    }
+    return index;
+}
+
+bool MediaIndex::save(const std::string& index_path) const {
+    // 后台线程与按需构建可能同时保存同一文件的索引，临时文件按线程区分
+    const std::string temp_path = index_path + ".tmp" +
+        std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id()));
+    {
+        std::ofstream out(temp_path, std::ios::binary | std::ios::trunc);
+        if (!out) {
+            return false;
+        }
+        out.write(INDEX_MAGIC, sizeof(INDEX_MAGIC));
+        put(out, INDEX_VERSION);
+        put(out, file_size_);
+        put(out, file_mtime_);
+        put(out, static_cast<uint32_t>(media_path_.size()));
+        out.write(media_path_.data(), static_cast<std::streamsize>(media_path_.size()));
+        put(out, stream_index_);
+        put(out, static_cast<uint8_t>(video_ ? 1 : 0));
+        put(out, time_base_num_);
+        put(out, time_base_den_);
+        put(out, start_pts_);
+        put(out, duration_);
+        put(out, static_cast<uint64_t>(packets_.size()));
+        put(out, static_cast<uint64_t>(keyframes_.size()));
+        out.write(reinterpret_cast<const char*>(packets_.data()),
+                  static_cast<std::streamsize>(packets_.size() * sizeof(Packet)));
+        out.write(reinterpret_cast<const char*>(keyframes_.data()),
+                  static_cast<std::streamsize>(keyframes_.size() * sizeof(uint32_t)));
+        if (!out.flush()) {
+            return false;
+        }
+    }
+    std::error_code ec;
+    fs::rename(temp_path, index_path, ec);
+    if (ec) {
+        fs::remove(temp_path, ec);
+        return false;
+    }
+    return true;
+}
+
+double MediaIndex::seconds(const Packet& packet) const {
+    return static_cast<double>(packet.pts - start_pts_) * time_base_num_ / time_base_den_;
+}
+
+const MediaIndex::Packet* MediaIndex::keyframe_before(double time) const {
+    auto it = std::upper_bound(keyframes_.begin(), keyframes_.end(), time,
+                               [this](double value, uint32_t keyframe) {
+                                   return value < seconds(packets_[keyframe]);
+                               });
+    return it == keyframes_.begin() ? nullptr : &packets_[*(it - 1)];
+}
+
+const MediaIndex::Packet* MediaIndex::keyframe_after(double time) const {
+    auto it = std::lower_bound(keyframes_.begin(), keyframes_.end(), time,
+                               [this](uint32_t keyframe, double value) {
+                                   return seconds(packets_[keyframe]) < value;
+                               });
+    return it == keyframes_.end() ? nullptr : &packets_[*it];
+}
+
+const MediaIndex::Packet* MediaIndex::packet_at(int64_t offset) const {
+    auto it = std::upper_bound(packets_.begin(), packets_.end(), offset,
+                               [](int64_t value, const Packet& packet) { return value < packet.pos; });
+    return it == packets_.begin() ? nullptr : &*(it - 1);
+}
+
+std::vector<double> MediaIndex::keyframe_times() const {
+    std::vector<double> times;
+    times.reserve(keyframes_.size());
+    for (uint32_t keyframe : keyframes_) {
+        times.push_back(seconds(packets_[keyframe]));
+    }
+    return times;
+}
+
+bool MediaIndex::valid_for(const std::string& media_path) const {
+    uint64_t size = 0;
+    int64_t mtime = 0;
+    return file_identity(media_path, size, mtime) && size == file_size_ && mtime == file_mtime_;
+}
+
+MediaIndexer& MediaIndexer::get_instance() {
+    // 有意不析构：后台线程由 atexit 中的 shutdown() 停止
+    static MediaIndexer* instance = new MediaIndexer();
+    return *instance;
+}
+
+MediaIndexer::MediaIndexer() {
+    const char* dir = std::getenv("MEDIA_SERVER_INDEX_DIR");
+    index_dir_ = dir && *dir ? dir : "../media/.index";
+    std::error_code ec;
+    fs::create_directories(index_dir_, ec);
+    if (ec) {
+        LOG_WARN("[Index] 无法创建索引目录 " << index_dir_ << ": " << ec.message());
+    }
+    thread_ = std::thread(&MediaIndexer::run, this);
+    std::atexit([] { MediaIndexer::get_instance().shutdown(); });
+}
+
+void MediaIndexer::shutdown() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_all();
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+void MediaIndexer::enqueue(const std::vector<std::string>& media_paths) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (const std::string& path : media_paths) {
+            if (queued_.insert(path).second) {
+                queue_.push_back(path);
+            }
+        }
+    }
+    wake_.notify_one();
+}
+
+std::string MediaIndexer::index_path(const std::string& media_path) const {
+    // 以路径散列命名；散列冲突时 load() 比对索引里记录的路径
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016zx.idx", std::hash<std::string>{}(media_path));
+    return index_dir_ + "/" + name;
+}
+
+std::shared_ptr<const MediaIndex> MediaIndexer::get(const std::string& media_path, bool build) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = cache_.find(media_path);
+        if (it != cache_.end()) {
+            if (it->second->second->valid_for(media_path)) {
+                lru_.splice(lru_.begin(), lru_, it->second);
+                return it->second->second;
+            }
+            lru_.erase(it->second);
+            cache_.erase(it);
+        }
+    }
+
+    std::shared_ptr<const MediaIndex> index = MediaIndex::load(index_path(media_path), media_path);
+    if (!index && build) {
+        index = build_and_store(media_path);
+    }
+    if (index) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = cache_.find(media_path);
+        if (it != cache_.end()) {
+            // 其他线程同时加载了同一文件
+            it->second->second = index;
+            lru_.splice(lru_.begin(), lru_, it->second);
+        } else {
+            if (cache_.size() >= MAX_CACHED) {
+                cache_.erase(lru_.back().first);
+                lru_.pop_back();
+            }
+            lru_.emplace_front(media_path, index);
+            cache_[media_path] = lru_.begin();
+        }
+    }
+    return index;
+}
+
+std::shared_ptr<const MediaIndex> MediaIndexer::build_and_store(const std::string& media_path) {
+    auto started = std::chrono::steady_clock::now();
+    std::shared_ptr<const MediaIndex> index = MediaIndex::build(media_path, &stopping_);
+    if (!index) {
+        if (!stopping_) {
+            LOG_WARN("[Index] 无法建立索引: " << media_path);
+            std::lock_guard<std::mutex> lock(mutex_);
+            ++failed_total_;
+        }
+        return nullptr;
+    }
+    if (!index->save(index_path(media_path))) {
+        LOG_WARN("[Index] 无法保存索引: " << media_path);
+    }
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - started).count();
+    LOG_INFO("[Index] " << media_path << ": " << index->packet_count() << " 个包, "
+             << index->keyframe_count() << " 个关键帧 (" << elapsed << " ms)");
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ++built_total_;
+    }
+    return index;
+}
+
+void MediaIndexer::run() {
+    for (;;) {
+        std::string path;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            wake_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+            if (stopping_) {
+                return;
+            }
+            path = std::move(queue_.front());
+            queue_.pop_front();
+        }
+
+        // 磁盘上已有有效索引的文件只校验文件头，不读入内存
+        if (!MediaIndex::current(index_path(path), path)) {
+            build_and_store(path);
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        queued_.erase(path);
+    }
+}
+
+MediaIndexer::Stats MediaIndexer::stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Stats stats;
+    stats.pending = queue_.size();
+    stats.cached = cache_.size();
+    stats.built_total = built_total_;
+    stats.failed_total = failed_total_;
+    return stats;
+}
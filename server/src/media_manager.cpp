@@ -1,5 +1,7 @@
 #include "media_manager.h"
-#include <iostream>
+#include "logger.h"
+#include "json_writer.h"
+#include "media_index.h"
 #include <filesystem>
 #include <chrono>
 #include <iomanip>
@@ -9,6 +11,7 @@
 #include <cctype>
 #include <memory>
 #include <atomic>
+#include <cstdio>
 
 namespace fs = std::filesystem;
 
@@ -75,6 +78,11 @@ MediaFile MediaFile::from_media_info(const MediaInfo& info, const std::string& f
 
 MediaManager::MediaManager() {
     analyzer_ = std::make_unique<MediaAnalyzer>();
+    char tag[24];
+    snprintf(tag, sizeof(tag), "%llx", static_cast<unsigned long long>(
+        std::chrono::system_clock::now().time_since_epoch().count()));
+    instance_tag_ = tag;
+    catalog_ = build_catalog(media_files_, generation_);
 }
 
 MediaManager& MediaManager::get_instance() {
@@ -83,21 +91,22 @@ MediaManager& MediaManager::get_instance() {
 }
 
 bool MediaManager::scan_directory(const std::string& path) {
-    std::lock_guard<std::mutex> lock(mutex_);
+    // 扫描过程（逐个文件 FFmpeg 探测）只持有 scan_mutex_；媒体库本身在扫描结束后
+    // 一次性替换，扫描期间 get_all_media() 等查询照常返回旧结果，不被阻塞
+    std::lock_guard<std::mutex> scan_lock(scan_mutex_);
     
     try {
         if (!fs::exists(path) || !fs::is_directory(path)) {
-            std::cerr << "Error: Directory does not exist: " << path << std::endl;
+            LOG_ERROR("Error: Directory does not exist: " << path);
             return false;
         }
         
-        media_files_.clear();
-        media_map_.clear();
+        std::vector<MediaFile> scanned;
         
-        std::cout << "========================================" << std::endl;
-        std::cout << "Scanning media directory with FFmpeg:" << std::endl;
-        std::cout << "  Path: " << path << std::endl;
-        std::cout << "========================================" << std::endl;
+        LOG_INFO("========================================");
+        LOG_INFO("Scanning media directory with FFmpeg:");
+        LOG_INFO("  Path: " << path);
+        LOG_INFO("========================================");
         
         int processed = 0;
         int successful = 0;
@@ -132,56 +141,84 @@ bool MediaManager::scan_directory(const std::string& path) {
                                 ftime - fs::file_time_type::clock::now() + std::chrono::system_clock::now());
                             auto cftime = std::chrono::system_clock::to_time_t(sctp);
                             
+                            std::tm local_time{};
+                            localtime_r(&cftime, &local_time);
                             std::stringstream ss;
-                            ss << std::put_time(std::localtime(&cftime), "%Y-%m-%d %H:%M:%S");
+                            ss << std::put_time(&local_time, "%Y-%m-%d %H:%M:%S");
                             media_file.created_time = ss.str();
                             
                             // 添加到列表
-                            media_files_.push_back(media_file);
-                            media_map_[media_file.id] = &media_files_.back();
+                            scanned.push_back(media_file);
                             successful++;
                             
                             // 输出分析结果
-                            std::cout << "✓ [" << successful << "] " << filename << std::endl;
-                            std::cout << "  Duration: " << std::fixed << std::setprecision(2) 
-                                      << media_file.duration << "s" << std::endl;
-                            std::cout << "  Resolution: " << media_file.width << "x" << media_file.height << std::endl;
-                            std::cout << "  Video: " << media_file.video_codec << " @ " 
-                                      << media_file.frame_rate << "fps" << std::endl;
-                            std::cout << "  Audio: " << media_file.audio_codec << " " 
-                                      << media_file.audio_sample_rate << "Hz " 
-                                      << media_file.channel_layout << std::endl;
+                            LOG_INFO("✓ [" << successful << "] " << filename);
+                            LOG_INFO("  Duration: " << std::fixed << std::setprecision(2) 
+                                     << media_file.duration << "s");
+                            LOG_INFO("  Resolution: " << media_file.width << "x" << media_file.height);
+                            LOG_INFO("  Video: " << media_file.video_codec << " @ " 
+                                     << media_file.frame_rate << "fps");
+                            LOG_INFO("  Audio: " << media_file.audio_codec << " " 
+                                     << media_file.audio_sample_rate << "Hz " 
+                                     << media_file.channel_layout);
                             if (!media_file.metadata.empty()) {
-                                std::cout << "  Metadata: " << media_file.metadata.size() << " entries" << std::endl;
+                                LOG_INFO("  Metadata: " << media_file.metadata.size() << " entries");
                             }
-                            std::cout << std::endl;
                             
                         } else {
-                            std::cerr << "✗ Failed to analyze: " << filename 
-                                      << " - " << media_info.error_message << std::endl;
+                            LOG_ERROR("✗ Failed to analyze: " << filename 
+                                      << " - " << media_info.error_message);
                             skipped++;
                         }
                     } catch (const std::exception& e) {
-                        std::cerr << "✗ Exception analyzing: " << filename 
-                                  << " - " << e.what() << std::endl;
+                        LOG_ERROR("✗ Exception analyzing: " << filename 
+                                  << " - " << e.what());
                         skipped++;
                     }
                 }
             }
         }
         
-        std::cout << "========================================" << std::endl;
-        std::cout << "Scan Summary:" << std::endl;
-        std::cout << "  Total processed: " << processed << std::endl;
-        std::cout << "  Successfully analyzed: " << successful << std::endl;
-        std::cout << "  Failed/Skipped: " << skipped << std::endl;
-        std::cout << "  Total in library: " << media_files_.size() << " media files" << std::endl;
-        std::cout << "========================================" << std::endl;
+        LOG_INFO("========================================");
+        LOG_INFO("Scan Summary:");
+        LOG_INFO("  Total processed: " << processed);
+        LOG_INFO("  Successfully analyzed: " << successful);
+        LOG_INFO("  Failed/Skipped: " << skipped);
+        LOG_INFO("  Total in library: " << scanned.size() << " media files");
+        LOG_INFO("========================================");
+        
+        // 扫描由 scan_mutex_ 串行化，generation_ 只在这里递增；序列化在锁外完成
+        uint64_t generation;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            generation = generation_ + 1;
+        }
+        auto catalog = build_catalog(scanned, generation);
+        
+        // 包索引在后台逐个建立（已有且未失效的直接跳过），扫描本身不等待
+        std::vector<std::string> paths;
+        paths.reserve(scanned.size());
+        for (const auto& media : scanned) {
+            paths.push_back(media.path);
+        }
+        MediaIndexer::get_instance().enqueue(paths);
+        
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            generation_ = generation;
+            catalog_ = std::move(catalog);
+            media_files_ = std::move(scanned);
+            // 向量不再增长后再建立索引，指针不会因扩容失效
+            media_map_.clear();
+            for (auto& media : media_files_) {
+                media_map_[media.id] = &media;
+            }
+        }
         
         return successful > 0;
         
     } catch (const std::exception& e) {
-        std::cerr << "Error scanning directory: " << e.what() << std::endl;
+        LOG_ERROR("Error scanning directory: " << e.what());
         return false;
     }
 }
@@ -191,20 +228,71 @@ std::vector<MediaFile> MediaManager::get_all_media() const {
     return media_files_;
 }
 
-MediaFile* MediaManager::get_media(const std::string& id) {
+std::shared_ptr<const MediaCatalog> MediaManager::get_catalog() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return catalog_;
+}
+
+std::shared_ptr<const MediaCatalog> MediaManager::build_catalog(const std::vector<MediaFile>& files,
+                                                               uint64_t generation) const {
+    auto catalog = std::make_shared<MediaCatalog>();
+    catalog->generation = generation;
+    catalog->etag = "\"catalog-" + instance_tag_ + "-" + std::to_string(generation) + "\"";
+    catalog->headers = "ETag: " + catalog->etag + "\r\nCache-Control: no-cache\r\n";
+    
+    // 字段沿用原有格式：数值也以字符串输出，前端按 parseInt / parseFloat 读取
+    std::string& json = catalog->json;
+    json.reserve(64 + files.size() * 256);
+    JsonWriter writer(json);
+    writer.begin_object();
+    writer.key("media_files").begin_array();
+    char number[32];
+    for (const auto& file : files) {
+        writer.begin_object();
+        writer.field("id", file.id);
+        writer.field("filename", file.filename);
+        writer.field("path", file.path);
+        snprintf(number, sizeof(number), "%g", file.duration);
+        writer.field("duration", number);
+        writer.field("size", std::to_string(file.size));
+        writer.field("width", std::to_string(file.width));
+        writer.field("height", std::to_string(file.height));
+        writer.field("video_codec", file.video_codec);
+        writer.field("audio_codec", file.audio_codec);
+        writer.end_object();
+    }
+    writer.end_array();
+    writer.field("count", files.size());
+    if (files.empty()) {
+        writer.field("message", "No media files found");
+    }
+    writer.end_object();
+    return catalog;
+}
+
+std::optional<MediaFile> MediaManager::get_media(const std::string& id) const {
     std::lock_guard<std::mutex> lock(mutex_);
     auto it = media_map_.find(id);
-    return (it != media_map_.end()) ? it->second : nullptr;
+    if (it == media_map_.end()) {
+        return std::nullopt;
+    }
+    return *it->second;
 }
 
-MediaFile* MediaManager::get_media_by_name(const std::string& filename) {
+std::string MediaManager::get_media_path(const std::string& id) const {
     std::lock_guard<std::mutex> lock(mutex_);
-    for (auto& media : media_files_) {
+    auto it = media_map_.find(id);
+    return (it != media_map_.end()) ? it->second->path : std::string();
+}
+
+std::optional<MediaFile> MediaManager::get_media_by_name(const std::string& filename) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto& media : media_files_) {
         if (media.filename == filename) {
-            return &media;
+            return media;
         }
     }
-    return nullptr;
+    return std::nullopt;
 }
 
 std::vector<MediaFile> MediaManager::search(const std::string& query) const {
@@ -0,0 +1,265 @@
+#include "metrics.h"
+#include <algorithm>
+#include <cstdio>
+
+const int LatencyBuckets::SUB_BUCKET_BITS;
+const int LatencyBuckets::SUB_BUCKETS;
+const int LatencyBuckets::MAX_MAGNITUDE;
+const int LatencyBuckets::COUNT;
+
+namespace {
+
+// 对外暴露的直方图边界（秒）。内部桶按上界归入第一个不小于它的边界
+const double EXPOSED_BOUNDS[] = {
+    0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025,
+    0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10
+};
+const size_t EXPOSED_BOUND_COUNT = sizeof(EXPOSED_BOUNDS) / sizeof(EXPOSED_BOUNDS[0]);
+
+const double QUANTILES[] = {0.5, 0.9, 0.99, 0.999};
+const char* const QUANTILE_LABELS[] = {"0.5", "0.9", "0.99", "0.999"};
+
+const char* const STATUS_CLASSES[] = {"1xx", "2xx", "3xx", "4xx", "5xx"};
+
+// 单写者计数：只有所属线程写入，不需要原子读-改-写
+inline void bump(std::atomic<uint64_t>& counter, uint64_t delta) {
+    counter.store(counter.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+}
+
+void append_label_value(std::string& out, std::string_view value) {
+    for (char c : value) {
+        switch (c) {
+            case '\\': out += "\\\\"; break;
+            case '"': out += "\\\""; break;
+            case '\n': out += "\\n"; break;
+            default: out += c; break;
+        }
+    }
+}
+
+} // namespace
+
+int LatencyBuckets::index(uint64_t micros) {
+    if (micros < static_cast<uint64_t>(SUB_BUCKETS)) {
+        return static_cast<int>(micros);
+    }
+    int magnitude = 63 - __builtin_clzll(micros);
+    if (magnitude > MAX_MAGNITUDE) {
+        return COUNT - 1;
+    }
+    int shift = magnitude - SUB_BUCKET_BITS;
+    int sub = static_cast<int>((micros >> shift) & (SUB_BUCKETS - 1));
+    return (shift + 1) * SUB_BUCKETS + sub;
+}
+
+uint64_t LatencyBuckets::upper_bound(int index) {
+    if (index < SUB_BUCKETS) {
+        return static_cast<uint64_t>(index);
+    }
+    int shift = index / SUB_BUCKETS - 1;
+    int sub = index % SUB_BUCKETS;
+    return (static_cast<uint64_t>(SUB_BUCKETS + sub + 1) << shift) - 1;
+}
+
+void PrometheusText::family(const char* name, const char* type, const char* help) {
+    out_ += "# HELP ";
+    out_ += name;
+    out_ += ' ';
+    out_ += help;
+    out_ += "\n# TYPE ";
+    out_ += name;
+    out_ += ' ';
+    out_ += type;
+    out_ += '\n';
+}
+
+void PrometheusText::begin_sample(const char* name, Labels labels) {
+    out_ += name;
+    if (labels.size() > 0) {
+        out_ += '{';
+        bool first = true;
+        for (const auto& [label, value] : labels) {
+            if (!first) {
+                out_ += ',';
+            }
+            first = false;
+            out_ += label;
+            out_ += "=\"";
+            append_label_value(out_, value);
+            out_ += '"';
+        }
+        out_ += '}';
+    }
+    out_ += ' ';
+}
+
+void PrometheusText::sample(const char* name, Labels labels, uint64_t value) {
+    begin_sample(name, labels);
+    out_ += std::to_string(value);
+    out_ += '\n';
+}
+
+void PrometheusText::sample(const char* name, Labels labels, double value) {
+    begin_sample(name, labels);
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "%.9g", value);
+    out_ += buffer;
+    out_ += '\n';
+}
+
+Metrics& Metrics::get_instance() {
+    static Metrics instance;
+    return instance;
+}
+
+Metrics::Shard::Shard(size_t slots)
+    : route_slots(slots),
+      routes(new RouteCounters[slots]()) {
+}
+
+void Metrics::set_routes(const std::vector<std::pair<std::string, std::string>>& method_and_pattern) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    routes_ = method_and_pattern;
+    route_slots_.store(routes_.size() + 1, std::memory_order_release);
+}
+
+Metrics::Shard* Metrics::local_shard() {
+    // 分片大小按首次记录时的路由数确定；路由表只在启动时编译，之后不变
+    thread_local Shard* shard = nullptr;
+    if (!shard) {
+        auto created = std::make_unique<Shard>(route_slots_.load(std::memory_order_acquire));
+        shard = created.get();
+        std::lock_guard<std::mutex> lock(mutex_);
+        shards_.push_back(std::move(created));
+    }
+    return shard;
+}
+
+void Metrics::record_request(int route_index, int status, uint64_t latency_micros, uint64_t bytes) {
+    Shard* shard = local_shard();
+    size_t slot = route_index >= 0 ? static_cast<size_t>(route_index) : shard->route_slots - 1;
+    if (slot >= shard->route_slots) {
+        return;
+    }
+
+    RouteCounters& counters = shard->routes[slot];
+    int status_class = status / 100 - 1;
+    if (status_class >= 0 && status_class < 5) {
+        bump(counters.by_class[status_class], 1);
+    }
+    bump(counters.bytes, bytes);
+    bump(counters.latency_sum_micros, latency_micros);
+    bump(counters.buckets[LatencyBuckets::index(latency_micros)], 1);
+}
+
+void Metrics::render(PrometheusText& out) const {
+    struct Totals {
+        uint64_t by_class[5] = {};
+        uint64_t bytes = 0;
+        uint64_t latency_sum_micros = 0;
+        uint64_t count = 0;
+        std::vector<uint64_t> buckets = std::vector<uint64_t>(LatencyBuckets::COUNT);
+    };
+
+    std::vector<std::pair<std::string, std::string>> routes;
+    std::vector<Totals> totals;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        routes = routes_;
+        routes.emplace_back("", "unmatched");
+        totals.resize(routes.size());
+        for (const auto& shard : shards_) {
+            size_t slots = std::min(shard->route_slots, totals.size());
+            for (size_t i = 0; i < slots; ++i) {
+                // 未匹配请求固定记在分片的最后一个槽位
+                size_t target = i + 1 == shard->route_slots ? totals.size() - 1 : i;
+                const RouteCounters& counters = shard->routes[i];
+                Totals& sum = totals[target];
+                for (int c = 0; c < 5; ++c) {
+                    uint64_t n = counters.by_class[c].load(std::memory_order_relaxed);
+                    sum.by_class[c] += n;
+                    sum.count += n;
+                }
+                sum.bytes += counters.bytes.load(std::memory_order_relaxed);
+                sum.latency_sum_micros += counters.latency_sum_micros.load(std::memory_order_relaxed);
+                for (int b = 0; b < LatencyBuckets::COUNT; ++b) {
+                    sum.buckets[b] += counters.buckets[b].load(std::memory_order_relaxed);
+                }
+            }
+        }
+    }
+
+    out.family("media_server_http_requests_total", "counter", "HTTP requests by route pattern and status class");
+    for (size_t i = 0; i < routes.size(); ++i) {
+        for (int c = 0; c < 5; ++c) {
+            if (totals[i].by_class[c] > 0) {
+                out.sample("media_server_http_requests_total",
+                           {{"method", routes[i].first}, {"route", routes[i].second}, {"code", STATUS_CLASSES[c]}},
+                           totals[i].by_class[c]);
+            }
+        }
+    }
+
+    out.family("media_server_http_response_bytes_total", "counter", "Response bytes queued for sending, headers included");
+    for (size_t i = 0; i < routes.size(); ++i) {
+        if (totals[i].count > 0) {
+            out.sample("media_server_http_response_bytes_total",
+                       {{"method", routes[i].first}, {"route", routes[i].second}}, totals[i].bytes);
+        }
+    }
+
+    out.family("media_server_http_request_duration_seconds", "histogram",
+               "Time from a parsed request to its queued response");
+    for (size_t i = 0; i < routes.size(); ++i) {
+        const Totals& sum = totals[i];
+        if (sum.count == 0) {
+            continue;
+        }
+        std::string_view method = routes[i].first;
+        std::string_view route = routes[i].second;
+
+        uint64_t cumulative = 0;
+        int bucket = 0;
+        for (size_t b = 0; b < EXPOSED_BOUND_COUNT; ++b) {
+            double bound_micros = EXPOSED_BOUNDS[b] * 1e6;
+            while (bucket < LatencyBuckets::COUNT &&
+                   static_cast<double>(LatencyBuckets::upper_bound(bucket)) <= bound_micros) {
+                cumulative += sum.buckets[bucket++];
+            }
+            char le[16];
+            snprintf(le, sizeof(le), "%g", EXPOSED_BOUNDS[b]);
+            out.sample("media_server_http_request_duration_seconds_bucket",
+                       {{"method", method}, {"route", route}, {"le", le}}, cumulative);
+        }
+        out.sample("media_server_http_request_duration_seconds_bucket",
+                   {{"method", method}, {"route", route}, {"le", "+Inf"}}, sum.count);
+        out.sample("media_server_http_request_duration_seconds_sum",
+                   {{"method", method}, {"route", route}}, static_cast<double>(sum.latency_sum_micros) / 1e6);
+        out.sample("media_server_http_request_duration_seconds_count",
+                   {{"method", method}, {"route", route}}, sum.count);
+    }
+
+    // 直方图的对外边界较粗，分位数按内部的细粒度分桶计算
+    out.family("media_server_http_request_latency_quantile_seconds", "gauge",
+               "Latency quantiles since start, from the high-resolution histogram");
+    for (size_t i = 0; i < routes.size(); ++i) {
+        const Totals& sum = totals[i];
+        if (sum.count == 0) {
+            continue;
+        }
+        for (size_t q = 0; q < sizeof(QUANTILES) / sizeof(QUANTILES[0]); ++q) {
+            uint64_t rank = static_cast<uint64_t>(QUANTILES[q] * static_cast<double>(sum.count - 1)) + 1;
+            uint64_t seen = 0;
+            int bucket = 0;
+            for (; bucket < LatencyBuckets::COUNT - 1; ++bucket) {
+                seen += sum.buckets[bucket];
+                if (seen >= rank) {
+                    break;
+                }
+            }
+            out.sample("media_server_http_request_latency_quantile_seconds",
+                       {{"method", routes[i].first}, {"route", routes[i].second}, {"quantile", QUANTILE_LABELS[q]}},
+                       static_cast<double>(LatencyBuckets::upper_bound(bucket)) / 1e6);
+        }
+    }
+}
@@ -0,0 +1,165 @@
+#include "route_trie.h"
+#include <algorithm>
+
+const size_t RouteTrie::MAX_PARAMS;
+
+namespace {
+
+// 从 pos 开始跳过连续的 '/'，取出下一段；没有更多段时返回 false
+bool next_segment(std::string_view path, size_t& pos, std::string_view& segment) {
+    while (pos < path.size() && path[pos] == '/') {
+        ++pos;
+    }
+    if (pos >= path.size()) {
+        return false;
+    }
+    size_t end = path.find('/', pos);
+    if (end == std::string_view::npos) {
+        end = path.size();
+    }
+    segment = path.substr(pos, end - pos);
+    pos = end;
+    return true;
+}
+
+} // namespace
+
+std::string_view RouteTrie::Match::param(std::string_view name) const {
+    for (size_t i = 0; i < param_count; ++i) {
+        if (params[i].first == name) {
+            return params[i].second;
+        }
+    }
+    return {};
+}
+
+RouteTrie::RouteTrie() {
+    clear();
+}
+
+void RouteTrie::clear() {
+    nodes_.clear();
+    nodes_.emplace_back();  // 根节点
+}
+
+int RouteTrie::add_child(int parent, std::string_view segment) {
+    if (segment[0] == ':' || segment[0] == '*') {
+        bool wildcard = segment[0] == '*';
+        int existing = wildcard ? nodes_[parent].wildcard_child : nodes_[parent].param_child;
+        if (existing >= 0) {
+            return existing;
+        }
+
+        int child = static_cast<int>(nodes_.size());
+        nodes_.emplace_back();
+        nodes_[child].param_name = std::string(segment.substr(1));
+        if (wildcard) {
+            nodes_[parent].wildcard_child = child;
+        } else {
+            nodes_[parent].param_child = child;
+        }
+        return child;
+    }
+
+    auto& children = nodes_[parent].static_children;
+    auto it = std::lower_bound(children.begin(), children.end(), segment,
+                               [](const std::pair<std::string, int>& entry, std::string_view key) {
+                                   return std::string_view(entry.first) < key;
+                               });
+    if (it != children.end() && it->first == segment) {
+        return it->second;
+    }
+
+    int child = static_cast<int>(nodes_.size());
+    children.insert(it, {std::string(segment), child});
+    nodes_.emplace_back();
+    return child;
+}
+
+void RouteTrie::insert(const std::string& method, const std::string& pattern, int route_index) {
+    int node = 0;
+    size_t pos = 0;
+    std::string_view segment;
+    std::string_view path(pattern);
+
+    while (next_segment(path, pos, segment)) {
+        node = add_child(node, segment);
+        if (segment[0] == '*') {
+            break;  // 通配段之后的内容被忽略
+        }
+    }
+
+    auto& handlers = nodes_[node].handlers;
+    for (const auto& entry : handlers) {
+        if (entry.first == method) {
+            return;
+        }
+    }
+    handlers.emplace_back(method, route_index);
+}
+
+int RouteTrie::handler_for(const Node& node, std::string_view method) const {
+    for (const auto& entry : node.handlers) {
+        if (entry.first == method) {
+            return entry.second;
+        }
+    }
+    return -1;
+}
+
+bool RouteTrie::find(std::string_view method, std::string_view path, Match& match) const {
+    match.route_index = -1;
+    match.param_count = 0;
+    return match_from(0, method, path, 0, match);
+}
+
+bool RouteTrie::match_from(int node_index, std::string_view method, std::string_view path,
+                           size_t pos, Match& match) const {
+    const Node& node = nodes_[node_index];
+    std::string_view segment;
+    size_t next_pos = pos;
+
+    if (!next_segment(path, next_pos, segment)) {
+        int route = handler_for(node, method);
+        if (route >= 0) {
+            match.route_index = route;
+            return true;
+        }
+        return false;
+    }
+
+    // 1. 静态段
+    auto it = std::lower_bound(node.static_children.begin(), node.static_children.end(), segment,
+                               [](const std::pair<std::string, int>& entry, std::string_view key) {
+                                   return std::string_view(entry.first) < key;
+                               });
+    if (it != node.static_children.end() && it->first == segment &&
+        match_from(it->second, method, path, next_pos, match)) {
+        return true;
+    }
+
+    // 2. 参数段
+    if (node.param_child >= 0 && match.param_count < MAX_PARAMS) {
+        const Node& child = nodes_[node.param_child];
+        size_t saved_count = match.param_count;
+        match.params[match.param_count++] = {child.param_name, segment};
+        if (match_from(node.param_child, method, path, next_pos, match)) {
+            return true;
+        }
+        match.param_count = saved_count;
+    }
+
+    // 3. 通配段：吞掉剩余路径
+    if (node.wildcard_child >= 0 && match.param_count < MAX_PARAMS) {
+        const Node& child = nodes_[node.wildcard_child];
+        int route = handler_for(child, method);
+        if (route >= 0) {
+            size_t start = next_pos - segment.size();
+            match.params[match.param_count++] = {child.param_name, path.substr(start)};
+            match.route_index = route;
+            return true;
+        }
+    }
+
+    return false;
+}
@@ -1,28 +1,55 @@
 #include "routes.h"
+#include "logger.h"
 #include "media_manager.h"
 #include "hls_processor.h"
-#include <iostream>
+#include "transcode_scheduler.h"
+#include "media_index.h"
+#include "http_range.h"
+#include "static_asset_cache.h"
+#include "metrics.h"
+#include "json_writer.h"
+#include <algorithm>
 #include <chrono>
-#include <iomanip>
-#include <sstream>
 #include <vector>
 #include <map>
 #include <functional>
-#include <fstream>
-#include <filesystem>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
-namespace fs = std::filesystem;
+using RouteParams = SimpleServer::RouteParams;
 
-// Helper function to read file content
-std::string read_file(const std::string& path) {
-    std::ifstream file(path, std::ios::binary);
-    if (!file) {
-        return "";
+// 固定内容的 JSON 响应体只构造一次，之后每个响应只增加引用计数
+static HttpResponse literal_json(int status, const std::shared_ptr<const std::string>& body) {
+    return HttpResponse::shared(status, "application/json", body);
+}
+
+static std::shared_ptr<const std::string> literal_body(const char* text) {
+    return std::make_shared<const std::string>(text);
+}
+
+static const auto NOT_FOUND_BODY = literal_body("{\"error\": \"Not found\"}");
+static const auto MEDIA_NOT_FOUND_BODY = literal_body("{\"error\": \"Media not found\"}");
+static const auto MEDIA_FILE_MISSING_BODY = literal_body("{\"error\": \"Media file missing\"}");
+static const auto MISSING_MEDIA_ID_BODY =
+    literal_body("{\"success\":false,\"error\":\"Missing media_id parameter\"}");
+static const auto STREAM_CREATE_FAILED_BODY =
+    literal_body("{\"success\":false,\"error\":\"Failed to create stream\"}");
+
+// 字符串键值表输出为 JSON 对象（值一律为字符串，与原有接口格式一致）
+static void append_json_object(std::string& body, const std::map<std::string, std::string>& fields) {
+    JsonWriter json(body);
+    json.begin_object();
+    for (const auto& [key, value] : fields) {
+        json.field(key, value);
     }
-    
-    std::ostringstream ss;
-    ss << file.rdbuf();
-    return ss.str();
+    json.end_object();
+}
+
+// If-None-Match 是否列出了 etag（或为 *）
+static bool etag_listed(std::string_view if_none_match, std::string_view etag) {
+    return if_none_match.find(etag) != std::string_view::npos ||
+           if_none_match.find('*') != std::string_view::npos;
 }
 
 // Get MIME type for file extension
@@ -61,355 +88,345 @@ std::string get_mime_type(const std::string& path) {
     return it != mime_types.end() ? it->second : "application/octet-stream";
 }
 
+// Web 前端资源缓存，首次使用时创建
+StaticAssetCache& static_assets() {
+    static StaticAssetCache cache("../web", get_mime_type);
+    return cache;
+}
+
+// 缓存命中：按 Accept-Encoding 选择预压缩版本，If-None-Match 命中时返回 304。
+// 消息体与头部都是资源加载时生成的共享缓冲区，响应只持有引用
+HttpResponse serve_cached_asset(const HttpRequest& request, const std::shared_ptr<const StaticAssetCache::Asset>& asset) {
+    const std::string* accept_encoding = request.get_header("Accept-Encoding");
+    const StaticAssetCache::Variant& variant = asset->select(accept_encoding ? *accept_encoding : std::string_view());
+
+    const std::string* if_none_match = request.get_header("If-None-Match");
+    if (if_none_match && variant.matches(*if_none_match)) {
+        HttpResponse response(304);
+        response.header_block = std::shared_ptr<const std::string>(asset, &variant.not_modified_headers);
+        return response;
+    }
+
+    HttpResponse response(200);
+    response.shared_body = variant.body;
+    response.header_block = std::shared_ptr<const std::string>(asset, &variant.response_headers);
+    return response;
+}
+
 // Static file handler
-std::string serve_static_file(const std::string& request_path) {
-    // Clean the path
+HttpResponse serve_static_file(const HttpRequest& request, const std::string& request_path) {
+    // Clean the path (query string is already split off by the parser)
     std::string clean_path = request_path;
     if (clean_path == "/") {
         clean_path = "/index.html";
     }
     
-    // Remove query parameters
-    size_t query_pos = clean_path.find('?');
-    if (query_pos != std::string::npos) {
-        clean_path = clean_path.substr(0, query_pos);
-    }
-    
     // Security: prevent directory traversal
     if (clean_path.find("..") != std::string::npos) {
-        return "HTTP/1.1 403 Forbidden\r\n"
-               "Content-Type: text/plain\r\n"
-               "Connection: close\r\n"
-               "\r\n"
-               "Forbidden";
+        return HttpResponse::text(403, "Forbidden");
     }
     
-    // Map to web directory
-    std::string file_path = "../web" + clean_path;
+    if (auto asset = static_assets().lookup(clean_path)) {
+        return serve_cached_asset(request, asset);
+    }
+
+    // 未缓存（过大或正在后台加载）的文件直接从磁盘发送
+    std::string file_path = static_assets().root() + clean_path;
     
-    // Default to index.html for directories
-    if (fs::is_directory(file_path)) {
+    // Open once and fstat the descriptor: the body is sent straight from it with sendfile
+    int fd = open(file_path.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat file_stat{};
+    if (fd >= 0 && fstat(fd, &file_stat) == 0 && S_ISDIR(file_stat.st_mode)) {
+        // Default to index.html for directories
+        close(fd);
         file_path += "/index.html";
+        fd = open(file_path.c_str(), O_RDONLY | O_CLOEXEC);
     }
     
     // Check if file exists
-    if (!fs::exists(file_path) || !fs::is_regular_file(file_path)) {
-        return "HTTP/1.1 404 Not Found\r\n"
-               "Content-Type: text/plain\r\n"
-               "Connection: close\r\n"
-               "\r\n"
-               "File not found: " + clean_path;
-    }
-    
-    // Read file content
-    std::string content = read_file(file_path);
-    if (content.empty()) {
-        return "HTTP/1.1 500 Internal Server Error\r\n"
-               "Content-Type: text/plain\r\n"
-               "Connection: close\r\n"
-               "\r\n"
-               "Error reading file";
+    if (fd < 0 || fstat(fd, &file_stat) != 0 || !S_ISREG(file_stat.st_mode)) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        return HttpResponse::text(404, "File not found: " + clean_path);
     }
     
-    // Get MIME type
-    std::string mime_type = get_mime_type(file_path);
-    
-    // Build response
-    std::stringstream response;
-    response << "HTTP/1.1 200 OK\r\n"
-             << "Content-Type: " << mime_type << "\r\n"
-             << "Connection: close\r\n"
-             << "\r\n"
-             << content;
-    
-    return response.str();
+    // The server adds Content-Length and streams the file body
+    return HttpResponse::file(200, get_mime_type(file_path), fd, 0, static_cast<size_t>(file_stat.st_size));
 }
 
-std::string create_json_response(const std::string& message, bool success) {
-    std::stringstream ss;
-    ss << "HTTP/1.1 " << (success ? "200 OK" : "400 Bad Request") << "\r\n"
-       << "Content-Type: application/json\r\n"
-       << "Connection: close\r\n"
-       << "\r\n"
-       << "{"
-       << "\"success\": " << (success ? "true" : "false") << ", "
-       << "\"message\": \"" << message << "\", "
-       << "\"timestamp\": " << std::chrono::duration_cast<std::chrono::seconds>(
-           std::chrono::system_clock::now().time_since_epoch()).count()
-       << "}";
-    return ss.str();
+HttpResponse create_json_response(const std::string& message, bool success) {
+    std::string body;
+    body.reserve(64 + message.size());
+    body += success ? "{\"success\": true, " : "{\"success\": false, ";
+    body += "\"message\": ";
+    JsonWriter::append_string(body, message);
+    body += ", \"timestamp\": ";
+    body += std::to_string(std::chrono::duration_cast<std::chrono::seconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count());
+    body += "}";
+    return HttpResponse::json(success ? 200 : 400, std::move(body));
 }
 
 void setup_routes(SimpleServer& server) {
-    std::cout << "Setting up routes..." << std::endl;
+    LOG_INFO("Setting up routes...");
     
     // Initialize media manager
     auto& media_mgr = MediaManager::get_instance();
     media_mgr.scan_directory("../media");
+
+    // 前端资源在启动时读入并压缩，首个页面请求无需等待
+    static_assets().warm();
     
     // 1. 首先注册API路由，避免被静态文件路由拦截
     
     // Server status
-    server.get("/api/status", [](const std::string&) -> std::string {
+    server.get("/api/status", [](const HttpRequest&, const RouteParams&) {
         auto now = std::chrono::system_clock::now();
         auto time = std::chrono::system_clock::to_time_t(now);
+        std::tm local_time{};
+        localtime_r(&time, &local_time);  // 多个事件循环线程并发调用，避免 std::localtime 的共享缓冲区
         
-        std::stringstream ss;
-        ss << "HTTP/1.1 200 OK\r\n"
-           << "Content-Type: application/json\r\n"
-           << "Connection: close\r\n"
-           << "\r\n"
-           << "{"
-           << "\"status\": \"running\", "
-           << "\"time\": \"" << std::put_time(std::localtime(&time), "%Y-%m-%d %H:%M:%S") << "\", "
-           << "\"uptime\": 0, "
-           << "\"version\": \"1.0.0\""
-           << "}";
-        return ss.str();
-    });
+        char body[128];
+        size_t length = strftime(body, sizeof(body),
+                                 "{\"status\": \"running\", \"time\": \"%Y-%m-%d %H:%M:%S\", "
+                                 "\"uptime\": 0, \"version\": \"1.0.0\"}", &local_time);
+        return HttpResponse::json(200, std::string(body, length));
+    }, SimpleServer::Dispatch::Inline, SimpleServer::Priority::Critical);
     
-    // Media list
-	server.get("/api/media/list", [](const std::string&) -> std::string {
-		auto& media_mgr = MediaManager::get_instance();
-		auto media_files = media_mgr.get_all_media();
-		
-		std::stringstream ss;
-		ss << "HTTP/1.1 200 OK\r\n"
-		   << "Content-Type: application/json\r\n"
-		   << "Connection: close\r\n"
-		   << "\r\n";
-		
-		if (media_files.empty()) {
-			ss << "{\"media_files\":[],\"count\":0,\"message\":\"No media files found\"}";
-		} else {
-			ss << "{\"media_files\":[";
-			
-			for (size_t i = 0; i < media_files.size(); ++i) {
-				const auto& file = media_files[i];
-				
-				// 使用简洁的格式，确保id字段正确
-				ss << "{";
-				ss << "\"id\":\"" << file.id << "\",";
-				ss << "\"filename\":\"" << file.filename << "\",";
-				ss << "\"path\":\"" << file.path << "\",";
-				ss << "\"duration\":\"" << file.duration << "\",";
-				ss << "\"size\":\"" << file.size << "\",";
-				ss << "\"width\":\"" << file.width << "\",";
-				ss << "\"height\":\"" << file.height << "\",";
-				ss << "\"video_codec\":\"" << file.video_codec << "\",";
-				ss << "\"audio_codec\":\"" << file.audio_codec << "\"";
-				ss << "}";
-				
-				if (i < media_files.size() - 1) {
-					ss << ",";
-				}
-			}
-			
-			ss << "],\"count\":" << media_files.size() << "}";
-		}
-		
-		return ss.str();
-	});
+    // Prometheus 指标（过载时同样保留，便于观察）
+    server.get("/metrics", [&server](const HttpRequest&, const RouteParams&) {
+        PrometheusText out;
+        Metrics::get_instance().render(out);
+        
+        out.family("media_server_open_connections", "gauge", "Client connections currently open");
+        out.sample("media_server_open_connections", {}, static_cast<uint64_t>(server.open_connections()));
+        out.family("media_server_worker_queue_depth", "gauge", "Blocking route tasks waiting for a worker thread");
+        out.sample("media_server_worker_queue_depth", {}, static_cast<uint64_t>(server.queued_worker_tasks()));
+        out.family("media_server_handlers_in_flight", "gauge", "Worker route handlers queued or running");
+        out.sample("media_server_handlers_in_flight", {}, static_cast<uint64_t>(server.inflight_handlers()));
+        out.family("media_server_load_level", "gauge", "Admission control level (0 normal, 1 elevated, 2 overloaded)");
+        out.sample("media_server_load_level", {}, static_cast<uint64_t>(server.load_level()));
+        out.family("media_server_requests_shed_total", "counter", "Requests rejected with 503 by admission control");
+        out.sample("media_server_requests_shed_total", {}, server.requests_shed());
+        
+        HLSMetrics hls = HLSProcessor::get_instance().get_metrics();
+        out.family("media_server_hls_segments_served_total", "counter", "HLS segments served per stream");
+        for (const auto& stream : hls.streams) {
+            out.sample("media_server_hls_segments_served_total",
+                       {{"stream", stream.stream_id}, {"media", stream.media_id}}, stream.segments_served);
+        }
+        out.family("media_server_hls_segment_bytes_total", "counter", "HLS segment bytes served per stream");
+        for (const auto& stream : hls.streams) {
+            out.sample("media_server_hls_segment_bytes_total",
+                       {{"stream", stream.stream_id}, {"media", stream.media_id}}, stream.segment_bytes);
+        }
+        out.family("media_server_transcoders_started_total", "counter", "Transcoders started successfully");
+        out.sample("media_server_transcoders_started_total", {}, hls.transcoders_started);
+        out.family("media_server_transcoders_failed_total", "counter", "Transcoders that failed to start");
+        out.sample("media_server_transcoders_failed_total", {}, hls.transcoders_failed);
+        out.family("media_server_transcoders_stopped_total", "counter", "Transcoders stopped with their stream");
+        out.sample("media_server_transcoders_stopped_total", {}, hls.transcoders_stopped);
+        out.family("media_server_transcoders_active", "gauge", "Streams with a running transcoder");
+        out.sample("media_server_transcoders_active", {}, static_cast<uint64_t>(hls.transcoders_active));
+        
+        TranscodeScheduler::Stats jobs = TranscodeScheduler::get_instance().stats();
+        out.family("media_server_transcode_queue_depth", "gauge", "Transcode jobs waiting for CPU budget");
+        out.sample("media_server_transcode_queue_depth", {{"priority", "interactive"}},
+                   static_cast<uint64_t>(jobs.queued_interactive));
+        out.sample("media_server_transcode_queue_depth", {{"priority", "background"}},
+                   static_cast<uint64_t>(jobs.queued_background));
+        out.family("media_server_transcode_jobs_running", "gauge", "Transcode jobs holding CPU budget");
+        out.sample("media_server_transcode_jobs_running", {}, static_cast<uint64_t>(jobs.running));
+        out.family("media_server_transcode_cpu_cores", "gauge", "Transcode CPU budget in cores");
+        out.sample("media_server_transcode_cpu_cores", {{"state", "used"}}, jobs.cpu_used / 100.0);
+        out.sample("media_server_transcode_cpu_cores", {{"state", "budget"}}, jobs.cpu_budget / 100.0);
+        out.family("media_server_transcode_jobs_cancelled_total", "counter", "Transcode jobs cancelled while queued");
+        out.sample("media_server_transcode_jobs_cancelled_total", {}, jobs.cancelled_total);
+        out.family("media_server_transcode_queue_wait_seconds", "summary", "Time transcode jobs waited for CPU budget");
+        out.sample("media_server_transcode_queue_wait_seconds_sum", {}, jobs.wait_sum_micros / 1e6);
+        out.sample("media_server_transcode_queue_wait_seconds_count", {}, jobs.admitted_total);
+        out.family("media_server_transcode_queue_wait_max_seconds", "gauge", "Longest transcode queue wait so far");
+        out.sample("media_server_transcode_queue_wait_max_seconds", {}, jobs.wait_max_micros / 1e6);
+        
+        MediaIndexer::Stats index = MediaIndexer::get_instance().stats();
+        out.family("media_server_media_index_pending", "gauge", "Media files waiting for a background index pass");
+        out.sample("media_server_media_index_pending", {}, static_cast<uint64_t>(index.pending));
+        out.family("media_server_media_index_cached", "gauge", "Packet indexes held in memory");
+        out.sample("media_server_media_index_cached", {}, static_cast<uint64_t>(index.cached));
+        out.family("media_server_media_index_builds_total", "counter", "Packet index builds by result");
+        out.sample("media_server_media_index_builds_total", {{"result", "ok"}}, index.built_total);
+        out.sample("media_server_media_index_builds_total", {{"result", "failed"}}, index.failed_total);
+        
+        return HttpResponse::with_body(200, "text/plain; version=0.0.4; charset=utf-8", std::move(out.str()));
+    }, SimpleServer::Dispatch::Inline, SimpleServer::Priority::Critical);
+    
+    // Media list：返回扫描时生成的 JSON 快照，请求之间不复制媒体库也不重新序列化
+    server.get("/api/media/list", [](const HttpRequest& request, const RouteParams&) {
+        auto catalog = MediaManager::get_instance().get_catalog();
+        
+        const std::string* if_none_match = request.get_header("If-None-Match");
+        if (if_none_match && etag_listed(*if_none_match, catalog->etag)) {
+            HttpResponse response(304);
+            response.header_block = std::shared_ptr<const std::string>(catalog, &catalog->headers);
+            return response;
+        }
+        
+        HttpResponse response(200);
+        response.content_type("application/json");
+        response.shared_body = std::shared_ptr<const std::string>(catalog, &catalog->json);
+        response.header_block = std::shared_ptr<const std::string>(catalog, &catalog->headers);
+        return response;
+    });
     
-    // Rescan media directory
-    server.get("/api/media/scan", [](const std::string&) -> std::string {
+    // Rescan media directory (FFmpeg probes every file: runs on the worker pool)
+    server.get("/api/media/scan", [](const HttpRequest&, const RouteParams&) {
         auto& media_mgr = MediaManager::get_instance();
         bool success = media_mgr.scan_directory("../media");
         
-        std::stringstream ss;
-        ss << "HTTP/1.1 200 OK\r\n"
-           << "Content-Type: application/json\r\n"
-           << "Connection: close\r\n"
-           << "\r\n"
-           << "{"
-           << "\"success\": " << (success ? "true" : "false") << ", "
-           << "\"message\": \"" << (success ? "Media directory scanned successfully" : "Failed to scan media directory") << "\", "
-           << "\"path\": \"../media\""
-           << "}";
-        return ss.str();
-    });
+        std::string body;
+        JsonWriter json(body);
+        json.begin_object()
+            .field("success", success)
+            .field("message", success ? "Media directory scanned successfully" : "Failed to scan media directory")
+            .field("path", "../media")
+            .end_object();
+        return HttpResponse::json(200, std::move(body));
+    }, SimpleServer::Dispatch::Worker, SimpleServer::Priority::Sheddable);
     
     // Get specific media info
-    server.get("/api/media/:id", [](const std::string& request) -> std::string {
-        // 解析请求行获取路径
-        std::istringstream request_stream(request);
-        std::string method, full_path, version;
-        request_stream >> method >> full_path >> version;
+    server.get("/api/media/:id", [](const HttpRequest&, const RouteParams& params) {
+        std::string media_id(params.param("id"));
         
-        // 提取路径和参数
-        size_t query_pos = full_path.find('?');
-        std::string path = (query_pos != std::string::npos) ? 
-                          full_path.substr(0, query_pos) : full_path;
+        auto& media_mgr = MediaManager::get_instance();
+        std::optional<MediaFile> media = media_mgr.get_media(media_id);
         
-        // 从路径中提取 ID
-        // 路径格式: /api/media/{id}
-        std::vector<std::string> parts;
-        size_t start = 0;
-        while (true) {
-            size_t end = path.find('/', start);
-            if (end == std::string::npos) {
-                parts.push_back(path.substr(start));
-                break;
-            }
-            parts.push_back(path.substr(start, end - start));
-            start = end + 1;
+        std::string body;
+        if (media) {
+            append_json_object(body, media->to_json());
+        } else {
+            JsonWriter json(body);
+            json.begin_object()
+                .field("error", "Media not found")
+                .field("requested_id", media_id)
+                .end_object();
         }
         
-        std::string media_id = "";
-        if (parts.size() >= 3) {
-            media_id = parts[2];  // /api/media/{id}
+        return HttpResponse::json(media ? 200 : 404, std::move(body));
+    });
+    
+    // Raw media file with byte-range support, for clients that can play the source directly
+    server.get("/media/:id/raw", [](const HttpRequest& request, const RouteParams& params) {
+        std::string media_path = MediaManager::get_instance().get_media_path(std::string(params.param("id")));
+        if (media_path.empty()) {
+            return literal_json(404, MEDIA_NOT_FOUND_BODY);
         }
         
-        auto& media_mgr = MediaManager::get_instance();
-        auto* media = media_mgr.get_media(media_id);
+        int fd = open(media_path.c_str(), O_RDONLY | O_CLOEXEC);
+        struct stat file_stat{};
+        if (fd < 0 || fstat(fd, &file_stat) != 0 || !S_ISREG(file_stat.st_mode)) {
+            if (fd >= 0) {
+                close(fd);
+            }
+            return literal_json(404, MEDIA_FILE_MISSING_BODY);
+        }
         
-        std::stringstream ss;
-        ss << "HTTP/1.1 " << (media ? "200 OK" : "404 Not Found") << "\r\n"
-           << "Content-Type: application/json\r\n"
-           << "Connection: close\r\n"
-           << "\r\n";
+        uint64_t file_size = static_cast<uint64_t>(file_stat.st_size);
+        std::string etag = make_etag(file_size, file_stat.st_mtim);
+        std::string last_modified = format_http_date(file_stat.st_mtime);
         
-        if (media) {
-            auto json_data = media->to_json();
-            ss << "{";
-            bool first = true;
-            for (const auto& [key, value] : json_data) {
-                if (!first) ss << ", ";
-                ss << "\"" << key << "\": \"" << value << "\"";
-                first = false;
-            }
-            ss << "}";
-        } else {
-            ss << "{\"error\": \"Media not found\", \"requested_id\": \"" << media_id << "\"}";
+        // Range only applies if If-Range (when present) still names this version of the file
+        ByteRange range;
+        RangeResult range_result = RangeResult::Full;
+        const std::string* range_header = request.get_header("Range");
+        const std::string* if_range = request.get_header("If-Range");
+        if (range_header && (!if_range || if_range_matches(*if_range, etag, last_modified))) {
+            range_result = parse_range_header(*range_header, file_size, range);
+        }
+        
+        if (range_result == RangeResult::Unsatisfiable || range_result == RangeResult::MultipleRanges) {
+            close(fd);
+            HttpResponse response = HttpResponse::text(416, "Range Not Satisfiable");
+            response.header("Content-Range", "bytes */" + std::to_string(file_size));
+            response.header("Accept-Ranges", "bytes");
+            return response;
         }
         
-        return ss.str();
+        // The body is streamed from the descriptor with sendfile: a seek is one small request,
+        // whatever the file size
+        HttpResponse response;
+        if (range_result == RangeResult::Partial) {
+            response = HttpResponse::file(206, get_mime_type(media_path), fd,
+                                          static_cast<off_t>(range.offset), range.length);
+            response.header("Content-Range", "bytes " + std::to_string(range.offset) + "-" +
+                                             std::to_string(range.offset + range.length - 1) + "/" +
+                                             std::to_string(file_size));
+        } else {
+            response = HttpResponse::file(200, get_mime_type(media_path), fd, 0, file_size);
+        }
+        response.header("Accept-Ranges", "bytes");
+        response.header("ETag", etag);
+        response.header("Last-Modified", last_modified);
+        response.header("Access-Control-Allow-Origin", "*");
+        response.header("Access-Control-Expose-Headers", "Content-Length, Content-Range, Accept-Ranges");
+        return response;
     });
     
     // Create session
-    server.get("/api/session/create", [](const std::string& request) -> std::string {
-        // Parse query parameters
-        std::string media_id = "1";
-        std::string filename = "";
-        
-        size_t query_start = request.find('?');
-        if (query_start != std::string::npos) {
-            std::string query = request.substr(query_start + 1);
-            
-            // Simple query parsing
-            size_t param_start = 0;
-            while (param_start < query.length()) {
-                size_t param_end = query.find('&', param_start);
-                std::string param = (param_end == std::string::npos) ? 
-                                   query.substr(param_start) : 
-                                   query.substr(param_start, param_end - param_start);
-                
-                size_t equal_pos = param.find('=');
-                if (equal_pos != std::string::npos) {
-                    std::string key = param.substr(0, equal_pos);
-                    std::string value = param.substr(equal_pos + 1);
-                    
-                    if (key == "media_id") media_id = value;
-                    else if (key == "filename") filename = value;
-                }
-                
-                param_start = (param_end == std::string::npos) ? query.length() : param_end + 1;
-            }
-        }
+    server.get("/api/session/create", [](const HttpRequest& request, const RouteParams&) {
+        std::string media_id = request.query("media_id", "1");
+        std::string filename = request.query("filename");
         
-        std::stringstream ss;
-        ss << "HTTP/1.1 200 OK\r\n"
-           << "Content-Type: application/json\r\n"
-           << "Connection: close\r\n"
-           << "\r\n"
-           << "{"
-           << "\"success\": true, "
-           << "\"session_id\": \"session_" << media_id << "\", "
-           << "\"media_id\": \"" << media_id << "\", "
-           << "\"filename\": \"" << filename << "\", "
-           << "\"status\": \"created\", "
-           << "\"stream_url\": \"http://localhost:8080/stream/session_" << media_id << "\""
-           << "}";
-        return ss.str();
+        std::string body;
+        JsonWriter json(body);
+        json.begin_object()
+            .field("success", true)
+            .field("session_id", "session_" + media_id)
+            .field("media_id", media_id)
+            .field("filename", filename)
+            .field("status", "created")
+            .field("stream_url", "http://localhost:8080/stream/session_" + media_id)
+            .end_object();
+        return HttpResponse::json(200, std::move(body));
     });
     
     // 2. 然后注册静态文件路由
-    server.get("/", [](const std::string&) -> std::string {
-        return serve_static_file("/");
+    server.get("/", [](const HttpRequest& request, const RouteParams&) {
+        return serve_static_file(request, "/");
     });
     
-    server.get("/index.html", [](const std::string&) -> std::string {
-        return serve_static_file("/");
+    server.get("/index.html", [](const HttpRequest& request, const RouteParams&) {
+        return serve_static_file(request, "/");
     });
     
     // CSS files
-    server.get("/css/:filename", [](const std::string& request) -> std::string {
-        // Extract filename from request
-        std::istringstream request_stream(request);
-        std::string method, full_path, version;
-        request_stream >> method >> full_path >> version;
-        
-        return serve_static_file(full_path);
+    server.get("/css/:filename", [](const HttpRequest& request, const RouteParams&) {
+        return serve_static_file(request, request.path);
     });
     
     // JS files
-    server.get("/js/:filename", [](const std::string& request) -> std::string {
-        std::istringstream request_stream(request);
-        std::string method, full_path, version;
-        request_stream >> method >> full_path >> version;
-        
-        return serve_static_file(full_path);
+    server.get("/js/:filename", [](const HttpRequest& request, const RouteParams&) {
+        return serve_static_file(request, request.path);
     });
     
     // Images
-    server.get("/images/:filename", [](const std::string& request) -> std::string {
-        std::istringstream request_stream(request);
-        std::string method, full_path, version;
-        request_stream >> method >> full_path >> version;
-        
-        return serve_static_file(full_path);
+    server.get("/images/:filename", [](const HttpRequest& request, const RouteParams&) {
+        return serve_static_file(request, request.path);
     });
 
     // 3. HLS 流媒体路由
-    // 创建 HLS 流
-	server.get("/api/hls/create", [](const std::string& request) -> std::string {
-		std::cout << "[API] 处理 /api/hls/create 请求" << std::endl;
+    // 创建 HLS 流（启动转码器会等待首个分片，在工作线程中执行）
+	server.get("/api/hls/create", [](const HttpRequest& request, const RouteParams&) {
+		LOG_DEBUG("[API] 处理 /api/hls/create 请求");
 		
-		// 解析请求
-		std::istringstream request_stream(request);
-		std::string method, full_path, version;
-		request_stream >> method >> full_path >> version;
-		
-		// 提取查询参数
-		size_t query_start = full_path.find('?');
-		std::string query_string = (query_start != std::string::npos) ? full_path.substr(query_start + 1) : "";
-		std::string path = (query_start != std::string::npos) ? full_path.substr(0, query_start) : full_path;
-		
-		std::cout << "[API] 完整路径: " << full_path << std::endl;
-		std::cout << "[API] 查询字符串: " << query_string << std::endl;
-		
-		// 简单的参数解析
-		std::string media_id;
-		size_t media_pos = query_string.find("media_id=");
-		if (media_pos != std::string::npos) {
-			media_id = query_string.substr(media_pos + 9);
-			// 移除可能的多余参数
-			size_t amp_pos = media_id.find('&');
-			if (amp_pos != std::string::npos) {
-				media_id = media_id.substr(0, amp_pos);
-			}
-		}
+		std::string media_id = request.query("media_id");
 		
 		if (media_id.empty()) {
-			std::cout << "[API] 错误: 缺少 media_id 参数" << std::endl;
-			return "HTTP/1.1 400 Bad Request\r\n"
-				   "Content-Type: application/json\r\n"
-				   "Connection: close\r\n"
-				   "\r\n"
-				   "{\"success\":false,\"error\":\"Missing media_id parameter\"}";
+			LOG_WARN("[API] 错误: 缺少 media_id 参数");
+			return literal_json(400, MISSING_MEDIA_ID_BODY);
 		}
 		
-		std::cout << "[API] 媒体ID: " << media_id << std::endl;
+		LOG_DEBUG("[API] 媒体ID: " << media_id);
 		
 		// 获取媒体管理器实例
 		auto& media_mgr = MediaManager::get_instance();
@@ -417,10 +434,12 @@ void setup_routes(SimpleServer& server) {
 		
 		// 查找媒体文件
 		std::string media_path;
+		const MediaFile* found = nullptr;
 		for (const auto& media : media_files) {
-			std::cout << "[API] 检查媒体: ID='" << media.id << "', 文件名='" << media.filename << "'" << std::endl;
+			LOG_DEBUG("[API] 检查媒体: ID='" << media.id << "', 文件名='" << media.filename << "'");
 			if (media.id == media_id) {
 				media_path = media.path;
+				found = &media;
 				break;
 			}
 		}
@@ -431,14 +450,13 @@ void setup_routes(SimpleServer& server) {
 				error_msg += media.id + ", ";
 			}
 			
-			return "HTTP/1.1 404 Not Found\r\n"
-				   "Content-Type: application/json\r\n"
-				   "Connection: close\r\n"
-				   "\r\n"
-				   "{\"success\":false,\"error\":\"" + error_msg + "\"}";
+			std::string body;
+			JsonWriter json(body);
+			json.begin_object().field("success", false).field("error", error_msg).end_object();
+			return HttpResponse::json(404, std::move(body));
 		}
 		
-		std::cout << "[API] 找到媒体文件: " << media_path << std::endl;
+		LOG_DEBUG("[API] 找到媒体文件: " << media_path);
 		
 		// 创建流配置
 		HLSStreamConfig config;
@@ -450,226 +468,138 @@ void setup_routes(SimpleServer& server) {
 		config.segment_prefix = "segment";
 		config.segment_duration = 4;
 		config.max_segments = 10;
+		// priority=background 用于预转码，排在所有交互播放之后
+		if (request.query("priority") == "background") {
+			config.priority = TranscodeScheduler::Priority::Background;
+		}
+		// 源编码信息让调度器区分直接复制（几乎不占 CPU）和完整转码；copy=0 强制转码
+		config.allow_stream_copy = request.query("copy") != "0";
+		// mode=continuous 从头连续转码；默认按需分片，播放列表立即完整可用
+		config.on_demand = request.query("mode") != "continuous";
+		config.source_video_codec = found->video_codec;
+		config.source_audio_codec = found->audio_codec;
+		config.source_audio_channels = found->audio_channels;
+		for (const auto& stream : found->streams) {
+			if (stream.codec_type == "video") {
+				config.source_pixel_format = stream.pixel_format;
+				break;
+			}
+		}
 		
 		// 创建流
 		auto& hls_processor = HLSProcessor::get_instance();
 		bool success = hls_processor.create_stream(media_path, media_id, config);
 		
 		if (success) {
-			std::stringstream ss;
-			ss << "HTTP/1.1 200 OK\r\n"
-			   << "Content-Type: application/json\r\n"
-			   << "Connection: close\r\n"
-			   << "\r\n"
-			   << "{\"success\":true,\"stream_id\":\"" << config.stream_id 
-			   << "\",\"message\":\"Stream created\"}";
-			return ss.str();
+			HLSStreamStatus status = hls_processor.get_stream_status(config.stream_id);
+			std::string body;
+			JsonWriter json(body);
+			json.begin_object()
+			    .field("success", true)
+			    .field("stream_id", config.stream_id)
+			    .field("status", status.status)
+			    .field("queue_position", status.queue_position)
+			    .field("message", status.queue_position > 0 ? "Stream queued" : "Stream created")
+			    .end_object();
+			return HttpResponse::json(200, std::move(body));
 		} else {
-			return "HTTP/1.1 500 Internal Server Error\r\n"
-				   "Content-Type: application/json\r\n"
-				   "Connection: close\r\n"
-				   "\r\n"
-				   "{\"success\":false,\"error\":\"Failed to create stream\"}";
+			return literal_json(500, STREAM_CREATE_FAILED_BODY);
 		}
-	});
+	}, SimpleServer::Dispatch::Worker, SimpleServer::Priority::Sheddable);
     
     // 获取 HLS 流状态
-    server.get("/api/hls/status/:stream_id", [](const std::string& request) -> std::string {
-        // 从请求中提取 stream_id
-        std::istringstream request_stream(request);
-        std::string method, full_path, version;
-        request_stream >> method >> full_path >> version;
-        
-        // 解析路径 /api/hls/status/{stream_id}
-        std::vector<std::string> parts;
-        size_t start = 0;
-        while (true) {
-            size_t end = full_path.find('/', start);
-            if (end == std::string::npos) {
-                parts.push_back(full_path.substr(start));
-                break;
-            }
-            parts.push_back(full_path.substr(start, end - start));
-            start = end + 1;
-        }
-        
-        if (parts.size() < 4) {
-            return "HTTP/1.1 400 Bad Request\r\n"
-                   "Content-Type: application/json\r\n"
-                   "Connection: close\r\n"
-                   "\r\n"
-                   "{\"error\": \"Invalid path\"}";
-        }
-        
-        std::string stream_id = parts[3];
+    server.get("/api/hls/status/:stream_id", [](const HttpRequest&, const RouteParams& params) {
+        std::string stream_id(params.param("stream_id"));
         
         auto& hls_processor = HLSProcessor::get_instance();
         auto status = hls_processor.get_stream_status(stream_id);
-        auto json_data = status.to_json();
-        
-        std::stringstream ss;
-        ss << "HTTP/1.1 200 OK\r\n"
-           << "Content-Type: application/json\r\n"
-           << "Connection: close\r\n"
-           << "\r\n"
-           << "{";
-        
-        bool first = true;
-        for (const auto& [key, value] : json_data) {
-            if (!first) ss << ", ";
-            ss << "\"" << key << "\": \"" << value << "\"";
-            first = false;
-        }
-        ss << "}";
         
-        return ss.str();
+        std::string body;
+        append_json_object(body, status.to_json());
+        return HttpResponse::json(200, std::move(body));
     });
     
     // 获取 HLS 播放列表
     // 在播放列表路由中添加CORS头
-	server.get("/hls/:stream_id/playlist.m3u8", [](const std::string& request) -> std::string {
-		std::istringstream request_stream(request);
-		std::string method, full_path, version;
-		request_stream >> method >> full_path >> version;
+	server.get("/hls/:stream_id/playlist.m3u8", [](const HttpRequest&, const RouteParams& params) {
+		std::string stream_id(params.param("stream_id"));
 		
-		// 提取 stream_id
-		size_t start = full_path.find("/hls/") + 5;
-		size_t end = full_path.find("/playlist.m3u8");
-		std::string stream_id = full_path.substr(start, end - start);
-		
-		std::cout << "[HLS] 获取播放列表: " << stream_id << std::endl;
+		LOG_DEBUG("[HLS] 获取播放列表: " << stream_id);
 		
 		auto& hls_processor = HLSProcessor::get_instance();
 		std::string playlist = hls_processor.get_playlist(stream_id);
 		
 		if (playlist.empty()) {
-			return "HTTP/1.1 404 Not Found\r\n"
-				   "Content-Type: text/plain\r\n"
-				   "Connection: close\r\n"
-				   "\r\n"
-				   "Playlist not found";
+			return HttpResponse::text(404, "Playlist not found");
 		}
 		
 		// 🔧 修复: 添加CORS头和正确的MIME类型
-		std::string response = "HTTP/1.1 200 OK\r\n";
-		response += "Content-Type: application/vnd.apple.mpegurl\r\n";
-		response += "Access-Control-Allow-Origin: *\r\n";  // 添加CORS
-		response += "Access-Control-Expose-Headers: Content-Length\r\n";
-		response += "Cache-Control: no-cache\r\n";
-		response += "Connection: close\r\n";
-		response += "\r\n";
-		response += playlist;
-		
+		HttpResponse response = HttpResponse::with_body(200, "application/vnd.apple.mpegurl", std::move(playlist));
+		response.header("Access-Control-Allow-Origin", "*");  // 添加CORS
+		response.header("Access-Control-Expose-Headers", "Content-Length");
+		response.header("Cache-Control", "no-cache");
 		return response;
-	});
+	}, SimpleServer::Dispatch::Inline, SimpleServer::Priority::Critical);
 
 	// 在分片文件路由中也添加CORS头
-	server.get("/hls/:stream_id/:segment", [](const std::string& request) -> std::string {
-		std::istringstream request_stream(request);
-		std::string method, full_path, version;
-		request_stream >> method >> full_path >> version;
+	// 已写完的分片在事件循环中直接打开发送；按需分片尚未产出时由 HLS 分片线程等待，
+	// 结果经回调交回事件循环，等待期间不占用工作线程
+	server.get_async("/hls/:stream_id/:segment", [](const HttpRequest&, const RouteParams& params,
+	                                               SimpleServer::Responder respond) {
+		std::string stream_id(params.param("stream_id"));
+		std::string segment_name(params.param("segment"));
 		
-		// 提取 stream_id 和 segment_name
-		size_t hls_pos = full_path.find("/hls/") + 5;
-		size_t segment_pos = full_path.find('/', hls_pos);
-		
-		if (segment_pos == std::string::npos) {
-			return "HTTP/1.1 400 Bad Request\r\nContent-Type: text/plain\r\nConnection: close\r\n\r\nInvalid path";
-		}
-		
-		std::string stream_id = full_path.substr(hls_pos, segment_pos - hls_pos);
-		std::string segment_name = full_path.substr(segment_pos + 1);
-		
-		std::cout << "[HLS] 获取分片: " << stream_id << "/" << segment_name << std::endl;
+		LOG_DEBUG("[HLS] 获取分片: " << stream_id << "/" << segment_name);
 		
 		auto& hls_processor = HLSProcessor::get_instance();
-		auto segment_data = hls_processor.get_segment(stream_id, segment_name);
-		
-		if (segment_data.empty()) {
-			return "HTTP/1.1 404 Not Found\r\nContent-Type: text/plain\r\nConnection: close\r\n\r\nSegment not found";
-		}
-		
-		// 🔧 修复: 添加CORS头
-		std::string response = "HTTP/1.1 200 OK\r\n";
-		response += "Content-Type: video/MP2T\r\n";
-		response += "Access-Control-Allow-Origin: *\r\n";  // 添加CORS
-		response += "Connection: close\r\n";
-		response += "\r\n";
-		
-		// 添加二进制数据
-		response.append(segment_data.begin(), segment_data.end());
-		
-		return response;
-	});
+		hls_processor.open_segment_async(stream_id, segment_name,
+			[respond = std::move(respond)](int segment_fd, size_t segment_size) {
+				if (segment_fd < 0) {
+					respond(HttpResponse::text(404, "Segment not found"));
+					return;
+				}
+				
+				// 分片内容由服务器直接从文件 sendfile 发送，不再读入内存
+				HttpResponse response = HttpResponse::file(200, "video/MP2T", segment_fd, 0, segment_size);
+				response.header("Access-Control-Allow-Origin", "*");  // 🔧 修复: 添加CORS
+				respond(std::move(response));
+			});
+	}, SimpleServer::Priority::Critical);
     
     // 列出所有 HLS 流
-    server.get("/api/hls/list", [](const std::string&) -> std::string {
+    server.get("/api/hls/list", [](const HttpRequest&, const RouteParams&) {
         auto& hls_processor = HLSProcessor::get_instance();
         auto streams = hls_processor.list_streams();
         
-        std::stringstream ss;
-        ss << "HTTP/1.1 200 OK\r\n"
-           << "Content-Type: application/json\r\n"
-           << "Connection: close\r\n"
-           << "\r\n"
-           << "{\"streams\": [";
-        
-        for (size_t i = 0; i < streams.size(); ++i) {
-            if (i > 0) ss << ", ";
-            ss << "\"" << streams[i] << "\"";
+        std::string body;
+        JsonWriter json(body);
+        json.begin_object().key("streams").begin_array();
+        for (const auto& stream : streams) {
+            json.value(stream);
         }
-        
-        ss << "], \"count\": " << streams.size() << "}";
-        return ss.str();
+        json.end_array().field("count", streams.size()).end_object();
+        return HttpResponse::json(200, std::move(body));
     });
     
     // 停止 HLS 流
-    server.get("/api/hls/stop/:stream_id", [](const std::string& request) -> std::string {
-        std::istringstream request_stream(request);
-        std::string method, full_path, version;
-        request_stream >> method >> full_path >> version;
-        
-        // 解析路径
-        std::vector<std::string> parts;
-        size_t start = 0;
-        while (true) {
-            size_t end = full_path.find('/', start);
-            if (end == std::string::npos) {
-                parts.push_back(full_path.substr(start));
-                break;
-            }
-            parts.push_back(full_path.substr(start, end - start));
-            start = end + 1;
-        }
-        
-        if (parts.size() < 4) {
-            return "HTTP/1.1 400 Bad Request\r\n"
-                   "Content-Type: application/json\r\n"
-                   "Connection: close\r\n"
-                   "\r\n"
-                   "{\"error\": \"Invalid path\"}";
-        }
-        
-        std::string stream_id = parts[3];
+    server.get("/api/hls/stop/:stream_id", [](const HttpRequest&, const RouteParams& params) {
+        std::string stream_id(params.param("stream_id"));
         
         auto& hls_processor = HLSProcessor::get_instance();
         bool success = hls_processor.stop_stream(stream_id);
         
-        std::stringstream ss;
-        ss << "HTTP/1.1 200 OK\r\n"
-           << "Content-Type: application/json\r\n"
-           << "Connection: close\r\n"
-           << "\r\n"
-           << "{\"success\": " << (success ? "true" : "false")
-           << ", \"message\": \"Stream stopped\", \"stream_id\": \"" << stream_id << "\"}";
-        
-        return ss.str();
-    });
+        std::string body;
+        JsonWriter json(body);
+        json.begin_object()
+            .field("success", success)
+            .field("message", "Stream stopped")
+            .field("stream_id", stream_id)
+            .end_object();
+        return HttpResponse::json(200, std::move(body));
+    }, SimpleServer::Dispatch::Worker);  // 等待转码线程退出并删除输出目录
 	
-	server.get("/:filename", [](const std::string& request) -> std::string {
-    std::istringstream request_stream(request);
-    std::string method, path, version;
-    request_stream >> method >> path >> version;
+	server.get("/:filename", [](const HttpRequest& request, const RouteParams&) {
+    const std::string& path = request.path;
     
     // 排除 API 路由
     if (path.find("/api/") == 0 || 
@@ -677,13 +607,13 @@ void setup_routes(SimpleServer& server) {
         path.find("/css/") == 0 ||
         path.find("/js/") == 0 ||
         path.find("/images/") == 0) {
-        return "HTTP/1.1 404 Not Found\r\nContent-Type: application/json\r\nConnection: close\r\n\r\n{\"error\": \"Not found\"}";
+        return literal_json(404, NOT_FOUND_BODY);
     }
     
-    return serve_static_file(path);
+    return serve_static_file(request, path);
 	});
 
-    std::cout << "Routes setup completed" << std::endl;
-    std::cout << "Web directory: ../web" << std::endl;
-    std::cout << "Media directory: ../media" << std::endl;
+    LOG_INFO("Routes setup completed");
+    LOG_INFO("Web directory: ../web");
+    LOG_INFO("Media directory: ../media");
 }
\ No newline at end of file
@@ -1,22 +1,79 @@
 #include "server.h"
-#include <iostream>
-#include <sstream>
+#include "metrics.h"
+#include "logger.h"
 #include <algorithm>
+#include <charconv>
 #include <cstring>
+#include <strings.h>
 #include <unistd.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/sendfile.h>
+#include <sys/eventfd.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <fcntl.h>
+#include <pthread.h>
+#include <csignal>
+#include <sched.h>
 #include <system_error>
+#include <utility>
+
+#ifdef MEDIA_SERVER_IO_URING
+#include "io_uring_ring.h"
+#endif
 
 // 常量定义
 const int SimpleServer::MAX_EVENTS;
 const int SimpleServer::BUFFER_SIZE;
 const int SimpleServer::BACKLOG;
+const int SimpleServer::DEFAULT_MAX_REQUESTS_PER_CONNECTION;
+const int SimpleServer::MAX_IOVECS;
+const size_t SimpleServer::DEFAULT_WRITE_LOW_WATERMARK;
+const size_t SimpleServer::DEFAULT_WRITE_HIGH_WATERMARK;
+const int SimpleServer::DEFAULT_WORKER_THREADS;
+const int SimpleServer::DEFAULT_MAX_CONNECTIONS;
+const int SimpleServer::DEFAULT_MAX_CONNECTIONS_PER_CLIENT;
+const size_t SimpleServer::HEAD_RESERVE;
+const size_t SimpleServer::MAX_SPARE_BUFFER;
+const size_t SimpleServer::CLIENT_SHARDS;
+
+// 固定内容的响应体只构造一次，之后每个响应只增加引用计数
+static const std::shared_ptr<const std::string> NOT_FOUND_BODY =
+    std::make_shared<const std::string>("{\"error\": \"Not found\"}");
+
+// 接受 h2c 升级的响应，其后紧跟服务器的 HTTP/2 连接前言
+static const std::shared_ptr<const std::string> SWITCHING_PROTOCOLS = std::make_shared<const std::string>(
+    "HTTP/1.1 101 Switching Protocols\r\nConnection: Upgrade\r\nUpgrade: h2c\r\n\r\n");
+
+static uint64_t elapsed_micros(std::chrono::steady_clock::time_point started) {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - started).count());
+}
 
-SimpleServer::SimpleServer(int port) : port_(port), server_fd_(-1), epoll_fd_(-1) {
-    std::cout << "服务器创建，端口: " << port_ << std::endl;
+// 连接数超限时的响应：预先生成，拒绝时只需一次 send
+static const char OVERLOADED_RESPONSE[] =
+    "HTTP/1.1 503 Service Unavailable\r\n"
+    "Retry-After: 1\r\n"
+    "Content-Length: 0\r\n"
+    "Connection: close\r\n"
+    "\r\n";
+
+#ifdef MEDIA_SERVER_IO_URING
+static const SimpleServer::IoBackend DEFAULT_IO_BACKEND = SimpleServer::IoBackend::IoUring;
+#else
+static const SimpleServer::IoBackend DEFAULT_IO_BACKEND = SimpleServer::IoBackend::Epoll;
+#endif
+
+SimpleServer::SimpleServer(int port, int num_reactors)
+    : port_(port), num_reactors_(num_reactors), io_backend_(DEFAULT_IO_BACKEND) {
+    if (num_reactors_ <= 0) {
+        num_reactors_ = static_cast<int>(std::thread::hardware_concurrency());
+        if (num_reactors_ <= 0) {
+            num_reactors_ = 1;
+        }
+    }
+    LOG_INFO("服务器创建，端口: " << port_ << "，事件循环数: " << num_reactors_);
 }
 
 SimpleServer::~SimpleServer() {
@@ -26,32 +83,73 @@ SimpleServer::~SimpleServer() {
 
 bool SimpleServer::start() {
     if (running_) {
-        std::cerr << "服务器已在运行中" << std::endl;
+        LOG_WARN("服务器已在运行中");
         return false;
     }
 
+    // 路由表在启动时编译为路由树，之后只读，各 reactor 无锁共享
+    compile_routes();
+    async_gate_ = std::make_shared<AsyncGate>();
+
+    // send 都带 MSG_NOSIGNAL，但 sendfile 没有对应的标志：对端在文件发送途中断开时
+    // 不能让 SIGPIPE 结束整个进程，写错误改由返回值 EPIPE 处理
+    signal(SIGPIPE, SIG_IGN);
+
     try {
-        setup_server_socket();
+        // 每个 reactor 各自绑定同一端口，由内核 (SO_REUSEPORT) 在监听 socket 间分发连接
+        for (int i = 0; i < num_reactors_; ++i) {
+            auto reactor = std::make_unique<Reactor>();
+            reactor->id = i;
+            setup_server_socket(*reactor);
+#ifdef MEDIA_SERVER_IO_URING
+            if (io_backend_ == IoBackend::IoUring && !setup_uring(*reactor)) {
+                LOG_WARN("io_uring 不可用，reactor " << i << " 使用 epoll");
+            }
+#endif
+            reactors_.push_back(std::move(reactor));
+        }
     } catch (const std::exception& e) {
-        std::cerr << "服务器启动失败: " << e.what() << std::endl;
+        LOG_ERROR("服务器启动失败: " << e.what());
         cleanup();
         return false;
     }
 
     running_ = true;
-    server_thread_ = std::thread(&SimpleServer::run, this);
+    worker_pool_.start(static_cast<size_t>(worker_threads_));
+
+    unsigned int cpu_count = std::thread::hardware_concurrency();
+    for (auto& reactor : reactors_) {
+        reactor->thread = std::thread(&SimpleServer::run, this, std::ref(*reactor));
+
+        // 多 reactor 时将每个循环绑定到一个核心，避免线程迁移带来的缓存失效
+        if (reactors_.size() > 1 && cpu_count > 0) {
+            cpu_set_t cpuset;
+            CPU_ZERO(&cpuset);
+            CPU_SET(reactor->id % cpu_count, &cpuset);
+            pthread_setaffinity_np(reactor->thread.native_handle(), sizeof(cpuset), &cpuset);
+        }
+    }
 
-    std::cout << "服务器启动成功，监听端口: " << port_ << std::endl;
+    LOG_INFO("服务器启动成功，监听端口: " << port_ << "，事件循环数: " << reactors_.size());
     return true;
 }
 
 void SimpleServer::stop() {
     if (running_) {
         running_ = false;
-        if (server_thread_.joinable()) {
-            server_thread_.join();
+        // 先停工作线程并关闭异步闸门：之后不会再有完成结果投递到即将销毁的 reactor
+        worker_pool_.stop();
+        {
+            std::lock_guard<std::mutex> lock(async_gate_->mutex);
+            async_gate_->open = false;
+        }
+        for (auto& reactor : reactors_) {
+            if (reactor->thread.joinable()) {
+                reactor->thread.join();
+            }
         }
-        std::cout << "服务器已停止" << std::endl;
+        cleanup();
+        LOG_INFO("服务器已停止");
     }
 }
 
@@ -59,354 +157,1284 @@ bool SimpleServer::is_running() const {
     return running_;
 }
 
-void SimpleServer::get(const std::string& path, std::function<std::string(const std::string&)> handler) {
-    add_route("GET", path, handler);
+int SimpleServer::reactor_count() const {
+    return num_reactors_;
+}
+
+int SimpleServer::open_connections() const {
+    return open_connections_.load(std::memory_order_relaxed);
+}
+
+size_t SimpleServer::queued_worker_tasks() const {
+    return worker_pool_.queued();
+}
+
+SimpleServer::LoadLevel SimpleServer::load_level() const {
+    LoadLevel level = LoadLevel::Normal;
+    for (const auto& reactor : reactors_) {
+        level = std::max(level, reactor_load(*reactor));
+    }
+    return level;
+}
+
+uint64_t SimpleServer::requests_shed() const {
+    return requests_shed_.load(std::memory_order_relaxed);
+}
+
+int SimpleServer::inflight_handlers() const {
+    return inflight_handlers_.load(std::memory_order_relaxed);
+}
+
+void SimpleServer::set_max_requests_per_connection(int max_requests) {
+    max_requests_per_connection_ = max_requests;
+}
+
+void SimpleServer::set_parser_limits(const HttpParser::Limits& limits) {
+    parser_limits_ = limits;
+}
+
+void SimpleServer::set_write_watermarks(size_t low, size_t high) {
+    write_low_watermark_ = std::min(low, high);
+    write_high_watermark_ = high;
+}
+
+void SimpleServer::set_worker_threads(int num_threads) {
+    worker_threads_ = std::max(num_threads, 1);
+}
+
+void SimpleServer::set_timeouts(const Timeouts& timeouts) {
+    timeouts_ = timeouts;
+}
+
+void SimpleServer::set_connection_limits(int max_connections, int max_connections_per_client) {
+    max_connections_ = std::max(max_connections, 0);
+    max_connections_per_client_ = std::max(max_connections_per_client, 0);
+}
+
+void SimpleServer::set_admission_limits(const AdmissionLimits& limits) {
+    admission_ = limits;
+}
+
+void SimpleServer::set_io_backend(IoBackend backend) {
+#ifndef MEDIA_SERVER_IO_URING
+    if (backend == IoBackend::IoUring) {
+        LOG_WARN("未以 ENABLE_IO_URING 构建，继续使用 epoll");
+        return;
+    }
+#endif
+    io_backend_ = backend;
+}
+
+SimpleServer::IoBackend SimpleServer::io_backend() const {
+    return io_backend_;
 }
 
-void SimpleServer::post(const std::string& path, std::function<std::string(const std::string&)> handler) {
-    add_route("POST", path, handler);
+void SimpleServer::get(const std::string& path, RouteHandler handler, Dispatch dispatch, Priority priority) {
+    add_route("GET", path, std::move(handler), dispatch, priority);
 }
 
-void SimpleServer::put(const std::string& path, std::function<std::string(const std::string&)> handler) {
-    add_route("PUT", path, handler);
+void SimpleServer::post(const std::string& path, RouteHandler handler, Dispatch dispatch, Priority priority) {
+    add_route("POST", path, std::move(handler), dispatch, priority);
 }
 
-void SimpleServer::del(const std::string& path, std::function<std::string(const std::string&)> handler) {
-    add_route("DELETE", path, handler);
+void SimpleServer::put(const std::string& path, RouteHandler handler, Dispatch dispatch, Priority priority) {
+    add_route("PUT", path, std::move(handler), dispatch, priority);
 }
 
-void SimpleServer::add_route(const std::string& method, const std::string& path,
-                            std::function<std::string(const std::string&)> handler) {
-    routes_.push_back({method, path, handler});
-    std::cout << "路由注册: " << method << " " << path << std::endl;
+void SimpleServer::del(const std::string& path, RouteHandler handler, Dispatch dispatch, Priority priority) {
+    add_route("DELETE", path, std::move(handler), dispatch, priority);
 }
 
-void SimpleServer::setup_server_socket() {
+void SimpleServer::add_route(const std::string& method, const std::string& path, RouteHandler handler,
+                             Dispatch dispatch, Priority priority) {
+    routes_.push_back({method, path, std::move(handler), dispatch, priority, nullptr});
+    LOG_INFO("路由注册: " << method << " " << path
+             << (dispatch == Dispatch::Worker ? " (工作线程)" : "")
+             << (priority == Priority::Critical ? " (过载时保留)" :
+                 priority == Priority::Sheddable ? " (过载时优先拒绝)" : ""));
+}
+
+void SimpleServer::get_async(const std::string& path, AsyncRouteHandler handler, Priority priority) {
+    add_async_route("GET", path, std::move(handler), priority);
+}
+
+void SimpleServer::add_async_route(const std::string& method, const std::string& path, AsyncRouteHandler handler,
+                                   Priority priority) {
+    routes_.push_back({method, path, nullptr, Dispatch::Inline, priority, std::move(handler)});
+    LOG_INFO("路由注册: " << method << " " << path << " (异步)"
+             << (priority == Priority::Critical ? " (过载时保留)" :
+                 priority == Priority::Sheddable ? " (过载时优先拒绝)" : ""));
+}
+
+void SimpleServer::compile_routes() {
+    route_trie_.clear();
+    std::vector<std::pair<std::string, std::string>> patterns;
+    for (size_t i = 0; i < routes_.size(); ++i) {
+        route_trie_.insert(routes_[i].method, routes_[i].path, static_cast<int>(i));
+        patterns.emplace_back(routes_[i].method, routes_[i].path);
+    }
+    // 指标按注册时的路由模式聚合，而不是具体路径，序列数量有界
+    Metrics::get_instance().set_routes(patterns);
+    LOG_INFO("路由树编译完成: " << routes_.size() << " 条路由, "
+             << route_trie_.node_count() << " 个节点");
+}
+
+void SimpleServer::setup_server_socket(Reactor& reactor) {
     // 创建 socket
-    server_fd_ = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
-    if (server_fd_ < 0) {
+    reactor.server_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if (reactor.server_fd < 0) {
         throw std::system_error(errno, std::system_category(), "socket 创建失败");
     }
 
     // 设置 SO_REUSEADDR
     int opt = 1;
-    if (setsockopt(server_fd_, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0) {
-        close(server_fd_);
+    if (setsockopt(reactor.server_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0) {
+        close_reactor(reactor);
         throw std::system_error(errno, std::system_category(), "setsockopt 失败");
     }
 
+    // 设置 SO_REUSEPORT，使每个 reactor 拥有自己的监听队列
+    if (setsockopt(reactor.server_fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) < 0) {
+        close_reactor(reactor);
+        throw std::system_error(errno, std::system_category(), "setsockopt(SO_REUSEPORT) 失败");
+    }
+
     // 绑定地址
     sockaddr_in address{};
     address.sin_family = AF_INET;
     address.sin_addr.s_addr = INADDR_ANY;
     address.sin_port = htons(port_);
 
-    if (bind(server_fd_, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0) {
-        close(server_fd_);
+    if (bind(reactor.server_fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0) {
+        close_reactor(reactor);
         throw std::system_error(errno, std::system_category(), "bind 失败，端口: " + std::to_string(port_));
     }
 
     // 监听
-    if (listen(server_fd_, BACKLOG) < 0) {
-        close(server_fd_);
+    if (listen(reactor.server_fd, BACKLOG) < 0) {
+        close_reactor(reactor);
         throw std::system_error(errno, std::system_category(), "listen 失败");
     }
 
     // 创建 epoll 实例
-    epoll_fd_ = epoll_create1(0);
-    if (epoll_fd_ < 0) {
-        close(server_fd_);
+    reactor.epoll_fd = epoll_create1(0);
+    if (reactor.epoll_fd < 0) {
+        close_reactor(reactor);
         throw std::system_error(errno, std::system_category(), "epoll_create1 失败");
     }
 
     // 添加服务器 socket 到 epoll
     epoll_event event{};
     event.events = EPOLLIN | EPOLLET;  // 边缘触发模式
-    event.data.fd = server_fd_;
+    event.data.fd = reactor.server_fd;
 
-    if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, server_fd_, &event) < 0) {
-        close(epoll_fd_);
-        close(server_fd_);
+    if (epoll_ctl(reactor.epoll_fd, EPOLL_CTL_ADD, reactor.server_fd, &event) < 0) {
+        close_reactor(reactor);
         throw std::system_error(errno, std::system_category(), "epoll_ctl 失败");
     }
+
+    // 工作线程完成通知
+    reactor.wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (reactor.wake_fd < 0) {
+        close_reactor(reactor);
+        throw std::system_error(errno, std::system_category(), "eventfd 创建失败");
+    }
+
+    epoll_event wake_event{};
+    wake_event.events = EPOLLIN | EPOLLET;
+    wake_event.data.fd = reactor.wake_fd;
+
+    if (epoll_ctl(reactor.epoll_fd, EPOLL_CTL_ADD, reactor.wake_fd, &wake_event) < 0) {
+        close_reactor(reactor);
+        throw std::system_error(errno, std::system_category(), "epoll_ctl(eventfd) 失败");
+    }
 }
 
-void SimpleServer::run() {
+void SimpleServer::run(Reactor& reactor) {
+#ifdef MEDIA_SERVER_IO_URING
+    if (reactor.ring) {
+        run_uring(reactor);
+        return;
+    }
+#endif
+
     epoll_event events[MAX_EVENTS];
+    const int server_fd = reactor.server_fd;
+    const int epoll_fd = reactor.epoll_fd;
 
-    std::cout << "服务器主循环开始" << std::endl;
+    LOG_INFO("服务器主循环开始 (reactor " << reactor.id << ")");
 
     while (running_) {
-        int num_events = epoll_wait(epoll_fd_, events, MAX_EVENTS, 1000);  // 1秒超时
+        auto wait_started = std::chrono::steady_clock::now();
+        int num_events = epoll_wait(epoll_fd, events, MAX_EVENTS, timer_wait_ms(reactor));
+        auto batch_started = std::chrono::steady_clock::now();
         
         if (num_events < 0) {
             if (errno == EINTR) {
                 continue;  // 被信号中断，继续循环
             }
-            std::cerr << "epoll_wait 错误: " << strerror(errno) << std::endl;
+            LOG_ERROR_LIMITED(10, "epoll_wait 错误: " << strerror(errno));
             break;
         }
 
+        // 先推进时间轮：之后处理事件时调度的定时器以当前时刻为起点
+        expire_timers(reactor);
+
         for (int i = 0; i < num_events; ++i) {
             int event_fd = events[i].data.fd;
             uint32_t event_flags = events[i].events;
 
-            // 处理错误事件
-            if (event_flags & (EPOLLERR | EPOLLHUP | EPOLLRDHUP)) {
-                if (event_fd != server_fd_) {
-                    close(event_fd);
+            if (event_fd == reactor.wake_fd) {
+                handle_completions(reactor);
+                continue;
+            }
+
+            // 处理错误事件（EPOLLRDHUP 仅表示对端半关闭，仍需读完已到达的请求）
+            if (event_flags & (EPOLLERR | EPOLLHUP)) {
+                if (event_fd != server_fd) {
+                    close_connection(reactor, event_fd);
                 }
                 continue;
             }
 
-            if (event_fd == server_fd_) {
+            if (event_fd == server_fd) {
                 // 接受新连接（边缘触发，需要循环接受）
                 while (running_) {
                     sockaddr_in client_addr{};
                     socklen_t addr_len = sizeof(client_addr);
 
-                    int client_fd = accept4(server_fd_, reinterpret_cast<sockaddr*>(&client_addr),
+                    int client_fd = accept4(server_fd, reinterpret_cast<sockaddr*>(&client_addr),
                                           &addr_len, SOCK_NONBLOCK);
 
                     if (client_fd < 0) {
                         if (errno == EAGAIN || errno == EWOULDBLOCK) {
                             break;  // 没有更多连接
                         }
-                        std::cerr << "accept 错误: " << strerror(errno) << std::endl;
+                        LOG_WARN_LIMITED(10, "accept 错误: " << strerror(errno));
                         break;
                     }
 
+                    if (!admit_client(client_addr.sin_addr.s_addr)) {
+                        reject_client(client_fd);
+                        continue;
+                    }
+
                     // 添加客户端到 epoll
                     epoll_event client_event{};
                     client_event.events = EPOLLIN | EPOLLET | EPOLLRDHUP;
                     client_event.data.fd = client_fd;
 
-                    if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, client_fd, &client_event) < 0) {
-                        std::cerr << "PS_FAILED: " << strerror(errno) << std::endl;
+                    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, client_fd, &client_event) < 0) {
+                        LOG_ERROR_LIMITED(10, "PS_FAILED: " << strerror(errno));
+                        release_client(client_addr.sin_addr.s_addr);
                         close(client_fd);
                         continue;
                     }
 
-                    // 记录连接信息
-                    char client_ip[INET_ADDRSTRLEN];
-                    inet_ntop(AF_INET, &client_addr.sin_addr, client_ip, sizeof(client_ip));
-                    std::cout << "新连接: " << client_ip << ":" << ntohs(client_addr.sin_port)
-                              << " (fd=" << client_fd << ")" << std::endl;
+                    auto inserted = reactor.connections.emplace(client_fd, Connection(parser_limits_));
+                    Connection& conn = inserted.first->second;
+                    conn.id = ++reactor.next_connection_id;
+                    conn.client_addr = client_addr.sin_addr.s_addr;
+                    conn.timer.data = static_cast<uint64_t>(client_fd);
+                    update_connection_timer(reactor, conn);
+
+                    LOG_DEBUG("新连接: " << peer_name(client_addr) << " (fd=" << client_fd << ")");
                 }
             } else {
-                // 处理客户端数据
-                handle_client_connection(event_fd);
+                // 先写后读：写路径可能释放积压并恢复读取
+                if (event_flags & EPOLLOUT) {
+                    handle_client_writable(reactor, event_fd);
+                }
+                if (event_flags & (EPOLLIN | EPOLLRDHUP)) {
+                    handle_client_connection(reactor, event_fd);
+                }
             }
         }
+
+        record_loop_lag(reactor, wait_started, batch_started);
     }
 
-    std::cout << "服务器主循环结束" << std::endl;
+    LOG_INFO("服务器主循环结束 (reactor " << reactor.id << ")");
 }
 
-void SimpleServer::handle_client_connection(int client_fd) {
-    std::string request_data;
-    char buffer[BUFFER_SIZE];
+void SimpleServer::handle_client_connection(Reactor& reactor, int client_fd) {
+    auto conn_it = reactor.connections.find(client_fd);
+    if (conn_it == reactor.connections.end()) {
+        close(client_fd);
+        return;
+    }
+    Connection& conn = conn_it->second;
 
-    // 边缘触发模式，需要循环读取直到没有数据
-    while (true) {
-        ssize_t bytes_read = recv(client_fd, buffer, sizeof(buffer) - 1, 0);
+    // 输出积压超过高水位时暂停读取，数据留在内核缓冲区，由写路径在降到低水位后恢复；
+    // 等待工作线程结果期间同理，由 handle_completions 恢复
+    if (conn.read_paused || conn.awaiting_worker) {
+        return;
+    }
+
+    char buffer[BUFFER_SIZE];
 
-        if (bytes_read > 0) {
-            buffer[bytes_read] = '\0';
-            request_data.append(buffer, bytes_read);
+    do {
+        // 边缘触发模式，需要循环读取直到没有数据
+        while (!conn.peer_closed) {
+            ssize_t bytes_read = recv(client_fd, buffer, sizeof(buffer), 0);
 
-            // 检查是否收到完整的 HTTP 请求（以 \r\n\r\n 结束）
-            if (request_data.find("\r\n\r\n") != std::string::npos) {
-                break;  // 收到完整请求
+            if (bytes_read > 0) {
+                conn.in_buffer.append(buffer, bytes_read);
+            } else if (bytes_read == 0) {
+                // 对端关闭写方向，处理完已收到的请求并发送完响应后关闭
+                conn.peer_closed = true;
+            } else {
+                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    break;  // 没有更多数据可读
+                } else if (errno == EINTR) {
+                    continue;
+                } else {
+                    LOG_WARN_LIMITED(10, "recv 错误 (fd=" << client_fd << "): " << strerror(errno));
+                    close_connection(reactor, client_fd);
+                    return;
+                }
             }
-        } else if (bytes_read == 0) {
-            // 连接关闭
-            close(client_fd);
+        }
+
+        process_requests(reactor, client_fd, conn);
+
+        if (!flush_output(reactor, client_fd, conn)) {
+            close_connection(reactor, client_fd);
             return;
-        } else {
-            if (errno == EAGAIN || errno == EWOULDBLOCK) {
-                break;  // 没有更多数据可读
-            } else {
-                std::cerr << "recv 错误 (fd=" << client_fd << "): " << strerror(errno) << std::endl;
-                close(client_fd);
-                return;
+        }
+        // 积压或流式响应在本轮就已全部发出时不会再有 EPOLLOUT，直接继续处理后续请求
+    } while (resume_reading(conn));
+
+    update_connection_timer(reactor, conn);
+}
+
+void SimpleServer::handle_client_writable(Reactor& reactor, int client_fd) {
+    auto conn_it = reactor.connections.find(client_fd);
+    if (conn_it == reactor.connections.end()) {
+        return;
+    }
+    Connection& conn = conn_it->second;
+
+    if (!flush_output(reactor, client_fd, conn)) {
+        close_connection(reactor, client_fd);
+        return;
+    }
+
+    // 积压降到低水位以下（且流式响应已结束）：恢复读取，并处理暂停期间已缓冲的流水线请求
+    if (resume_reading(conn)) {
+        handle_client_connection(reactor, client_fd);
+        return;
+    }
+    update_connection_timer(reactor, conn);
+}
+
+bool SimpleServer::resume_reading(Connection& conn) {
+    if (conn.read_paused && !conn.stream && conn.out_bytes <= write_low_watermark_) {
+        conn.read_paused = false;
+        return true;
+    }
+    return false;
+}
+
+void SimpleServer::process_requests(Reactor& reactor, int client_fd, Connection& conn) {
+    // 按顺序处理缓冲区中所有完整的请求（流水线），响应依次进入输出队列。
+    // 解析器只扫描新到达的字节，未完成的请求留在缓冲区中等待下一次唤醒。
+    if (!conn.h2 && conn.requests_served == 0 && !conn.parser.in_progress() &&
+        Http2Session::matches_preface(conn.in_buffer.data(), conn.in_buffer.size())) {
+        // prior knowledge：客户端直接以 HTTP/2 前言开始。前言收齐前不交给 HTTP/1 解析器
+        if (conn.in_buffer.size() < Http2Session::PREFACE_SIZE) {
+            return;
+        }
+        conn.h2 = std::make_unique<Http2Session>(parser_limits_);
+        conn.h2->set_resumer(stream_resumer(reactor, client_fd, conn));
+    }
+    if (conn.h2) {
+        process_h2(reactor, client_fd, conn);
+        return;
+    }
+
+    size_t consumed = 0;
+
+    while (!conn.close_after_flush && !conn.awaiting_worker && !conn.stream && consumed < conn.in_buffer.size()) {
+        if (conn.out_bytes >= write_high_watermark_) {
+            conn.read_paused = true;
+            break;
+        }
+
+        HttpParser::Status status = conn.parser.parse(conn.in_buffer.data() + consumed,
+                                                      conn.in_buffer.size() - consumed);
+        if (status == HttpParser::Status::NeedMore) {
+            break;
+        }
+
+        if (status == HttpParser::Status::Error) {
+            int error_status = conn.parser.error_status();
+            size_t bytes = enqueue_output(conn, error_response(error_status), false, false);
+            Metrics::get_instance().record_request(-1, error_status, 0, bytes);
+            conn.close_after_flush = true;
+            break;
+        }
+
+        const HttpRequest& request = conn.parser.request();
+        consumed += conn.parser.consumed();
+        ++conn.requests_served;
+
+        if (Http2Session::is_upgrade_request(request)) {
+            auto session = std::make_unique<Http2Session>(parser_limits_);
+            if (session->start_upgrade(request)) {
+                // 升级请求成为流 1，其响应在 101 之后以 HTTP/2 帧发出
+                conn.out_bytes += SWITCHING_PROTOCOLS->size();
+                conn.out_queue.emplace_back(SWITCHING_PROTOCOLS);
+                conn.h2 = std::move(session);
+                conn.h2->set_resumer(stream_resumer(reactor, client_fd, conn));
+                conn.parser.reset();
+                break;
+            }
+        }
+
+        bool keep_alive = wants_keep_alive(request) && !conn.peer_closed;
+        bool chunked = request.version != "HTTP/1.0";
+        if (max_requests_per_connection_ > 0 &&
+            conn.requests_served >= max_requests_per_connection_) {
+            keep_alive = false;
+        }
+
+        auto started = std::chrono::steady_clock::now();
+        RouteParams params;
+        route_trie_.find(request.method, request.path, params);
+        HttpResponse response;
+        if (shed_request(reactor, params.route_index)) {
+            response = overloaded_response();
+        } else if (params.route_index >= 0 && routes_[params.route_index].async_handler) {
+            Completion completion;
+            completion.client_fd = client_fd;
+            completion.connection_id = conn.id;
+            completion.keep_alive = keep_alive;
+            completion.chunked = chunked;
+            completion.route_index = params.route_index;
+            completion.started = started;
+            if (!invoke_async(reactor, std::move(completion), request, params, response)) {
+                // 与工作线程路径相同：结果由 handle_completions 入队
+                conn.awaiting_worker = true;
+                conn.parser.reset();
+                break;
+            }
+        } else if (params.route_index >= 0 && routes_[params.route_index].dispatch == Dispatch::Worker) {
+            Completion completion;
+            completion.client_fd = client_fd;
+            completion.connection_id = conn.id;
+            completion.keep_alive = keep_alive;
+            completion.chunked = chunked;
+            completion.route_index = params.route_index;
+            completion.started = started;
+            if (dispatch_to_worker(reactor, std::move(completion), request)) {
+                // 响应稍后由 handle_completions 入队，连接状态在那时更新
+                conn.awaiting_worker = true;
+                conn.parser.reset();
+                break;
             }
+            response = overloaded_response();
+        } else {
+            response = invoke_route(request, params);
         }
+        int response_status = response.status;
+        conn.close_after_flush = !keep_alive;
+        size_t bytes = enqueue_output(conn, std::move(response), keep_alive, chunked);
+        Metrics::get_instance().record_request(params.route_index, response_status,
+                                               elapsed_micros(started), bytes);
+        conn.parser.reset();
     }
 
-    if (request_data.empty()) {
+    conn.in_buffer.erase(0, consumed);
+    if (conn.h2) {
+        // 升级后缓冲区中剩下的是客户端的 HTTP/2 前言和后续帧
+        process_h2(reactor, client_fd, conn);
         return;
     }
 
-    try {
-        // 解析 HTTP 请求
-        HttpRequest request = parse_http_request(request_data);
-
-        // 查找匹配的路由
-        std::string response = "HTTP/1.1 404 Not Found\r\n"
-                               "Content-Type: application/json\r\n"
-                               "Connection: close\r\n"
-                               "Content-Length: 24\r\n"
-                               "\r\n"
-                               "{\"error\": \"Not found\"}";
-
-        std::map<std::string, std::string> route_params;
-
-        for (const auto& route : routes_) {
-            if (route.method == request.method &&
-                path_matches(request.path, route.path, route_params)) {
-                response = route.handler(request_data);
+    // 对端已半关闭且没有可继续解析的请求：发送完剩余响应后关闭
+    if (conn.peer_closed && !conn.read_paused && !conn.awaiting_worker && !conn.stream) {
+        conn.close_after_flush = true;
+    }
+}
+
+void SimpleServer::process_h2(Reactor& reactor, int client_fd, Connection& conn) {
+    Http2Session& session = *conn.h2;
+    // 控制帧（PING / SETTINGS 的应答）不受低水位限制，对端不读取时同样暂停读取
+    if (conn.out_bytes >= write_high_watermark_) {
+        conn.read_paused = true;
+        return;
+    }
+
+    size_t consumed = session.receive(conn.in_buffer.data(), conn.in_buffer.size());
+    conn.in_buffer.erase(0, consumed);
+
+    uint32_t stream_id = 0;
+    HttpRequest request;
+    while (session.next_request(stream_id, request)) {
+        ++conn.requests_served;
+        auto started = std::chrono::steady_clock::now();
+        RouteParams params;
+        route_trie_.find(request.method, request.path, params);
+        HttpResponse response;
+        if (shed_request(reactor, params.route_index)) {
+            response = overloaded_response();
+        } else if (params.route_index >= 0 && routes_[params.route_index].async_handler) {
+            Completion completion;
+            completion.client_fd = client_fd;
+            completion.connection_id = conn.id;
+            completion.stream_id = stream_id;
+            completion.route_index = params.route_index;
+            completion.started = started;
+            if (!invoke_async(reactor, std::move(completion), request, params, response)) {
+                continue;  // 响应由 handle_completions 交回会话
+            }
+        } else if (params.route_index >= 0 && routes_[params.route_index].dispatch == Dispatch::Worker) {
+            if (conn.h2_worker_jobs >= worker_threads_) {
+                // 一个连接不能占满线程池队列；handle_completions 交回结果后再继续分派
+                --conn.requests_served;
+                session.defer(stream_id, std::move(request));
                 break;
             }
+            Completion completion;
+            completion.client_fd = client_fd;
+            completion.connection_id = conn.id;
+            completion.stream_id = stream_id;
+            completion.route_index = params.route_index;
+            completion.pooled = true;
+            completion.started = started;
+            if (dispatch_to_worker(reactor, std::move(completion), std::move(request))) {
+                ++conn.h2_worker_jobs;
+                continue;  // 其他流照常处理，响应由 handle_completions 交回会话
+            }
+            response = overloaded_response();
+        } else {
+            response = invoke_route(request, params);
         }
+        int response_status = response.status;
+        size_t bytes = response.content_length();
+        session.respond(stream_id, std::move(response));
+        Metrics::get_instance().record_request(params.route_index, response_status,
+                                               elapsed_micros(started), bytes);
+    }
+}
 
-        // 发送响应
-        send_response(client_fd, response);
+SimpleServer::OutputChunk::~OutputChunk() {
+    if (file_fd >= 0) {
+        close(file_fd);
+    }
+}
 
-    } catch (const std::exception& e) {
-        std::cerr << "请求处理错误: " << e.what() << std::endl;
-        std::string error_response = "HTTP/1.1 500 Internal Server Error\r\n"
-                                     "Content-Type: text/plain\r\n"
-                                     "Connection: close\r\n"
-                                     "\r\n"
-                                     "Internal Server Error";
-        send_response(client_fd, error_response);
+SimpleServer::OutputChunk::OutputChunk(OutputChunk&& other) noexcept
+    : data(std::move(other.data)),
+      shared(std::move(other.shared)),
+      file_fd(std::exchange(other.file_fd, -1)),
+      file_offset(other.file_offset),
+      file_length(other.file_length) {
+}
+
+size_t SimpleServer::enqueue_output(Connection& conn, HttpResponse response, bool keep_alive, bool chunked) {
+    // 204 / 304 没有消息体，流式响应的 producer 不会被调用
+    if (response.is_stream() && (response.status == 204 || response.status == 304)) {
+        response.producer = nullptr;
+    }
+    if (response.is_stream() && !chunked) {
+        // HTTP/1.0 不支持 chunked：不声明长度，发送完毕后关闭连接
+        keep_alive = false;
+        conn.close_after_flush = true;
     }
 
-    // 短连接：处理完立即关闭
-    close(client_fd);
+    // 头部、内存消息体、文件体各自成为一个片段；消息体直接移入队列，不与头部拼接复制
+    std::string head = std::move(conn.spare_buffer);
+    conn.spare_buffer = std::string();
+    serialize_head(response, keep_alive, chunked, head);
+    size_t queued_before = conn.out_bytes;
+    conn.out_bytes += head.size();
+    conn.out_queue.emplace_back(std::move(head));
+
+    if (response.is_stream()) {
+        // 消息体由 flush 时的 pump_stream 按积压情况逐块生成；结束前不处理后续请求
+        conn.stream = std::move(response.producer);
+        conn.stream_wake = std::move(response.stream_wake);
+        conn.stream_chunked = chunked;
+        conn.stream_parked = false;
+        conn.read_paused = true;
+        return conn.out_bytes - queued_before;
+    }
+
+    if (!response.body.empty()) {
+        conn.out_bytes += response.body.size();
+        conn.out_queue.emplace_back(std::move(response.body));
+    }
+
+    if (response.shared_body && !response.shared_body->empty()) {
+        conn.out_bytes += response.shared_body->size();
+        conn.out_queue.emplace_back(std::move(response.shared_body));
+    }
+
+    if (response.has_file() && response.file_length > 0) {
+        OutputChunk chunk;
+        chunk.file_fd = std::exchange(response.file_fd, -1);
+        chunk.file_offset = response.file_offset;
+        chunk.file_length = response.file_length;
+        conn.out_bytes += chunk.file_length;
+        conn.out_queue.push_back(std::move(chunk));
+    }
+    return conn.out_bytes - queued_before;
+}
+
+ssize_t SimpleServer::write_front(int client_fd, Connection& conn) {
+    OutputChunk& front = conn.out_queue.front();
+
+    if (front.is_file()) {
+        // 文件体：内核直接从页缓存发送，不经过用户态
+        off_t offset = front.file_offset + static_cast<off_t>(conn.out_offset);
+        return sendfile(client_fd, front.file_fd, &offset, front.file_length - conn.out_offset);
+    }
+
+    // 内存片段：把连续的内存片段合并为一次 sendmsg，遇到文件片段为止
+    iovec iov[MAX_IOVECS];
+    int iov_count = 0;
+    size_t offset = conn.out_offset;
+    bool file_follows = false;
+    for (auto it = conn.out_queue.begin(); it != conn.out_queue.end() && iov_count < MAX_IOVECS; ++it) {
+        if (it->is_file()) {
+            file_follows = true;
+            break;
+        }
+        const std::string& bytes = it->bytes();
+        iov[iov_count].iov_base = const_cast<char*>(bytes.data()) + offset;
+        iov[iov_count].iov_len = bytes.size() - offset;
+        ++iov_count;
+        offset = 0;
+    }
+
+    msghdr message{};
+    message.msg_iov = iov;
+    message.msg_iovlen = iov_count;
+
+    // 头部后紧跟文件体时设置 MSG_MORE，让头部与文件首段合并成同一个 TCP 报文
+    return sendmsg(client_fd, &message, MSG_NOSIGNAL | (file_follows ? MSG_MORE : 0));
+}
+
+void SimpleServer::consume_output(Connection& conn, size_t sent) {
+    // 释放已完整发送的片段，记录队首的部分发送位置
+    size_t remaining = sent;
+    conn.out_bytes -= remaining;
+    conn.bytes_sent += remaining;
+    while (remaining > 0) {
+        size_t front_left = conn.out_queue.front().size() - conn.out_offset;
+        if (remaining >= front_left) {
+            remaining -= front_left;
+            // 留下一块中等大小的缓冲区给下一个响应头；大块消息体直接释放，不长期占用内存
+            std::string& data = conn.out_queue.front().data;
+            if (data.capacity() > conn.spare_buffer.capacity() && data.capacity() <= MAX_SPARE_BUFFER) {
+                conn.spare_buffer = std::move(data);
+            }
+            conn.out_queue.pop_front();
+            conn.out_offset = 0;
+        } else {
+            conn.out_offset += remaining;
+            remaining = 0;
+        }
+    }
 }
 
-SimpleServer::HttpRequest SimpleServer::parse_http_request(const std::string& request) const {
-    HttpRequest result;
-    std::istringstream stream(request);
-    std::string line;
+std::function<void(uint32_t)> SimpleServer::stream_resumer(Reactor& reactor, int client_fd,
+                                                           const Connection& conn) const {
+    // 连接可能已关闭、fd 已被复用：与工作线程的结果一样由 handle_completions 按连接 ID 丢弃
+    return [gate = async_gate_, owner = &reactor, client_fd, connection_id = conn.id](uint32_t stream_id) {
+        Completion completion;
+        completion.client_fd = client_fd;
+        completion.connection_id = connection_id;
+        completion.stream_id = stream_id;
+        completion.resume = true;
+        std::lock_guard<std::mutex> lock(gate->mutex);
+        if (gate->open) {
+            post_completion(*owner, std::move(completion));
+        }
+    };
+}
+
+void SimpleServer::pump_stream(Reactor& reactor, int client_fd, Connection& conn) {
+    if (conn.h2) {
+        // 控制帧总是写出；HEADERS / DATA 只补到低水位，其余留在会话中按优先级等待
+        size_t budget = conn.out_bytes < write_low_watermark_ ? write_low_watermark_ - conn.out_bytes : 0;
+        std::string frames = std::move(conn.spare_buffer);
+        conn.spare_buffer = std::string();
+        frames.clear();
+        conn.h2->produce(frames, budget);
+        if (!frames.empty()) {
+            conn.out_bytes += frames.size();
+            conn.out_queue.emplace_back(std::move(frames));
+        } else {
+            conn.spare_buffer = std::move(frames);
+        }
+        // GOAWAY 已发出，或对端半关闭后所有响应都已交给输出队列：发送完毕后关闭
+        if (conn.h2->finished() ||
+            (conn.peer_closed && !conn.h2->awaiting_responses() && !conn.h2->has_pending_data())) {
+            conn.close_after_flush = true;
+        }
+        return;
+    }
+
+    // 只在积压低于低水位时继续生成：慢速客户端不会让整个响应堆积在内存中，
+    // 首块数据在生成后随即发出，与响应总长度无关
+    while (conn.stream && !conn.stream_parked && conn.out_bytes < write_low_watermark_) {
+        std::string chunk = std::move(conn.spare_buffer);
+        conn.spare_buffer = std::string();
+        chunk.clear();
+
+        bool more = false;
+        try {
+            more = conn.stream(chunk);
+        } catch (const std::exception& e) {
+            // 状态行已发出，无法再改成错误响应：发完已生成的部分后关闭连接且不发送结束块，
+            // 客户端可据此判断响应不完整
+            LOG_ERROR_LIMITED(10, "流式响应生成错误: " << e.what());
+            conn.stream = nullptr;
+            conn.stream_wake = nullptr;
+            conn.close_after_flush = true;
+            return;
+        }
+
+        if (chunk.empty() && more) {
+            // 暂无数据：挂起到唤醒句柄 notify 为止，不空转事件循环
+            if (!conn.stream_wake) {
+                LOG_ERROR_LIMITED(10, "流式响应没有唤醒句柄却返回了空块");
+                conn.stream = nullptr;
+                conn.stream_wake = nullptr;
+                conn.close_after_flush = true;
+                return;
+            }
+            auto resume = stream_resumer(reactor, client_fd, conn);
+            if (conn.stream_wake->park([resume] { resume(0); })) {
+                conn.stream_parked = true;
+            }
+            continue;
+        }
 
-    // 解析请求行
-    if (std::getline(stream, line)) {
-        std::istringstream line_stream(line);
-        line_stream >> result.method >> result.path >> result.version;
+        // 空块会被当作结束标记，只在流结束时发送
+        if (!chunk.empty()) {
+            if (conn.stream_chunked) {
+                char size_line[24];
+                auto result = std::to_chars(size_line, size_line + sizeof(size_line) - 2, chunk.size(), 16);
+                *result.ptr++ = '\r';
+                *result.ptr++ = '\n';
+                conn.out_bytes += static_cast<size_t>(result.ptr - size_line);
+                conn.out_queue.emplace_back(std::string(size_line, result.ptr));
+                chunk += "\r\n";
+            }
+            conn.out_bytes += chunk.size();
+            conn.out_queue.emplace_back(std::move(chunk));
+        }
 
-        // 去除 \r（如果存在）
-        if (!result.version.empty() && result.version.back() == '\r') {
-            result.version.pop_back();
+        if (!more) {
+            conn.stream = nullptr;
+            conn.stream_wake = nullptr;
+            if (conn.stream_chunked) {
+                conn.out_bytes += 5;
+                conn.out_queue.emplace_back(std::string("0\r\n\r\n"));
+            }
         }
     }
+}
+
+bool SimpleServer::flush_output(Reactor& reactor, int client_fd, Connection& conn) {
+    while (true) {
+        pump_stream(reactor, client_fd, conn);
+        if (conn.out_queue.empty()) {
+            break;
+        }
+        ssize_t sent = write_front(client_fd, conn);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;  // socket 缓冲区已满，等待 EPOLLOUT
+            }
+            LOG_WARN_LIMITED(10, "send 错误 (fd=" << client_fd << "): " << strerror(errno));
+            return false;
+        }
+        if (sent == 0 && conn.out_queue.front().is_file()) {
+            // 文件在发送过程中被截断，已声明的 Content-Length 无法兑现
+            LOG_WARN_LIMITED(10, "sendfile 提前结束 (fd=" << client_fd << ")");
+            return false;
+        }
 
-    // 分离查询参数
-    size_t query_pos = result.path.find('?');
-    if (query_pos != std::string::npos) {
-        std::string query_string = result.path.substr(query_pos + 1);
-        result.query_params = parse_query_params(query_string);
-        result.path = result.path.substr(0, query_pos);
+        consume_output(conn, static_cast<size_t>(sent));
+    }
+    // 挂起的流式响应（HTTP/1.0 以关闭连接结束）尚未结束，不能因队列暂时为空而关闭
+    if (conn.out_queue.empty() && conn.close_after_flush && !conn.stream) {
+        return false;
     }
 
-    // 解析头部
-    while (std::getline(stream, line) && line != "\r" && !line.empty()) {
-        size_t colon_pos = line.find(':');
-        if (colon_pos != std::string::npos) {
-            std::string key = line.substr(0, colon_pos);
-            std::string value = line.substr(colon_pos + 1);
+    // 仅在有积压时关注 EPOLLOUT，空闲连接的写就绪不会唤醒事件循环
+    bool want_write = !conn.out_queue.empty();
+    if (want_write != conn.want_write) {
+        epoll_event event{};
+        event.events = EPOLLIN | EPOLLET | EPOLLRDHUP | (want_write ? static_cast<uint32_t>(EPOLLOUT) : 0u);
+        event.data.fd = client_fd;
+        if (epoll_ctl(reactor.epoll_fd, EPOLL_CTL_MOD, client_fd, &event) < 0) {
+            LOG_ERROR_LIMITED(10, "epoll_ctl(MOD) 失败 (fd=" << client_fd << "): " << strerror(errno));
+            return false;
+        }
+        conn.want_write = want_write;
+    }
+
+    return true;
+}
+
+HttpResponse SimpleServer::dispatch_request(const HttpRequest& request) const {
+    // 在编译好的路由树中查找，不做堆分配；参数直接指向请求路径
+    RouteParams params;
+    route_trie_.find(request.method, request.path, params);
+    return invoke_route(request, params);
+}
+
+HttpResponse SimpleServer::invoke_route(const HttpRequest& request, const RouteParams& params) const {
+    if (params.route_index < 0) {
+        return HttpResponse::shared(404, "application/json", NOT_FOUND_BODY);
+    }
+
+    try {
+        return routes_[params.route_index].handler(request, params);
+    } catch (const std::exception& e) {
+        LOG_ERROR_LIMITED(10, "请求处理错误: " << e.what());
+        return HttpResponse::text(500, "Internal Server Error");
+    }
+}
 
-            // 去除首尾空白字符
-            key.erase(0, key.find_first_not_of(" \t"));
-            key.erase(key.find_last_not_of(" \t") + 1);
-            value.erase(0, value.find_first_not_of(" \t"));
-            value.erase(value.find_last_not_of(" \t") + 1);
+bool SimpleServer::dispatch_to_worker(Reactor& reactor, Completion completion, HttpRequest request) {
+    // 解析器会被下一个请求复用，工作线程持有请求的独立副本，并在副本上重新匹配路由参数。
+    // 任务必须可复制，Completion（含只能移动的响应）经 shared_ptr 传入
+    Reactor* owner = &reactor;
+    auto pending = std::make_shared<Completion>(std::move(completion));
+    inflight_handlers_.fetch_add(1, std::memory_order_relaxed);
+    bool submitted = worker_pool_.submit([this, owner, pending, request = std::move(request)]() {
+        pending->response = dispatch_request(request);
+        inflight_handlers_.fetch_sub(1, std::memory_order_relaxed);
+        post_completion(*owner, std::move(*pending));
+    });
+    if (!submitted) {
+        inflight_handlers_.fetch_sub(1, std::memory_order_relaxed);
+    }
+    return submitted;
+}
 
-            // 去除 \r（如果存在）
-            if (!value.empty() && value.back() == '\r') {
-                value.pop_back();
+void SimpleServer::post_completion(Reactor& reactor, Completion completion) {
+    {
+        std::lock_guard<std::mutex> lock(reactor.completion_mutex);
+        reactor.completions.push_back(std::move(completion));
+    }
+    uint64_t one = 1;
+    ssize_t written = write(reactor.wake_fd, &one, sizeof(one));
+    (void)written;  // 计数器溢出前必然已被事件循环读走；EAGAIN 时事件循环已处于待唤醒状态
+}
+
+bool SimpleServer::invoke_async(Reactor& reactor, Completion completion, const HttpRequest& request,
+                                const RouteParams& params, HttpResponse& response) {
+    // 回调在处理函数内（事件循环线程）被调用时结果直接交还调用方；之后在任何线程被调用时
+    // 经闸门投递到所属 reactor。in_handler 与 inline_result 只在事件循环线程上读写
+    struct Call {
+        Reactor* owner = nullptr;
+        std::shared_ptr<AsyncGate> gate;
+        std::thread::id loop_thread = std::this_thread::get_id();
+        bool in_handler = true;
+        bool inline_result = false;
+        std::atomic<bool> answered{false};
+        Completion completion;
+
+        void deliver(HttpResponse result) {
+            if (answered.exchange(true)) {
+                return;
+            }
+            completion.response = std::move(result);
+            if (std::this_thread::get_id() == loop_thread && in_handler) {
+                inline_result = true;
+                return;
+            }
+            std::lock_guard<std::mutex> lock(gate->mutex);
+            if (gate->open) {
+                post_completion(*owner, std::move(completion));
             }
+        }
 
-            result.headers[key] = value;
+        ~Call() {
+            deliver(HttpResponse::text(500, "Internal Server Error"));
         }
+    };
+
+    auto call = std::make_shared<Call>();
+    call->owner = &reactor;
+    call->gate = async_gate_;
+    call->completion = std::move(completion);
+    try {
+        routes_[params.route_index].async_handler(request, params, [call](HttpResponse result) {
+            call->deliver(std::move(result));
+        });
+    } catch (const std::exception& e) {
+        LOG_ERROR_LIMITED(10, "请求处理错误: " << e.what());
+        call->deliver(HttpResponse::text(500, "Internal Server Error"));
+    }
+    call->in_handler = false;
+    if (!call->inline_result) {
+        return false;
     }
+    response = std::move(call->completion.response);
+    return true;
+}
 
-    // 解析消息体（如果有）
-    if (result.headers.count("Content-Length")) {
-        try {
-            size_t content_length = std::stoul(result.headers.at("Content-Length"));
-            size_t header_end = request.find("\r\n\r\n");
-            if (header_end != std::string::npos) {
-                header_end += 4;  // 跳过空行
-                if (header_end < request.length()) {
-                    result.body = request.substr(header_end, content_length);
+void SimpleServer::handle_completions(Reactor& reactor) {
+    uint64_t count = 0;
+    while (read(reactor.wake_fd, &count, sizeof(count)) > 0) {
+    }
+
+    std::vector<Completion> ready;
+    {
+        std::lock_guard<std::mutex> lock(reactor.completion_mutex);
+        ready.swap(reactor.completions);
+    }
+
+    for (auto& completion : ready) {
+        auto conn_it = reactor.connections.find(completion.client_fd);
+        if (conn_it == reactor.connections.end() || conn_it->second.id != completion.connection_id) {
+            continue;  // 连接在等待期间已关闭（fd 可能已被新连接复用）
+        }
+        Connection& conn = conn_it->second;
+
+        int response_status = completion.response.status;
+        size_t bytes = 0;
+        if (completion.resume) {
+            // 挂起的流式响应有了新数据：解除挂起，下面的 flush 会继续调用 producer
+            if (completion.stream_id != 0) {
+                if (!conn.h2) {
+                    continue;
+                }
+                conn.h2->resume(completion.stream_id);
+            } else {
+                if (!conn.stream_parked) {
+                    continue;
                 }
+                conn.stream_parked = false;
             }
-        } catch (const std::exception&) {
-            // 忽略 Content-Length 解析错误
+        } else if (completion.stream_id != 0) {
+            // HTTP/2：交给会话，与其他流的帧一起在 flush 时编码
+            if (!conn.h2) {
+                continue;
+            }
+            if (completion.pooled) {
+                --conn.h2_worker_jobs;
+            }
+            bytes = completion.response.content_length();
+            conn.h2->respond(completion.stream_id, std::move(completion.response));
+        } else {
+            conn.awaiting_worker = false;
+            conn.close_after_flush = !completion.keep_alive;
+            bytes = enqueue_output(conn, std::move(completion.response), completion.keep_alive, completion.chunked);
+        }
+        if (!completion.resume) {
+            Metrics::get_instance().record_request(completion.route_index, response_status,
+                                                   elapsed_micros(completion.started), bytes);
+        }
+
+#ifdef MEDIA_SERVER_IO_URING
+        if (reactor.ring) {
+            uring_resume(reactor, completion.client_fd, conn);
+            continue;
+        }
+#endif
+
+        // 恢复读取，处理等待期间缓冲的流水线请求，并发出响应
+        if (conn.read_paused) {
+            if (!flush_output(reactor, completion.client_fd, conn)) {
+                close_connection(reactor, completion.client_fd);
+            } else if (resume_reading(conn)) {
+                handle_client_connection(reactor, completion.client_fd);
+            } else {
+                update_connection_timer(reactor, conn);
+            }
+        } else {
+            handle_client_connection(reactor, completion.client_fd);
         }
     }
+}
 
-    return result;
+HttpResponse SimpleServer::error_response(int status) {
+    switch (status) {
+        case 408:
+        case 413:
+        case 431:
+        case 501:
+            break;
+        default:
+            status = 400;
+            break;
+    }
+    return HttpResponse::text(status, HttpResponse::reason_phrase(status));
 }
 
-std::string SimpleServer::extract_clean_path(const std::string& path) const {
-    size_t query_pos = path.find('?');
-    return (query_pos != std::string::npos) ? path.substr(0, query_pos) : path;
+bool SimpleServer::wants_keep_alive(const HttpRequest& request) {
+    const std::string* connection = request.get_header("Connection");
+    std::string value = connection ? *connection : "";
+    std::transform(value.begin(), value.end(), value.begin(), ::tolower);
+
+    // HTTP/1.1 默认持久连接；HTTP/1.0 需显式声明 keep-alive
+    if (request.version == "HTTP/1.0") {
+        return value.find("keep-alive") != std::string::npos;
+    }
+    return value.find("close") == std::string::npos;
 }
 
-std::map<std::string, std::string> SimpleServer::parse_query_params(const std::string& query_string) const {
-    std::map<std::string, std::string> params;
-    std::vector<std::string> pairs = split_string(query_string, '&');
+void SimpleServer::serialize_head(const HttpResponse& response, bool keep_alive, bool chunked, std::string& head) {
+    // 分帧由服务器统一负责：处理函数设置的 Connection / Content-Length / Transfer-Encoding 一律忽略。
+    // 状态行、Content-Type 与 Connection 都是预生成的片段，只做拷贝
+    head.clear();
+    head.reserve(HEAD_RESERVE);
+    head += HttpResponse::status_line(response.status);
+    if (response.content_type_line) {
+        head += *response.content_type_line;
+    }
+
+    for (const auto& [name, value] : response.headers) {
+        if (strcasecmp(name.c_str(), "Connection") == 0 || strcasecmp(name.c_str(), "Content-Length") == 0 ||
+            strcasecmp(name.c_str(), "Transfer-Encoding") == 0) {
+            continue;
+        }
+        head += name;
+        head += ": ";
+        head += value;
+        head += "\r\n";
+    }
+
+    if (response.header_block) {
+        head += *response.header_block;
+    }
+
+    // 204 / 304 不带消息体，也不声明长度；流式响应长度未知，以 chunked 分帧或由关闭连接结束
+    if (response.is_stream()) {
+        if (chunked) {
+            head += "Transfer-Encoding: chunked\r\n";
+        }
+    } else if (response.status != 204 && response.status != 304) {
+        char length[24];
+        auto result = std::to_chars(length, length + sizeof(length), response.content_length());
+        head += "Content-Length: ";
+        head.append(length, result.ptr);
+        head += "\r\n";
+    }
+    head += keep_alive ? "Connection: keep-alive\r\n\r\n" : "Connection: close\r\n\r\n";
+}
 
-    for (const auto& pair : pairs) {
-        size_t equal_pos = pair.find('=');
-        if (equal_pos != std::string::npos) {
-            std::string key = pair.substr(0, equal_pos);
-            std::string value = pair.substr(equal_pos + 1);
-            // 这里可以添加 URL 解码
-            params[key] = value;
+void SimpleServer::close_connection(Reactor& reactor, int client_fd) {
+    epoll_ctl(reactor.epoll_fd, EPOLL_CTL_DEL, client_fd, nullptr);
+    close(client_fd);
+    auto conn_it = reactor.connections.find(client_fd);
+    if (conn_it != reactor.connections.end()) {
+        forget_connection(reactor, client_fd, conn_it->second);
+    }
+}
+
+void SimpleServer::forget_connection(Reactor& reactor, int client_fd, Connection& conn) {
+    reactor.timers.cancel(conn.timer);
+    release_client(conn.client_addr);
+    reactor.connections.erase(client_fd);
+}
+
+void SimpleServer::update_connection_timer(Reactor& reactor, Connection& conn) {
+    TimerPhase phase;
+    if (conn.awaiting_worker || (conn.h2 && conn.h2->awaiting_responses())) {
+        phase = TimerPhase::None;
+    } else if (!conn.out_queue.empty() || (conn.h2 && conn.h2->has_pending_data())) {
+        phase = TimerPhase::Write;
+    } else if (conn.stream_parked) {
+        phase = TimerPhase::None;  // 已生成的部分都已发出，等待数据来源唤醒
+    } else if (conn.requests_served == 0 || !conn.in_buffer.empty()) {
+        phase = TimerPhase::Request;
+    } else {
+        phase = TimerPhase::Idle;
+    }
+
+    std::chrono::milliseconds timeout{0};
+    switch (phase) {
+        case TimerPhase::Request: timeout = timeouts_.request; break;
+        case TimerPhase::Idle: timeout = timeouts_.keep_alive; break;
+        case TimerPhase::Write: timeout = timeouts_.write; break;
+        case TimerPhase::None: break;
+    }
+    if (timeout.count() <= 0) {
+        reactor.timers.cancel(conn.timer);
+        conn.timer_phase = phase;
+        return;
+    }
+
+    // 阶段未变时保持原截止时间；写阶段只在发送有进展时顺延
+    // （HTTP/2 响应在等待对端 WINDOW_UPDATE 时输出队列为空，积压字节数不能反映进展）
+    if (phase == conn.timer_phase && conn.timer.active() &&
+        (phase != TimerPhase::Write || conn.bytes_sent == conn.timer_bytes_sent)) {
+        return;
+    }
+    conn.timer_phase = phase;
+    conn.timer_bytes_sent = conn.bytes_sent;
+    reactor.timers.schedule(conn.timer, timeout);
+}
+
+int SimpleServer::timer_wait_ms(const Reactor& reactor) const {
+    // 有定时器时按 tick 唤醒，否则只需定期检查 running_
+    return reactor.timers.empty() ? 1000 : static_cast<int>(reactor.timers.tick().count());
+}
+
+void SimpleServer::expire_timers(Reactor& reactor) {
+    reactor.timers.advance(TimerWheel::Clock::now(), [this, &reactor](TimerWheel::Timer& timer) {
+        handle_timeout(reactor, static_cast<int>(timer.data));
+    });
+}
+
+void SimpleServer::handle_timeout(Reactor& reactor, int client_fd) {
+    auto conn_it = reactor.connections.find(client_fd);
+    if (conn_it == reactor.connections.end()) {
+        return;
+    }
+    Connection& conn = conn_it->second;
+
+    // 请求已开始但未收齐：回 408 后关闭；其余情况（空闲、从未发送请求、写停滞、HTTP/2）直接关闭
+    bool send_408 = conn.timer_phase == TimerPhase::Request && !conn.in_buffer.empty() && !conn.h2;
+    LOG_INFO_LIMITED(10, "连接超时 (fd=" << client_fd << ", "
+                         << (conn.timer_phase == TimerPhase::Write ? "写" :
+                             conn.timer_phase == TimerPhase::Idle ? "空闲" : "读请求") << ")");
+
+#ifdef MEDIA_SERVER_IO_URING
+    if (reactor.ring) {
+        if (!send_408) {
+            uring_close(reactor, client_fd, conn);
+            return;
+        }
+        enqueue_output(conn, error_response(408), false, false);
+        conn.close_after_flush = true;
+        if (uring_flush(reactor, client_fd, conn)) {
+            update_connection_timer(reactor, conn);
         }
+        return;
     }
+#endif
 
-    return params;
+    if (!send_408) {
+        close_connection(reactor, client_fd);
+        return;
+    }
+    enqueue_output(conn, error_response(408), false, false);
+    conn.close_after_flush = true;
+    if (!flush_output(reactor, client_fd, conn)) {
+        close_connection(reactor, client_fd);
+        return;
+    }
+    update_connection_timer(reactor, conn);
 }
 
-bool SimpleServer::path_matches(const std::string& request_path, const std::string& route_path,
-                               std::map<std::string, std::string>& params) const {
-    std::vector<std::string> request_parts = split_string(request_path, '/');
-    std::vector<std::string> route_parts = split_string(route_path, '/');
+size_t SimpleServer::client_shard(uint32_t client_addr) {
+    // 同一网段的地址只有个别字节不同，乘法散列后取高位，分片更均匀
+    uint32_t hash = client_addr * 0x9e3779b1u;
+    return (hash >> 16) % CLIENT_SHARDS;
+}
 
-    if (request_parts.size() != route_parts.size()) {
+bool SimpleServer::admit_client(uint32_t client_addr) {
+    int open = open_connections_.fetch_add(1, std::memory_order_relaxed) + 1;
+    if (max_connections_ > 0 && open > max_connections_) {
+        open_connections_.fetch_sub(1, std::memory_order_relaxed);
         return false;
     }
-    
-    for (size_t i = 0; i < route_parts.size(); ++i) {
-        if (route_parts[i].empty()) continue;
 
-        if (route_parts[i][0] == ':') {
-            // 参数化路由部分
-            std::string param_name = route_parts[i].substr(1);
-            params[param_name] = request_parts[i];
-        } else if (route_parts[i] != request_parts[i]) {
+    if (max_connections_per_client_ > 0) {
+        ClientShard& shard = client_shards_[client_shard(client_addr)];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        int& count = shard.connections[client_addr];
+        if (count >= max_connections_per_client_) {
+            open_connections_.fetch_sub(1, std::memory_order_relaxed);
             return false;
         }
+        ++count;
     }
-
     return true;
 }
 
-void SimpleServer::send_response(int client_fd, const std::string& response) {
-    ssize_t total_sent = 0;
-    size_t remaining = response.length();
-
-    while (remaining > 0) {
-        ssize_t sent = send(client_fd, response.c_str() + total_sent, remaining, MSG_NOSIGNAL);
+void SimpleServer::release_client(uint32_t client_addr) {
+    open_connections_.fetch_sub(1, std::memory_order_relaxed);
 
-        if (sent < 0) {
-            if (errno == EAGAIN || errno == EWOULDBLOCK) {
-                // 暂时不可写，可以重试或等待
-                continue;
-            }
-            std::cerr << "send 错误 (fd=" << client_fd << "): " << strerror(errno) << std::endl;
-            break;
+    if (max_connections_per_client_ > 0) {
+        ClientShard& shard = client_shards_[client_shard(client_addr)];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.connections.find(client_addr);
+        if (it != shard.connections.end() && --it->second <= 0) {
+            shard.connections.erase(it);
         }
+    }
+}
+
+void SimpleServer::reject_client(int client_fd) {
+    // 新连接的发送缓冲区是空的，这几十字节不会阻塞；失败也无需处理
+    ssize_t sent = send(client_fd, OVERLOADED_RESPONSE, sizeof(OVERLOADED_RESPONSE) - 1,
+                        MSG_DONTWAIT | MSG_NOSIGNAL);
+    (void)sent;
+    close(client_fd);
+}
 
-        total_sent += sent;
-        remaining -= sent;
+void SimpleServer::record_loop_lag(Reactor& reactor, std::chrono::steady_clock::time_point wait_started,
+                                   std::chrono::steady_clock::time_point batch_started) {
+    // 一批就绪事件的处理时长即新到达的事件最多要等待的时间。等待时间超过当前估计说明
+    // 循环已追上积压，直接取本批样本；否则按 1/8 指数平滑，单个慢批次不会立即触发拒绝
+    auto micros = [](std::chrono::steady_clock::duration d) {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(d).count());
+    };
+    uint64_t busy = micros(std::chrono::steady_clock::now() - batch_started);
+    uint64_t idle = micros(batch_started - wait_started);
+    uint64_t lag = reactor.lag_micros.load(std::memory_order_relaxed);
+    lag = idle > lag ? busy : lag - lag / 8 + busy / 8;
+    reactor.lag_micros.store(lag, std::memory_order_relaxed);
+}
+
+SimpleServer::LoadLevel SimpleServer::reactor_load(const Reactor& reactor) const {
+    auto exceeds = [](uint64_t value, uint64_t limit) { return limit > 0 && value >= limit; };
+    uint64_t lag_ms = reactor.lag_micros.load(std::memory_order_relaxed) / 1000;
+    uint64_t inflight = static_cast<uint64_t>(std::max(inflight_handlers_.load(std::memory_order_relaxed), 0));
+
+    if (exceeds(lag_ms, static_cast<uint64_t>(admission_.lag_overloaded.count())) ||
+        exceeds(inflight, static_cast<uint64_t>(std::max(admission_.inflight_overloaded, 0)))) {
+        return LoadLevel::Overloaded;
     }
+    if (exceeds(lag_ms, static_cast<uint64_t>(admission_.lag_elevated.count())) ||
+        exceeds(inflight, static_cast<uint64_t>(std::max(admission_.inflight_elevated, 0)))) {
+        return LoadLevel::Elevated;
+    }
+    return LoadLevel::Normal;
+}
+
+bool SimpleServer::shed_request(const Reactor& reactor, int route_index) {
+    // 未匹配的请求（404）按 Normal 处理
+    Priority priority = route_index >= 0 ? routes_[route_index].priority : Priority::Normal;
+    if (priority == Priority::Critical) {
+        return false;
+    }
+    LoadLevel level = reactor_load(reactor);
+    if (level == LoadLevel::Normal || (level == LoadLevel::Elevated && priority == Priority::Normal)) {
+        return false;
+    }
+    requests_shed_.fetch_add(1, std::memory_order_relaxed);
+    LOG_WARN_LIMITED(10, "负载过高，拒绝请求 (reactor " << reactor.id << ", "
+                         << (level == LoadLevel::Overloaded ? "严重过载" : "负载升高") << ")");
+    return true;
+}
+
+HttpResponse SimpleServer::overloaded_response() {
+    HttpResponse response = HttpResponse::text(503, "Service Unavailable");
+    response.header("Retry-After", "1");
+    return response;
+}
+
+std::string SimpleServer::peer_name(const sockaddr_in& addr) {
+    char ip[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &addr.sin_addr, ip, sizeof(ip));
+    return std::string(ip) + ":" + std::to_string(ntohs(addr.sin_port));
 }
 
 bool SimpleServer::set_socket_nonblocking(int fd) {
@@ -417,33 +1445,42 @@ bool SimpleServer::set_socket_nonblocking(int fd) {
     return fcntl(fd, F_SETFL, flags | O_NONBLOCK) != -1;
 }
 
-std::vector<std::string> SimpleServer::split_string(const std::string& str, char delimiter) {
-    std::vector<std::string> result;
-    size_t start = 0;
-    size_t end = 0;
+void SimpleServer::close_reactor(Reactor& reactor) {
+    for (auto& pair : reactor.connections) {
+        close(pair.first);
+        reactor.timers.cancel(pair.second.timer);
+        release_client(pair.second.client_addr);
+    }
+#ifdef MEDIA_SERVER_IO_URING
+    // 连接的在途操作已在 run_uring 退出前收尾；先销毁 ring，再释放连接持有的缓冲区
+    reactor.ring.reset();
+#endif
+    reactor.connections.clear();
+
+    {
+        std::lock_guard<std::mutex> lock(reactor.completion_mutex);
+        reactor.completions.clear();
+    }
 
-    while ((end = str.find(delimiter, start)) != std::string::npos) {
-        if (end != start) {
-            result.push_back(str.substr(start, end - start));
-        }
-        start = end + 1;
+    if (reactor.wake_fd >= 0) {
+        close(reactor.wake_fd);
+        reactor.wake_fd = -1;
     }
 
-    if (start < str.length()) {
-        result.push_back(str.substr(start));
+    if (reactor.epoll_fd >= 0) {
+        close(reactor.epoll_fd);
+        reactor.epoll_fd = -1;
     }
 
-    return result;
+    if (reactor.server_fd >= 0) {
+        close(reactor.server_fd);
+        reactor.server_fd = -1;
+    }
 }
 
 void SimpleServer::cleanup() {
-    if (epoll_fd_ >= 0) {
-        close(epoll_fd_);
-        epoll_fd_ = -1;
-    }
-
-    if (server_fd_ >= 0) {
-        close(server_fd_);
-        server_fd_ = -1;
+    for (auto& reactor : reactors_) {
+        close_reactor(*reactor);
     }
+    reactors_.clear();
 }
\ No newline at end of file
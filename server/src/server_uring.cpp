@@ -0,0 +1,549 @@
+// io_uring 后端仅在 -DENABLE_IO_URING=ON 时编译
+#ifdef MEDIA_SERVER_IO_URING
+
+#include "server.h"
+#include "io_uring_ring.h"
+#include "logger.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+const unsigned SimpleServer::URING_ENTRIES;
+const unsigned SimpleServer::URING_RECV_BUFFERS;
+const unsigned SimpleServer::URING_RECV_BUFFER_SIZE;
+const unsigned SimpleServer::URING_FIXED_BUFFERS;
+const unsigned SimpleServer::URING_FIXED_BUFFER_SIZE;
+
+namespace {
+
+// user_data 编码：高位为 fd，低 8 位为操作类型。
+// 连接在全部在途操作完成前不会关闭 fd，因此 fd 在此期间不会被复用。
+enum UringOp : uint64_t {
+    OP_ACCEPT = 1,
+    OP_WAKE,
+    OP_RECV,
+    OP_SEND,
+    OP_FILE_READ,
+    OP_FILE_SEND,
+    OP_CANCEL
+};
+
+uint64_t make_user_data(int fd, UringOp op) {
+    return (static_cast<uint64_t>(static_cast<uint32_t>(fd)) << 8) | op;
+}
+
+int user_data_fd(uint64_t user_data) {
+    return static_cast<int>(user_data >> 8);
+}
+
+UringOp user_data_op(uint64_t user_data) {
+    return static_cast<UringOp>(user_data & 0xff);
+}
+
+} // namespace
+
+bool SimpleServer::setup_uring(Reactor& reactor) {
+    try {
+        reactor.ring = std::make_unique<IoUringRing>(URING_ENTRIES, URING_RECV_BUFFERS, URING_RECV_BUFFER_SIZE,
+                                                     URING_FIXED_BUFFERS, URING_FIXED_BUFFER_SIZE);
+    } catch (const std::exception& e) {
+        LOG_WARN("io_uring 初始化失败: " << e.what());
+        return false;
+    }
+
+    // io_uring 对 O_NONBLOCK 的 fd 会直接返回 -EAGAIN 而不是挂起等待，监听 socket 改回阻塞模式
+    int flags = fcntl(reactor.server_fd, F_GETFL, 0);
+    if (flags == -1 || fcntl(reactor.server_fd, F_SETFL, flags & ~O_NONBLOCK) == -1 ||
+        !uring_arm_accept(reactor) || !uring_arm_wake(reactor)) {
+        reactor.ring.reset();
+        return false;
+    }
+    return true;
+}
+
+bool SimpleServer::uring_arm_accept(Reactor& reactor) {
+    io_uring_sqe* sqe = reactor.ring->get_sqe();
+    if (!sqe) {
+        return false;
+    }
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = reactor.server_fd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_CLOEXEC;
+    sqe->user_data = make_user_data(reactor.server_fd, OP_ACCEPT);
+    return true;
+}
+
+bool SimpleServer::uring_arm_wake(Reactor& reactor) {
+    io_uring_sqe* sqe = reactor.ring->get_sqe();
+    if (!sqe) {
+        return false;
+    }
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = reactor.wake_fd;
+    sqe->poll32_events = POLLIN;
+    sqe->len = IORING_POLL_ADD_MULTI;
+    sqe->user_data = make_user_data(reactor.wake_fd, OP_WAKE);
+    return true;
+}
+
+void SimpleServer::run_uring(Reactor& reactor) {
+    IoUringRing& ring = *reactor.ring;
+    auto handle = [this, &reactor](const io_uring_cqe& cqe) {
+        uring_handle_completion(reactor, cqe.user_data, cqe.res, cqe.flags);
+    };
+
+    LOG_INFO("服务器主循环开始 (reactor " << reactor.id << ", io_uring)");
+
+    while (running_) {
+        auto wait_started = std::chrono::steady_clock::now();
+        if (ring.submit_and_wait(timer_wait_ms(reactor)) < 0 && errno != EBUSY && errno != EAGAIN) {
+            LOG_ERROR_LIMITED(10, "io_uring_enter 错误: " << strerror(errno));
+            break;
+        }
+        auto batch_started = std::chrono::steady_clock::now();
+        expire_timers(reactor);
+        ring.drain_completions(handle);
+        record_loop_lag(reactor, wait_started, batch_started);
+    }
+
+    // 收尾：关闭全部连接并等待其在途操作结束，之后销毁 ring 时内核不再引用连接的缓冲区
+    std::vector<int> open_fds;
+    for (const auto& pair : reactor.connections) {
+        open_fds.push_back(pair.first);
+    }
+    for (int fd : open_fds) {
+        auto conn_it = reactor.connections.find(fd);
+        if (conn_it != reactor.connections.end()) {
+            uring_close(reactor, fd, conn_it->second);
+        }
+    }
+    for (int i = 0; i < 100 && !reactor.connections.empty(); ++i) {
+        ring.submit_and_wait(10);
+        ring.drain_completions(handle);
+    }
+
+    LOG_INFO("服务器主循环结束 (reactor " << reactor.id << ")");
+}
+
+void SimpleServer::uring_handle_completion(Reactor& reactor, uint64_t user_data, int result, uint32_t flags) {
+    int fd = user_data_fd(user_data);
+    UringOp op = user_data_op(user_data);
+    bool more = flags & IORING_CQE_F_MORE;
+
+    if (op == OP_ACCEPT) {
+        if (result >= 0) {
+            uring_accept(reactor, result);
+        } else if (result != -ECANCELED && running_) {
+            LOG_WARN_LIMITED(10, "accept 错误: " << strerror(-result));
+        }
+        if (!more && running_) {
+            uring_arm_accept(reactor);
+        }
+        return;
+    }
+
+    if (op == OP_WAKE) {
+        handle_completions(reactor);
+        if (!more && running_) {
+            uring_arm_wake(reactor);
+        }
+        return;
+    }
+
+    auto conn_it = reactor.connections.find(fd);
+    if (conn_it == reactor.connections.end()) {
+        if (flags & IORING_CQE_F_BUFFER) {
+            reactor.ring->recycle_recv_buffer(static_cast<uint16_t>(flags >> IORING_CQE_BUFFER_SHIFT));
+        }
+        return;
+    }
+    Connection& conn = conn_it->second;
+
+    switch (op) {
+        case OP_RECV:
+            uring_received(reactor, fd, conn, result, flags);
+            break;
+        case OP_SEND:
+            uring_sent(reactor, fd, conn, result);
+            break;
+        case OP_FILE_READ:
+            uring_file_read(reactor, fd, conn, result);
+            break;
+        case OP_FILE_SEND:
+            uring_file_sent(reactor, fd, conn, result);
+            break;
+        case OP_CANCEL:
+            uring_op_finished(reactor, fd, conn);
+            break;
+        default:
+            break;
+    }
+}
+
+void SimpleServer::uring_accept(Reactor& reactor, int client_fd) {
+    sockaddr_in client_addr{};
+    socklen_t addr_len = sizeof(client_addr);
+    getpeername(client_fd, reinterpret_cast<sockaddr*>(&client_addr), &addr_len);
+    if (!admit_client(client_addr.sin_addr.s_addr)) {
+        reject_client(client_fd);
+        return;
+    }
+
+    auto inserted = reactor.connections.emplace(client_fd, Connection(parser_limits_));
+    Connection& conn = inserted.first->second;
+    conn.id = ++reactor.next_connection_id;
+    conn.client_addr = client_addr.sin_addr.s_addr;
+    conn.timer.data = static_cast<uint64_t>(client_fd);
+
+    LOG_DEBUG("新连接: " << peer_name(client_addr) << " (fd=" << client_fd << ")");
+
+    if (!uring_update_recv(reactor, client_fd, conn)) {
+        uring_close(reactor, client_fd, conn);
+        return;
+    }
+    update_connection_timer(reactor, conn);
+}
+
+bool SimpleServer::uring_update_recv(Reactor& reactor, int client_fd, Connection& conn) {
+    auto& state = conn.uring;
+    bool want_read = !conn.read_paused && !conn.awaiting_worker && !conn.peer_closed && !state.closing;
+
+    if (want_read && !state.recv_armed) {
+        // multishot recv：一次提交持续接收，数据写入内核从 buffer ring 中挑选的缓冲区
+        io_uring_sqe* sqe = reactor.ring->get_sqe();
+        if (!sqe) {
+            return false;
+        }
+        sqe->opcode = IORING_OP_RECV;
+        sqe->fd = client_fd;
+        sqe->flags = IOSQE_BUFFER_SELECT;
+        sqe->buf_group = IoUringRing::RECV_BUFFER_GROUP;
+        sqe->ioprio = IORING_RECV_MULTISHOT;
+        sqe->user_data = make_user_data(client_fd, OP_RECV);
+        state.recv_armed = true;
+        ++state.inflight_ops;
+    } else if (!want_read && state.recv_armed && !state.recv_cancel_pending && !state.closing) {
+        // 暂停读取（积压或等待工作线程）：撤销 recv，数据留在内核 socket 缓冲区
+        io_uring_sqe* sqe = reactor.ring->get_sqe();
+        if (!sqe) {
+            return false;
+        }
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->addr = make_user_data(client_fd, OP_RECV);
+        sqe->user_data = make_user_data(client_fd, OP_CANCEL);
+        state.recv_cancel_pending = true;
+        ++state.inflight_ops;
+    }
+    return true;
+}
+
+void SimpleServer::uring_received(Reactor& reactor, int client_fd, Connection& conn, int result, uint32_t flags) {
+    auto& state = conn.uring;
+    bool failed = false;
+
+    if (flags & IORING_CQE_F_BUFFER) {
+        uint16_t buffer_id = static_cast<uint16_t>(flags >> IORING_CQE_BUFFER_SHIFT);
+        if (result > 0 && !state.closing) {
+            conn.in_buffer.append(reactor.ring->recv_buffer(buffer_id), static_cast<size_t>(result));
+        }
+        reactor.ring->recycle_recv_buffer(buffer_id);
+    }
+
+    if (result == 0) {
+        // 对端关闭写方向，处理完已收到的请求并发送完响应后关闭
+        conn.peer_closed = true;
+    } else if (result < 0 && result != -ENOBUFS && result != -ECANCELED) {
+        // -ENOBUFS 表示接收缓冲区暂时耗尽，下面重新挂起 recv 即可
+        if (!state.closing) {
+            LOG_WARN_LIMITED(10, "recv 错误 (fd=" << client_fd << "): " << strerror(-result));
+        }
+        failed = true;
+    }
+
+    if (!(flags & IORING_CQE_F_MORE)) {
+        state.recv_armed = false;
+        state.recv_cancel_pending = false;
+        if (!uring_op_finished(reactor, client_fd, conn)) {
+            return;
+        }
+    }
+    if (state.closing) {
+        return;
+    }
+    if (failed) {
+        uring_close(reactor, client_fd, conn);
+        return;
+    }
+
+    uring_resume(reactor, client_fd, conn);
+}
+
+void SimpleServer::uring_resume(Reactor& reactor, int client_fd, Connection& conn) {
+    if (conn.uring.closing) {
+        return;
+    }
+    process_requests(reactor, client_fd, conn);
+    if (!uring_flush(reactor, client_fd, conn)) {
+        return;
+    }
+    if (!uring_update_recv(reactor, client_fd, conn)) {
+        uring_close(reactor, client_fd, conn);
+        return;
+    }
+    update_connection_timer(reactor, conn);
+}
+
+bool SimpleServer::uring_flush(Reactor& reactor, int client_fd, Connection& conn) {
+    auto& state = conn.uring;
+    if (state.closing) {
+        return false;
+    }
+    if (state.send_inflight) {
+        return true;  // 同一连接同时只有一个发送操作，保证字节顺序
+    }
+    pump_stream(reactor, client_fd, conn);
+    if (conn.out_queue.empty()) {
+        if (conn.close_after_flush && !conn.stream) {
+            uring_close(reactor, client_fd, conn);
+            return false;
+        }
+        return true;
+    }
+
+    IoUringRing& ring = *reactor.ring;
+    OutputChunk& front = conn.out_queue.front();
+
+    if (front.is_file()) {
+        // 文件体：READ(_FIXED) 读入注册的暂存缓冲区，链接的 SEND 在读完成后立即发出，
+        // 一次提交完成一轮读+发，不经过事件循环往返
+        if (state.fixed_buffer < 0 && !state.heap_buffer) {
+            state.fixed_buffer = ring.acquire_fixed_buffer();
+            if (state.fixed_buffer < 0) {
+                state.heap_buffer.reset(new char[URING_FIXED_BUFFER_SIZE]);
+            }
+        }
+        char* buffer = state.fixed_buffer >= 0 ? ring.fixed_buffer(state.fixed_buffer) : state.heap_buffer.get();
+        size_t remaining = front.file_length - conn.out_offset;
+        size_t chunk = std::min<size_t>(remaining, URING_FIXED_BUFFER_SIZE);
+        bool more_follows = chunk < remaining || conn.out_queue.size() > 1;
+
+        if (ring.sq_space_left() < 2) {
+            ring.submit_and_wait(0);
+        }
+        io_uring_sqe* read_sqe = ring.get_sqe();
+        io_uring_sqe* send_sqe = read_sqe ? ring.get_sqe() : nullptr;
+        if (!send_sqe) {
+            uring_close(reactor, client_fd, conn);
+            return false;
+        }
+
+        read_sqe->opcode = state.fixed_buffer >= 0 ? IORING_OP_READ_FIXED : IORING_OP_READ;
+        read_sqe->fd = front.file_fd;
+        read_sqe->addr = reinterpret_cast<uint64_t>(buffer);
+        read_sqe->len = static_cast<uint32_t>(chunk);
+        read_sqe->off = static_cast<uint64_t>(front.file_offset) + conn.out_offset;
+        read_sqe->buf_index = static_cast<uint16_t>(std::max(state.fixed_buffer, 0));
+        read_sqe->flags = IOSQE_IO_LINK;
+        read_sqe->user_data = make_user_data(client_fd, OP_FILE_READ);
+
+        send_sqe->opcode = IORING_OP_SEND;
+        send_sqe->fd = client_fd;
+        send_sqe->addr = reinterpret_cast<uint64_t>(buffer);
+        send_sqe->len = static_cast<uint32_t>(chunk);
+        send_sqe->msg_flags = MSG_NOSIGNAL | (more_follows ? MSG_MORE : 0);
+        send_sqe->user_data = make_user_data(client_fd, OP_FILE_SEND);
+
+        state.staged_bytes = chunk;  // 读完成后更新为实际读到的字节数
+        state.staged_sent = 0;
+        state.inflight_ops += 2;
+        state.send_inflight = true;
+        return true;
+    }
+
+    // 内存片段：连续的内存片段合并为一次 sendmsg，遇到文件片段为止
+    state.send_iov.clear();
+    size_t offset = conn.out_offset;
+    bool file_follows = false;
+    for (auto it = conn.out_queue.begin(); it != conn.out_queue.end(); ++it) {
+        if (it->is_file()) {
+            file_follows = true;
+            break;
+        }
+        if (state.send_iov.size() >= static_cast<size_t>(MAX_IOVECS)) {
+            break;
+        }
+        iovec iov;
+        const std::string& bytes = it->bytes();
+        iov.iov_base = const_cast<char*>(bytes.data()) + offset;
+        iov.iov_len = bytes.size() - offset;
+        state.send_iov.push_back(iov);
+        offset = 0;
+    }
+
+    io_uring_sqe* sqe = ring.get_sqe();
+    if (!sqe) {
+        uring_close(reactor, client_fd, conn);
+        return false;
+    }
+    state.send_msg = msghdr{};
+    state.send_msg.msg_iov = state.send_iov.data();
+    state.send_msg.msg_iovlen = state.send_iov.size();
+
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = client_fd;
+    sqe->addr = reinterpret_cast<uint64_t>(&state.send_msg);
+    sqe->len = 1;
+    sqe->msg_flags = MSG_NOSIGNAL | (file_follows ? MSG_MORE : 0);
+    sqe->user_data = make_user_data(client_fd, OP_SEND);
+    ++state.inflight_ops;
+    state.send_inflight = true;
+    return true;
+}
+
+void SimpleServer::uring_sent(Reactor& reactor, int client_fd, Connection& conn, int result) {
+    auto& state = conn.uring;
+    state.send_inflight = false;
+    if (!uring_op_finished(reactor, client_fd, conn) || state.closing) {
+        return;
+    }
+    if (result < 0) {
+        if (result != -EPIPE && result != -ECONNRESET) {
+            LOG_WARN_LIMITED(10, "send 错误 (fd=" << client_fd << "): " << strerror(-result));
+        }
+        uring_close(reactor, client_fd, conn);
+        return;
+    }
+
+    consume_output(conn, static_cast<size_t>(result));
+    uring_after_send(reactor, client_fd, conn);
+}
+
+void SimpleServer::uring_file_read(Reactor& reactor, int client_fd, Connection& conn, int result) {
+    auto& state = conn.uring;
+    if (result > 0) {
+        state.staged_bytes = static_cast<size_t>(result);
+    } else {
+        state.staged_bytes = 0;
+    }
+    if (!uring_op_finished(reactor, client_fd, conn) || state.closing) {
+        return;
+    }
+    if (result <= 0) {
+        // 读失败或文件在发送过程中被截断，已声明的 Content-Length 无法兑现；链接的 SEND 随之被取消
+        LOG_WARN_LIMITED(10, "文件读取失败 (fd=" << client_fd << "): "
+                             << (result < 0 ? strerror(-result) : "unexpected EOF"));
+        uring_close(reactor, client_fd, conn);
+    }
+}
+
+void SimpleServer::uring_file_sent(Reactor& reactor, int client_fd, Connection& conn, int result) {
+    auto& state = conn.uring;
+    if (!uring_op_finished(reactor, client_fd, conn) || state.closing) {
+        return;
+    }
+
+    if (result == -ECANCELED && state.staged_bytes > 0) {
+        // 短读打断了链接：单独发送已读到的部分
+        uring_send_staged(reactor, client_fd, conn);
+        return;
+    }
+    if (result < 0) {
+        if (result != -EPIPE && result != -ECONNRESET && result != -ECANCELED) {
+            LOG_WARN_LIMITED(10, "send 错误 (fd=" << client_fd << "): " << strerror(-result));
+        }
+        uring_close(reactor, client_fd, conn);
+        return;
+    }
+
+    state.staged_sent += static_cast<size_t>(result);
+    consume_output(conn, static_cast<size_t>(result));
+    if (state.staged_sent < state.staged_bytes) {
+        uring_send_staged(reactor, client_fd, conn);
+        return;
+    }
+
+    // 暂存区已发完；队首不再是文件时归还暂存缓冲区
+    state.send_inflight = false;
+    state.staged_bytes = 0;
+    state.staged_sent = 0;
+    if (conn.out_queue.empty() || !conn.out_queue.front().is_file()) {
+        release_staging(reactor, conn);
+    }
+    uring_after_send(reactor, client_fd, conn);
+}
+
+void SimpleServer::uring_send_staged(Reactor& reactor, int client_fd, Connection& conn) {
+    auto& state = conn.uring;
+    io_uring_sqe* sqe = reactor.ring->get_sqe();
+    if (!sqe) {
+        uring_close(reactor, client_fd, conn);
+        return;
+    }
+    char* buffer = state.fixed_buffer >= 0 ? reactor.ring->fixed_buffer(state.fixed_buffer) : state.heap_buffer.get();
+    sqe->opcode = IORING_OP_SEND;
+    sqe->fd = client_fd;
+    sqe->addr = reinterpret_cast<uint64_t>(buffer + state.staged_sent);
+    sqe->len = static_cast<uint32_t>(state.staged_bytes - state.staged_sent);
+    sqe->msg_flags = MSG_NOSIGNAL | MSG_MORE;
+    sqe->user_data = make_user_data(client_fd, OP_FILE_SEND);
+    ++state.inflight_ops;
+}
+
+void SimpleServer::uring_after_send(Reactor& reactor, int client_fd, Connection& conn) {
+    // 积压降到低水位以下（且流式响应已结束）：恢复读取，并处理暂停期间已缓冲的流水线请求
+    if (resume_reading(conn)) {
+        uring_resume(reactor, client_fd, conn);
+        return;
+    }
+    if (uring_flush(reactor, client_fd, conn)) {
+        update_connection_timer(reactor, conn);
+    }
+}
+
+void SimpleServer::release_staging(Reactor& reactor, Connection& conn) {
+    auto& state = conn.uring;
+    if (state.fixed_buffer >= 0) {
+        reactor.ring->release_fixed_buffer(state.fixed_buffer);
+        state.fixed_buffer = -1;
+    }
+    state.heap_buffer.reset();
+}
+
+void SimpleServer::uring_close(Reactor& reactor, int client_fd, Connection& conn) {
+    auto& state = conn.uring;
+    if (state.closing) {
+        return;
+    }
+    state.closing = true;
+    reactor.timers.cancel(conn.timer);
+
+    if (state.inflight_ops == 0) {
+        release_staging(reactor, conn);
+        close(client_fd);
+        forget_connection(reactor, client_fd, conn);
+        return;
+    }
+
+    // 让挂起的 recv/send 尽快以错误结束，最后一个操作完成时关闭 fd
+    shutdown(client_fd, SHUT_RDWR);
+}
+
+bool SimpleServer::uring_op_finished(Reactor& reactor, int client_fd, Connection& conn) {
+    auto& state = conn.uring;
+    if (--state.inflight_ops == 0 && state.closing) {
+        release_staging(reactor, conn);
+        close(client_fd);
+        forget_connection(reactor, client_fd, conn);
+        return false;
+    }
+    return true;
+}
+
+#endif // MEDIA_SERVER_IO_URING
@@ -0,0 +1,374 @@
+#include "static_asset_cache.h"
+#include "logger.h"
+#include "http_range.h"
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <strings.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#ifdef MEDIA_SERVER_HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef MEDIA_SERVER_HAVE_BROTLI
+#include <brotli/encode.h>
+#endif
+
+const std::chrono::milliseconds StaticAssetCache::DEFAULT_REVALIDATE_INTERVAL{1000};
+const size_t StaticAssetCache::MAX_ASSET_SIZE;
+
+namespace {
+
+// 小于该大小的文件压缩收益抵不过 Content-Encoding 的开销
+const size_t MIN_COMPRESS_SIZE = 256;
+
+std::string_view trim(std::string_view value) {
+    while (!value.empty() && (value.front() == ' ' || value.front() == '\t')) {
+        value.remove_prefix(1);
+    }
+    while (!value.empty() && (value.back() == ' ' || value.back() == '\t')) {
+        value.remove_suffix(1);
+    }
+    return value;
+}
+
+bool equals_ignore_case(std::string_view a, const char* b) {
+    size_t length = strlen(b);
+    return a.size() == length && strncasecmp(a.data(), b, length) == 0;
+}
+
+// 按逗号切分列表型头部，逐项回调（已去除首尾空白，跳过空项）
+template <typename Callback>
+void for_each_list_item(std::string_view list, Callback&& callback) {
+    while (!list.empty()) {
+        size_t comma = list.find(',');
+        std::string_view item = trim(list.substr(0, comma));
+        if (!item.empty()) {
+            callback(item);
+        }
+        if (comma == std::string_view::npos) {
+            break;
+        }
+        list.remove_prefix(comma + 1);
+    }
+}
+
+bool is_compressible(const std::string& content_type) {
+    return content_type.compare(0, 5, "text/") == 0 ||
+           content_type == "application/javascript" ||
+           content_type == "application/json" ||
+           content_type == "image/svg+xml";
+}
+
+// "\"size-mtime\"" -> "\"size-mtime-gz\""：不同编码是不同的表示，强 ETag 必须不同
+std::string variant_etag(const std::string& etag, const char* suffix) {
+    return etag.substr(0, etag.size() - 1) + "-" + suffix + "\"";
+}
+
+std::shared_ptr<const std::string> gzip_compress(const std::string& input) {
+#ifdef MEDIA_SERVER_HAVE_ZLIB
+    z_stream stream{};
+    // windowBits 15 + 16：输出带 gzip 头尾，而不是裸 zlib 流
+    if (deflateInit2(&stream, Z_BEST_COMPRESSION, Z_DEFLATED, 15 + 16, 9, Z_DEFAULT_STRATEGY) != Z_OK) {
+        return nullptr;
+    }
+    std::string output(deflateBound(&stream, input.size()), '\0');
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(input.data()));
+    stream.avail_in = static_cast<uInt>(input.size());
+    stream.next_out = reinterpret_cast<Bytef*>(&output[0]);
+    stream.avail_out = static_cast<uInt>(output.size());
+    int result = deflate(&stream, Z_FINISH);
+    output.resize(stream.total_out);
+    deflateEnd(&stream);
+    if (result != Z_STREAM_END) {
+        return nullptr;
+    }
+    return std::make_shared<const std::string>(std::move(output));
+#else
+    (void)input;
+    return nullptr;
+#endif
+}
+
+std::shared_ptr<const std::string> brotli_compress(const std::string& input) {
+#ifdef MEDIA_SERVER_HAVE_BROTLI
+    size_t output_size = BrotliEncoderMaxCompressedSize(input.size());
+    if (output_size == 0) {
+        return nullptr;
+    }
+    std::string output(output_size, '\0');
+    if (!BrotliEncoderCompress(BROTLI_MAX_QUALITY, BROTLI_DEFAULT_WINDOW, BROTLI_MODE_TEXT,
+                               input.size(), reinterpret_cast<const uint8_t*>(input.data()),
+                               &output_size, reinterpret_cast<uint8_t*>(&output[0]))) {
+        return nullptr;
+    }
+    output.resize(output_size);
+    return std::make_shared<const std::string>(std::move(output));
+#else
+    (void)input;
+    return nullptr;
+#endif
+}
+
+} // namespace
+
+void StaticAssetCache::format_headers(const Asset& asset, Variant& variant) {
+    // 每次使用前向服务器确认，未修改时只需一个 304
+    std::string common;
+    if (asset.compressible) {
+        common += "Vary: Accept-Encoding\r\n";
+    }
+    common += "ETag: " + variant.etag + "\r\n";
+    common += "Last-Modified: " + asset.last_modified + "\r\n";
+    common += "Cache-Control: no-cache\r\n";
+
+    variant.response_headers = "Content-Type: " + asset.content_type + "\r\n";
+    if (variant.content_encoding) {
+        variant.response_headers += std::string("Content-Encoding: ") + variant.content_encoding + "\r\n";
+    }
+    variant.response_headers += common;
+    variant.not_modified_headers = std::move(common);
+}
+
+const StaticAssetCache::Variant& StaticAssetCache::Asset::select(std::string_view accept_encoding) const {
+    // 未列出的编码取 "*" 的 q 值；都没有则不可接受
+    double q_br = -1, q_gzip = -1, q_any = -1;
+    for_each_list_item(accept_encoding, [&](std::string_view item) {
+        std::string_view coding = trim(item.substr(0, item.find(';')));
+        double q = 1.0;
+        size_t q_pos = item.find("q=");
+        if (q_pos != std::string_view::npos) {
+            q = std::strtod(std::string(item.substr(q_pos + 2)).c_str(), nullptr);
+        }
+        if (equals_ignore_case(coding, "br")) {
+            q_br = q;
+        } else if (equals_ignore_case(coding, "gzip") || equals_ignore_case(coding, "x-gzip")) {
+            q_gzip = q;
+        } else if (coding == "*") {
+            q_any = q;
+        }
+    });
+    if (q_br < 0) {
+        q_br = q_any;
+    }
+    if (q_gzip < 0) {
+        q_gzip = q_any;
+    }
+
+    if (brotli.body && q_br > 0 && (q_br >= q_gzip || !gzip.body)) {
+        return brotli;
+    }
+    if (gzip.body && q_gzip > 0) {
+        return gzip;
+    }
+    return identity;
+}
+
+bool StaticAssetCache::Variant::matches(std::string_view if_none_match) const {
+    bool matched = false;
+    for_each_list_item(if_none_match, [&](std::string_view tag) {
+        if (tag == "*") {
+            matched = true;
+            return;
+        }
+        // If-None-Match 使用弱比较
+        if (tag.substr(0, 2) == "W/") {
+            tag.remove_prefix(2);
+        }
+        if (body && tag == etag) {
+            matched = true;
+        }
+    });
+    return matched;
+}
+
+StaticAssetCache::StaticAssetCache(std::string root, ContentTypeResolver content_type_of,
+                                   std::chrono::milliseconds revalidate_interval)
+    : root_(std::move(root)),
+      revalidate_interval_(revalidate_interval),
+      content_type_of_(std::move(content_type_of)),
+      reload_thread_(&StaticAssetCache::run_reloads, this) {
+}
+
+StaticAssetCache::~StaticAssetCache() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    reload_cv_.notify_all();
+    reload_thread_.join();
+}
+
+std::shared_ptr<const StaticAssetCache::Asset> StaticAssetCache::lookup(const std::string& path) {
+    auto now = std::chrono::steady_clock::now();
+    std::shared_ptr<const Asset> cached;
+    struct timespec cached_mtime{};
+    off_t cached_size = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = entries_.find(path);
+        if (it != entries_.end()) {
+            if (now - it->second.checked < revalidate_interval_) {
+                return it->second.asset;
+            }
+            // 先更新检查时间，同一时刻的其它请求继续使用旧内容，只由一个线程 stat
+            it->second.checked = now;
+            cached = it->second.asset;
+            cached_mtime = it->second.mtime;
+            cached_size = it->second.size;
+        }
+    }
+
+    struct stat file_stat{};
+    if (resolve(path, file_stat).empty()) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        entries_.erase(path);
+        return nullptr;
+    }
+
+    if (cached && file_stat.st_size == cached_size &&
+        file_stat.st_mtim.tv_sec == cached_mtime.tv_sec && file_stat.st_mtim.tv_nsec == cached_mtime.tv_nsec) {
+        return cached;
+    }
+    if (static_cast<size_t>(file_stat.st_size) > MAX_ASSET_SIZE) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        entries_.erase(path);
+        return nullptr;
+    }
+
+    // 读文件与最高级别压缩可能耗时数百毫秒，不能在事件循环上进行
+    schedule_reload(path);
+    return cached;
+}
+
+std::string StaticAssetCache::resolve(const std::string& path, struct stat& file_stat) const {
+    std::string file_path = root_ + path;
+    if (stat(file_path.c_str(), &file_stat) == 0 && S_ISDIR(file_stat.st_mode)) {
+        file_path += "/index.html";
+    }
+    if (stat(file_path.c_str(), &file_stat) != 0 || !S_ISREG(file_stat.st_mode)) {
+        return std::string();
+    }
+    return file_path;
+}
+
+std::shared_ptr<const StaticAssetCache::Asset> StaticAssetCache::reload(const std::string& path) {
+    struct stat file_stat{};
+    std::string file_path = resolve(path, file_stat);
+    Entry fresh;
+    std::shared_ptr<const Asset> asset = file_path.empty() ? nullptr : load(file_path, fresh);
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!asset) {
+        entries_.erase(path);
+        return nullptr;
+    }
+    fresh.checked = std::chrono::steady_clock::now();
+    entries_[path] = fresh;
+    return asset;
+}
+
+void StaticAssetCache::schedule_reload(const std::string& path) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (stopping_ || !reloading_.insert(path).second) {
+            return;
+        }
+        reload_queue_.push_back(path);
+    }
+    reload_cv_.notify_one();
+}
+
+void StaticAssetCache::run_reloads() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        reload_cv_.wait(lock, [this] { return stopping_ || !reload_queue_.empty(); });
+        if (stopping_) {
+            return;
+        }
+        std::string path = std::move(reload_queue_.front());
+        reload_queue_.pop_front();
+        lock.unlock();
+        reload(path);
+        lock.lock();
+        reloading_.erase(path);
+    }
+}
+
+std::shared_ptr<const StaticAssetCache::Asset> StaticAssetCache::load(const std::string& file_path, Entry& entry) const {
+    int fd = open(file_path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return nullptr;
+    }
+    struct stat file_stat{};
+    if (fstat(fd, &file_stat) != 0 || !S_ISREG(file_stat.st_mode) ||
+        static_cast<size_t>(file_stat.st_size) > MAX_ASSET_SIZE) {
+        close(fd);
+        return nullptr;
+    }
+
+    std::string content(static_cast<size_t>(file_stat.st_size), '\0');
+    size_t total = 0;
+    while (total < content.size()) {
+        ssize_t n = pread(fd, &content[total], content.size() - total, static_cast<off_t>(total));
+        if (n <= 0) {
+            break;
+        }
+        total += static_cast<size_t>(n);
+    }
+    close(fd);
+    if (total != content.size()) {
+        return nullptr;
+    }
+
+    auto asset = std::make_shared<Asset>();
+    asset->content_type = content_type_of_ ? content_type_of_(file_path) : "application/octet-stream";
+    asset->last_modified = format_http_date(file_stat.st_mtime);
+    asset->identity.etag = make_etag(static_cast<uint64_t>(file_stat.st_size), file_stat.st_mtim);
+    asset->compressible = is_compressible(asset->content_type);
+
+    if (asset->compressible && content.size() >= MIN_COMPRESS_SIZE) {
+        // 压缩后不比原文小的版本不保留
+        auto gzipped = gzip_compress(content);
+        if (gzipped && gzipped->size() < content.size()) {
+            asset->gzip.body = std::move(gzipped);
+            asset->gzip.etag = variant_etag(asset->identity.etag, "gz");
+            asset->gzip.content_encoding = "gzip";
+        }
+        auto brotli = brotli_compress(content);
+        if (brotli && brotli->size() < content.size()) {
+            asset->brotli.body = std::move(brotli);
+            asset->brotli.etag = variant_etag(asset->identity.etag, "br");
+            asset->brotli.content_encoding = "br";
+        }
+    }
+    asset->identity.body = std::make_shared<const std::string>(std::move(content));
+
+    for (Variant* variant : {&asset->identity, &asset->gzip, &asset->brotli}) {
+        if (variant->body) {
+            format_headers(*asset, *variant);
+        }
+    }
+
+    entry.asset = asset;
+    entry.mtime = file_stat.st_mtim;
+    entry.size = file_stat.st_size;
+    return asset;
+}
+
+void StaticAssetCache::warm() {
+    namespace fs = std::filesystem;
+    size_t loaded = 0;
+    std::error_code ec;
+    for (fs::recursive_directory_iterator it(root_, ec), end; !ec && it != end; it.increment(ec)) {
+        if (!it->is_regular_file(ec)) {
+            continue;
+        }
+        std::string relative = fs::relative(it->path(), root_, ec).generic_string();
+        if (!ec && reload("/" + relative)) {
+            ++loaded;
+        }
+    }
+    LOG_INFO("静态资源缓存预热完成: " << loaded << " 个文件 (" << root_ << ")");
+}
@@ -0,0 +1,80 @@
+#include "timer_wheel.h"
+#include <algorithm>
+
+const std::chrono::milliseconds TimerWheel::DEFAULT_TICK{100};
+const int TimerWheel::LEVELS;
+const int TimerWheel::SLOT_BITS;
+const uint64_t TimerWheel::SLOTS;
+const uint64_t TimerWheel::SLOT_MASK;
+
+TimerWheel::TimerWheel(std::chrono::milliseconds tick)
+    : tick_(std::max(tick, std::chrono::milliseconds(1))),
+      start_(Clock::now()) {
+    for (auto& level : slots_) {
+        for (Timer& slot : level) {
+            slot.prev_ = slot.next_ = &slot;
+        }
+    }
+}
+
+void TimerWheel::schedule(Timer& timer, std::chrono::milliseconds delay) {
+    if (timer.active()) {
+        unlink(timer);
+        --size_;
+    }
+
+    // 向上取整到 tick，且至少为下一个 tick：当前 tick 的槽位已经处理过
+    const uint64_t max_delta = (uint64_t(1) << (SLOT_BITS * LEVELS)) - 1;
+    uint64_t ticks = delay.count() > 0 ? static_cast<uint64_t>((delay.count() + tick_.count() - 1) / tick_.count()) : 0;
+    ticks = std::min(std::max<uint64_t>(ticks, 1), max_delta);
+
+    timer.expires_ = current_tick_ + ticks;
+    place(timer);
+    ++size_;
+}
+
+void TimerWheel::cancel(Timer& timer) {
+    if (timer.active()) {
+        unlink(timer);
+        --size_;
+    }
+}
+
+void TimerWheel::place(Timer& timer) {
+    // 距到期的 tick 数决定层级：第 l 层覆盖 [SLOTS^l, SLOTS^(l+1)) 个 tick
+    uint64_t delta = timer.expires_ > current_tick_ ? timer.expires_ - current_tick_ : 0;
+    int level = 0;
+    while (level < LEVELS - 1 && delta >= (uint64_t(1) << (SLOT_BITS * (level + 1)))) {
+        ++level;
+    }
+    // 已到期（cascade 下放时可能出现）的放入当前 tick 的槽位，随后立即处理
+    uint64_t expires = std::max(timer.expires_, current_tick_);
+    Timer& slot = slots_[level][(expires >> (SLOT_BITS * level)) & SLOT_MASK];
+
+    timer.prev_ = slot.prev_;
+    timer.next_ = &slot;
+    slot.prev_->next_ = &timer;
+    slot.prev_ = &timer;
+}
+
+void TimerWheel::cascade() {
+    // 低层转完一圈时，把上一层当前槽位的定时器按剩余时间重新分配到低层
+    for (int level = 1; level < LEVELS; ++level) {
+        uint64_t shift = SLOT_BITS * level;
+        if ((current_tick_ & ((uint64_t(1) << shift) - 1)) != 0) {
+            break;
+        }
+        Timer& slot = slots_[level][(current_tick_ >> shift) & SLOT_MASK];
+        while (slot.next_ != &slot) {
+            Timer* timer = slot.next_;
+            unlink(*timer);
+            place(*timer);
+        }
+    }
+}
+
+void TimerWheel::unlink(Timer& timer) {
+    timer.prev_->next_ = timer.next_;
+    timer.next_->prev_ = timer.prev_;
+    timer.prev_ = timer.next_ = nullptr;
+}
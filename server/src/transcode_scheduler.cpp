@@ -0,0 +1,156 @@
+#include "transcode_scheduler.h"
+#include "logger.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <thread>
+
+namespace {
+
+unsigned budget_from_env() {
+    const char* value = std::getenv("MEDIA_SERVER_TRANSCODE_CORES");
+    if (value) {
+        double cores = std::atof(value);
+        if (cores > 0) {
+            return static_cast<unsigned>(cores * 100);
+        }
+    }
+    return std::max(1u, std::thread::hardware_concurrency()) * 100;
+}
+
+const char* priority_name(TranscodeScheduler::Priority priority) {
+    return priority == TranscodeScheduler::Priority::Interactive ? "interactive" : "background";
+}
+
+} // namespace
+
+TranscodeScheduler& TranscodeScheduler::get_instance() {
+    // 有意不析构：HLSProcessor 等单例的析构函数里仍会归还预算
+    static TranscodeScheduler* instance = new TranscodeScheduler();
+    return *instance;
+}
+
+TranscodeScheduler::TranscodeScheduler() : cpu_budget_(budget_from_env()) {
+    LOG_INFO("[Scheduler] 转码 CPU 预算: " << cpu_budget_ / 100.0 << " 核");
+}
+
+TranscodeScheduler::JobId TranscodeScheduler::submit(const std::string& name, Priority priority,
+                                                     unsigned cpu, StartFn start) {
+    std::vector<Job> ready;
+    JobId id;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        id = next_id_++;
+        queues_[static_cast<int>(priority)].push_back(
+            {id, name, priority, std::max(cpu, 1u), std::move(start), std::chrono::steady_clock::now()});
+        ready = admit_locked();
+        if (running_.count(id) == 0) {
+            LOG_INFO("[Scheduler] 任务排队: " << name << " (" << priority_name(priority)
+                     << ", 位置 " << queue_position_locked(id) << ")");
+        }
+    }
+    start_jobs(ready);
+    return id;
+}
+
+void TranscodeScheduler::finish(JobId id) {
+    std::vector<Job> ready;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = running_.find(id);
+        if (it == running_.end()) {
+            return;
+        }
+        cpu_used_ -= it->second;
+        running_.erase(it);
+        ready = admit_locked();
+    }
+    start_jobs(ready);
+}
+
+bool TranscodeScheduler::cancel(JobId id) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& queue : queues_) {
+        auto it = std::find_if(queue.begin(), queue.end(), [id](const Job& job) { return job.id == id; });
+        if (it != queue.end()) {
+            queue.erase(it);
+            ++cancelled_total_;
+            return true;
+        }
+    }
+    return false;
+}
+
+size_t TranscodeScheduler::queue_position(JobId id) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return queue_position_locked(id);
+}
+
+size_t TranscodeScheduler::queue_position_locked(JobId id) const {
+    size_t ahead = 0;
+    for (const auto& queue : queues_) {
+        for (const Job& job : queue) {
+            ++ahead;
+            if (job.id == id) {
+                return ahead;
+            }
+        }
+    }
+    return 0;
+}
+
+TranscodeScheduler::Stats TranscodeScheduler::stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Stats stats;
+    stats.queued_interactive = queues_[static_cast<int>(Priority::Interactive)].size();
+    stats.queued_background = queues_[static_cast<int>(Priority::Background)].size();
+    stats.running = running_.size();
+    stats.cpu_used = cpu_used_;
+    stats.cpu_budget = cpu_budget_;
+    stats.admitted_total = admitted_total_;
+    stats.cancelled_total = cancelled_total_;
+    stats.wait_sum_micros = wait_sum_micros_;
+    stats.wait_max_micros = wait_max_micros_;
+    return stats;
+}
+
+void TranscodeScheduler::set_cpu_budget(unsigned cpu) {
+    std::vector<Job> ready;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        cpu_budget_ = std::max(cpu, 1u);
+        ready = admit_locked();
+    }
+    start_jobs(ready);
+}
+
+std::vector<TranscodeScheduler::Job> TranscodeScheduler::admit_locked() {
+    std::vector<Job> ready;
+    auto now = std::chrono::steady_clock::now();
+    for (auto& queue : queues_) {
+        while (!queue.empty()) {
+            Job& job = queue.front();
+            if (!running_.empty() && cpu_used_ + job.cpu > cpu_budget_) {
+                return ready;  // 队首放不下，后面的任务（含低优先级）都不插队
+            }
+            uint64_t waited = static_cast<uint64_t>(
+                std::chrono::duration_cast<std::chrono::microseconds>(now - job.enqueued).count());
+            wait_sum_micros_ += waited;
+            wait_max_micros_ = std::max(wait_max_micros_, waited);
+            ++admitted_total_;
+            cpu_used_ += job.cpu;
+            running_[job.id] = job.cpu;
+            ready.push_back(std::move(job));
+            queue.pop_front();
+        }
+    }
+    return ready;
+}
+
+void TranscodeScheduler::start_jobs(std::vector<Job>& jobs) {
+    for (Job& job : jobs) {
+        LOG_INFO("[Scheduler] 启动任务: " << job.name << " (" << priority_name(job.priority)
+                 << ", CPU " << job.cpu / 100.0 << " 核)");
+        job.start(job.id);
+    }
+}
@@ -0,0 +1,80 @@
+#include "worker_pool.h"
+#include "logger.h"
+#include <utility>
+
+const size_t WorkerPool::DEFAULT_MAX_QUEUE;
+
+WorkerPool::WorkerPool(size_t max_queue) : max_queue_(max_queue) {
+}
+
+WorkerPool::~WorkerPool() {
+    stop();
+}
+
+void WorkerPool::start(size_t num_threads) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!threads_.empty()) {
+        return;
+    }
+    stopping_ = false;
+    for (size_t i = 0; i < num_threads; ++i) {
+        threads_.emplace_back(&WorkerPool::worker_loop, this);
+    }
+}
+
+void WorkerPool::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (threads_.empty()) {
+            return;
+        }
+        stopping_ = true;
+        tasks_.clear();
+    }
+    cv_.notify_all();
+
+    for (auto& thread : threads_) {
+        if (thread.joinable()) {
+            thread.join();
+        }
+    }
+    threads_.clear();
+}
+
+bool WorkerPool::submit(Task task) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (stopping_ || threads_.empty() || tasks_.size() >= max_queue_) {
+            return false;
+        }
+        tasks_.push_back(std::move(task));
+    }
+    cv_.notify_one();
+    return true;
+}
+
+size_t WorkerPool::queued() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return tasks_.size();
+}
+
+void WorkerPool::worker_loop() {
+    while (true) {
+        Task task;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cv_.wait(lock, [this] { return stopping_ || !tasks_.empty(); });
+            if (stopping_) {
+                return;
+            }
+            task = std::move(tasks_.front());
+            tasks_.pop_front();
+        }
+
+        try {
+            task();
+        } catch (const std::exception& e) {
+            LOG_ERROR("工作线程任务异常: " << e.what());
+        }
+    }
+}